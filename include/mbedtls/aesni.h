@@ -66,6 +66,20 @@ int mbedtls_aesni_crypt_ecb( mbedtls_aes_context *ctx,
                      const unsigned char input[16],
                      unsigned char output[16] );
 
+/**
+ * \brief          AES-NI AES-ECB encryption of four consecutive blocks,
+ *                 interleaved round by round
+ *
+ * \param ctx      AES context set up for encryption
+ * \param input    64-byte input, four blocks
+ * \param output   64-byte output, four blocks; may be the same as input
+ *
+ * \return         0 on success (cannot fail)
+ */
+int mbedtls_aesni_encrypt_4blocks( mbedtls_aes_context *ctx,
+                           const unsigned char input[64],
+                           unsigned char output[64] );
+
 /**
  * \brief          GCM multiplication: c = a * b in GF(2^128)
  *
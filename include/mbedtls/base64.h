@@ -71,6 +71,12 @@ int mbedtls_base64_encode( unsigned char *dst, size_t dlen, size_t *olen,
  *
  * \note           Call this function with *dst = NULL or dlen = 0 to obtain
  *                 the required buffer size in *olen
+ *
+ * \note           The input is checked and decoded in a single pass, so
+ *                 the destination buffer may have been partly written to
+ *                 when an error is found. The bytes written are then set
+ *                 to zero before returning. A buffer of ( slen / 4 ) * 3 + 3
+ *                 bytes is always large enough.
  */
 int mbedtls_base64_decode( unsigned char *dst, size_t dlen, size_t *olen,
                    const unsigned char *src, size_t slen );
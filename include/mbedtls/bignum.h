@@ -79,6 +79,23 @@
 
 #define MBEDTLS_MPI_MAX_BITS                              ( 8 * MBEDTLS_MPI_MAX_SIZE )    /**< Maximum number of bits for usable MPIs. */
 
+#if !defined(MBEDTLS_MPI_SCRATCH_SIZE)
+/*
+ * Size in bytes of the scratch arena MPI temporaries are taken from within
+ * a scope opened with mbedtls_mpi_scratch_push(), if MBEDTLS_MPI_SCRATCH is
+ * enabled. Temporaries that do not fit are allocated on the heap.
+ */
+#define MBEDTLS_MPI_SCRATCH_SIZE                          32768    /**< Size of the scratch arena. */
+#endif /* !MBEDTLS_MPI_SCRATCH_SIZE */
+
+#if !defined(MBEDTLS_MPI_SCRATCH_MAX_DEPTH)
+/*
+ * Maximum nesting of scratch scopes. Scopes nested deeper share the arena
+ * space of their enclosing scope.
+ */
+#define MBEDTLS_MPI_SCRATCH_MAX_DEPTH                     4        /**< Maximum nesting of scratch scopes. */
+#endif /* !MBEDTLS_MPI_SCRATCH_MAX_DEPTH */
+
 /*
  * When reading from files with mbedtls_mpi_read_file() and writing to files with
  * mbedtls_mpi_write_file() the buffer should have space
@@ -807,6 +824,48 @@ int mbedtls_mpi_gen_prime( mbedtls_mpi *X, size_t nbits, int flags,
                    int (*f_rng)(void *, unsigned char *, size_t),
                    void *p_rng );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+/**
+ * \brief          Open a scratch scope for the calling thread.
+ *
+ *                 Until the matching mbedtls_mpi_scratch_pop(), MPIs that
+ *                 grow take their limbs from a per-thread arena by bumping
+ *                 a pointer instead of calling mbedtls_calloc(), and give
+ *                 them back by moving it down when freed in reverse order.
+ *                 The arena is allocated when the outermost scope is
+ *                 opened and freed when it is closed.
+ *
+ *                 This is meant to be called on entry of higher-level
+ *                 operations doing many MPI computations, such as an
+ *                 ECDSA signature or an RSA private key operation.
+ *
+ * \note           If the arena cannot be allocated, MPIs are allocated on
+ *                 the heap as usual.
+ */
+void mbedtls_mpi_scratch_push( void );
+
+/**
+ * \brief          Close the innermost scratch scope of the calling thread.
+ *
+ *                 MPIs allocated within the scope and not freed by then,
+ *                 such as results, are moved to the heap. The part of the
+ *                 arena used by the scope is then zeroized.
+ *
+ * \warning        Every MPI allocated within the scope must either have
+ *                 been freed or still be in use at the same address.
+ *
+ * \warning        An MPI that cannot be moved to the heap is reset to 0.
+ *                 Callers must then discard the values they keep across
+ *                 operations, such as cached precomputations or blinding
+ *                 values, so that they are not used as 0 later.
+ *
+ * \return         0 if successful,
+ *                 MBEDTLS_ERR_MPI_ALLOC_FAILED if an MPI could not be moved
+ *                 to the heap, in which case it is freed
+ */
+int mbedtls_mpi_scratch_pop( void );
+#endif /* MBEDTLS_MPI_SCRATCH */
+
 /**
  * \brief          Checkup routine
  *
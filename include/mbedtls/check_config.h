@@ -74,6 +74,11 @@
 #error "MBEDTLS_CTR_DRBG_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_CTR_DRBG_THREAD_C) &&                                   \
+    ( !defined(MBEDTLS_CTR_DRBG_C) || !defined(MBEDTLS_THREADING_PTHREAD) )
+#error "MBEDTLS_CTR_DRBG_THREAD_C defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_DHM_C) && !defined(MBEDTLS_BIGNUM_C)
 #error "MBEDTLS_DHM_C defined, but not all prerequisites"
 #endif
@@ -274,10 +279,25 @@
 #error "MBEDTLS_MEMORY_BUFFER_ALLOC_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS) &&                     \
+    !defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
+#error "MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_MPI_SCRATCH) &&                                    \
+    ( !defined(MBEDTLS_BIGNUM_C) ||                                     \
+      ( defined(MBEDTLS_THREADING_C) && !defined(MBEDTLS_THREADING_PTHREAD) ) )
+#error "MBEDTLS_MPI_SCRATCH defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_PADLOCK_C) && !defined(MBEDTLS_HAVE_ASM)
 #error "MBEDTLS_PADLOCK_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_BASE64_SIMD) && !defined(MBEDTLS_BASE64_C)
+#error "MBEDTLS_BASE64_SIMD defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_PEM_PARSE_C) && !defined(MBEDTLS_BASE64_C)
 #error "MBEDTLS_PEM_PARSE_C defined, but not all prerequisites"
 #endif
@@ -469,6 +489,11 @@
 #error "MBEDTLS_ENTROPY_NV_SEED defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_ENTROPY_BACKGROUND) &&\
+    ( !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_THREADING_PTHREAD) )
+#error "MBEDTLS_ENTROPY_BACKGROUND defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_PLATFORM_NV_SEED_ALT) &&\
     !defined(MBEDTLS_ENTROPY_NV_SEED)
 #error "MBEDTLS_PLATFORM_NV_SEED_ALT defined, but not all prerequisites"
@@ -506,14 +531,19 @@
 #error "MBEDTLS_PSA_CRYPTO_SPM defined, but not all prerequisites"
 #endif
 
-#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C) && defined(MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C)
-#error "Only one of MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C or MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C can be defined"
+#if ( defined(MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C) &&     \
+      ( defined(MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C) ||    \
+        defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C) ) ) || \
+    ( defined(MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C) &&      \
+      defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C) )
+#error "Only one of MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C, MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C or MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C can be defined"
 #endif
 
 #if defined(MBEDTLS_PSA_CRYPTO_STORAGE_C) &&            \
     !( defined(MBEDTLS_PSA_CRYPTO_C) &&                 \
        ( defined(MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C) ||  \
-         defined(MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C) ) )
+         defined(MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C) ||   \
+         defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C) ) )
 #error "MBEDTLS_PSA_CRYPTO_STORAGE_C defined, but not all prerequisites"
 #endif
 
@@ -528,6 +558,22 @@
 #error "MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C) &&             \
+    !( defined(MBEDTLS_PSA_CRYPTO_STORAGE_C) &&           \
+       defined(MBEDTLS_FS_IO) )
+#error "MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE) &&                  \
+    !defined(MBEDTLS_PSA_CRYPTO_STORAGE_C)
+#error "MBEDTLS_PSA_CRYPTO_KEY_CACHE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP) &&          \
+    !defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+#error "MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_RSA_C) && ( !defined(MBEDTLS_BIGNUM_C) ||         \
     !defined(MBEDTLS_OID_C) )
 #error "MBEDTLS_RSA_C defined, but not all prerequisites"
@@ -641,11 +687,44 @@
 #error "MBEDTLS_SSL_TICKET_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C) &&                                    \
+    ( !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_ECDH_C) )
+#error "MBEDTLS_SSL_ECDHE_POOL_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_POOL_C) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_POOL_C defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_CBC_RECORD_SPLITTING) && \
     !defined(MBEDTLS_SSL_PROTO_SSL3) && !defined(MBEDTLS_SSL_PROTO_TLS1)
 #error "MBEDTLS_SSL_CBC_RECORD_SPLITTING defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_CERT_MSG_CACHE) &&                                  \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_CERT_MSG_CACHE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX) && !defined(MBEDTLS_SSL_SRV_C)
+#error "MBEDTLS_SSL_CIPHERSUITE_INDEX defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_WRITE_CORK) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_WRITE_CORK defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_READ_AHEAD) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_READ_AHEAD defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_ASYNC_RECORD) &&                                 \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_SSL_PROTO_TLS1_2) || \
+      ( !defined(MBEDTLS_GCM_C) && !defined(MBEDTLS_CCM_C) &&             \
+        !defined(MBEDTLS_CHACHAPOLY_C) ) )
+#error "MBEDTLS_SSL_ASYNC_RECORD defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION) && \
         !defined(MBEDTLS_X509_CRT_PARSE_C)
 #error "MBEDTLS_SSL_SERVER_NAME_INDICATION defined, but not all prerequisites"
@@ -694,6 +773,24 @@
 #error "MBEDTLS_X509_CRT_PARSE_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_X509_CRT_STORE) && !defined(MBEDTLS_X509_CRT_PARSE_C)
+#error "MBEDTLS_X509_CRT_STORE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_CRT_PARSE_BULK) &&                             \
+    ( !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(MBEDTLS_FS_IO) )
+#error "MBEDTLS_X509_CRT_PARSE_BULK defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_CRT_PARSE_BULK) && defined(_WIN32)
+#error "MBEDTLS_X509_CRT_PARSE_BULK is only supported on POSIX systems"
+#endif
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C) &&                                \
+    ( !defined(MBEDTLS_X509_CRT_STORE) || !defined(MBEDTLS_SHA256_C) )
+#error "MBEDTLS_X509_CRT_CACHE_C defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_X509_CRL_PARSE_C) && ( !defined(MBEDTLS_X509_USE_C) )
 #error "MBEDTLS_X509_CRL_PARSE_C defined, but not all prerequisites"
 #endif
@@ -538,6 +538,20 @@
  */
 //#define MBEDTLS_AES_FEWER_TABLES
 
+/**
+ * \def MBEDTLS_BASE64_SIMD
+ *
+ * Use SSE2 to encode and decode base64 on x86 and x86-64, 16 characters at a
+ * time. Decoding also uses SSSE3 if the compiler targets it (e.g. -mssse3).
+ * The instructions are selected at compile time: this option has no effect
+ * if the compiler does not target SSE2, and on other architectures.
+ *
+ * Requires: MBEDTLS_BASE64_C
+ *
+ * Uncomment this macro to enable the SIMD base64 code.
+ */
+//#define MBEDTLS_BASE64_SIMD
+
 /**
  * \def MBEDTLS_CAMELLIA_SMALL_MEMORY
  *
@@ -1046,6 +1060,23 @@
  */
 //#define MBEDTLS_GENPRIME
 
+/**
+ * \def MBEDTLS_MPI_SCRATCH
+ *
+ * Take the MPI temporaries of ECDSA, ECDH, RSA private key and DHM secret
+ * computations from a per-thread scratch arena, allocated once per
+ * operation, instead of allocating each of them on the heap. See
+ * mbedtls_mpi_scratch_push().
+ *
+ * Module:  library/bignum.c
+ *
+ * Requires: MBEDTLS_BIGNUM_C
+ *           MBEDTLS_THREADING_PTHREAD if MBEDTLS_THREADING_C is enabled
+ *
+ * Uncomment this macro to use a scratch arena for MPI temporaries.
+ */
+//#define MBEDTLS_MPI_SCRATCH
+
 /**
  * \def MBEDTLS_FS_IO
  *
@@ -1121,6 +1152,22 @@
  */
 //#define MBEDTLS_ENTROPY_NV_SEED
 
+/**
+ * \def MBEDTLS_ENTROPY_BACKGROUND
+ *
+ * Enable mbedtls_entropy_background_start(), which runs a thread gathering
+ * entropy ahead of time, so that mbedtls_entropy_func() can hand out a ready
+ * block instead of polling the sources while its caller waits. The time
+ * callers still spend gathering is reported by
+ * mbedtls_entropy_background_get_stats().
+ *
+ * Requires: MBEDTLS_ENTROPY_C, MBEDTLS_THREADING_PTHREAD
+ *
+ * Uncomment this macro to take slow entropy sources off the path of DRBG
+ * reseeds.
+ */
+//#define MBEDTLS_ENTROPY_BACKGROUND
+
 /**
  * \def MBEDTLS_MEMORY_DEBUG
  *
@@ -1146,6 +1193,26 @@
  */
 //#define MBEDTLS_MEMORY_BACKTRACE
 
+/**
+ * \def MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS
+ *
+ * Make the buffer allocator scale with the number of threads using it.
+ * Free blocks are kept in lists segregated by size, so that a fitting block
+ * is found in constant time in most cases instead of by walking all free
+ * blocks. With MBEDTLS_THREADING_PTHREAD, the buffer is also split into
+ * per-thread arenas, each with its own mutex, so that threads allocating
+ * concurrently do not wait for each other.
+ *
+ * \warning The largest possible allocation is the size of one arena, see
+ *          MBEDTLS_MEMORY_BUFFER_ALLOC_ARENA_MIN_SIZE.
+ *
+ * Requires: MBEDTLS_MEMORY_BUFFER_ALLOC_C
+ *
+ * Uncomment this macro to use size classes and arenas in the buffer
+ * allocator.
+ */
+//#define MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS
+
 /**
  * \def MBEDTLS_PK_RSA_ALT_SUPPORT
  *
@@ -1177,6 +1244,39 @@
  */
 #define MBEDTLS_PKCS1_V21
 
+/**
+ * \def MBEDTLS_PSA_CRYPTO_KEY_CACHE
+ *
+ * Keep persistent keys in memory after their last handle is closed, so that
+ * opening them again needs neither a storage access nor parsing. This lets
+ * applications that use many persistent keys open a key for each operation
+ * and close it right after, instead of keeping handles open.
+ *
+ * The cache is limited to MBEDTLS_PSA_CRYPTO_KEY_CACHE_SIZE bytes of key
+ * material, and the least recently closed keys are evicted first.
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_STORAGE_C
+ *
+ * Uncomment this macro to cache persistent keys.
+ */
+//#define MBEDTLS_PSA_CRYPTO_KEY_CACHE
+
+/**
+ * \def MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP
+ *
+ * Map the file of MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C in memory, so that
+ * persistent keys are parsed in place when they are opened instead of being
+ * read into a buffer and copied again. Opening a key that is not in the page
+ * cache then costs a page fault rather than several system calls.
+ *
+ * The file is mapped read-only, with mmap(), which must be available.
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C
+ *
+ * Uncomment this macro to map the key log in memory.
+ */
+//#define MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP
+
 /**
  * \def MBEDTLS_RSA_NO_CRT
  *
@@ -1236,6 +1336,20 @@
  */
 //#define MBEDTLS_SSL_ASYNC_PRIVATE
 
+/**
+ * \def MBEDTLS_SSL_ASYNC_RECORD
+ *
+ * Enable asynchronous protection of application data records, see
+ * mbedtls_ssl_conf_async_record_cb(). This allows you to configure an SSL
+ * connection to hand outgoing records of TLS 1.2 AEAD ciphersuites to
+ * worker threads, which encrypt them concurrently while the library still
+ * sends them in order.
+ *
+ * Requires: MBEDTLS_SSL_PROTO_TLS1_2 and at least one of MBEDTLS_GCM_C,
+ *           MBEDTLS_CCM_C, MBEDTLS_CHACHAPOLY_C
+ */
+//#define MBEDTLS_SSL_ASYNC_RECORD
+
 /**
  * \def MBEDTLS_SSL_DEBUG_ALL
  *
@@ -1327,6 +1441,68 @@
  */
 //#define MBEDTLS_SSL_CBC_RECORD_SPLITTING
 
+/**
+ * \def MBEDTLS_SSL_CERT_MSG_CACHE
+ *
+ * Serialize the Certificate handshake message for each certificate chain
+ * set with mbedtls_ssl_conf_own_cert() once, when it is set, rather than on
+ * every full handshake. The message is then written with a single copy.
+ *
+ * This costs one heap copy of each certificate chain per configuration.
+ * Chains set with mbedtls_ssl_set_hs_own_cert() are not cached.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment this macro to cache Certificate messages.
+ */
+//#define MBEDTLS_SSL_CERT_MSG_CACHE
+
+/**
+ * \def MBEDTLS_SSL_CIPHERSUITE_INDEX
+ *
+ * Index the ciphersuite lists of server configurations when they are set.
+ * The index maps ciphersuite IDs to their definitions through a hash table
+ * and records what each ciphersuite needs in bitsets, so that a server
+ * matches the client's offer against its list in a single pass, without
+ * searching the ciphersuite definitions for each pair of candidates.
+ *
+ * This costs about 2.5 kB of heap per server configuration with the
+ * default ciphersuite list.
+ *
+ * Requires: MBEDTLS_SSL_SRV_C
+ *
+ * Uncomment this macro to index server ciphersuite lists.
+ */
+//#define MBEDTLS_SSL_CIPHERSUITE_INDEX
+
+/**
+ * \def MBEDTLS_SSL_WRITE_CORK
+ *
+ * Enable corked writes, see mbedtls_ssl_set_write_cork().
+ *
+ * While a TLS connection is corked, mbedtls_ssl_write() appends application
+ * data to an open record instead of sending one record per call. Full
+ * records are protected and packed back to back in the output buffer, and
+ * everything is handed to the send callback in one go on mbedtls_ssl_flush()
+ * or when the output buffer is full.
+ *
+ * Comment this macro to disable support for corked writes.
+ */
+//#define MBEDTLS_SSL_WRITE_CORK
+
+/**
+ * \def MBEDTLS_SSL_READ_AHEAD
+ *
+ * Enable read-ahead for TLS connections, see mbedtls_ssl_conf_read_ahead().
+ *
+ * With read-ahead configured, receive calls made after the handshake ask the
+ * transport for more than the rest of the current record, and
+ * mbedtls_ssl_read() then decrypts several buffered records in one call.
+ *
+ * Comment this macro to disable support for read-ahead.
+ */
+//#define MBEDTLS_SSL_READ_AHEAD
+
 /**
  * \def MBEDTLS_SSL_RENEGOTIATION
  *
@@ -1680,6 +1856,35 @@
  */
 #define MBEDTLS_X509_CHECK_EXTENDED_KEY_USAGE
 
+/**
+ * \def MBEDTLS_X509_CRT_STORE
+ *
+ * Enable the indexed trust store mbedtls_x509_crt_store, which looks up
+ * candidate parents by subject name hash and subject key identifier instead
+ * of walking the whole list of trusted certificates for each verification.
+ *
+ * Requires: MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment this macro to enable mbedtls_x509_crt_verify_with_store() and
+ * mbedtls_ssl_conf_ca_store().
+ */
+//#define MBEDTLS_X509_CRT_STORE
+
+/**
+ * \def MBEDTLS_X509_CRT_PARSE_BULK
+ *
+ * Enable mbedtls_x509_crt_parse_path_bulk(), which loads a directory of
+ * certificates by mapping the files into memory and, with
+ * MBEDTLS_THREADING_PTHREAD, parsing them on several threads.
+ *
+ * Requires: MBEDTLS_X509_CRT_PARSE_C, MBEDTLS_FS_IO
+ *
+ * This module uses opendir(), open() and mmap(), so it needs a POSIX system.
+ *
+ * Uncomment this macro to enable mbedtls_x509_crt_parse_path_bulk().
+ */
+//#define MBEDTLS_X509_CRT_PARSE_BULK
+
 /**
  * \def MBEDTLS_X509_RSASSA_PSS_SUPPORT
  *
@@ -2100,6 +2305,22 @@
  */
 #define MBEDTLS_CTR_DRBG_C
 
+/**
+ * \def MBEDTLS_CTR_DRBG_THREAD_C
+ *
+ * Enable per-thread CTR_DRBG instances behind a single RNG callback,
+ * mbedtls_ctr_drbg_thread_random(), which generates random data without
+ * taking a lock.
+ *
+ * Module:  library/ctr_drbg_thread.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_CTR_DRBG_C, MBEDTLS_THREADING_PTHREAD
+ *
+ * Uncomment to stop threads sharing an RNG from contending for its mutex.
+ */
+//#define MBEDTLS_CTR_DRBG_THREAD_C
+
 /**
  * \def MBEDTLS_DEBUG_C
  *
@@ -2646,6 +2867,66 @@
 #define USE_CRYPTO_SUBMODULE
 #define MBEDTLS_PSA_CRYPTO_C
 
+/**
+ * \def MBEDTLS_PSA_CRYPTO_STORAGE_C
+ *
+ * Enable the Platform Security Architecture persistent key storage.
+ *
+ * Module:  library/psa_crypto_storage.c
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_C and exactly one of
+ *           MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C,
+ *           MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C or
+ *           MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C
+ */
+#define MBEDTLS_PSA_CRYPTO_STORAGE_C
+
+/**
+ * \def MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C
+ *
+ * Enable persistent key storage over files, one per key, for the Platform
+ * Security Architecture cryptography API.
+ *
+ * Module:  library/psa_crypto_storage_file.c
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_STORAGE_C, MBEDTLS_FS_IO
+ */
+//#define MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C
+
+/**
+ * \def MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C
+ *
+ * Enable persistent key storage over the PSA Internal Trusted Storage API
+ * for the Platform Security Architecture cryptography API.
+ *
+ * Module:  library/psa_crypto_storage_its.c
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_STORAGE_C
+ */
+#define MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C
+
+/**
+ * \def MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C
+ *
+ * Enable persistent key storage in a single append-only file for the
+ * Platform Security Architecture cryptography API.
+ *
+ * Keys are appended to the file as records protected by a CRC, and found
+ * through an index kept in memory, which is built by reading the file when
+ * persistent storage is first accessed. This scales to a much larger number
+ * of keys than MBEDTLS_PSA_CRYPTO_STORAGE_FILE_C, which needs a file system
+ * lookup for every access.
+ *
+ * The file must only be used by one process at a time. See the options
+ * MBEDTLS_PSA_CRYPTO_STORAGE_LOG_xxx for when it is synchronized to the
+ * storage medium and compacted.
+ *
+ * Module:  library/psa_crypto_storage_log.c
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_STORAGE_C, MBEDTLS_FS_IO
+ */
+//#define MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C
+
 /**
  * \def MBEDTLS_RIPEMD160_C
  *
@@ -2752,6 +3033,39 @@
  */
 #define MBEDTLS_SSL_COOKIE_C
 
+/**
+ * \def MBEDTLS_SSL_ECDHE_POOL_C
+ *
+ * Enable a pool of pre-generated ECDHE key pairs for SSL servers, to be
+ * filled by application threads and attached to a configuration with
+ * mbedtls_ssl_conf_ecdhe_pool().
+ *
+ * Module:  library/ssl_ecdhe_pool.c
+ * Caller:  library/ssl_srv.c
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_ECDH_C
+ *
+ * Uncomment to take ECDHE key generation off the handshake path of servers
+ * with idle time between bursts of connections.
+ */
+//#define MBEDTLS_SSL_ECDHE_POOL_C
+
+/**
+ * \def MBEDTLS_SSL_POOL_C
+ *
+ * Enable a slab pool for SSL record buffers, transforms and handshake
+ * parameters, to be attached to a configuration with mbedtls_ssl_conf_pool().
+ *
+ * Module:  library/ssl_pool.c
+ * Caller:  library/ssl_tls.c
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment to avoid hitting the heap for every connection set up or torn
+ * down by servers with many short-lived connections.
+ */
+//#define MBEDTLS_SSL_POOL_C
+
 /**
  * \def MBEDTLS_SSL_TICKET_C
  *
@@ -2897,6 +3211,22 @@
  */
 #define MBEDTLS_X509_CRT_PARSE_C
 
+/**
+ * \def MBEDTLS_X509_CRT_CACHE_C
+ *
+ * Enable a cache of verified certificate chains for trust stores.
+ *
+ * Module:  library/x509_crt_cache.c
+ * Caller:  library/x509_crt.c
+ *
+ * Requires: MBEDTLS_X509_CRT_STORE, MBEDTLS_SHA256_C
+ *
+ * This module allows mbedtls_x509_crt_verify_with_store() and the SSL/TLS
+ * module, when configured with mbedtls_ssl_conf_ca_store(), to skip the
+ * signature checks for chains that were recently verified successfully.
+ */
+//#define MBEDTLS_X509_CRT_CACHE_C
+
 /**
  * \def MBEDTLS_X509_CRL_PARSE_C
  *
@@ -2994,6 +3324,8 @@
 /* MPI / BIGNUM options */
 //#define MBEDTLS_MPI_WINDOW_SIZE            6 /**< Maximum windows size used. */
 //#define MBEDTLS_MPI_MAX_SIZE            1024 /**< Maximum number of bytes for usable MPIs. */
+//#define MBEDTLS_MPI_SCRATCH_SIZE       32768 /**< Size of the scratch arena. */
+//#define MBEDTLS_MPI_SCRATCH_MAX_DEPTH      4 /**< Maximum nesting of scratch scopes. */
 
 /* CTR_DRBG options */
 //#define MBEDTLS_CTR_DRBG_ENTROPY_LEN               48 /**< Amount of entropy used per seed by default (48 with SHA-512, 32 with SHA-256) */
@@ -3017,10 +3349,13 @@
 /* Entropy options */
 //#define MBEDTLS_ENTROPY_MAX_SOURCES                20 /**< Maximum number of sources supported */
 //#define MBEDTLS_ENTROPY_MAX_GATHER                128 /**< Maximum amount requested from entropy sources */
+//#define MBEDTLS_ENTROPY_BACKGROUND_BLOCKS           8 /**< Blocks kept ready by the background thread */
 //#define MBEDTLS_ENTROPY_MIN_HARDWARE               32 /**< Default minimum number of bytes required for the hardware entropy source mbedtls_hardware_poll() before entropy is released */
 
 /* Memory buffer allocator options */
 //#define MBEDTLS_MEMORY_ALIGN_MULTIPLE      4 /**< Align on multiples of this value */
+//#define MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS_MAX      4 /**< Maximum number of per-thread arenas */
+//#define MBEDTLS_MEMORY_BUFFER_ALLOC_ARENA_MIN_SIZE  65536 /**< Minimum size of a per-thread arena */
 
 /* Platform options */
 //#define MBEDTLS_PLATFORM_STD_MEM_HDR   <stdlib.h> /**< Header to include if MBEDTLS_PLATFORM_NO_STD_FUNCTIONS is defined. Don't define if no header is needed. */
@@ -3052,10 +3387,23 @@
 //#define MBEDTLS_PLATFORM_NV_SEED_READ_MACRO   mbedtls_platform_std_nv_seed_read /**< Default nv_seed_read function to use, can be undefined */
 //#define MBEDTLS_PLATFORM_NV_SEED_WRITE_MACRO  mbedtls_platform_std_nv_seed_write /**< Default nv_seed_write function to use, can be undefined */
 
+/* PSA key cache options */
+//#define MBEDTLS_PSA_CRYPTO_KEY_CACHE_SIZE   65536 /**< Bytes of key material kept in the key cache */
+
+/* PSA key log options */
+//#define MBEDTLS_PSA_CRYPTO_STORAGE_LOG_SYNC_INTERVAL    64 /**< Records appended between two synchronizations of the key log */
+//#define MBEDTLS_PSA_CRYPTO_STORAGE_LOG_COMPACT_MIN   65536 /**< Bytes of deleted records before the key log may be compacted */
+
 /* SSL Cache options */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_TIMEOUT       86400 /**< 1 day  */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_MAX_ENTRIES      50 /**< Maximum entries in cache */
 
+/* SSL pool options */
+//#define MBEDTLS_SSL_POOL_DEFAULT_SLAB_OBJECTS       4 /**< Objects carved from each slab */
+
+/* SSL ECDHE pool options */
+//#define MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES           4 /**< Maximum curves in a pool */
+
 /* SSL options */
 
 /** \def MBEDTLS_SSL_MAX_CONTENT_LEN
@@ -3120,6 +3468,7 @@
 //#define MBEDTLS_SSL_DTLS_MAX_BUFFERING             32768
 
 //#define MBEDTLS_SSL_DEFAULT_TICKET_LIFETIME     86400 /**< Lifetime of session tickets (if enabled) */
+//#define MBEDTLS_SSL_ASYNC_RECORD_SLOTS             4 /**< Maximum number of records of a connection being protected asynchronously */
 //#define MBEDTLS_PSK_MAX_LEN               32 /**< Max size of TLS pre-shared keys, in bytes (default 256 bits) */
 //#define MBEDTLS_SSL_COOKIE_TIMEOUT        60 /**< Default expiration delay of DTLS cookies, in seconds if HAVE_TIME, or in number of cookies issued */
 
@@ -3140,6 +3489,8 @@
 /* X509 options */
 //#define MBEDTLS_X509_MAX_INTERMEDIATE_CA   8   /**< Maximum number of intermediate CAs in a verification chain. */
 //#define MBEDTLS_X509_MAX_FILE_PATH_LEN     512 /**< Maximum length of a path/filename string in bytes including the null terminator character ('\0'). */
+//#define MBEDTLS_X509_CRT_CACHE_DEFAULT_TIMEOUT       3600 /**< 1 hour */
+//#define MBEDTLS_X509_CRT_CACHE_DEFAULT_MAX_ENTRIES     64 /**< Maximum entries in the verification cache */
 
 /**
  * Allow SHA-1 in the default TLS configuration for certificate signing.
@@ -3238,5 +3589,3 @@
 #endif
 
 #endif /* MBEDTLS_CONFIG_H */
-#define MBEDTLS_PSA_CRYPTO_STORAGE_C
-#define MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C
\ No newline at end of file
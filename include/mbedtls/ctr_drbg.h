@@ -46,6 +46,7 @@
 #define MBEDTLS_ERR_CTR_DRBG_REQUEST_TOO_BIG              -0x0036  /**< The requested random buffer length is too big. */
 #define MBEDTLS_ERR_CTR_DRBG_INPUT_TOO_BIG                -0x0038  /**< The input (entropy + additional data) is too large. */
 #define MBEDTLS_ERR_CTR_DRBG_FILE_IO_ERROR                -0x003A  /**< Read or write error in file. */
+#define MBEDTLS_ERR_CTR_DRBG_ALLOC_FAILED                 -0x003B  /**< Failed to allocate memory. */
 
 #define MBEDTLS_CTR_DRBG_BLOCKSIZE          16 /**< The block size used by the cipher. */
 
@@ -130,6 +131,9 @@ typedef struct mbedtls_ctr_drbg_context
     int reseed_interval;        /*!< The reseed interval. */
 
     mbedtls_aes_context aes_ctx;        /*!< The AES context. */
+    mbedtls_aes_context df_ctx;         /*!< The AES context of the
+                                             derivation function, with its
+                                             fixed key. */
 
     /*
      * Callbacks (Entropy)
@@ -0,0 +1,236 @@
+/**
+ * \file ctr_drbg_thread.h
+ *
+ * \brief Per-thread CTR_DRBG instances behind a single RNG callback
+ *
+ * Sharing one CTR_DRBG context between threads serializes every call to
+ * mbedtls_ctr_drbg_random() on the context mutex. The contexts defined here
+ * give each calling thread its own CTR_DRBG instance instead, created and
+ * seeded on first use from a shared entropy source, so that generating
+ * random data takes no lock.
+ */
+/*
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+#ifndef MBEDTLS_CTR_DRBG_THREAD_H
+#define MBEDTLS_CTR_DRBG_THREAD_H
+
+#include "ctr_drbg.h"
+#include "threading.h"
+
+#include <pthread.h>
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_CTR_DRBG_THREAD_BUFFERED_MAX)
+#define MBEDTLS_CTR_DRBG_THREAD_BUFFERED_MAX    64  /*!< Largest request served from the buffer */
+#endif
+
+/* \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ctr_drbg_thread_context mbedtls_ctr_drbg_thread_context;
+
+/**
+ * \brief   CTR_DRBG instance of one thread
+ */
+typedef struct mbedtls_ctr_drbg_thread_instance
+{
+    mbedtls_ctr_drbg_context drbg;      /*!< DRBG, only used by its thread  */
+    unsigned long forks;                /*!< forks seen when last seeded    */
+    mbedtls_ctr_drbg_thread_context *ctx;   /*!< owning context             */
+    unsigned char *buf;                 /*!< pre-generated output, or NULL  */
+    size_t buf_len;                     /*!< size of buf                    */
+    size_t buf_pos;                     /*!< offset of the first unused
+                                             byte; those before are wiped   */
+    struct mbedtls_ctr_drbg_thread_instance *next;  /*!< next in list       */
+} mbedtls_ctr_drbg_thread_instance;
+
+/**
+ * \brief   Per-thread CTR_DRBG context
+ */
+struct mbedtls_ctr_drbg_thread_context
+{
+    int (*f_entropy)(void *, unsigned char *, size_t);
+                                /*!< entropy function shared by instances   */
+    void *p_entropy;            /*!< context for the entropy function       */
+    unsigned char *custom;      /*!< personalization data of instances      */
+    size_t custom_len;          /*!< length of custom                       */
+    int reseed_interval;        /*!< reseed interval of new instances       */
+    int prediction_resistance;  /*!< prediction resistance of new instances */
+    size_t buffer_size;         /*!< output buffer size of new instances    */
+    size_t instances;           /*!< number of instances created            */
+    int key_created;            /*!< key holds a thread-specific key        */
+    pthread_key_t key;          /*!< key to the instance of each thread     */
+    mbedtls_ctr_drbg_thread_instance *list;
+                                /*!< live instances, one per thread         */
+    mbedtls_threading_mutex_t mutex;
+                                /*!< mutex protecting list and instances;
+                                     not taken to generate random data      */
+};
+
+/**
+ * \brief          Initialize a per-thread CTR_DRBG context
+ *
+ * \param ctx      context to initialize
+ */
+void mbedtls_ctr_drbg_thread_init( mbedtls_ctr_drbg_thread_context *ctx );
+
+/**
+ * \brief          Set up the entropy source and the personalization data
+ *                 used to seed the instance of each thread.
+ *
+ *                 Each instance is seeded as by mbedtls_ctr_drbg_seed(),
+ *                 with \p custom followed by a per-instance counter as
+ *                 personalization data, so that no two instances start from
+ *                 the same state even if the entropy source were to repeat
+ *                 itself.
+ *
+ * \note           \p f_entropy is called by whichever thread needs to seed
+ *                 or reseed its instance, so it must be thread-safe.
+ *                 mbedtls_entropy_func() is when MBEDTLS_THREADING_C is
+ *                 enabled.
+ *
+ * \param ctx      context to set up
+ * \param f_entropy entropy callback
+ * \param p_entropy entropy context, for example an mbedtls_entropy_context
+ * \param custom   personalization data, can be NULL
+ * \param len      length of the personalization data, at most
+ *                 MBEDTLS_CTR_DRBG_MAX_SEED_INPUT - MBEDTLS_CTR_DRBG_ENTROPY_LEN
+ *                 - 8 bytes
+ *
+ * \note           A context can only be set up once: free it and initialize
+ *                 it again to change these parameters.
+ *
+ * \return         0 if successful,
+ *                 MBEDTLS_ERR_THREADING_BAD_INPUT_DATA if \p ctx is already
+ *                 set up,
+ *                 MBEDTLS_ERR_CTR_DRBG_INPUT_TOO_BIG if \p len is too large,
+ *                 MBEDTLS_ERR_CTR_DRBG_ALLOC_FAILED on allocation failure, or
+ *                 MBEDTLS_ERR_THREADING_MUTEX_ERROR if no thread-specific
+ *                 key could be created
+ */
+int mbedtls_ctr_drbg_thread_setup( mbedtls_ctr_drbg_thread_context *ctx,
+                                   int (*f_entropy)(void *, unsigned char *, size_t),
+                                   void *p_entropy,
+                                   const unsigned char *custom,
+                                   size_t len );
+
+/**
+ * \brief          Set the reseed interval of the instances, as by
+ *                 mbedtls_ctr_drbg_set_reseed_interval().
+ *
+ * \note           This only applies to instances created after the call, so
+ *                 it should be called before any thread generates data.
+ *
+ * \param ctx      context
+ * \param interval reseed interval
+ */
+void mbedtls_ctr_drbg_thread_set_reseed_interval( mbedtls_ctr_drbg_thread_context *ctx,
+                                                  int interval );
+
+/**
+ * \brief          Enable or disable prediction resistance of the instances,
+ *                 as by mbedtls_ctr_drbg_set_prediction_resistance().
+ *
+ * \note           This only applies to instances created after the call, so
+ *                 it should be called before any thread generates data.
+ *
+ * \param ctx      context
+ * \param resistance MBEDTLS_CTR_DRBG_PR_ON or MBEDTLS_CTR_DRBG_PR_OFF
+ */
+void mbedtls_ctr_drbg_thread_set_prediction_resistance( mbedtls_ctr_drbg_thread_context *ctx,
+                                                        int resistance );
+
+/**
+ * \brief          Have each instance pre-generate up to \p size bytes of
+ *                 output, from which requests of at most
+ *                 MBEDTLS_CTR_DRBG_THREAD_BUFFERED_MAX bytes are served by
+ *                 copying, instead of running a full CTR_DRBG generate
+ *                 operation for each of them. Buffering is off by default.
+ *
+ *                 Served bytes are wiped from the buffer. The buffer is
+ *                 discarded when the instance is reseeded, including after
+ *                 a fork, so that no output generated before a reseed is
+ *                 handed out after it.
+ *
+ * \note           Output generated in advance lives in memory until it is
+ *                 used, so only enable this if that is acceptable. It has no
+ *                 effect on instances with prediction resistance, which
+ *                 must reseed for every request.
+ *
+ * \note           This only applies to instances created after the call, so
+ *                 it should be called before any thread generates data.
+ *
+ * \param ctx      context
+ * \param size     buffer size in bytes, a few KB being typical, or 0 to
+ *                 disable buffering
+ */
+void mbedtls_ctr_drbg_thread_set_buffer_size( mbedtls_ctr_drbg_thread_context *ctx,
+                                              size_t size );
+
+/**
+ * \brief          Generate random data using the instance of the calling
+ *                 thread, creating and seeding it on the first call.
+ *                 (Thread-safe, and takes no lock after the first call of
+ *                 each thread)
+ *
+ *                 This can be used as the f_rng callback wherever
+ *                 mbedtls_ctr_drbg_random() can, with the per-thread
+ *                 context as p_rng.
+ *
+ * \note           The instance of the calling thread is reseeded before use
+ *                 if the process has forked since it was last used, so that
+ *                 parent and child never share output. Other ways of cloning
+ *                 the process memory are not detected.
+ *
+ * \param p_rng    per-thread CTR_DRBG context
+ * \param output   buffer to fill
+ * \param output_len length of the buffer, at most
+ *                 MBEDTLS_CTR_DRBG_MAX_REQUEST bytes
+ *
+ * \return         0 if successful, or an MBEDTLS_ERR_CTR_DRBG_XXX or
+ *                 MBEDTLS_ERR_THREADING_XXX error code
+ */
+int mbedtls_ctr_drbg_thread_random( void *p_rng,
+                                    unsigned char *output, size_t output_len );
+
+/**
+ * \brief          Free the instances of all threads and clear memory
+ *
+ * \warning        No thread may be using the context while, or after, this
+ *                 function is called.
+ *
+ * \param ctx      context to free
+ */
+void mbedtls_ctr_drbg_thread_free( mbedtls_ctr_drbg_thread_context *ctx );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ctr_drbg_thread.h */
@@ -515,6 +515,22 @@ void mbedtls_ecp_restart_init( mbedtls_ecp_restart_ctx *ctx );
 void mbedtls_ecp_restart_free( mbedtls_ecp_restart_ctx *ctx );
 #endif /* MBEDTLS_ECP_RESTARTABLE */
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+/**
+ * \brief           This function discards the precomputed points cached in
+ *                  an ECP group and the state kept in a restart context.
+ *
+ *                  It is called when mbedtls_mpi_scratch_pop() fails, since
+ *                  some of these values may then have been reset to zero.
+ *                  They are computed again by the next operation.
+ *
+ * \param grp       The group whose cached points are discarded.
+ * \param rs_ctx    The restart context to clear, or NULL.
+ */
+void mbedtls_ecp_scratch_discard( mbedtls_ecp_group *grp,
+                                  mbedtls_ecp_restart_ctx *rs_ctx );
+#endif /* MBEDTLS_MPI_SCRATCH */
+
 /**
  * \brief           This function copies the contents of point \p Q into
  *                  point \p P.
@@ -50,6 +50,11 @@
 #include "havege.h"
 #endif
 
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+#include <stdint.h>
+#include <pthread.h>
+#endif
+
 #define MBEDTLS_ERR_ENTROPY_SOURCE_FAILED                 -0x003C  /**< Critical entropy source failure. */
 #define MBEDTLS_ERR_ENTROPY_MAX_SOURCES                   -0x003E  /**< No more sources can be added. */
 #define MBEDTLS_ERR_ENTROPY_NO_SOURCES_DEFINED            -0x0040  /**< No sources have been added to poll. */
@@ -72,6 +77,10 @@
 #define MBEDTLS_ENTROPY_MAX_GATHER      128     /**< Maximum amount requested from entropy sources */
 #endif
 
+#if !defined(MBEDTLS_ENTROPY_BACKGROUND_BLOCKS)
+#define MBEDTLS_ENTROPY_BACKGROUND_BLOCKS   8   /**< Blocks kept ready by the background thread */
+#endif
+
 /* \} name SECTION: Module settings */
 
 #if defined(MBEDTLS_ENTROPY_SHA512_ACCUMULATOR)
@@ -117,6 +126,22 @@ typedef struct mbedtls_entropy_source_state
 }
 mbedtls_entropy_source_state;
 
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+/**
+ * \brief           Counters of the background entropy service
+ */
+typedef struct mbedtls_entropy_background_stats
+{
+    size_t served;          /**< requests served from the ready pool */
+    size_t stalls;          /**< requests that found the pool empty and
+                                 gathered entropy themselves */
+    uint64_t stall_usec;    /**< time spent in those requests, in
+                                 microseconds */
+    size_t ready;           /**< blocks currently ready */
+}
+mbedtls_entropy_background_stats;
+#endif /* MBEDTLS_ENTROPY_BACKGROUND */
+
 /**
  * \brief           Entropy context structure
  */
@@ -139,6 +164,20 @@ typedef struct mbedtls_entropy_context
 #if defined(MBEDTLS_ENTROPY_NV_SEED)
     int initial_entropy_run;
 #endif
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+    int bg_running;                     /*!< background thread started  */
+    int bg_stop;                        /*!< thread asked to stop       */
+    long bg_pid;                        /*!< process of the thread      */
+    pthread_t bg_thread;                /*!< background thread          */
+    pthread_mutex_t bg_mutex;           /*!< protects the fields below  */
+    pthread_cond_t bg_cond;             /*!< pool or bg_stop changed    */
+    unsigned char bg_ready[MBEDTLS_ENTROPY_BACKGROUND_BLOCKS][MBEDTLS_ENTROPY_BLOCK_SIZE];
+                                        /*!< blocks ready for use       */
+    int bg_ready_count;                 /*!< number of blocks ready     */
+    mbedtls_entropy_background_stats bg_stats;  /*!< usage counters     */
+    struct mbedtls_entropy_context *bg_next;    /*!< next context with a
+                                                     background thread   */
+#endif
 }
 mbedtls_entropy_context;
 
@@ -192,6 +231,10 @@ int mbedtls_entropy_gather( mbedtls_entropy_context *ctx );
  *                  (Maximum length: MBEDTLS_ENTROPY_BLOCK_SIZE)
  *                  (Thread-safe if MBEDTLS_THREADING_C is enabled)
  *
+ * \note            If a background thread was started with
+ *                  mbedtls_entropy_background_start(), this takes a block
+ *                  it prepared instead, when one is ready.
+ *
  * \param data      Entropy context
  * \param output    Buffer to fill
  * \param len       Number of bytes desired, must be at most MBEDTLS_ENTROPY_BLOCK_SIZE
@@ -200,6 +243,55 @@ int mbedtls_entropy_gather( mbedtls_entropy_context *ctx );
  */
 int mbedtls_entropy_func( void *data, unsigned char *output, size_t len );
 
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+/**
+ * \brief           Start a thread that gathers entropy in the background
+ *                  and keeps up to MBEDTLS_ENTROPY_BACKGROUND_BLOCKS blocks
+ *                  of output ready.
+ *
+ *                  mbedtls_entropy_func() then hands out a ready block,
+ *                  without polling any source. If none is ready, it
+ *                  gathers entropy itself as usual, which is counted as a
+ *                  stall in the statistics.
+ *
+ * \note            This must be called after the sources have been added,
+ *                  and before the context is shared between threads.
+ *
+ * \note            The thread does not survive fork(): in a child process,
+ *                  the blocks inherited from the parent are wiped and
+ *                  mbedtls_entropy_func() gathers entropy itself. The
+ *                  context's mutexes are held across fork() so that the
+ *                  child does not inherit them locked by the thread.
+ *
+ * \param ctx       Entropy context
+ *
+ * \return          0 if successful, or MBEDTLS_ERR_THREADING_MUTEX_ERROR if
+ *                  the thread could not be started
+ */
+int mbedtls_entropy_background_start( mbedtls_entropy_context *ctx );
+
+/**
+ * \brief           Stop the background thread, wait for it to return and
+ *                  wipe the blocks it prepared. This is also done by
+ *                  mbedtls_entropy_free().
+ *
+ * \warning         No other thread may be using the context.
+ *
+ * \param ctx       Entropy context
+ */
+void mbedtls_entropy_background_stop( mbedtls_entropy_context *ctx );
+
+/**
+ * \brief           Get the counters of the background entropy service
+ *                  (Thread-safe)
+ *
+ * \param ctx       Entropy context
+ * \param stats     Structure to fill with the current counters
+ */
+void mbedtls_entropy_background_get_stats( mbedtls_entropy_context *ctx,
+                                           mbedtls_entropy_background_stats *stats );
+#endif /* MBEDTLS_ENTROPY_BACKGROUND */
+
 /**
  * \brief           Add data to the accumulator manually
  *                  (Thread-safe if MBEDTLS_THREADING_C is enabled)
@@ -60,7 +60,7 @@
  * OID       1  0x002E-0x002E   0x000B-0x000B
  * PADLOCK   1  0x0030-0x0030
  * DES       2  0x0032-0x0032   0x0033-0x0033
- * CTR_DBRG  4  0x0034-0x003A
+ * CTR_DBRG  5  0x0034-0x003A   0x003B-0x003B
  * ENTROPY   3  0x003C-0x0040   0x003D-0x003F
  * NET      13  0x0042-0x0052   0x0043-0x0049
  * ARIA      4  0x0058-0x005E
@@ -44,6 +44,14 @@
 #define MBEDTLS_MEMORY_ALIGN_MULTIPLE       4 /**< Align on multiples of this value */
 #endif
 
+#if !defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS_MAX)
+#define MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS_MAX      4 /**< Maximum number of per-thread arenas */
+#endif
+
+#if !defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENA_MIN_SIZE)
+#define MBEDTLS_MEMORY_BUFFER_ALLOC_ARENA_MIN_SIZE  65536 /**< Minimum size of a per-thread arena */
+#endif
+
 /* \} name SECTION: Module settings */
 
 #define MBEDTLS_MEMORY_VERIFY_NONE         0
@@ -64,8 +72,15 @@ extern "C" {
  *          (Provided mbedtls_calloc() and mbedtls_free() are thread-safe if
  *           MBEDTLS_THREADING_C is defined)
  *
- * \note    This code is not optimized and provides a straight-forward
- *          implementation of a stack-based memory allocator.
+ * \note    Without MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS, this code is not
+ *          optimized and provides a straight-forward implementation of a
+ *          stack-based memory allocator.
+ *
+ * \note    With MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS and
+ *          MBEDTLS_THREADING_PTHREAD, the buffer is split into up to
+ *          MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS_MAX arenas of at least
+ *          MBEDTLS_MEMORY_BUFFER_ALLOC_ARENA_MIN_SIZE bytes each. A single
+ *          allocation must then fit in one arena.
  *
  * \param buf   buffer to use as heap
  * \param len   size of the buffer
@@ -197,6 +197,9 @@
 #define MBEDTLS_SSL_CBC_RECORD_SPLITTING_DISABLED    0
 #define MBEDTLS_SSL_CBC_RECORD_SPLITTING_ENABLED     1
 
+#define MBEDTLS_SSL_WRITE_CORK_DISABLED         0
+#define MBEDTLS_SSL_WRITE_CORK_ENABLED          1
+
 #define MBEDTLS_SSL_ARC4_ENABLED                0
 #define MBEDTLS_SSL_ARC4_DISABLED               1
 
@@ -256,6 +259,14 @@
 #define MBEDTLS_SSL_DTLS_MAX_BUFFERING 32768
 #endif
 
+/*
+ * Maximum number of application data records of one connection that can be
+ * protected asynchronously at the same time.
+ */
+#if !defined(MBEDTLS_SSL_ASYNC_RECORD_SLOTS)
+#define MBEDTLS_SSL_ASYNC_RECORD_SLOTS 4
+#endif
+
 /* \} name SECTION: Module settings */
 
 /*
@@ -574,6 +585,19 @@ typedef struct mbedtls_ssl_key_cert mbedtls_ssl_key_cert;
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 typedef struct mbedtls_ssl_flight_item mbedtls_ssl_flight_item;
 #endif
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+typedef struct mbedtls_ssl_ciphersuite_index mbedtls_ssl_ciphersuite_index;
+#endif
+
+#if defined(MBEDTLS_SSL_POOL_C)
+/* Defined in ssl_pool.h */
+typedef struct mbedtls_ssl_pool_context mbedtls_ssl_pool_context;
+#endif
+
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+/* Defined in ssl_ecdhe_pool.h */
+typedef struct mbedtls_ssl_ecdhe_pool_context mbedtls_ssl_ecdhe_pool_context;
+#endif
 
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
@@ -787,6 +811,92 @@ typedef int mbedtls_ssl_async_resume_t( mbedtls_ssl_context *ssl,
 typedef void mbedtls_ssl_async_cancel_t( mbedtls_ssl_context *ssl );
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+/* Defined in ssl_internal.h */
+typedef struct mbedtls_ssl_async_record mbedtls_ssl_async_record;
+
+/**
+ * \brief           Callback type: start protecting an application data
+ *                  record.
+ *
+ *                  This callback is called by mbedtls_ssl_write() once an
+ *                  application data record is ready to be encrypted and
+ *                  authenticated. It typically enqueues \p record for a
+ *                  worker thread, which then calls
+ *                  mbedtls_ssl_async_record_protect() on it, and returns
+ *                  without waiting for the operation to complete.
+ *
+ *                  Each record carries its own cipher context, sequence
+ *                  number and buffer, so several records of the same
+ *                  connection may be protected concurrently and complete in
+ *                  any order; the library still sends them in order.
+ *                  \p record remains valid until the resume callback has
+ *                  reported its completion, or the cancel callback has been
+ *                  called for it.
+ *
+ *                  This function may call mbedtls_ssl_async_record_set_data()
+ *                  to attach an operation context to \p record.
+ *
+ * \param ssl       The SSL connection instance. It should not be modified,
+ *                  and must not be accessed by the worker.
+ * \param record    The record to protect.
+ *
+ * \return          0 if the operation was started successfully.
+ * \return          #MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH if the record
+ *                  should be protected synchronously by the library instead.
+ * \return          Any other error indicates a fatal failure and is
+ *                  propagated up the call chain.
+ */
+typedef int mbedtls_ssl_async_record_start_t( mbedtls_ssl_context *ssl,
+                                              mbedtls_ssl_async_record *record );
+
+/**
+ * \brief           Callback type: check an asynchronous record protection.
+ *
+ *                  This callback is called, in record order, before the
+ *                  library sends a record whose protection was started by
+ *                  the ::mbedtls_ssl_async_record_start_t callback. It must
+ *                  not wait for the operation to complete.
+ *
+ *                  Before returning 0, this function must make sure that
+ *                  everything the worker wrote to \p record is visible to
+ *                  the calling thread, for example by locking the mutex the
+ *                  worker released after mbedtls_ssl_async_record_protect()
+ *                  returned. It must free any resources associated with the
+ *                  operation when it returns a value other than
+ *                  #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS.
+ *
+ * \param ssl       The SSL connection instance. It should not be modified.
+ * \param record    The record being protected.
+ *
+ * \return          0 if mbedtls_ssl_async_record_protect() has returned for
+ *                  \p record. The library then checks its result.
+ * \return          #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if the operation is
+ *                  still in progress. The SSL function that was called
+ *                  returns the same error and must be called again later.
+ * \return          Any other error indicates a fatal failure and is
+ *                  propagated up the call chain.
+ */
+typedef int mbedtls_ssl_async_record_resume_t( mbedtls_ssl_context *ssl,
+                                               mbedtls_ssl_async_record *record );
+
+/**
+ * \brief           Callback type: cancel an asynchronous record protection.
+ *
+ *                  This callback is called by mbedtls_ssl_free() and
+ *                  mbedtls_ssl_session_reset() for each record whose
+ *                  protection was started but not reported complete by the
+ *                  resume callback. Once it returns, no worker may access
+ *                  \p record anymore: if the protection is running, this
+ *                  function must wait for it to finish.
+ *
+ * \param ssl       The SSL connection instance. It should not be modified.
+ * \param record    The record being protected.
+ */
+typedef void mbedtls_ssl_async_record_cancel_t( mbedtls_ssl_context *ssl,
+                                                mbedtls_ssl_async_record *record );
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
+
 /*
  * This structure is used for storing current session data.
  */
@@ -837,6 +947,10 @@ struct mbedtls_ssl_config
      */
 
     const int *ciphersuite_list[4]; /*!< allowed ciphersuites per version   */
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    mbedtls_ssl_ciphersuite_index *ciphersuite_index[4]; /*!< index of each
+                                          list, servers only            */
+#endif
 
     /** Callback for printing debug output                                  */
     void (*f_dbg)(void *, int, const char *, int, const char *);
@@ -852,6 +966,15 @@ struct mbedtls_ssl_config
     int (*f_set_cache)(void *, const mbedtls_ssl_session *);
     void *p_cache;                  /*!< context for cache callbacks        */
 
+#if defined(MBEDTLS_SSL_POOL_C)
+    mbedtls_ssl_pool_context *p_pool; /*!< pool for buffers and sub-contexts */
+#endif
+
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+    mbedtls_ssl_ecdhe_pool_context *p_ecdhe_pool; /*!< pre-generated ECDHE
+                                                       key pairs            */
+#endif
+
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
     /** Callback for setting cert according to SNI extension                */
     int (*f_sni)(void *, mbedtls_ssl_context *, const unsigned char *, size_t);
@@ -901,6 +1024,9 @@ struct mbedtls_ssl_config
     mbedtls_ssl_key_cert *key_cert; /*!< own certificate/key pair(s)        */
     mbedtls_x509_crt *ca_chain;     /*!< trusted CAs                        */
     mbedtls_x509_crl *ca_crl;       /*!< trusted CAs CRLs                   */
+#if defined(MBEDTLS_X509_CRT_STORE)
+    mbedtls_x509_crt_store *ca_store; /*!< index of ca_chain, or NULL       */
+#endif
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
@@ -913,6 +1039,13 @@ struct mbedtls_ssl_config
     void *p_async_config_data; /*!< Configuration data set by mbedtls_ssl_conf_async_private_cb(). */
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    mbedtls_ssl_async_record_start_t *f_async_record_start; /*!< start asynchronous record protection */
+    mbedtls_ssl_async_record_resume_t *f_async_record_resume; /*!< check asynchronous record protection */
+    mbedtls_ssl_async_record_cancel_t *f_async_record_cancel; /*!< cancel asynchronous record protection */
+    void *p_async_record_config_data; /*!< Configuration data set by mbedtls_ssl_conf_async_record_cb(). */
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
+
 #if defined(MBEDTLS_KEY_EXCHANGE__WITH_CERT__ENABLED)
     const int *sig_hashes;          /*!< allowed signature hashes           */
 #endif
@@ -969,6 +1102,12 @@ struct mbedtls_ssl_config
 
     uint32_t read_timeout;          /*!< timeout for mbedtls_ssl_read (ms)  */
 
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+    size_t read_ahead;              /*!< bytes requested per receive call
+                                         once the handshake is over
+                                         (0: read up to record boundary)    */
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     uint32_t hs_timeout_min;        /*!< initial value of the handshake
                                          retransmission timeout (ms)        */
@@ -1115,9 +1254,16 @@ struct mbedtls_ssl_context
     size_t in_left;             /*!< amount of data read so far       */
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     uint16_t in_epoch;          /*!< DTLS epoch for incoming records  */
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+#if defined(MBEDTLS_SSL_PROTO_DTLS) || defined(MBEDTLS_SSL_READ_AHEAD)
     size_t next_record_offset;  /*!< offset of the next record in datagram
+                                     or read-ahead data
                                      (equal to in_left if none)       */
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
+#endif /* MBEDTLS_SSL_PROTO_DTLS || MBEDTLS_SSL_READ_AHEAD */
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+    int read_ahead_ret;         /*!< error on a record read ahead, to
+                                     return from the next read        */
+#endif
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
     uint64_t in_window_top;     /*!< last validated record seq_num    */
     uint64_t in_window;         /*!< bitmask for replay detection     */
@@ -1161,6 +1307,20 @@ struct mbedtls_ssl_context
 #if defined(MBEDTLS_SSL_CBC_RECORD_SPLITTING)
     signed char split_done;     /*!< current record already splitted? */
 #endif /* MBEDTLS_SSL_CBC_RECORD_SPLITTING */
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    size_t out_cork_len;        /*!< application data accumulated in
+                                     the open record at out_msg       */
+    unsigned char out_cork;     /*!< coalesce application writes?     */
+    unsigned char out_cork_pending; /*!< sealed application records
+                                     waiting in the output buffer     */
+#endif /* MBEDTLS_SSL_WRITE_CORK */
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    mbedtls_ssl_async_record *async_rec; /*!< record slots for asynchronous
+                                     protection (allocated on use)    */
+    size_t async_rec_head;      /*!< oldest record in flight          */
+    size_t async_rec_count;     /*!< records being protected or
+                                     waiting to be sent               */
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
 
     /*
      * PKI layer
@@ -1481,6 +1641,35 @@ void mbedtls_ssl_set_mtu( mbedtls_ssl_context *ssl, uint16_t mtu );
  */
 void mbedtls_ssl_conf_read_timeout( mbedtls_ssl_config *conf, uint32_t timeout );
 
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+/**
+ * \brief          Set the read-ahead budget for TLS connections
+ *                 (Default: 0, read-ahead disabled.)
+ *
+ *                 Once the handshake is over, each receive call asks the
+ *                 underlying transport for up to \p budget bytes (bounded
+ *                 by the room left in the input buffer) instead of stopping
+ *                 at the end of the current record. Records received that
+ *                 way are kept in the input buffer, and mbedtls_ssl_read()
+ *                 decrypts as many complete application data records as
+ *                 fit in the caller's buffer without further I/O.
+ *
+ * \note           The receive callback must be able to return fewer bytes
+ *                 than requested (like \c mbedtls_net_recv() does),
+ *                 otherwise it may block waiting for data the peer never
+ *                 sends.
+ *
+ * \note           Use \c mbedtls_ssl_check_pending() before idling on the
+ *                 underlying transport, as records may already have been
+ *                 read ahead.
+ *
+ * \param conf     SSL configuration context
+ * \param budget   Maximum number of bytes requested per receive call,
+ *                 or 0 to only read up to the end of the current record.
+ */
+void mbedtls_ssl_conf_read_ahead( mbedtls_ssl_config *conf, size_t budget );
+#endif /* MBEDTLS_SSL_READ_AHEAD */
+
 /**
  * \brief          Set the timer callbacks (Mandatory for DTLS.)
  *
@@ -1705,6 +1894,95 @@ void mbedtls_ssl_set_async_operation_data( mbedtls_ssl_context *ssl,
                                  void *ctx );
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+/**
+ * \brief           Configure asynchronous record protection callbacks.
+ *
+ *                  Once the handshake is over, application data written with
+ *                  mbedtls_ssl_write() on a TLS 1.2 connection using an AEAD
+ *                  ciphersuite (GCM, CCM or ChaCha20-Poly1305) is split into
+ *                  records that are handed to \p f_start, up to
+ *                  MBEDTLS_SSL_ASYNC_RECORD_SLOTS at a time. Records are sent
+ *                  in order as they complete, from mbedtls_ssl_write() and
+ *                  mbedtls_ssl_flush(). Other connections and records keep
+ *                  being protected synchronously.
+ *
+ *                  While records are in flight, mbedtls_ssl_write() returns
+ *                  #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS when all slots are
+ *                  busy, and any other function that needs to send a record
+ *                  (mbedtls_ssl_flush(), mbedtls_ssl_close_notify(),
+ *                  mbedtls_ssl_renegotiate(), ...) returns it until the
+ *                  records before it have been sent.
+ *
+ * \param conf      SSL configuration context
+ * \param f_start   Callback to start protecting a record. See the
+ *                  description of ::mbedtls_ssl_async_record_start_t.
+ *                  Use \c NULL to disable asynchronous record protection.
+ * \param f_resume  Callback to check the completion of a record. See the
+ *                  description of ::mbedtls_ssl_async_record_resume_t.
+ *                  This may not be \c NULL unless \p f_start is \c NULL.
+ * \param f_cancel  Callback to cancel the protection of a record. See the
+ *                  description of ::mbedtls_ssl_async_record_cancel_t.
+ *                  If this is \c NULL, mbedtls_ssl_free() and
+ *                  mbedtls_ssl_session_reset() wait for records in flight by
+ *                  calling \p f_resume until they complete.
+ * \param config_data A pointer to configuration data which can be
+ *                  retrieved with
+ *                  mbedtls_ssl_conf_get_async_record_config_data(). The
+ *                  library stores this value without dereferencing it.
+ */
+void mbedtls_ssl_conf_async_record_cb( mbedtls_ssl_config *conf,
+                                       mbedtls_ssl_async_record_start_t *f_start,
+                                       mbedtls_ssl_async_record_resume_t *f_resume,
+                                       mbedtls_ssl_async_record_cancel_t *f_cancel,
+                                       void *config_data );
+
+/**
+ * \brief           Retrieve the configuration data set by
+ *                  mbedtls_ssl_conf_async_record_cb().
+ *
+ * \param conf      SSL configuration context
+ * \return          The configuration data set by
+ *                  mbedtls_ssl_conf_async_record_cb().
+ */
+void *mbedtls_ssl_conf_get_async_record_config_data( const mbedtls_ssl_config *conf );
+
+/**
+ * \brief           Encrypt and authenticate a record handed out by the
+ *                  ::mbedtls_ssl_async_record_start_t callback.
+ *
+ * \note            This function only accesses \p record, and may be called
+ *                  from any thread. Records may be protected concurrently.
+ *
+ * \param record    The record to protect.
+ *
+ * \return          0 if successful, or a cipher error code. The result is
+ *                  also stored in \p record and checked by the library
+ *                  once the resume callback reports completion.
+ */
+int mbedtls_ssl_async_record_protect( mbedtls_ssl_async_record *record );
+
+/**
+ * \brief           Retrieve the operation context attached to a record.
+ *
+ * \param record    The record being protected.
+ *
+ * \return          The value last set with mbedtls_ssl_async_record_set_data()
+ *                  since the record was handed to the start callback, or
+ *                  \c NULL.
+ */
+void *mbedtls_ssl_async_record_get_data( const mbedtls_ssl_async_record *record );
+
+/**
+ * \brief           Attach an operation context to a record.
+ *
+ * \param record    The record being protected.
+ * \param ctx       The new value of the operation context.
+ */
+void mbedtls_ssl_async_record_set_data( mbedtls_ssl_async_record *record,
+                                        void *ctx );
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
+
 /**
  * \brief          Callback type: generate a cookie
  *
@@ -1956,6 +2234,43 @@ void mbedtls_ssl_conf_session_cache( mbedtls_ssl_config *conf,
         int (*f_set_cache)(void *, const mbedtls_ssl_session *) );
 #endif /* MBEDTLS_SSL_SRV_C */
 
+#if defined(MBEDTLS_SSL_POOL_C)
+/**
+ * \brief          Set the pool used for the record buffers, transforms and
+ *                 handshake parameters of every SSL context set up with
+ *                 this configuration. (Default: NULL, use mbedtls_calloc())
+ *
+ * \note           The pool must be set before any context is set up with
+ *                 mbedtls_ssl_setup() and must not be changed or freed
+ *                 while such contexts exist.
+ *
+ * \param conf     SSL configuration
+ * \param pool     pool context (see \c ssl_pool.h), or NULL
+ */
+void mbedtls_ssl_conf_pool( mbedtls_ssl_config *conf,
+                            mbedtls_ssl_pool_context *pool );
+#endif /* MBEDTLS_SSL_POOL_C */
+
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+/**
+ * \brief          Set the pool of pre-generated ECDHE key pairs used by
+ *                 servers with this configuration. (Default: NULL, generate
+ *                 each key pair during the handshake)
+ *
+ *                 Each ECDHE handshake takes a key pair for the negotiated
+ *                 curve from the pool, and only generates one if none is
+ *                 ready.
+ *
+ * \note           The pool is filled by the application, typically from
+ *                 worker threads, with mbedtls_ssl_ecdhe_pool_fill().
+ *
+ * \param conf     SSL configuration
+ * \param pool     pool context (see \c ssl_ecdhe_pool.h), or NULL
+ */
+void mbedtls_ssl_conf_ecdhe_pool( mbedtls_ssl_config *conf,
+                                  mbedtls_ssl_ecdhe_pool_context *pool );
+#endif /* MBEDTLS_SSL_ECDHE_POOL_C */
+
 #if defined(MBEDTLS_SSL_CLI_C)
 /**
  * \brief          Request resumption of session (client-side only)
@@ -1986,6 +2301,11 @@ int mbedtls_ssl_set_session( mbedtls_ssl_context *ssl, const mbedtls_ssl_session
  *                      over the preference of the client unless
  *                      MBEDTLS_SSL_SRV_RESPECT_CLIENT_PREFERENCE is defined!
  *
+ * \note                With MBEDTLS_SSL_CIPHERSUITE_INDEX, server
+ *                      configurations index the list here, so its contents
+ *                      must not change afterwards. If the index can't be
+ *                      allocated, the server searches the list itself.
+ *
  * \param conf          SSL configuration
  * \param ciphersuites  0-terminated list of allowed ciphersuites
  */
@@ -2044,6 +2364,28 @@ void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config *conf,
                                mbedtls_x509_crt *ca_chain,
                                mbedtls_x509_crl *ca_crl );
 
+#if defined(MBEDTLS_X509_CRT_STORE)
+/**
+ * \brief          Set the data required to verify peer certificate, using
+ *                 an indexed trust store for chain building.
+ *
+ * \note           This sets the trusted CA chain to the chain indexed by
+ *                 \p ca_store, which is still used for the list of
+ *                 acceptable CAs sent in a CertificateRequest.
+ *                 Certificates set with mbedtls_ssl_set_hs_ca_chain() are
+ *                 verified without the store.
+ *
+ * \param conf     SSL configuration
+ * \param ca_store trust store set up with mbedtls_x509_crt_store_setup(),
+ *                 which must stay valid and unmodified while the
+ *                 configuration is in use
+ * \param ca_crl   trusted CA CRLs
+ */
+void mbedtls_ssl_conf_ca_store( mbedtls_ssl_config *conf,
+                                mbedtls_x509_crt_store *ca_store,
+                                mbedtls_x509_crl *ca_crl );
+#endif /* MBEDTLS_X509_CRT_STORE */
+
 /**
  * \brief          Set own certificate chain and private key
  *
@@ -2066,6 +2408,10 @@ void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config *conf,
  *                 whether it matches those preferences - the server can then
  *                 decide what it wants to do with it.
  *
+ * \note           With MBEDTLS_SSL_CERT_MSG_CACHE, the Certificate message
+ *                 is serialized by this function, so the chain must be
+ *                 complete and must not be modified afterwards.
+ *
  * \param conf     SSL configuration
  * \param own_cert own public certificate chain
  * \param pk_key   own private key
@@ -2830,7 +3176,9 @@ void mbedtls_ssl_conf_renegotiation_period( mbedtls_ssl_config *conf,
  *                 also signal pending data, but the converse does
  *                 not hold. For example, in DTLS there might be
  *                 further records waiting to be processed from
- *                 the current underlying transport's datagram.
+ *                 the current underlying transport's datagram,
+ *                 and in TLS with read-ahead enabled, further
+ *                 records may already be in the input buffer.
  *
  * \note           If this function returns 1 (data pending), this
  *                 does not imply that a subsequent call to
@@ -3152,6 +3500,12 @@ int mbedtls_ssl_renegotiate( mbedtls_ssl_context *ssl );
  *                 on it before re-using it for a new connection; the current
  *                 connection must be closed.
  *
+ * \note           With read-ahead enabled (see mbedtls_ssl_conf_read_ahead()),
+ *                 the contents of several application data records already
+ *                 received may be returned by a single call. If one of them
+ *                 turns out to be invalid, the corresponding error is
+ *                 returned and the connection must be closed as above.
+ *
  * \note           When this function returns #MBEDTLS_ERR_SSL_CLIENT_RECONNECT
  *                 (which can only happen server-side), it means that a client
  *                 is initiating a new connection using the same source port.
@@ -3245,6 +3599,58 @@ int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len )
  */
 int mbedtls_ssl_write( mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len );
 
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+/**
+ * \brief          Enable / Disable coalescing of application writes
+ *                 (TLS only, no effect on DTLS).
+ *                 (Default: MBEDTLS_SSL_WRITE_CORK_DISABLED)
+ *
+ *                 While enabled, mbedtls_ssl_write() appends data to an open
+ *                 record instead of protecting and sending one record per
+ *                 call. A record is only sealed when it reaches the maximum
+ *                 fragment length, and sealed records are packed in the
+ *                 output buffer and only handed to the send callback when
+ *                 that buffer is full or when mbedtls_ssl_flush() is called.
+ *
+ * \note           Data written while the cork is enabled may stay in
+ *                 memory indefinitely: call mbedtls_ssl_flush() once a
+ *                 batch of writes is complete. Disabling the cork does not
+ *                 send anything by itself.
+ *
+ * \note           Writes of 0 bytes are a no-op while the cork is enabled.
+ *
+ * \note           Coalescing is not applied while 1/n-1 record splitting
+ *                 (see mbedtls_ssl_conf_cbc_record_splitting()) is active,
+ *                 nor with compression.
+ *
+ * \param ssl      SSL context
+ * \param cork     MBEDTLS_SSL_WRITE_CORK_ENABLED or
+ *                 MBEDTLS_SSL_WRITE_CORK_DISABLED
+ */
+void mbedtls_ssl_set_write_cork( mbedtls_ssl_context *ssl, int cork );
+#endif /* MBEDTLS_SSL_WRITE_CORK */
+
+#if defined(MBEDTLS_SSL_WRITE_CORK) || defined(MBEDTLS_SSL_ASYNC_RECORD)
+/**
+ * \brief          Seal the open application record, if any, and send all
+ *                 buffered records to the peer, including records being
+ *                 protected asynchronously.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         0 if all buffered data has been handed to the send
+ *                 callback,
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE if the underlying transport
+ *                 is not ready - in this case you must call this function
+ *                 again when it is,
+ *                 #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if a record is still
+ *                 being protected (see mbedtls_ssl_conf_async_record_cb())
+ *                 - in this case you must call this function again later,
+ *                 or another SSL error code.
+ */
+int mbedtls_ssl_flush( mbedtls_ssl_context *ssl );
+#endif /* MBEDTLS_SSL_WRITE_CORK || MBEDTLS_SSL_ASYNC_RECORD */
+
 /**
  * \brief           Send an alert message
  *
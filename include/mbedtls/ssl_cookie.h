@@ -26,6 +26,14 @@
 
 #include "ssl.h"
 
+#if defined(MBEDTLS_SHA256_C)
+#include "sha256.h"
+#elif defined(MBEDTLS_SHA512_C)
+#include "sha512.h"
+#elif defined(MBEDTLS_SHA1_C)
+#include "sha1.h"
+#endif
+
 #if defined(MBEDTLS_THREADING_C)
 #include "threading.h"
 #endif
@@ -47,12 +55,33 @@
 extern "C" {
 #endif
 
+/**
+ * \brief          HMAC key, as the hash states after absorbing the inner
+ *                 and outer pads. These states are copied for each cookie,
+ *                 so that they are only ever read once set up.
+ */
+typedef struct mbedtls_ssl_cookie_key
+{
+#if defined(MBEDTLS_SHA256_C)
+    mbedtls_sha256_context  inner;      /*!< state after the inner pad      */
+    mbedtls_sha256_context  outer;      /*!< state after the outer pad      */
+#elif defined(MBEDTLS_SHA512_C)
+    mbedtls_sha512_context  inner;      /*!< state after the inner pad      */
+    mbedtls_sha512_context  outer;      /*!< state after the outer pad      */
+#elif defined(MBEDTLS_SHA1_C)
+    mbedtls_sha1_context    inner;      /*!< state after the inner pad      */
+    mbedtls_sha1_context    outer;      /*!< state after the outer pad      */
+#endif
+} mbedtls_ssl_cookie_key;
+
 /**
  * \brief          Context for the default cookie functions.
  */
 typedef struct mbedtls_ssl_cookie_ctx
 {
-    mbedtls_md_context_t    hmac_ctx;   /*!< context for the HMAC portion   */
+    mbedtls_ssl_cookie_key  keys[3];    /*!< keys, used in turn             */
+    unsigned long   generation; /*!< number of key rotations; the current
+                                     key is keys[generation % 3]    */
 #if !defined(MBEDTLS_HAVE_TIME)
     unsigned long   serial;     /*!< serial number for expiration   */
 #endif
@@ -76,6 +105,30 @@ int mbedtls_ssl_cookie_setup( mbedtls_ssl_cookie_ctx *ctx,
                       int (*f_rng)(void *, unsigned char *, size_t),
                       void *p_rng );
 
+/**
+ * \brief          Replace the key used to generate cookies with a new one.
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Cookies generated with the previous key are still
+ *                 accepted, cookies generated with older ones are not.
+ *                 Generating and checking cookies never waits for a
+ *                 rotation: the new key is written to a slot that is not
+ *                 in use and then published at once.
+ *
+ * \note           Rotations must be further apart than the time it takes to
+ *                 generate or check a cookie, which any sensible rotation
+ *                 interval is.
+ *
+ * \param ctx      Cookie context, set up with mbedtls_ssl_cookie_setup()
+ * \param f_rng    RNG function
+ * \param p_rng    RNG parameter
+ *
+ * \return         0 if successful, or an RNG or mutex error code
+ */
+int mbedtls_ssl_cookie_rotate( mbedtls_ssl_cookie_ctx *ctx,
+                               int (*f_rng)(void *, unsigned char *, size_t),
+                               void *p_rng );
+
 /**
  * \brief          Set expiration delay for cookies
  *                 (Default MBEDTLS_SSL_COOKIE_TIMEOUT)
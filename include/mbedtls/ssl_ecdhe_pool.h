@@ -0,0 +1,190 @@
+/**
+ * \file ssl_ecdhe_pool.h
+ *
+ * \brief Pool of pre-generated ECDHE key pairs for SSL servers
+ */
+/*
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+#ifndef MBEDTLS_SSL_ECDHE_POOL_H
+#define MBEDTLS_SSL_ECDHE_POOL_H
+
+#include "ssl.h"
+#include "ecp.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES)
+#define MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES   4   /*!< Maximum curves in a pool */
+#endif
+
+/* \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_ecdhe_pool_key mbedtls_ssl_ecdhe_pool_key;
+
+/**
+ * \brief   Key pairs ready for one curve
+ */
+typedef struct mbedtls_ssl_ecdhe_pool_curve
+{
+    mbedtls_ecp_group_id grp_id;        /*!< curve                          */
+    mbedtls_ssl_ecdhe_pool_key *keys;   /*!< key pairs ready for use        */
+    size_t ready;                       /*!< number of key pairs in keys    */
+    size_t pending;                     /*!< key pairs being generated      */
+} mbedtls_ssl_ecdhe_pool_curve;
+
+/**
+ * \brief   Usage counters
+ */
+typedef struct mbedtls_ssl_ecdhe_pool_stats
+{
+    size_t hits;                /*!< handshakes served a pre-generated key  */
+    size_t misses;              /*!< handshakes that generated their key    */
+    size_t ready;               /*!< key pairs currently ready, all curves  */
+} mbedtls_ssl_ecdhe_pool_stats;
+
+/**
+ * \brief   Pool context
+ */
+struct mbedtls_ssl_ecdhe_pool_context
+{
+    mbedtls_ssl_ecdhe_pool_curve curves[MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES];
+                                /*!< curves served by the pool              */
+    size_t curve_count;         /*!< number of entries in curves            */
+    size_t keys_per_curve;      /*!< key pairs to keep ready per curve      */
+    size_t hits;                /*!< see mbedtls_ssl_ecdhe_pool_stats       */
+    size_t misses;              /*!< see mbedtls_ssl_ecdhe_pool_stats       */
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t mutex;    /*!< mutex                          */
+#endif
+};
+
+/**
+ * \brief          Initialize a pool context
+ *
+ * \param pool     pool context
+ */
+void mbedtls_ssl_ecdhe_pool_init( mbedtls_ssl_ecdhe_pool_context *pool );
+
+/**
+ * \brief          Set the curves served by the pool and the number of key
+ *                 pairs to keep ready for each of them.
+ *
+ * \note           This must be called before the pool is attached to a
+ *                 configuration or filled.
+ *
+ * \param pool     pool context
+ * \param curves   curves, terminated by MBEDTLS_ECP_DP_NONE, for example
+ *                 the list given to mbedtls_ssl_conf_curves()
+ * \param keys     number of key pairs to keep ready per curve
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_SSL_BAD_INPUT_DATA if
+ *                 there are more than MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES
+ *                 curves or one of them is not supported
+ */
+int mbedtls_ssl_ecdhe_pool_setup( mbedtls_ssl_ecdhe_pool_context *pool,
+                                  const mbedtls_ecp_group_id *curves,
+                                  size_t keys );
+
+/**
+ * \brief          Generate key pairs for the curves that are short of their
+ *                 target, starting with the emptiest one.
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This is meant to be called from worker threads while the
+ *                 server is idle: key generation takes place without
+ *                 holding the pool mutex, so several threads can fill the
+ *                 same pool at once while handshakes take keys from it.
+ *
+ * \note           Each call loads its own copy of the curves and of their
+ *                 precomputed tables, so asking for several keys per call
+ *                 is more efficient than calling this once per key.
+ *
+ * \param pool     pool context
+ * \param f_rng    RNG function, which must be thread-safe if this is
+ *                 called from several threads
+ * \param p_rng    RNG parameter
+ * \param max      maximum number of key pairs to generate, or 0 to go on
+ *                 until the pool is full
+ *
+ * \return         the number of key pairs generated, 0 if the pool is full,
+ *                 or a negative error code
+ */
+int mbedtls_ssl_ecdhe_pool_fill( mbedtls_ssl_ecdhe_pool_context *pool,
+                                 int (*f_rng)(void *, unsigned char *, size_t),
+                                 void *p_rng,
+                                 size_t max );
+
+/**
+ * \brief          Take a key pair from the pool. Each key pair is handed
+ *                 out once and then removed from the pool.
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \note           This is called by the SSL server for configurations with
+ *                 a pool set with mbedtls_ssl_conf_ecdhe_pool().
+ *
+ * \param pool     pool context
+ * \param grp_id   curve of the key pair
+ * \param d        private key, replaced with the one taken
+ * \param Q        public key, replaced with the one taken
+ *
+ * \return         0 if a key pair was taken, 1 if none is ready for the curve
+ */
+int mbedtls_ssl_ecdhe_pool_take( mbedtls_ssl_ecdhe_pool_context *pool,
+                                 mbedtls_ecp_group_id grp_id,
+                                 mbedtls_mpi *d, mbedtls_ecp_point *Q );
+
+/**
+ * \brief          Get the usage counters of the pool
+ *
+ * \param pool     pool context
+ * \param stats    structure to fill with the current counters
+ */
+void mbedtls_ssl_ecdhe_pool_get_stats( mbedtls_ssl_ecdhe_pool_context *pool,
+                                       mbedtls_ssl_ecdhe_pool_stats *stats );
+
+/**
+ * \brief          Free referenced items in a pool context and clear memory
+ *
+ * \warning        Threads filling the pool must have returned, and no
+ *                 handshake may be using it, before calling this function.
+ *
+ * \param pool     pool context
+ */
+void mbedtls_ssl_ecdhe_pool_free( mbedtls_ssl_ecdhe_pool_context *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_ecdhe_pool.h */
@@ -376,6 +376,11 @@ struct mbedtls_ssl_handshake_params
     mbedtls_sha512_context fin_sha512;
 #endif
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    unsigned char *transcript;          /*!<  messages kept until the
+                                              digests to use are known */
+    size_t transcript_len;              /*!<  length of transcript    */
+    size_t transcript_size;             /*!<  size of transcript      */
+    int checksums;                      /*!<  running digests         */
 
     void (*update_checksum)(mbedtls_ssl_context *, const unsigned char *, size_t);
     void (*calc_verify)(mbedtls_ssl_context *, unsigned char *);
@@ -450,6 +455,11 @@ struct mbedtls_ssl_transform
     mbedtls_cipher_context_t cipher_ctx_enc;    /*!<  encryption context      */
     mbedtls_cipher_context_t cipher_ctx_dec;    /*!<  decryption context      */
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    unsigned char key_enc[32];          /*!<  encryption key, for the
+                                              contexts of async records */
+#endif
+
     /*
      * Session specific compression layer
      */
@@ -459,6 +469,30 @@ struct mbedtls_ssl_transform
 #endif
 };
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+/*
+ * Application data record being protected outside of the SSL context
+ */
+struct mbedtls_ssl_async_record
+{
+    mbedtls_cipher_context_t cipher;    /*!<  AEAD context of this slot   */
+    const mbedtls_cipher_info_t *cipher_info; /*!< cipher it is set up for */
+    unsigned char key[32];              /*!<  key it is set up with       */
+
+    unsigned char iv[12];               /*!<  nonce                       */
+    unsigned char add_data[13];         /*!<  additional data             */
+    unsigned char *buf;                 /*!<  header, explicit IV,
+                                              payload, then tag         */
+    size_t hdr_len;                     /*!<  header and explicit IV len  */
+    size_t len;                         /*!<  payload length              */
+    size_t taglen;                      /*!<  tag length                  */
+
+    int state;                          /*!<  idle, running or done       */
+    int ret;                            /*!<  result of the protection    */
+    void *user_data;                    /*!<  operation context           */
+};
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 /*
  * List of certificate + private key pairs
@@ -467,10 +501,73 @@ struct mbedtls_ssl_key_cert
 {
     mbedtls_x509_crt *cert;                 /*!< cert                       */
     mbedtls_pk_context *key;                /*!< private key                */
+#if defined(MBEDTLS_SSL_CERT_MSG_CACHE)
+    unsigned char *cert_msg;                /*!< Certificate message body,
+                                                 or NULL if not cached      */
+    size_t cert_msg_len;                    /*!< length of cert_msg         */
+#endif
     mbedtls_ssl_key_cert *next;             /*!< next key/cert pair         */
 };
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+/*
+ * Longest ciphersuite list that gets an index
+ */
+#define MBEDTLS_SSL_CIPHERSUITE_INDEX_MAX   512
+
+/*
+ * Capabilities of the ciphersuites of an index, one bitset each
+ */
+#define MBEDTLS_SSL_CS_MINOR_VERSION_0  0   /* usable with this version   */
+#define MBEDTLS_SSL_CS_MINOR_VERSION_1  1
+#define MBEDTLS_SSL_CS_MINOR_VERSION_2  2
+#define MBEDTLS_SSL_CS_MINOR_VERSION_3  3
+#define MBEDTLS_SSL_CS_NODTLS           4   /* not usable with DTLS       */
+#define MBEDTLS_SSL_CS_ARC4             5   /* uses RC4                   */
+#define MBEDTLS_SSL_CS_ECJPAKE          6   /* uses EC J-PAKE             */
+#define MBEDTLS_SSL_CS_EC               7   /* needs a common curve       */
+#define MBEDTLS_SSL_CS_PSK              8   /* needs a pre-shared key     */
+#define MBEDTLS_SSL_CS_CAPS             9
+
+#define MBEDTLS_SSL_CIPHERSUITE_HASH( id )  \
+    ( ( (uint32_t) ( id ) * 0x9E3779B1u ) >> 16 )
+
+/*
+ * Index of a ciphersuite list, built when the list is configured
+ */
+struct mbedtls_ssl_ciphersuite_index
+{
+    const int *list;                        /*!< list indexed               */
+    size_t count;                           /*!< known ciphersuites in list */
+    size_t words;                           /*!< 32-bit words per bitset    */
+    const mbedtls_ssl_ciphersuite_t **info; /*!< definitions, in list order */
+    uint32_t *caps;                         /*!< capability bitsets         */
+    uint16_t *slots;                        /*!< ID hash table, holding
+                                                 positions in info plus 1   */
+    size_t slot_mask;                       /*!< hash table size minus 1    */
+};
+
+/*
+ * Position of a ciphersuite in an index, or -1 if it isn't in the list
+ */
+static inline int mbedtls_ssl_ciphersuite_index_find(
+                        const mbedtls_ssl_ciphersuite_index *index, int id )
+{
+    size_t i = MBEDTLS_SSL_CIPHERSUITE_HASH( id ) & index->slot_mask;
+
+    while( index->slots[i] != 0 )
+    {
+        if( index->info[index->slots[i] - 1]->id == id )
+            return( index->slots[i] - 1 );
+
+        i = ( i + 1 ) & index->slot_mask;
+    }
+
+    return( -1 );
+}
+#endif /* MBEDTLS_SSL_CIPHERSUITE_INDEX */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 /*
  * List of handshake messages kept around for resending
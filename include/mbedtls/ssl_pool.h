@@ -0,0 +1,174 @@
+/**
+ * \file ssl_pool.h
+ *
+ * \brief SSL/TLS pool for record buffers and per-connection structures
+ */
+/*
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+#ifndef MBEDTLS_SSL_POOL_H
+#define MBEDTLS_SSL_POOL_H
+
+#include "ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_POOL_DEFAULT_SLAB_OBJECTS)
+#define MBEDTLS_SSL_POOL_DEFAULT_SLAB_OBJECTS   4   /*!< Objects carved from each slab */
+#endif
+
+/* \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Classes of objects managed by the pool.
+ *          Each class has its own object size and free list.
+ */
+typedef enum
+{
+    MBEDTLS_SSL_POOL_IN_BUF = 0,    /*!< incoming record buffer         */
+    MBEDTLS_SSL_POOL_OUT_BUF,       /*!< outgoing record buffer         */
+    MBEDTLS_SSL_POOL_TRANSFORM,     /*!< mbedtls_ssl_transform          */
+    MBEDTLS_SSL_POOL_HANDSHAKE,     /*!< mbedtls_ssl_handshake_params   */
+    MBEDTLS_SSL_POOL_CLASSES        /*!< number of classes (not a class) */
+} mbedtls_ssl_pool_class;
+
+typedef struct mbedtls_ssl_pool_slab mbedtls_ssl_pool_slab;
+
+/**
+ * \brief   Usage counters for one object class
+ */
+typedef struct mbedtls_ssl_pool_stats
+{
+    size_t hits;                /*!< allocations served from the free list  */
+    size_t misses;              /*!< allocations that required a new slab   */
+    size_t in_use;              /*!< objects currently handed out           */
+    size_t cached;              /*!< objects currently on the free list     */
+} mbedtls_ssl_pool_stats;
+
+/**
+ * \brief   Pool context
+ */
+struct mbedtls_ssl_pool_context
+{
+    mbedtls_ssl_pool_slab *slabs[MBEDTLS_SSL_POOL_CLASSES]; /*!< slabs owned
+                                                         by the pool      */
+    void *free_list[MBEDTLS_SSL_POOL_CLASSES]; /*!< released objects     */
+    mbedtls_ssl_pool_stats stats[MBEDTLS_SSL_POOL_CLASSES]; /*!< counters */
+    size_t slab_objects;        /*!< objects allocated per slab             */
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t mutex;    /*!< mutex                          */
+#endif
+};
+
+/**
+ * \brief          Initialize a pool context
+ *
+ * \param pool     pool context
+ */
+void mbedtls_ssl_pool_init( mbedtls_ssl_pool_context *pool );
+
+/**
+ * \brief          Set the number of objects allocated together in one slab
+ *                 whenever a class runs out of free objects.
+ *                 (Default: MBEDTLS_SSL_POOL_DEFAULT_SLAB_OBJECTS)
+ *
+ * \param pool     pool context
+ * \param objects  number of objects per slab (0 is treated as 1)
+ */
+void mbedtls_ssl_pool_set_slab_objects( mbedtls_ssl_pool_context *pool,
+                                        size_t objects );
+
+/**
+ * \brief          Pre-allocate room for \p connections simultaneous
+ *                 connections, so that connection setup does not hit the
+ *                 heap until that number is exceeded.
+ *
+ * \param pool     pool context
+ * \param connections  number of connections to reserve objects for
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_SSL_ALLOC_FAILED
+ */
+int mbedtls_ssl_pool_reserve( mbedtls_ssl_pool_context *pool,
+                              size_t connections );
+
+/**
+ * \brief          Take a zero-initialized object of the given class from the
+ *                 pool, allocating a new slab if needed.
+ *
+ * \note           This is called by the SSL module for contexts whose
+ *                 configuration has a pool set with mbedtls_ssl_conf_pool().
+ *
+ * \param pool     pool context
+ * \param cls      object class
+ *
+ * \return         a pointer to the object, or NULL on allocation failure
+ */
+void *mbedtls_ssl_pool_alloc( mbedtls_ssl_pool_context *pool,
+                              mbedtls_ssl_pool_class cls );
+
+/**
+ * \brief          Wipe an object and return it to the pool.
+ *
+ * \param pool     pool context
+ * \param cls      object class, must match the class it was allocated with
+ * \param obj      object to release (may be NULL)
+ */
+void mbedtls_ssl_pool_release( mbedtls_ssl_pool_context *pool,
+                               mbedtls_ssl_pool_class cls, void *obj );
+
+/**
+ * \brief          Get the usage counters of one object class
+ *
+ * \param pool     pool context
+ * \param cls      object class
+ * \param stats    structure to fill with the current counters
+ */
+void mbedtls_ssl_pool_get_stats( mbedtls_ssl_pool_context *pool,
+                                 mbedtls_ssl_pool_class cls,
+                                 mbedtls_ssl_pool_stats *stats );
+
+/**
+ * \brief          Free referenced items in a pool context and clear memory
+ *
+ * \warning        All SSL contexts using this pool must have been freed
+ *                 with mbedtls_ssl_free() before calling this function.
+ *
+ * \param pool     pool context
+ */
+void mbedtls_ssl_pool_free( mbedtls_ssl_pool_context *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_pool.h */
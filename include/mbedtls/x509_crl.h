@@ -92,6 +92,11 @@ typedef struct mbedtls_x509_crl
     mbedtls_pk_type_t sig_pk;           /**< Internal representation of the Public Key algorithm of the signature algorithm, e.g. MBEDTLS_PK_RSA */
     void *sig_opts;             /**< Signature options to be passed to mbedtls_pk_verify_ext(), e.g. for RSASSA-PSS */
 
+    mbedtls_x509_crl_entry *entry_block;    /**< Internal. Storage for the entries following \c entry. */
+    size_t entry_block_len;                 /**< Internal. Number of entries in \c entry_block. */
+    const mbedtls_x509_crl_entry **entry_index; /**< Internal. Entries sorted by serial number, used by mbedtls_x509_crt_is_revoked(). */
+    size_t entry_count;                     /**< Internal. Number of entries in \c entry_index. */
+
     struct mbedtls_x509_crl *next;
 }
 mbedtls_x509_crl;
@@ -52,6 +52,13 @@ extern "C" {
  */
 typedef struct mbedtls_x509_crt
 {
+    int own_buffer;                     /**< Indicates if \c raw is owned
+                                         *   by the structure or not.        */
+    int lazy;                           /**< Indicates if \c issuer, \c subject,
+                                         *   \c subject_alt_names and
+                                         *   \c ext_key_usage are still to be
+                                         *   decoded, see
+                                         *   mbedtls_x509_crt_decode().      */
     mbedtls_x509_buf raw;               /**< The raw certificate data (DER). */
     mbedtls_x509_buf tbs;               /**< The raw certificate body (DER). The part that is To Be Signed. */
 
@@ -200,6 +207,46 @@ typedef void mbedtls_x509_crt_restart_ctx;
 
 #endif /* MBEDTLS_ECDSA_C && MBEDTLS_ECP_RESTARTABLE */
 
+#if defined(MBEDTLS_X509_CRT_STORE)
+
+/**
+ * \brief       Index entry of a trust store
+ */
+typedef struct mbedtls_x509_crt_store_entry
+{
+    uint32_t hash;              /**< Hash of the subject name or of the subject key identifier. */
+    size_t order;               /**< Position of the certificate in the indexed list. */
+    mbedtls_x509_crt *crt;      /**< The indexed certificate. */
+    mbedtls_x509_buf key_id;    /**< The subject key identifier, if any (p is NULL otherwise). */
+} mbedtls_x509_crt_store_entry;
+
+/**
+ * \brief       Trusted certificates indexed for chain building
+ *
+ *              Parents are looked up by subject name hash and by subject
+ *              key identifier instead of walking the whole list of trusted
+ *              certificates for each link of the chain.
+ */
+typedef struct mbedtls_x509_crt_store
+{
+    mbedtls_x509_crt *ca_chain;                 /**< The indexed certificates (not owned). */
+    mbedtls_x509_crt_store_entry *by_subject;   /**< All certificates, sorted by subject name hash. */
+    size_t subject_count;                       /**< Number of entries in by_subject. */
+    mbedtls_x509_crt_store_entry *by_key_id;    /**< Certificates with a subject key identifier, sorted by its hash. */
+    size_t key_id_count;                        /**< Number of entries in by_key_id. */
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+    uint32_t generation;                        /**< Incremented each time the store is set up. */
+    struct mbedtls_x509_crt_cache_context *cache; /**< Cache of chains verified with this store, or NULL. */
+#endif
+} mbedtls_x509_crt_store;
+
+#else /* MBEDTLS_X509_CRT_STORE */
+
+/* Now we can declare functions that take a pointer to that */
+typedef void mbedtls_x509_crt_store;
+
+#endif /* MBEDTLS_X509_CRT_STORE */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 /**
  * Default security profile. Should provide a good balance between security
@@ -231,6 +278,51 @@ extern const mbedtls_x509_crt_profile mbedtls_x509_crt_profile_suiteb;
 int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *buf,
                         size_t buflen );
 
+/**
+ * \brief          Parse a single DER formatted certificate and add it
+ *                 to the chained list, without copying the DER data
+ *                 or decoding the names and name lists.
+ *
+ *                 The fields \c raw, \c tbs, \c issuer_raw,
+ *                 \c subject_raw and \c v3_ext point into \p buf, and
+ *                 \c issuer, \c subject, \c subject_alt_names and
+ *                 \c ext_key_usage are left empty until
+ *                 mbedtls_x509_crt_decode() is called. Their encoding is
+ *                 still checked here, and chain verification, name
+ *                 matching and usage checks work from the raw data, so the
+ *                 certificate can be used without ever decoding them.
+ *
+ * \warning        The buffer must outlive the chain and must not be
+ *                 modified while the certificate is in use. It is not
+ *                 freed or zeroized by mbedtls_x509_crt_free().
+ *
+ * \param chain    points to the start of the chain
+ * \param buf      buffer holding the certificate DER data
+ * \param buflen   size of the buffer
+ *
+ * \return         0 if successful, or a specific X509 or PEM error code
+ */
+int mbedtls_x509_crt_parse_der_nocopy( mbedtls_x509_crt *chain,
+                                       const unsigned char *buf,
+                                       size_t buflen );
+
+/**
+ * \brief          Decode the issuer, subject, subject_alt_names and
+ *                 ext_key_usage fields of the certificates in a chain
+ *                 that were parsed with mbedtls_x509_crt_parse_der_nocopy().
+ *                 Certificates that are already decoded are left as is.
+ *
+ * \note           Call this before reading these fields directly. It is not
+ *                 needed for use by the library, and modifies the
+ *                 certificates, so it must not run while they are shared
+ *                 with other threads.
+ *
+ * \param chain    points to the start of the chain
+ *
+ * \return         0 if successful, or a specific X509 error code
+ */
+int mbedtls_x509_crt_decode( mbedtls_x509_crt *chain );
+
 /**
  * \brief          Parse one or more certificates and add them
  *                 to the chained list. Parses permissively. If some
@@ -278,6 +370,34 @@ int mbedtls_x509_crt_parse_file( mbedtls_x509_crt *chain, const char *path );
  *                 if partly successful or a specific X509 or PEM error code
  */
 int mbedtls_x509_crt_parse_path( mbedtls_x509_crt *chain, const char *path );
+
+#if defined(MBEDTLS_X509_CRT_PARSE_BULK)
+/**
+ * \brief          Load all certificate files from a path and add them to
+ *                 the chained list, like mbedtls_x509_crt_parse_path(), but
+ *                 mapping the files into memory and parsing them on
+ *                 several threads.
+ *
+ *                 The resulting chain, in directory order, and the return
+ *                 value are the same as with mbedtls_x509_crt_parse_path().
+ *                 To look up parents quickly in a large chain, pass it to
+ *                 mbedtls_x509_crt_store_setup() afterwards.
+ *
+ * \note           Files are the unit of work: a single file holding many
+ *                 PEM certificates is parsed on one thread.
+ *
+ * \param chain    points to the start of the chain
+ * \param path     directory / folder to read the certificate files from
+ * \param threads  number of threads to parse on, including the calling
+ *                 one. Values below 2, or builds without
+ *                 MBEDTLS_THREADING_PTHREAD, parse in the calling thread.
+ *
+ * \return         0 if all certificates parsed successfully, a positive number
+ *                 if partly successful or a specific X509 or PEM error code
+ */
+int mbedtls_x509_crt_parse_path_bulk( mbedtls_x509_crt *chain,
+                                      const char *path, int threads );
+#endif /* MBEDTLS_X509_CRT_PARSE_BULK */
 #endif /* MBEDTLS_FS_IO */
 
 /**
@@ -441,6 +561,121 @@ int mbedtls_x509_crt_verify_restartable( mbedtls_x509_crt *crt,
                      void *p_vrfy,
                      mbedtls_x509_crt_restart_ctx *rs_ctx );
 
+#if defined(MBEDTLS_X509_CRT_STORE)
+/**
+ * \brief          Initialize a trust store
+ *
+ * \param store    Trust store to initialize
+ */
+void mbedtls_x509_crt_store_init( mbedtls_x509_crt_store *store );
+
+/**
+ * \brief          Index a list of trusted certificates
+ *
+ * \note           The store only references the certificates: \p ca_chain
+ *                 must remain valid and unmodified while the store is in
+ *                 use. If more certificates are parsed into \p ca_chain,
+ *                 call this function again to index them.
+ *
+ * \param store    Trust store to set up (any previous index is replaced)
+ * \param ca_chain The list of trusted CAs, as for the \c trust_ca
+ *                 parameter of \c mbedtls_x509_crt_verify()
+ *
+ * \return         0 if successful, or MBEDTLS_ERR_X509_ALLOC_FAILED
+ */
+int mbedtls_x509_crt_store_setup( mbedtls_x509_crt_store *store,
+                                  mbedtls_x509_crt *ca_chain );
+
+/**
+ * \brief          Free the index of a trust store (the indexed
+ *                 certificates are left untouched)
+ *
+ * \param store    Trust store to free
+ */
+void mbedtls_x509_crt_store_free( mbedtls_x509_crt_store *store );
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+/**
+ * \brief          Attach a cache of verified chains to a trust store
+ *
+ * \note           Verifications with this store then look up the chain
+ *                 presented by the peer, the store generation, the CRLs
+ *                 and the profile in the cache, and skip chain building
+ *                 and signature checks when the same inputs were already
+ *                 verified successfully. Only fully valid chains are
+ *                 cached, until the cache timeout or the first expiry of
+ *                 a certificate or CRL involved, whichever comes first.
+ *                 Name checks and the verification callback still run on
+ *                 every verification.
+ *
+ * \note           A cache can be shared by several stores. Setting up or
+ *                 freeing a store removes its entries from the cache.
+ *
+ * \param store    Trust store
+ * \param cache    Verification cache, initialized with
+ *                 mbedtls_x509_crt_cache_init(), or NULL to detach
+ */
+void mbedtls_x509_crt_store_set_cache( mbedtls_x509_crt_store *store,
+                                       struct mbedtls_x509_crt_cache_context *cache );
+#endif /* MBEDTLS_X509_CRT_CACHE_C */
+
+/**
+ * \brief          Verify the certificate signature according to profile,
+ *                 looking up trusted CAs in a trust store
+ *
+ * \note           Same as \c mbedtls_x509_crt_verify_with_profile() with
+ *                 the certificates indexed in \p store as \c trust_ca,
+ *                 except that trusted CAs whose subject key identifier
+ *                 matches the authority key identifier of the child are
+ *                 tried first when looking for a parent.
+ *
+ * \param crt      a certificate (chain) to be verified
+ * \param store    the trusted CAs
+ * \param ca_crl   the list of CRLs for trusted CAs
+ * \param profile  security profile for verification
+ * \param cn       expected Common Name (can be set to
+ *                 NULL if the CN must not be verified)
+ * \param flags    result of the verification
+ * \param f_vrfy   verification function
+ * \param p_vrfy   verification parameter
+ *
+ * \return         See \c mbedtls_x509_crt_verify_with_profile().
+ */
+int mbedtls_x509_crt_verify_with_store( mbedtls_x509_crt *crt,
+                     const mbedtls_x509_crt_store *store,
+                     mbedtls_x509_crl *ca_crl,
+                     const mbedtls_x509_crt_profile *profile,
+                     const char *cn, uint32_t *flags,
+                     int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                     void *p_vrfy );
+
+/**
+ * \brief          Restartable version of
+ *                 \c mbedtls_x509_crt_verify_with_store()
+ *
+ * \param crt      a certificate (chain) to be verified
+ * \param store    the trusted CAs
+ * \param ca_crl   the list of CRLs for trusted CAs
+ * \param profile  security profile for verification
+ * \param cn       expected Common Name (can be set to
+ *                 NULL if the CN must not be verified)
+ * \param flags    result of the verification
+ * \param f_vrfy   verification function
+ * \param p_vrfy   verification parameter
+ * \param rs_ctx   restart context (NULL to disable restart)
+ *
+ * \return         See \c mbedtls_x509_crt_verify_restartable().
+ */
+int mbedtls_x509_crt_verify_with_store_restartable( mbedtls_x509_crt *crt,
+                     const mbedtls_x509_crt_store *store,
+                     mbedtls_x509_crl *ca_crl,
+                     const mbedtls_x509_crt_profile *profile,
+                     const char *cn, uint32_t *flags,
+                     int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                     void *p_vrfy,
+                     mbedtls_x509_crt_restart_ctx *rs_ctx );
+#endif /* MBEDTLS_X509_CRT_STORE */
+
 #if defined(MBEDTLS_X509_CHECK_KEY_USAGE)
 /**
  * \brief          Check usage of certificate against keyUsage extension.
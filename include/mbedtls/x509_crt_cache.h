@@ -0,0 +1,187 @@
+/**
+ * \file x509_crt_cache.h
+ *
+ * \brief Cache of verified certificate chains
+ */
+/*
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+#ifndef MBEDTLS_X509_CRT_CACHE_H
+#define MBEDTLS_X509_CRT_CACHE_H
+
+#include "x509_crt.h"
+
+#if defined(MBEDTLS_HAVE_TIME)
+#include "platform_time.h"
+#endif
+
+#if defined(MBEDTLS_THREADING_C)
+#include "threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_X509_CRT_CACHE_DEFAULT_TIMEOUT)
+#define MBEDTLS_X509_CRT_CACHE_DEFAULT_TIMEOUT      3600   /*!< 1 hour */
+#endif
+
+#if !defined(MBEDTLS_X509_CRT_CACHE_DEFAULT_MAX_ENTRIES)
+#define MBEDTLS_X509_CRT_CACHE_DEFAULT_MAX_ENTRIES    64   /*!< Maximum entries in cache */
+#endif
+
+/* \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_x509_crt_cache_context mbedtls_x509_crt_cache_context;
+typedef struct mbedtls_x509_crt_cache_entry mbedtls_x509_crt_cache_entry;
+
+/**
+ * \brief   A verified chain.
+ *
+ *          The chain is recorded as positions in the list of certificates
+ *          presented by the peer, possibly followed by a certificate from
+ *          the trust store it was verified with.
+ */
+struct mbedtls_x509_crt_cache_entry
+{
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t timestamp;           /*!< entry timestamp                */
+#endif
+    const void *owner;                  /*!< trust store of the entry       */
+    unsigned char key[32];              /*!< hash of the verification inputs */
+    mbedtls_x509_time valid_to;         /*!< earliest expiry in the chain   */
+    size_t len;                         /*!< number of certificates         */
+    unsigned char pos[MBEDTLS_X509_MAX_VERIFY_CHAIN_SIZE]; /*!< positions in
+                                             the presented list             */
+    mbedtls_x509_crt *trusted;          /*!< trusted certificate ending the
+                                             chain, or NULL                 */
+    mbedtls_x509_crt_cache_entry *next; /*!< chain pointer                  */
+};
+
+/**
+ * \brief Cache context
+ */
+struct mbedtls_x509_crt_cache_context
+{
+    mbedtls_x509_crt_cache_entry *chain; /*!< start of the chain            */
+    int timeout;                /*!< cache entry timeout                    */
+    int max_entries;            /*!< maximum entries                        */
+    size_t hits;                /*!< lookups that found a verified chain    */
+    size_t misses;              /*!< lookups that did not                   */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t mutex;    /*!< mutex                          */
+#endif
+};
+
+/**
+ * \brief          Initialize a verification cache context
+ *
+ * \param cache    verification cache context
+ */
+void mbedtls_x509_crt_cache_init( mbedtls_x509_crt_cache_context *cache );
+
+/**
+ * \brief          Look up a verified chain
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \note           This is called by mbedtls_x509_crt_verify_with_store()
+ *                 for stores with a cache attached with
+ *                 mbedtls_x509_crt_store_set_cache().
+ *
+ * \param cache    verification cache context
+ * \param owner    trust store the chain was verified with
+ * \param key      hash of the verification inputs
+ * \param entry    entry to fill in if found
+ *
+ * \return         0 if a valid entry was found, 1 otherwise
+ */
+int mbedtls_x509_crt_cache_get( mbedtls_x509_crt_cache_context *cache,
+                                const void *owner,
+                                const unsigned char key[32],
+                                mbedtls_x509_crt_cache_entry *entry );
+
+/**
+ * \brief          Record a verified chain
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param cache    verification cache context
+ * \param entry    entry to copy into the cache
+ *
+ * \return         0 if successful, 1 otherwise
+ */
+int mbedtls_x509_crt_cache_set( mbedtls_x509_crt_cache_context *cache,
+                                const mbedtls_x509_crt_cache_entry *entry );
+
+/**
+ * \brief          Remove all entries verified with a given trust store
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \note           This is called when the store is set up again or freed.
+ *
+ * \param cache    verification cache context
+ * \param owner    trust store
+ */
+void mbedtls_x509_crt_cache_purge( mbedtls_x509_crt_cache_context *cache,
+                                   const void *owner );
+
+#if defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Set the cache timeout
+ *                 (Default: MBEDTLS_X509_CRT_CACHE_DEFAULT_TIMEOUT (1 hour))
+ *
+ *                 A timeout of 0 indicates no timeout. Entries also expire
+ *                 with the first certificate or CRL of their chain.
+ *
+ * \param cache    verification cache context
+ * \param timeout  cache entry timeout in seconds
+ */
+void mbedtls_x509_crt_cache_set_timeout( mbedtls_x509_crt_cache_context *cache,
+                                         int timeout );
+#endif /* MBEDTLS_HAVE_TIME */
+
+/**
+ * \brief          Set the maximum number of cache entries
+ *                 (Default: MBEDTLS_X509_CRT_CACHE_DEFAULT_MAX_ENTRIES (64))
+ *
+ * \param cache    verification cache context
+ * \param max      cache entry maximum
+ */
+void mbedtls_x509_crt_cache_set_max_entries( mbedtls_x509_crt_cache_context *cache,
+                                             int max );
+
+/**
+ * \brief          Free referenced items in a cache context and clear memory
+ *
+ * \param cache    verification cache context
+ */
+void mbedtls_x509_crt_cache_free( mbedtls_x509_crt_cache_context *cache );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* x509_crt_cache.h */
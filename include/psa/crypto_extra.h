@@ -120,6 +120,89 @@ void mbedtls_psa_crypto_free( void );
 psa_status_t mbedtls_psa_inject_entropy(const unsigned char *seed,
                                         size_t seed_size);
 
+/**
+ * \brief Start a batch of persistent key creations.
+ *
+ * Persistent keys imported, generated or destroyed after this call and
+ * before mbedtls_psa_storage_commit_batch() are written to storage as a
+ * whole: after a crash or power failure, either all of them or none of
+ * them are found in storage. The whole batch is also synchronized with
+ * the storage medium only once, when it is committed, which makes
+ * provisioning many keys much faster.
+ *
+ * The keys of the batch can be used as soon as they are created. If the
+ * batch is not committed, for example because mbedtls_psa_crypto_free()
+ * is called first, the persistent keys it created are absent, and those it
+ * destroyed present, after the next call to psa_crypto_init().
+ *
+ * This is an Mbed TLS extension.
+ *
+ * \note This function is only supported with the key log storage backend
+ *       (MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C).
+ *
+ * \retval #PSA_SUCCESS
+ * \retval #PSA_ERROR_BAD_STATE
+ *         The library has not been initialized, or a batch is already open.
+ * \retval #PSA_ERROR_NOT_SUPPORTED
+ *         The storage backend does not support batches.
+ * \retval #PSA_ERROR_STORAGE_FAILURE
+ */
+psa_status_t mbedtls_psa_storage_begin_batch(void);
+
+/**
+ * \brief Commit the batch of persistent key creations started with
+ *        mbedtls_psa_storage_begin_batch().
+ *
+ * When this function returns successfully, all the changes made to
+ * persistent keys during the batch have reached the storage medium.
+ *
+ * This is an Mbed TLS extension.
+ *
+ * \retval #PSA_SUCCESS
+ * \retval #PSA_ERROR_BAD_STATE
+ *         The library has not been initialized, or no batch is open.
+ * \retval #PSA_ERROR_NOT_SUPPORTED
+ *         The storage backend does not support batches.
+ * \retval #PSA_ERROR_STORAGE_FAILURE
+ *         The batch is no longer open. If writing to storage failed while
+ *         it was open, none of its changes are kept. If only synchronizing
+ *         with the storage medium failed, all of them are kept but may not
+ *         survive a power failure.
+ */
+psa_status_t mbedtls_psa_storage_commit_batch(void);
+
+/**
+ * \brief Statistics of the cache of closed persistent keys.
+ */
+typedef struct mbedtls_psa_key_cache_stats_s
+{
+    /** Persistent keys opened from the cache */
+    size_t hits;
+    /** Persistent keys opened from storage */
+    size_t misses;
+    /** Keys evicted from the cache to keep it within its size limit */
+    size_t evictions;
+    /** Keys currently in the cache */
+    size_t keys;
+    /** Estimated memory used by the keys currently in the cache, in bytes */
+    size_t bytes;
+} mbedtls_psa_key_cache_stats_t;
+
+/**
+ * \brief Get statistics of the cache of closed persistent keys.
+ *
+ * With MBEDTLS_PSA_CRYPTO_KEY_CACHE, persistent keys stay in memory after
+ * psa_close_key(), up to MBEDTLS_PSA_CRYPTO_KEY_CACHE_SIZE bytes, so that
+ * psa_open_key() finds them without reading storage. The counters are
+ * reset by mbedtls_psa_crypto_free().
+ *
+ * This is an Mbed TLS extension.
+ *
+ * \param[out] stats    The current counters. All zero if the cache is not
+ *                      enabled at compile time.
+ */
+void mbedtls_psa_get_key_cache_stats(mbedtls_psa_key_cache_stats_t *stats);
+
 
 #ifdef __cplusplus
 }
@@ -28,9 +28,21 @@
 #if defined(MBEDTLS_BASE64_C)
 
 #include "mbedtls/base64.h"
+#include "mbedtls/platform_util.h"
 
 #include <stdint.h>
 
+#if defined(MBEDTLS_BASE64_SIMD) &&                                     \
+    ( defined(__SSE2__) || defined(_M_X64) ||                           \
+      ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) )
+#define BASE64_SSE2
+#include <string.h>
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#endif
+
 #if defined(MBEDTLS_SELF_TEST)
 #include <string.h>
 #if defined(MBEDTLS_PLATFORM_C)
@@ -71,6 +83,114 @@ static const unsigned char base64_dec_map[128] =
 
 #define BASE64_SIZE_T_MAX   ( (size_t) -1 ) /* SIZE_T_MAX is not standard */
 
+#if defined(BASE64_SSE2)
+/*
+ * Encode 12 bytes into 16 characters
+ */
+static void base64_encode_block_sse2( unsigned char *dst,
+                                      const unsigned char *src )
+{
+    __m128i w, idx, off;
+
+    /* One group of 3 bytes per 32-bit lane, as a 24-bit big-endian value */
+    w = _mm_setr_epi32( ( src[0] << 16 ) | ( src[ 1] << 8 ) | src[ 2],
+                        ( src[3] << 16 ) | ( src[ 4] << 8 ) | src[ 5],
+                        ( src[6] << 16 ) | ( src[ 7] << 8 ) | src[ 8],
+                        ( src[9] << 16 ) | ( src[10] << 8 ) | src[11] );
+
+    /* Spread the four 6-bit indices of each lane to its bytes, in order */
+    idx = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128( _mm_srli_epi32( w, 18 ), _mm_set1_epi32( 0x3F ) ),
+                _mm_and_si128( _mm_srli_epi32( w,  4 ), _mm_set1_epi32( 0x3F00 ) ) ),
+            _mm_or_si128(
+                _mm_and_si128( _mm_slli_epi32( w, 10 ), _mm_set1_epi32( 0x3F0000 ) ),
+                _mm_and_si128( _mm_slli_epi32( w, 24 ), _mm_set1_epi32( 0x3F000000 ) ) ) );
+
+    /* Offset from index to character, by range: 'A'-'Z', 'a'-'z', '0'-'9',
+     * '+' and '/' */
+    off = _mm_set1_epi8( 'A' );
+    off = _mm_add_epi8( off, _mm_and_si128( _mm_cmpgt_epi8( idx, _mm_set1_epi8( 25 ) ),
+                                            _mm_set1_epi8( 'a' - 26 - 'A' ) ) );
+    off = _mm_add_epi8( off, _mm_and_si128( _mm_cmpgt_epi8( idx, _mm_set1_epi8( 51 ) ),
+                                            _mm_set1_epi8( '0' - 52 - 'a' + 26 ) ) );
+    off = _mm_add_epi8( off, _mm_and_si128( _mm_cmpeq_epi8( idx, _mm_set1_epi8( 62 ) ),
+                                            _mm_set1_epi8( '+' - 62 - '0' + 52 ) ) );
+    off = _mm_add_epi8( off, _mm_and_si128( _mm_cmpeq_epi8( idx, _mm_set1_epi8( 63 ) ),
+                                            _mm_set1_epi8( '/' - 63 - '0' + 52 ) ) );
+
+    _mm_storeu_si128( (__m128i *) dst, _mm_add_epi8( idx, off ) );
+}
+
+/*
+ * Decode 16 characters into 12 bytes, if they are all in the base64
+ * alphabet. Padding, line breaks and spaces are left to the caller.
+ */
+static int base64_decode_block_sse2( unsigned char *dst,
+                                     const unsigned char *src )
+{
+    __m128i in, upper, lower, digit, plus, slash, off, v;
+#if defined(__SSSE3__)
+    unsigned char out[16];
+#else
+    uint32_t out[4];
+    int k;
+#endif
+
+    in = _mm_loadu_si128( (const __m128i *) src );
+
+    /* Signed comparisons: bytes above 127 are in none of the ranges */
+    upper = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8( 'A' - 1 ) ),
+                           _mm_cmplt_epi8( in, _mm_set1_epi8( 'Z' + 1 ) ) );
+    lower = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8( 'a' - 1 ) ),
+                           _mm_cmplt_epi8( in, _mm_set1_epi8( 'z' + 1 ) ) );
+    digit = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8( '0' - 1 ) ),
+                           _mm_cmplt_epi8( in, _mm_set1_epi8( '9' + 1 ) ) );
+    plus  = _mm_cmpeq_epi8( in, _mm_set1_epi8( '+' ) );
+    slash = _mm_cmpeq_epi8( in, _mm_set1_epi8( '/' ) );
+
+    if( _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( upper, lower ),
+                           _mm_or_si128( _mm_or_si128( digit, plus ), slash ) ) )
+        != 0xFFFF )
+        return( -1 );
+
+    off = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128( upper, _mm_set1_epi8( -'A' ) ),
+                _mm_and_si128( lower, _mm_set1_epi8( 26 - 'a' ) ) ),
+            _mm_or_si128(
+                _mm_or_si128(
+                    _mm_and_si128( digit, _mm_set1_epi8( 52 - '0' ) ),
+                    _mm_and_si128( plus,  _mm_set1_epi8( 62 - '+' ) ) ),
+                _mm_and_si128( slash, _mm_set1_epi8( 63 - '/' ) ) ) );
+    v = _mm_add_epi8( in, off );
+
+    /* Merge pairs of 6-bit values into 12 bits per 16-bit lane, then pairs
+     * of those into 24 bits per 32-bit lane */
+    v = _mm_or_si128( _mm_slli_epi16( _mm_and_si128( v, _mm_set1_epi16( 0xFF ) ), 6 ),
+                      _mm_srli_epi16( v, 8 ) );
+    v = _mm_or_si128( _mm_slli_epi32( _mm_and_si128( v, _mm_set1_epi32( 0xFFFF ) ), 12 ),
+                      _mm_srli_epi32( v, 16 ) );
+
+#if defined(__SSSE3__)
+    v = _mm_shuffle_epi8( v, _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                            14, 13, 12, -1, -1, -1, -1 ) );
+    _mm_storeu_si128( (__m128i *) out, v );
+    memcpy( dst, out, 12 );
+#else
+    _mm_storeu_si128( (__m128i *) out, v );
+    for( k = 0; k < 4; k++ )
+    {
+        *dst++ = (unsigned char)( out[k] >> 16 );
+        *dst++ = (unsigned char)( out[k] >>  8 );
+        *dst++ = (unsigned char)( out[k]       );
+    }
+#endif
+
+    return( 0 );
+}
+#endif /* BASE64_SSE2 */
+
 /*
  * Encode a buffer into base64 format
  */
@@ -105,7 +225,15 @@ int mbedtls_base64_encode( unsigned char *dst, size_t dlen, size_t *olen,
 
     n = ( slen / 3 ) * 3;
 
-    for( i = 0, p = dst; i < n; i += 3 )
+    i = 0;
+    p = dst;
+
+#if defined(BASE64_SSE2)
+    for( ; n - i >= 12; i += 12, src += 12, p += 16 )
+        base64_encode_block_sse2( p, src );
+#endif
+
+    for( ; i < n; i += 3 )
     {
         C1 = *src++;
         C2 = *src++;
@@ -144,13 +272,35 @@ int mbedtls_base64_encode( unsigned char *dst, size_t dlen, size_t *olen,
 int mbedtls_base64_decode( unsigned char *dst, size_t dlen, size_t *olen,
                    const unsigned char *src, size_t slen )
 {
-    size_t i, n;
-    uint32_t j, x;
+    int ret = MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    size_t i, n, room;
+    uint32_t j, k, x, v;
     unsigned char *p;
 
-    /* First pass: check for validity and get output length */
-    for( i = n = j = 0; i < slen; i++ )
+    /*
+     * Check for validity and decode in a single pass. Complete groups of
+     * four characters are written out as long as they fit, the required
+     * length is only known at the end.
+     */
+    room = ( dst != NULL ) ? dlen : 0;
+
+    for( i = n = 0, j = k = v = 0, p = dst; i < slen; i++ )
     {
+#if defined(BASE64_SSE2)
+        /* Whole groups without padding, spaces or line breaks */
+        while( k == 0 && j == 0 && slen - i >= 16 && room >= 12 &&
+               base64_decode_block_sse2( p, src + i ) == 0 )
+        {
+            i += 16;
+            n += 16;
+            p += 12;
+            room -= 12;
+        }
+
+        if( i == slen )
+            break;
+#endif
+
         /* Skip spaces before checking for EOL */
         x = 0;
         while( i < slen && src[i] == ' ' )
@@ -172,18 +322,37 @@ int mbedtls_base64_decode( unsigned char *dst, size_t dlen, size_t *olen,
 
         /* Space inside a line is an error */
         if( x != 0 )
-            return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+            goto cleanup;
 
         if( src[i] == '=' && ++j > 2 )
-            return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+            goto cleanup;
 
         if( src[i] > 127 || base64_dec_map[src[i]] == 127 )
-            return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+            goto cleanup;
 
         if( base64_dec_map[src[i]] < 64 && j != 0 )
-            return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+            goto cleanup;
 
         n++;
+
+        v = ( v << 6 ) | ( base64_dec_map[src[i]] & 0x3F );
+
+        if( ++k == 4 )
+        {
+            k = 0;
+
+            /* Once a group does not fit, stop writing: dlen is too small */
+            if( room < 3 - j )
+            {
+                room = 0;
+                continue;
+            }
+
+            room -= 3 - j;
+            if( j < 3 ) *p++ = (unsigned char)( v >> 16 );
+            if( j < 2 ) *p++ = (unsigned char)( v >>  8 );
+            if( j < 1 ) *p++ = (unsigned char)( v       );
+        }
     }
 
     if( n == 0 )
@@ -202,29 +371,20 @@ int mbedtls_base64_decode( unsigned char *dst, size_t dlen, size_t *olen,
     if( dst == NULL || dlen < n )
     {
         *olen = n;
-        return( MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL );
-    }
-
-   for( j = 3, n = x = 0, p = dst; i > 0; i--, src++ )
-   {
-        if( *src == '\r' || *src == '\n' || *src == ' ' )
-            continue;
-
-        j -= ( base64_dec_map[*src] == 64 );
-        x  = ( x << 6 ) | ( base64_dec_map[*src] & 0x3F );
-
-        if( ++n == 4 )
-        {
-            n = 0;
-            if( j > 0 ) *p++ = (unsigned char)( x >> 16 );
-            if( j > 1 ) *p++ = (unsigned char)( x >>  8 );
-            if( j > 2 ) *p++ = (unsigned char)( x       );
-        }
+        ret = MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+        goto cleanup;
     }
 
     *olen = p - dst;
 
     return( 0 );
+
+cleanup:
+    /* Do not leave the groups decoded before the error in dst */
+    if( p != dst )
+        mbedtls_platform_zeroize( dst, p - dst );
+
+    return( ret );
 }
 
 #if defined(MBEDTLS_SELF_TEST)
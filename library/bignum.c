@@ -59,6 +59,10 @@
 #define mbedtls_free       free
 #endif
 
+#if defined(MBEDTLS_MPI_SCRATCH) && defined(MBEDTLS_THREADING_PTHREAD)
+#include <pthread.h>
+#endif
+
 #define ciL    (sizeof(mbedtls_mpi_uint))         /* chars in limb  */
 #define biL    (ciL << 3)               /* bits  in limb  */
 #define biH    (ciL << 2)               /* half limb size */
@@ -78,6 +82,263 @@ static void mbedtls_mpi_zeroize( mbedtls_mpi_uint *v, size_t n )
     mbedtls_platform_zeroize( v, ciL * n );
 }
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+/*
+ * The scratch arena is a stack of blocks, each made of a header and limbs.
+ * The space above the top of the stack is kept zeroed, so that blocks can
+ * be handed out as if they came from calloc(). Freed blocks are given back
+ * once they reach the top of the stack. Each block records the MPI using
+ * it, so that MPIs still in use when a scope is closed can be moved to the
+ * heap.
+ */
+typedef struct
+{
+    mbedtls_mpi *owner;     /* MPI using the block, NULL once freed     */
+    size_t limbs;           /* number of limbs in the block             */
+    size_t prev;            /* offset of the previous block             */
+} mpi_scratch_block;
+
+typedef struct
+{
+    unsigned char *buf;     /* arena                                    */
+    size_t top;             /* offset of the free space                 */
+    size_t last;            /* offset of the last block                 */
+    int depth;              /* number of open scopes                    */
+    size_t mark_top[MBEDTLS_MPI_SCRATCH_MAX_DEPTH];     /* top and last */
+    size_t mark_last[MBEDTLS_MPI_SCRATCH_MAX_DEPTH];    /* at push      */
+} mpi_scratch;
+
+/* Sizes rounded up for the limbs that follow to be aligned */
+#define MPI_SCRATCH_ALIGN( n )  ( ( (n) + ciL - 1 ) / ciL * ciL )
+#define MPI_SCRATCH_HDR         MPI_SCRATCH_ALIGN( sizeof( mpi_scratch_block ) )
+#define MPI_SCRATCH_NONE        ( (size_t) -1 )
+
+#define MPI_SCRATCH_BLOCK( s, off ) \
+    ( (mpi_scratch_block *) ( (s)->buf + (off) ) )
+#define MPI_SCRATCH_LIMBS( blk )    \
+    ( (mbedtls_mpi_uint *) ( (unsigned char *) (blk) + MPI_SCRATCH_HDR ) )
+
+#if defined(MBEDTLS_THREADING_PTHREAD)
+static pthread_key_t mpi_scratch_key;
+static pthread_once_t mpi_scratch_once = PTHREAD_ONCE_INIT;
+static int mpi_scratch_key_ok = 0;
+
+static void mpi_scratch_key_create( void )
+{
+    mpi_scratch_key_ok = ( pthread_key_create( &mpi_scratch_key, NULL ) == 0 );
+}
+
+static mpi_scratch *mpi_scratch_get( void )
+{
+    if( pthread_once( &mpi_scratch_once, mpi_scratch_key_create ) != 0 ||
+        ! mpi_scratch_key_ok )
+        return( NULL );
+
+    return( pthread_getspecific( mpi_scratch_key ) );
+}
+
+static int mpi_scratch_set( mpi_scratch *s )
+{
+    return( pthread_setspecific( mpi_scratch_key, s ) );
+}
+#else
+static mpi_scratch *mpi_scratch_current = NULL;
+
+static mpi_scratch *mpi_scratch_get( void )
+{
+    return( mpi_scratch_current );
+}
+
+static int mpi_scratch_set( mpi_scratch *s )
+{
+    mpi_scratch_current = s;
+    return( 0 );
+}
+#endif /* MBEDTLS_THREADING_PTHREAD */
+
+/*
+ * Block holding the limbs p, if they are in the arena of the calling thread
+ */
+static mpi_scratch_block *mpi_scratch_find( const mbedtls_mpi_uint *p )
+{
+    mpi_scratch *s;
+    const unsigned char *c = (const unsigned char *) p;
+
+    if( p == NULL || ( s = mpi_scratch_get() ) == NULL )
+        return( NULL );
+
+    if( c < s->buf || c >= s->buf + MBEDTLS_MPI_SCRATCH_SIZE )
+        return( NULL );
+
+    return( (mpi_scratch_block *) ( c - MPI_SCRATCH_HDR ) );
+}
+
+/*
+ * Record that X now holds its limbs, after its contents were moved
+ */
+static void mpi_scratch_own( mbedtls_mpi *X )
+{
+    mpi_scratch_block *blk = mpi_scratch_find( X->p );
+
+    if( blk != NULL )
+        blk->owner = X;
+}
+#endif /* MBEDTLS_MPI_SCRATCH */
+
+/*
+ * Allocate limbs for X, zeroed
+ */
+static mbedtls_mpi_uint *mpi_alloc_limbs( mbedtls_mpi *X, size_t nblimbs )
+{
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mpi_scratch *s = mpi_scratch_get();
+    mpi_scratch_block *blk;
+
+    if( s != NULL && MBEDTLS_MPI_SCRATCH_SIZE - s->top >= MPI_SCRATCH_HDR &&
+        nblimbs <= ( MBEDTLS_MPI_SCRATCH_SIZE - s->top - MPI_SCRATCH_HDR ) / ciL )
+    {
+        blk = MPI_SCRATCH_BLOCK( s, s->top );
+        blk->owner = X;
+        blk->limbs = nblimbs;
+        blk->prev = s->last;
+
+        s->last = s->top;
+        s->top += MPI_SCRATCH_HDR + nblimbs * ciL;
+
+        return( MPI_SCRATCH_LIMBS( blk ) );
+    }
+#else
+    (void) X;
+#endif
+
+    return( (mbedtls_mpi_uint *) mbedtls_calloc( nblimbs, ciL ) );
+}
+
+/*
+ * Zeroize and free limbs
+ */
+static void mpi_free_limbs( mbedtls_mpi_uint *p, size_t n )
+{
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mpi_scratch *s;
+    mpi_scratch_block *blk = mpi_scratch_find( p );
+    size_t base;
+#endif
+
+    mbedtls_mpi_zeroize( p, n );
+
+#if defined(MBEDTLS_MPI_SCRATCH)
+    if( blk != NULL )
+    {
+        s = mpi_scratch_get();
+        blk->owner = NULL;
+
+        /* Give back the freed blocks at the top of the current scope */
+        base = s->depth <= MBEDTLS_MPI_SCRATCH_MAX_DEPTH ?
+               s->mark_top[s->depth - 1] :
+               s->mark_top[MBEDTLS_MPI_SCRATCH_MAX_DEPTH - 1];
+
+        while( s->last != MPI_SCRATCH_NONE && s->last >= base )
+        {
+            blk = MPI_SCRATCH_BLOCK( s, s->last );
+            if( blk->owner != NULL )
+                break;
+
+            s->top = s->last;
+            s->last = blk->prev;
+            mbedtls_platform_zeroize( blk, MPI_SCRATCH_HDR );
+        }
+
+        return;
+    }
+#endif
+
+    mbedtls_free( p );
+}
+
+#if defined(MBEDTLS_MPI_SCRATCH)
+void mbedtls_mpi_scratch_push( void )
+{
+    mpi_scratch *s = mpi_scratch_get();
+
+    if( s == NULL )
+    {
+        s = mbedtls_calloc( 1, MPI_SCRATCH_ALIGN( sizeof( mpi_scratch ) ) +
+                               MBEDTLS_MPI_SCRATCH_SIZE );
+        if( s == NULL )
+            return;
+
+        s->buf = (unsigned char *) s + MPI_SCRATCH_ALIGN( sizeof( mpi_scratch ) );
+        s->last = MPI_SCRATCH_NONE;
+
+        if( mpi_scratch_set( s ) != 0 )
+        {
+            mbedtls_free( s );
+            return;
+        }
+    }
+
+    if( s->depth < MBEDTLS_MPI_SCRATCH_MAX_DEPTH )
+    {
+        s->mark_top[s->depth] = s->top;
+        s->mark_last[s->depth] = s->last;
+    }
+
+    s->depth++;
+}
+
+int mbedtls_mpi_scratch_pop( void )
+{
+    int ret = 0;
+    mpi_scratch *s = mpi_scratch_get();
+    mpi_scratch_block *blk;
+    mbedtls_mpi *X;
+    mbedtls_mpi_uint *p;
+    size_t off;
+
+    if( s == NULL )
+        return( 0 );
+
+    if( --s->depth >= MBEDTLS_MPI_SCRATCH_MAX_DEPTH )
+        return( 0 );
+
+    /* Move the MPIs that outlive the scope to the heap */
+    for( off = s->last; off != s->mark_last[s->depth]; off = blk->prev )
+    {
+        blk = MPI_SCRATCH_BLOCK( s, off );
+        X = blk->owner;
+
+        if( X == NULL || X->p != MPI_SCRATCH_LIMBS( blk ) )
+            continue;
+
+        if( ( p = mbedtls_calloc( X->n, ciL ) ) == NULL )
+        {
+            X->s = 1;
+            X->n = 0;
+            X->p = NULL;
+            ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+            continue;
+        }
+
+        memcpy( p, X->p, X->n * ciL );
+        X->p = p;
+    }
+
+    mbedtls_platform_zeroize( s->buf + s->mark_top[s->depth],
+                              s->top - s->mark_top[s->depth] );
+    s->top = s->mark_top[s->depth];
+    s->last = s->mark_last[s->depth];
+
+    if( s->depth == 0 )
+    {
+        (void) mpi_scratch_set( NULL );
+        mbedtls_free( s );
+    }
+
+    return( ret );
+}
+#endif /* MBEDTLS_MPI_SCRATCH */
+
 /*
  * Initialize one MPI
  */
@@ -100,10 +361,7 @@ void mbedtls_mpi_free( mbedtls_mpi *X )
         return;
 
     if( X->p != NULL )
-    {
-        mbedtls_mpi_zeroize( X->p, X->n );
-        mbedtls_free( X->p );
-    }
+        mpi_free_limbs( X->p, X->n );
 
     X->s = 1;
     X->n = 0;
@@ -122,14 +380,13 @@ int mbedtls_mpi_grow( mbedtls_mpi *X, size_t nblimbs )
 
     if( X->n < nblimbs )
     {
-        if( ( p = (mbedtls_mpi_uint*)mbedtls_calloc( nblimbs, ciL ) ) == NULL )
+        if( ( p = mpi_alloc_limbs( X, nblimbs ) ) == NULL )
             return( MBEDTLS_ERR_MPI_ALLOC_FAILED );
 
         if( X->p != NULL )
         {
             memcpy( p, X->p, X->n * ciL );
-            mbedtls_mpi_zeroize( X->p, X->n );
-            mbedtls_free( X->p );
+            mpi_free_limbs( X->p, X->n );
         }
 
         X->n = nblimbs;
@@ -160,14 +417,13 @@ int mbedtls_mpi_shrink( mbedtls_mpi *X, size_t nblimbs )
     if( i < nblimbs )
         i = nblimbs;
 
-    if( ( p = (mbedtls_mpi_uint*)mbedtls_calloc( i, ciL ) ) == NULL )
+    if( ( p = mpi_alloc_limbs( X, i ) ) == NULL )
         return( MBEDTLS_ERR_MPI_ALLOC_FAILED );
 
     if( X->p != NULL )
     {
         memcpy( p, X->p, i * ciL );
-        mbedtls_mpi_zeroize( X->p, X->n );
-        mbedtls_free( X->p );
+        mpi_free_limbs( X->p, X->n );
     }
 
     X->n = i;
@@ -226,6 +482,11 @@ void mbedtls_mpi_swap( mbedtls_mpi *X, mbedtls_mpi *Y )
     memcpy( &T,  X, sizeof( mbedtls_mpi ) );
     memcpy(  X,  Y, sizeof( mbedtls_mpi ) );
     memcpy(  Y, &T, sizeof( mbedtls_mpi ) );
+
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mpi_scratch_own( X );
+    mpi_scratch_own( Y );
+#endif
 }
 
 /*
@@ -1674,7 +1935,12 @@ int mbedtls_mpi_exp_mod( mbedtls_mpi *X, const mbedtls_mpi *A, const mbedtls_mpi
         MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &RR, &RR, N ) );
 
         if( _RR != NULL )
+        {
             memcpy( _RR, &RR, sizeof( mbedtls_mpi ) );
+#if defined(MBEDTLS_MPI_SCRATCH)
+            mpi_scratch_own( _RR );
+#endif
+        }
     }
     else
         memcpy( &RR, _RR, sizeof( mbedtls_mpi ) );
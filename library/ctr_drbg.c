@@ -37,6 +37,13 @@
 
 #include <string.h>
 
+#if defined(MBEDTLS_AESNI_C) && !defined(MBEDTLS_AES_ALT)
+#include "mbedtls/aesni.h"
+#if defined(MBEDTLS_HAVE_X86_64)
+#define CTR_DRBG_AESNI
+#endif
+#endif
+
 #if defined(MBEDTLS_FS_IO)
 #include <stdio.h>
 #endif
@@ -50,6 +57,45 @@
 #endif /* MBEDTLS_PLATFORM_C */
 #endif /* MBEDTLS_SELF_TEST */
 
+/*
+ * Encrypt consecutive blocks in place, four at a time with AES-NI
+ */
+static int ctr_drbg_encrypt_blocks( mbedtls_aes_context *aes_ctx,
+                                    unsigned char *buf, size_t blocks )
+{
+    int ret;
+
+#if defined(CTR_DRBG_AESNI)
+    if( mbedtls_aesni_has_support( MBEDTLS_AESNI_AES ) )
+    {
+        for( ; blocks >= 4; blocks -= 4, buf += 4 * MBEDTLS_CTR_DRBG_BLOCKSIZE )
+            mbedtls_aesni_encrypt_4blocks( aes_ctx, buf, buf );
+    }
+#endif
+
+    for( ; blocks > 0; blocks--, buf += MBEDTLS_CTR_DRBG_BLOCKSIZE )
+    {
+        if( ( ret = mbedtls_aes_crypt_ecb( aes_ctx, MBEDTLS_AES_ENCRYPT, buf, buf ) ) != 0 )
+            return( ret );
+    }
+
+    return( 0 );
+}
+
+/*
+ * Set up the key of the derivation function, 00 01 02 ... 1F
+ */
+static int block_cipher_df_setkey( mbedtls_aes_context *df_ctx )
+{
+    unsigned char key[MBEDTLS_CTR_DRBG_KEYSIZE];
+    int i;
+
+    for( i = 0; i < MBEDTLS_CTR_DRBG_KEYSIZE; i++ )
+        key[i] = i;
+
+    return( mbedtls_aes_setkey_enc( df_ctx, key, MBEDTLS_CTR_DRBG_KEYBITS ) );
+}
+
 /*
  * CTR_DRBG context initialization
  */
@@ -92,6 +138,7 @@ int mbedtls_ctr_drbg_seed_entropy_len(
     memset( key, 0, MBEDTLS_CTR_DRBG_KEYSIZE );
 
     mbedtls_aes_init( &ctx->aes_ctx );
+    mbedtls_aes_init( &ctx->df_ctx );
 
     ctx->f_entropy = f_entropy;
     ctx->p_entropy = p_entropy;
@@ -107,6 +154,11 @@ int mbedtls_ctr_drbg_seed_entropy_len(
         return( ret );
     }
 
+    if( ( ret = block_cipher_df_setkey( &ctx->df_ctx ) ) != 0 )
+    {
+        return( ret );
+    }
+
     if( ( ret = mbedtls_ctr_drbg_reseed( ctx, custom, len ) ) != 0 )
     {
         return( ret );
@@ -133,6 +185,7 @@ void mbedtls_ctr_drbg_free( mbedtls_ctr_drbg_context *ctx )
     mbedtls_mutex_free( &ctx->mutex );
 #endif
     mbedtls_aes_free( &ctx->aes_ctx );
+    mbedtls_aes_free( &ctx->df_ctx );
     mbedtls_platform_zeroize( ctx, sizeof( mbedtls_ctr_drbg_context ) );
 }
 
@@ -151,13 +204,16 @@ void mbedtls_ctr_drbg_set_reseed_interval( mbedtls_ctr_drbg_context *ctx, int in
     ctx->reseed_interval = interval;
 }
 
-static int block_cipher_df( unsigned char *output,
+/*
+ * The key schedule of the derivation function is set up once per context,
+ * in df_ctx. The BCC chains for the successive output blocks only differ by
+ * their IV, so they are run side by side over the input.
+ */
+static int block_cipher_df( mbedtls_aes_context *df_ctx, unsigned char *output,
                             const unsigned char *data, size_t data_len )
 {
     unsigned char buf[MBEDTLS_CTR_DRBG_MAX_SEED_INPUT + MBEDTLS_CTR_DRBG_BLOCKSIZE + 16];
-    unsigned char tmp[MBEDTLS_CTR_DRBG_SEEDLEN];
-    unsigned char key[MBEDTLS_CTR_DRBG_KEYSIZE];
-    unsigned char chain[MBEDTLS_CTR_DRBG_BLOCKSIZE];
+    unsigned char chain[4 * MBEDTLS_CTR_DRBG_BLOCKSIZE];
     unsigned char *p, *iv;
     mbedtls_aes_context aes_ctx;
     int ret = 0;
@@ -168,16 +224,18 @@ static int block_cipher_df( unsigned char *output,
     if( data_len > MBEDTLS_CTR_DRBG_MAX_SEED_INPUT )
         return( MBEDTLS_ERR_CTR_DRBG_INPUT_TOO_BIG );
 
-    memset( buf, 0, MBEDTLS_CTR_DRBG_MAX_SEED_INPUT + MBEDTLS_CTR_DRBG_BLOCKSIZE + 16 );
     mbedtls_aes_init( &aes_ctx );
 
     /*
-     * Construct IV (16 bytes) and S in buffer
-     * IV = Counter (in 32-bits) padded to 16 with zeroes
+     * Construct S in buffer, after room for the IV
      * S = Length input string (in 32-bits) || Length of output (in 32-bits) ||
      *     data || 0x80
      *     (Total is padded to a multiple of 16-bytes with zeroes)
      */
+    buf_len = MBEDTLS_CTR_DRBG_BLOCKSIZE + 8 + data_len + 1;
+    memset( buf, 0, ( buf_len + MBEDTLS_CTR_DRBG_BLOCKSIZE - 1 ) &
+                    ~(size_t)( MBEDTLS_CTR_DRBG_BLOCKSIZE - 1 ) );
+
     p = buf + MBEDTLS_CTR_DRBG_BLOCKSIZE;
     *p++ = ( data_len >> 24 ) & 0xff;
     *p++ = ( data_len >> 16 ) & 0xff;
@@ -188,55 +246,50 @@ static int block_cipher_df( unsigned char *output,
     memcpy( p, data, data_len );
     p[data_len] = 0x80;
 
-    buf_len = MBEDTLS_CTR_DRBG_BLOCKSIZE + 8 + data_len + 1;
-
-    for( i = 0; i < MBEDTLS_CTR_DRBG_KEYSIZE; i++ )
-        key[i] = i;
-
-    if( ( ret = mbedtls_aes_setkey_enc( &aes_ctx, key, MBEDTLS_CTR_DRBG_KEYBITS ) ) != 0 )
-    {
-        goto exit;
-    }
-
     /*
-     * Reduce data to MBEDTLS_CTR_DRBG_SEEDLEN bytes of data
+     * Reduce data to MBEDTLS_CTR_DRBG_SEEDLEN bytes of data: chain j starts
+     * from IV = j (in 32-bits) padded to 16 with zeroes
      */
-    for( j = 0; j < MBEDTLS_CTR_DRBG_SEEDLEN; j += MBEDTLS_CTR_DRBG_BLOCKSIZE )
-    {
-        p = buf;
-        memset( chain, 0, MBEDTLS_CTR_DRBG_BLOCKSIZE );
-        use_len = buf_len;
+    memset( chain, 0, sizeof( chain ) );
+    for( j = 0; j < MBEDTLS_CTR_DRBG_SEEDLEN / MBEDTLS_CTR_DRBG_BLOCKSIZE; j++ )
+        chain[j * MBEDTLS_CTR_DRBG_BLOCKSIZE + 3] = (unsigned char) j;
+
+    p = buf + MBEDTLS_CTR_DRBG_BLOCKSIZE;
+    use_len = buf_len - MBEDTLS_CTR_DRBG_BLOCKSIZE;
 
-        while( use_len > 0 )
+    while( 1 )
+    {
+#if defined(CTR_DRBG_AESNI)
+        /* All chains in one go, the last block being scratch space */
+        if( mbedtls_aesni_has_support( MBEDTLS_AESNI_AES ) )
+            mbedtls_aesni_encrypt_4blocks( df_ctx, chain, chain );
+        else
+#endif
+        if( ( ret = ctr_drbg_encrypt_blocks( df_ctx, chain,
+                        MBEDTLS_CTR_DRBG_SEEDLEN / MBEDTLS_CTR_DRBG_BLOCKSIZE ) ) != 0 )
         {
-            for( i = 0; i < MBEDTLS_CTR_DRBG_BLOCKSIZE; i++ )
-                chain[i] ^= p[i];
-            p += MBEDTLS_CTR_DRBG_BLOCKSIZE;
-            use_len -= ( use_len >= MBEDTLS_CTR_DRBG_BLOCKSIZE ) ?
-                       MBEDTLS_CTR_DRBG_BLOCKSIZE : use_len;
-
-            if( ( ret = mbedtls_aes_crypt_ecb( &aes_ctx, MBEDTLS_AES_ENCRYPT, chain, chain ) ) != 0 )
-            {
-                goto exit;
-            }
+            goto exit;
         }
 
-        memcpy( tmp + j, chain, MBEDTLS_CTR_DRBG_BLOCKSIZE );
+        if( use_len == 0 )
+            break;
 
-        /*
-         * Update IV
-         */
-        buf[3]++;
+        for( j = 0; j < MBEDTLS_CTR_DRBG_SEEDLEN; j += MBEDTLS_CTR_DRBG_BLOCKSIZE )
+            for( i = 0; i < MBEDTLS_CTR_DRBG_BLOCKSIZE; i++ )
+                chain[j + i] ^= p[i];
+        p += MBEDTLS_CTR_DRBG_BLOCKSIZE;
+        use_len -= ( use_len >= MBEDTLS_CTR_DRBG_BLOCKSIZE ) ?
+                   MBEDTLS_CTR_DRBG_BLOCKSIZE : use_len;
     }
 
     /*
      * Do final encryption with reduced data
      */
-    if( ( ret = mbedtls_aes_setkey_enc( &aes_ctx, tmp, MBEDTLS_CTR_DRBG_KEYBITS ) ) != 0 )
+    if( ( ret = mbedtls_aes_setkey_enc( &aes_ctx, chain, MBEDTLS_CTR_DRBG_KEYBITS ) ) != 0 )
     {
         goto exit;
     }
-    iv = tmp + MBEDTLS_CTR_DRBG_KEYSIZE;
+    iv = chain + MBEDTLS_CTR_DRBG_KEYSIZE;
     p = output;
 
     for( j = 0; j < MBEDTLS_CTR_DRBG_SEEDLEN; j += MBEDTLS_CTR_DRBG_BLOCKSIZE )
@@ -254,8 +307,6 @@ exit:
     * tidy up the stack
     */
     mbedtls_platform_zeroize( buf, sizeof( buf ) );
-    mbedtls_platform_zeroize( tmp, sizeof( tmp ) );
-    mbedtls_platform_zeroize( key, sizeof( key ) );
     mbedtls_platform_zeroize( chain, sizeof( chain ) );
     if( 0 != ret )
     {
@@ -268,44 +319,47 @@ exit:
     return( ret );
 }
 
-/* CTR_DRBG_Update (SP 800-90A &sect;10.2.1.2)
- * ctr_drbg_update_internal(ctx, provided_data)
- * implements
- * CTR_DRBG_Update(provided_data, Key, V)
- * with inputs and outputs
- *   ctx->aes_ctx = Key
- *   ctx->counter = V
+/*
+ * Increase the counter (V) and encrypt it, for each of the given number of
+ * blocks. The counter values are laid out in output first, so that they can
+ * be encrypted in place several at a time.
  */
-static int ctr_drbg_update_internal( mbedtls_ctr_drbg_context *ctx,
-                              const unsigned char data[MBEDTLS_CTR_DRBG_SEEDLEN] )
+static int ctr_drbg_crypt_counter( mbedtls_ctr_drbg_context *ctx,
+                                   unsigned char *output, size_t blocks )
 {
-    unsigned char tmp[MBEDTLS_CTR_DRBG_SEEDLEN];
-    unsigned char *p = tmp;
-    int i, j;
-    int ret = 0;
-
-    memset( tmp, 0, MBEDTLS_CTR_DRBG_SEEDLEN );
+    unsigned char *p = output;
+    size_t n;
+    int i, ret;
 
-    for( j = 0; j < MBEDTLS_CTR_DRBG_SEEDLEN; j += MBEDTLS_CTR_DRBG_BLOCKSIZE )
+    for( n = 0; n < blocks; n++ )
     {
-        /*
-         * Increase counter
-         */
         for( i = MBEDTLS_CTR_DRBG_BLOCKSIZE; i > 0; i-- )
             if( ++ctx->counter[i - 1] != 0 )
                 break;
 
-        /*
-         * Crypt counter block
-         */
-        if( ( ret = mbedtls_aes_crypt_ecb( &ctx->aes_ctx, MBEDTLS_AES_ENCRYPT, ctx->counter, p ) ) != 0 )
-        {
-            return( ret );
-        }
-
+        memcpy( p, ctx->counter, MBEDTLS_CTR_DRBG_BLOCKSIZE );
         p += MBEDTLS_CTR_DRBG_BLOCKSIZE;
     }
 
+    if( ( ret = ctr_drbg_encrypt_blocks( &ctx->aes_ctx, output, blocks ) ) != 0 )
+    {
+        /* Do not leave counter values behind */
+        mbedtls_platform_zeroize( output, blocks * MBEDTLS_CTR_DRBG_BLOCKSIZE );
+        return( ret );
+    }
+
+    return( 0 );
+}
+
+/*
+ * Second half of CTR_DRBG_Update: tmp holds the encrypted counter blocks
+ */
+static int ctr_drbg_update_state( mbedtls_ctr_drbg_context *ctx,
+                                  unsigned char tmp[MBEDTLS_CTR_DRBG_SEEDLEN],
+                                  const unsigned char data[MBEDTLS_CTR_DRBG_SEEDLEN] )
+{
+    int i, ret;
+
     for( i = 0; i < MBEDTLS_CTR_DRBG_SEEDLEN; i++ )
         tmp[i] ^= data[i];
 
@@ -321,6 +375,31 @@ static int ctr_drbg_update_internal( mbedtls_ctr_drbg_context *ctx,
     return( 0 );
 }
 
+/* CTR_DRBG_Update (SP 800-90A &sect;10.2.1.2)
+ * ctr_drbg_update_internal(ctx, provided_data)
+ * implements
+ * CTR_DRBG_Update(provided_data, Key, V)
+ * with inputs and outputs
+ *   ctx->aes_ctx = Key
+ *   ctx->counter = V
+ */
+static int ctr_drbg_update_internal( mbedtls_ctr_drbg_context *ctx,
+                              const unsigned char data[MBEDTLS_CTR_DRBG_SEEDLEN] )
+{
+    unsigned char tmp[MBEDTLS_CTR_DRBG_SEEDLEN];
+    int ret;
+
+    if( ( ret = ctr_drbg_crypt_counter( ctx, tmp,
+                    MBEDTLS_CTR_DRBG_SEEDLEN / MBEDTLS_CTR_DRBG_BLOCKSIZE ) ) == 0 )
+    {
+        ret = ctr_drbg_update_state( ctx, tmp, data );
+    }
+
+    mbedtls_platform_zeroize( tmp, sizeof( tmp ) );
+
+    return( ret );
+}
+
 /* CTR_DRBG_Instantiate with derivation function (SP 800-90A &sect;10.2.1.3.2)
  * mbedtls_ctr_drbg_update(ctx, additional, add_len)
  * implements
@@ -345,7 +424,7 @@ void mbedtls_ctr_drbg_update( mbedtls_ctr_drbg_context *ctx,
         if( add_len > MBEDTLS_CTR_DRBG_MAX_SEED_INPUT )
             add_len = MBEDTLS_CTR_DRBG_MAX_SEED_INPUT;
 
-        block_cipher_df( add_input, additional, add_len );
+        block_cipher_df( &ctx->df_ctx, add_input, additional, add_len );
         ctr_drbg_update_internal( ctx, add_input );
     }
 }
@@ -398,7 +477,7 @@ int mbedtls_ctr_drbg_reseed( mbedtls_ctr_drbg_context *ctx,
     /*
      * Reduce to 384 bits
      */
-    if( ( ret = block_cipher_df( seed, seed, seedlen ) ) != 0 )
+    if( ( ret = block_cipher_df( &ctx->df_ctx, seed, seed, seedlen ) ) != 0 )
     {
         return( ret );
     }
@@ -441,10 +520,8 @@ int mbedtls_ctr_drbg_random_with_add( void *p_rng,
     int ret = 0;
     mbedtls_ctr_drbg_context *ctx = (mbedtls_ctr_drbg_context *) p_rng;
     unsigned char add_input[MBEDTLS_CTR_DRBG_SEEDLEN];
-    unsigned char *p = output;
-    unsigned char tmp[MBEDTLS_CTR_DRBG_BLOCKSIZE];
-    int i;
-    size_t use_len;
+    unsigned char tmp[MBEDTLS_CTR_DRBG_BLOCKSIZE + MBEDTLS_CTR_DRBG_SEEDLEN];
+    size_t blocks, rem;
 
     if( output_len > MBEDTLS_CTR_DRBG_MAX_REQUEST )
         return( MBEDTLS_ERR_CTR_DRBG_REQUEST_TOO_BIG );
@@ -466,7 +543,7 @@ int mbedtls_ctr_drbg_random_with_add( void *p_rng,
 
     if( add_len > 0 )
     {
-        if( ( ret = block_cipher_df( add_input, additional, add_len ) ) != 0 )
+        if( ( ret = block_cipher_df( &ctx->df_ctx, add_input, additional, add_len ) ) != 0 )
         {
             return( ret );
         }
@@ -476,34 +553,31 @@ int mbedtls_ctr_drbg_random_with_add( void *p_rng,
         }
     }
 
-    while( output_len > 0 )
-    {
-        /*
-         * Increase counter
-         */
-        for( i = MBEDTLS_CTR_DRBG_BLOCKSIZE; i > 0; i-- )
-            if( ++ctx->counter[i - 1] != 0 )
-                break;
+    /*
+     * Whole blocks are generated in place. The last partial block, if any,
+     * and the blocks of the final update follow on the same counter values,
+     * so they are generated together.
+     */
+    blocks = output_len / MBEDTLS_CTR_DRBG_BLOCKSIZE;
+    rem = output_len % MBEDTLS_CTR_DRBG_BLOCKSIZE;
 
-        /*
-         * Crypt counter block
-         */
-        if( ( ret = mbedtls_aes_crypt_ecb( &ctx->aes_ctx, MBEDTLS_AES_ENCRYPT, ctx->counter, tmp ) ) != 0 )
-        {
-            return( ret );
-        }
+    if( ( ret = ctr_drbg_crypt_counter( ctx, output, blocks ) ) != 0 )
+    {
+        return( ret );
+    }
 
-        use_len = ( output_len > MBEDTLS_CTR_DRBG_BLOCKSIZE ) ? MBEDTLS_CTR_DRBG_BLOCKSIZE :
-                                                       output_len;
-        /*
-         * Copy random block to destination
-         */
-        memcpy( p, tmp, use_len );
-        p += use_len;
-        output_len -= use_len;
+    if( ( ret = ctr_drbg_crypt_counter( ctx, tmp, ( rem != 0 ) +
+                    MBEDTLS_CTR_DRBG_SEEDLEN / MBEDTLS_CTR_DRBG_BLOCKSIZE ) ) != 0 )
+    {
+        return( ret );
     }
 
-    if( ( ret = ctr_drbg_update_internal( ctx, add_input ) ) != 0 )
+    memcpy( output + blocks * MBEDTLS_CTR_DRBG_BLOCKSIZE, tmp, rem );
+
+    ret = ctr_drbg_update_state( ctx, tmp + ( rem != 0 ? MBEDTLS_CTR_DRBG_BLOCKSIZE : 0 ),
+                                 add_input );
+    mbedtls_platform_zeroize( tmp, sizeof( tmp ) );
+    if( ret != 0 )
     {
         return( ret );
     }
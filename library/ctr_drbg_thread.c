@@ -0,0 +1,436 @@
+/*
+ *  Per-thread CTR_DRBG instances behind a single RNG callback
+ *
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+/*
+ * Each thread finds its instance through a thread-specific key. The mutex
+ * is only taken to create an instance and to free it when its thread exits,
+ * both of which happen once per thread; instances are kept in a list so that
+ * those of threads still running can be freed with the context.
+ *
+ * Forks are counted by a pthread_atfork() handler run in the child. An
+ * instance records the count when it is seeded, and is reseeded from the
+ * entropy source when it next runs in a process where the count differs.
+ *
+ * A reseed is told apart from a plain generate operation by the reseed
+ * counter of the DRBG, which is reset instead of incremented.
+ */
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_CTR_DRBG_THREAD_C)
+
+#if defined(MBEDTLS_PLATFORM_C)
+#include "mbedtls/platform.h"
+#else
+#include <stdlib.h>
+#define mbedtls_calloc    calloc
+#define mbedtls_free      free
+#endif
+
+#include "mbedtls/ctr_drbg_thread.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+static pthread_once_t ctr_drbg_thread_once = PTHREAD_ONCE_INIT;
+static int ctr_drbg_thread_atfork_ret = -1;
+static volatile unsigned long ctr_drbg_thread_forks = 0;
+
+static void ctr_drbg_thread_fork_child( void )
+{
+    ctr_drbg_thread_forks++;
+}
+
+static void ctr_drbg_thread_register_atfork( void )
+{
+    ctr_drbg_thread_atfork_ret =
+        pthread_atfork( NULL, NULL, ctr_drbg_thread_fork_child );
+}
+
+static void ctr_drbg_thread_instance_free( mbedtls_ctr_drbg_thread_instance *inst )
+{
+    if( inst->buf != NULL )
+    {
+        mbedtls_platform_zeroize( inst->buf, inst->buf_len );
+        mbedtls_free( inst->buf );
+    }
+
+    mbedtls_ctr_drbg_free( &inst->drbg );
+    mbedtls_platform_zeroize( inst, sizeof( mbedtls_ctr_drbg_thread_instance ) );
+    mbedtls_free( inst );
+}
+
+/*
+ * Called with the instance of an exiting thread
+ */
+static void ctr_drbg_thread_destroy( void *p )
+{
+    mbedtls_ctr_drbg_thread_instance *inst = p, **prv;
+    mbedtls_ctr_drbg_thread_context *ctx = inst->ctx;
+
+    if( mbedtls_mutex_lock( &ctx->mutex ) != 0 )
+        return;
+
+    for( prv = &ctx->list; *prv != NULL; prv = &(*prv)->next )
+    {
+        if( *prv == inst )
+        {
+            *prv = inst->next;
+            break;
+        }
+    }
+
+    mbedtls_mutex_unlock( &ctx->mutex );
+
+    ctr_drbg_thread_instance_free( inst );
+}
+
+void mbedtls_ctr_drbg_thread_init( mbedtls_ctr_drbg_thread_context *ctx )
+{
+    memset( ctx, 0, sizeof( mbedtls_ctr_drbg_thread_context ) );
+
+    ctx->reseed_interval = MBEDTLS_CTR_DRBG_RESEED_INTERVAL;
+    ctx->prediction_resistance = MBEDTLS_CTR_DRBG_PR_OFF;
+
+    mbedtls_mutex_init( &ctx->mutex );
+}
+
+int mbedtls_ctr_drbg_thread_setup( mbedtls_ctr_drbg_thread_context *ctx,
+                                   int (*f_entropy)(void *, unsigned char *, size_t),
+                                   void *p_entropy,
+                                   const unsigned char *custom,
+                                   size_t len )
+{
+    /* Threads may already hold instances tied to the current key */
+    if( ctx->key_created )
+        return( MBEDTLS_ERR_THREADING_BAD_INPUT_DATA );
+
+    if( len > MBEDTLS_CTR_DRBG_MAX_SEED_INPUT - MBEDTLS_CTR_DRBG_ENTROPY_LEN - 8 )
+        return( MBEDTLS_ERR_CTR_DRBG_INPUT_TOO_BIG );
+
+    if( pthread_once( &ctr_drbg_thread_once,
+                      ctr_drbg_thread_register_atfork ) != 0 ||
+        ctr_drbg_thread_atfork_ret != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+
+    if( len != 0 )
+    {
+        if( ( ctx->custom = mbedtls_calloc( 1, len ) ) == NULL )
+            return( MBEDTLS_ERR_CTR_DRBG_ALLOC_FAILED );
+
+        memcpy( ctx->custom, custom, len );
+        ctx->custom_len = len;
+    }
+
+    if( pthread_key_create( &ctx->key, ctr_drbg_thread_destroy ) != 0 )
+    {
+        mbedtls_free( ctx->custom );
+        ctx->custom = NULL;
+        ctx->custom_len = 0;
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+    }
+
+    ctx->key_created = 1;
+    ctx->f_entropy = f_entropy;
+    ctx->p_entropy = p_entropy;
+
+    return( 0 );
+}
+
+void mbedtls_ctr_drbg_thread_set_reseed_interval( mbedtls_ctr_drbg_thread_context *ctx,
+                                                  int interval )
+{
+    ctx->reseed_interval = interval;
+}
+
+void mbedtls_ctr_drbg_thread_set_prediction_resistance( mbedtls_ctr_drbg_thread_context *ctx,
+                                                        int resistance )
+{
+    ctx->prediction_resistance = resistance;
+}
+
+void mbedtls_ctr_drbg_thread_set_buffer_size( mbedtls_ctr_drbg_thread_context *ctx,
+                                              size_t size )
+{
+    ctx->buffer_size = size;
+}
+
+/*
+ * Create, seed and register the instance of the calling thread
+ */
+static int ctr_drbg_thread_instance_new( mbedtls_ctr_drbg_thread_context *ctx,
+                                         mbedtls_ctr_drbg_thread_instance **out )
+{
+    int ret;
+    size_t n;
+    int interval, resistance;
+    size_t buffer_size;
+    unsigned char custom[MBEDTLS_CTR_DRBG_MAX_SEED_INPUT];
+    mbedtls_ctr_drbg_thread_instance *inst;
+
+    if( ( inst = mbedtls_calloc( 1, sizeof( *inst ) ) ) == NULL )
+        return( MBEDTLS_ERR_CTR_DRBG_ALLOC_FAILED );
+
+    mbedtls_ctr_drbg_init( &inst->drbg );
+    inst->ctx = ctx;
+
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+    {
+        ctr_drbg_thread_instance_free( inst );
+        return( ret );
+    }
+
+    n = ctx->instances++;
+    interval = ctx->reseed_interval;
+    resistance = ctx->prediction_resistance;
+    buffer_size = ctx->buffer_size;
+
+    if( ( ret = mbedtls_mutex_unlock( &ctx->mutex ) ) != 0 )
+    {
+        ctr_drbg_thread_instance_free( inst );
+        return( ret );
+    }
+
+    /* Prediction resistance means reseeding for each request: no buffer */
+    if( buffer_size != 0 && resistance == MBEDTLS_CTR_DRBG_PR_OFF )
+    {
+        if( ( inst->buf = mbedtls_calloc( 1, buffer_size ) ) == NULL )
+        {
+            ctr_drbg_thread_instance_free( inst );
+            return( MBEDTLS_ERR_CTR_DRBG_ALLOC_FAILED );
+        }
+
+        inst->buf_len = buffer_size;
+        inst->buf_pos = buffer_size;
+    }
+
+    /* Personalize each instance with its serial number */
+    if( ctx->custom_len != 0 )
+        memcpy( custom, ctx->custom, ctx->custom_len );
+    custom[ctx->custom_len    ] = (unsigned char)( (uint64_t) n >> 56 );
+    custom[ctx->custom_len + 1] = (unsigned char)( (uint64_t) n >> 48 );
+    custom[ctx->custom_len + 2] = (unsigned char)( (uint64_t) n >> 40 );
+    custom[ctx->custom_len + 3] = (unsigned char)( (uint64_t) n >> 32 );
+    custom[ctx->custom_len + 4] = (unsigned char)( n >> 24 );
+    custom[ctx->custom_len + 5] = (unsigned char)( n >> 16 );
+    custom[ctx->custom_len + 6] = (unsigned char)( n >>  8 );
+    custom[ctx->custom_len + 7] = (unsigned char)( n       );
+
+    /* Seeding calls the entropy source, so it is done outside the mutex */
+    inst->forks = ctr_drbg_thread_forks;
+    ret = mbedtls_ctr_drbg_seed( &inst->drbg, ctx->f_entropy, ctx->p_entropy,
+                                 custom, ctx->custom_len + 8 );
+    mbedtls_platform_zeroize( custom, sizeof( custom ) );
+    if( ret != 0 )
+    {
+        ctr_drbg_thread_instance_free( inst );
+        return( ret );
+    }
+
+    mbedtls_ctr_drbg_set_reseed_interval( &inst->drbg, interval );
+    mbedtls_ctr_drbg_set_prediction_resistance( &inst->drbg, resistance );
+
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+    {
+        ctr_drbg_thread_instance_free( inst );
+        return( ret );
+    }
+
+    inst->next = ctx->list;
+    ctx->list = inst;
+
+    if( pthread_setspecific( ctx->key, inst ) != 0 )
+    {
+        ctx->list = inst->next;
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 && ret == 0 )
+    {
+        /* Registered, so it will be freed with the thread or the context */
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+    }
+
+    if( ret != 0 )
+    {
+        ctr_drbg_thread_instance_free( inst );
+        return( ret );
+    }
+
+    *out = inst;
+
+    return( 0 );
+}
+
+/*
+ * Wipe the unused part of the buffer of an instance
+ */
+static void ctr_drbg_thread_discard( mbedtls_ctr_drbg_thread_instance *inst )
+{
+    if( inst->buf == NULL )
+        return;
+
+    mbedtls_platform_zeroize( inst->buf + inst->buf_pos,
+                              inst->buf_len - inst->buf_pos );
+    inst->buf_pos = inst->buf_len;
+}
+
+/*
+ * Fill the buffer of an instance, keeping only output generated since the
+ * last reseed
+ */
+static int ctr_drbg_thread_refill( mbedtls_ctr_drbg_thread_instance *inst )
+{
+    int ret, reseed_counter;
+    size_t off, use_len;
+
+    for( off = 0; off < inst->buf_len; off += use_len )
+    {
+        use_len = inst->buf_len - off;
+        if( use_len > MBEDTLS_CTR_DRBG_MAX_REQUEST )
+            use_len = MBEDTLS_CTR_DRBG_MAX_REQUEST;
+
+        reseed_counter = inst->drbg.reseed_counter;
+        if( ( ret = mbedtls_ctr_drbg_random_with_add( &inst->drbg,
+                                                      inst->buf + off, use_len,
+                                                      NULL, 0 ) ) != 0 )
+        {
+            mbedtls_platform_zeroize( inst->buf, off + use_len );
+            return( ret );
+        }
+
+        /* Reseeded after the first chunk: keep the last one only */
+        if( off != 0 && inst->drbg.reseed_counter != reseed_counter + 1 )
+        {
+            memmove( inst->buf + inst->buf_len - use_len, inst->buf + off,
+                     use_len );
+            mbedtls_platform_zeroize( inst->buf, inst->buf_len - use_len );
+            inst->buf_pos = inst->buf_len - use_len;
+            return( 0 );
+        }
+    }
+
+    inst->buf_pos = 0;
+
+    return( 0 );
+}
+
+static int ctr_drbg_thread_buffered( mbedtls_ctr_drbg_thread_instance *inst,
+                                     unsigned char *output, size_t output_len )
+{
+    int ret;
+    size_t use_len;
+
+    while( output_len > 0 )
+    {
+        if( inst->buf_pos == inst->buf_len &&
+            ( ret = ctr_drbg_thread_refill( inst ) ) != 0 )
+            return( ret );
+
+        use_len = inst->buf_len - inst->buf_pos;
+        if( use_len > output_len )
+            use_len = output_len;
+
+        memcpy( output, inst->buf + inst->buf_pos, use_len );
+        mbedtls_platform_zeroize( inst->buf + inst->buf_pos, use_len );
+
+        inst->buf_pos += use_len;
+        output += use_len;
+        output_len -= use_len;
+    }
+
+    return( 0 );
+}
+
+int mbedtls_ctr_drbg_thread_random( void *p_rng,
+                                    unsigned char *output, size_t output_len )
+{
+    int ret, reseed_counter;
+    mbedtls_ctr_drbg_thread_context *ctx = p_rng;
+    mbedtls_ctr_drbg_thread_instance *inst;
+    unsigned long forks;
+
+    if( ctx->key_created == 0 )
+        return( MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED );
+
+    inst = pthread_getspecific( ctx->key );
+    if( inst == NULL &&
+        ( ret = ctr_drbg_thread_instance_new( ctx, &inst ) ) != 0 )
+        return( ret );
+
+    /* Never let a forked child replay the output of its parent */
+    forks = ctr_drbg_thread_forks;
+    if( inst->forks != forks )
+    {
+        ctr_drbg_thread_discard( inst );
+
+        if( ( ret = mbedtls_ctr_drbg_reseed( &inst->drbg, NULL, 0 ) ) != 0 )
+            return( ret );
+
+        inst->forks = forks;
+    }
+
+    if( inst->buf != NULL && output_len <= MBEDTLS_CTR_DRBG_THREAD_BUFFERED_MAX )
+        return( ctr_drbg_thread_buffered( inst, output, output_len ) );
+
+    /* The instance is only used by this thread: no need for its mutex */
+    reseed_counter = inst->drbg.reseed_counter;
+    ret = mbedtls_ctr_drbg_random_with_add( &inst->drbg, output, output_len,
+                                            NULL, 0 );
+
+    if( ret == 0 && inst->drbg.reseed_counter != reseed_counter + 1 )
+        ctr_drbg_thread_discard( inst );
+
+    return( ret );
+}
+
+void mbedtls_ctr_drbg_thread_free( mbedtls_ctr_drbg_thread_context *ctx )
+{
+    mbedtls_ctr_drbg_thread_instance *inst;
+
+    if( ctx == NULL )
+        return;
+
+    /* Deleting the key first keeps exiting threads away from the list */
+    if( ctx->key_created )
+        pthread_key_delete( ctx->key );
+
+    while( ( inst = ctx->list ) != NULL )
+    {
+        ctx->list = inst->next;
+        ctr_drbg_thread_instance_free( inst );
+    }
+
+    if( ctx->custom != NULL )
+    {
+        mbedtls_platform_zeroize( ctx->custom, ctx->custom_len );
+        mbedtls_free( ctx->custom );
+    }
+
+    mbedtls_mutex_free( &ctx->mutex );
+
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_ctr_drbg_thread_context ) );
+}
+
+#endif /* MBEDTLS_CTR_DRBG_THREAD_C */
@@ -389,6 +389,10 @@ int mbedtls_dhm_calc_secret( mbedtls_dhm_context *ctx,
 
     mbedtls_mpi_init( &GYb );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mbedtls_mpi_scratch_push();
+#endif
+
     /* Blind peer's value */
     if( f_rng != NULL )
     {
@@ -417,6 +421,17 @@ int mbedtls_dhm_calc_secret( mbedtls_dhm_context *ctx,
 cleanup:
     mbedtls_mpi_free( &GYb );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    if( mbedtls_mpi_scratch_pop() != 0 )
+    {
+        /* The blinding values may have been lost: draw new ones */
+        mbedtls_mpi_free( &ctx->pX );
+        mbedtls_mpi_free( &ctx->Vi );
+        mbedtls_mpi_free( &ctx->Vf );
+        ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+    }
+#endif
+
     if( ret != 0 )
         return( MBEDTLS_ERR_DHM_CALC_SECRET_FAILED + ret );
 
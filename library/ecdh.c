@@ -54,6 +54,10 @@ static int ecdh_gen_public_restartable( mbedtls_ecp_group *grp,
 {
     int ret;
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mbedtls_mpi_scratch_push();
+#endif
+
     /* If multiplication is in progress, we already generated a privkey */
 #if defined(MBEDTLS_ECP_RESTARTABLE)
     if( rs_ctx == NULL || rs_ctx->rsm == NULL )
@@ -64,6 +68,14 @@ static int ecdh_gen_public_restartable( mbedtls_ecp_group *grp,
                                                   f_rng, p_rng, rs_ctx ) );
 
 cleanup:
+#if defined(MBEDTLS_MPI_SCRATCH)
+    if( mbedtls_mpi_scratch_pop() != 0 )
+    {
+        mbedtls_ecp_scratch_discard( grp, rs_ctx );
+        ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+    }
+#endif
+
     return( ret );
 }
 
@@ -94,6 +106,10 @@ static int ecdh_compute_shared_restartable( mbedtls_ecp_group *grp,
 
     mbedtls_ecp_point_init( &P );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mbedtls_mpi_scratch_push();
+#endif
+
     MBEDTLS_MPI_CHK( mbedtls_ecp_mul_restartable( grp, &P, d, Q,
                                                   f_rng, p_rng, rs_ctx ) );
 
@@ -108,6 +124,14 @@ static int ecdh_compute_shared_restartable( mbedtls_ecp_group *grp,
 cleanup:
     mbedtls_ecp_point_free( &P );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    if( mbedtls_mpi_scratch_pop() != 0 )
+    {
+        mbedtls_ecp_scratch_discard( grp, rs_ctx );
+        ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+    }
+#endif
+
     return( ret );
 }
 
@@ -267,6 +267,10 @@ static int ecdsa_sign_restartable( mbedtls_ecp_group *grp,
 
     ECDSA_RS_ENTER( sig );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mbedtls_mpi_scratch_push();
+#endif
+
 #if defined(MBEDTLS_ECP_RESTARTABLE)
     if( rs_ctx != NULL && rs_ctx->sig != NULL )
     {
@@ -365,6 +369,14 @@ cleanup:
     mbedtls_ecp_point_free( &R );
     mbedtls_mpi_free( &k ); mbedtls_mpi_free( &e ); mbedtls_mpi_free( &t );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    if( mbedtls_mpi_scratch_pop() != 0 )
+    {
+        mbedtls_ecp_scratch_discard( grp, ECDSA_RS_ECP );
+        ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+    }
+#endif
+
     ECDSA_RS_LEAVE( sig );
 
     return( ret );
@@ -486,6 +498,10 @@ static int ecdsa_verify_restartable( mbedtls_ecp_group *grp,
 
     ECDSA_RS_ENTER( ver );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mbedtls_mpi_scratch_push();
+#endif
+
 #if defined(MBEDTLS_ECP_RESTARTABLE)
     if( rs_ctx != NULL && rs_ctx->ver != NULL )
     {
@@ -565,6 +581,14 @@ cleanup:
     mbedtls_mpi_free( &e ); mbedtls_mpi_free( &s_inv );
     mbedtls_mpi_free( &u1 ); mbedtls_mpi_free( &u2 );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    if( mbedtls_mpi_scratch_pop() != 0 )
+    {
+        mbedtls_ecp_scratch_discard( grp, ECDSA_RS_ECP );
+        ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+    }
+#endif
+
     ECDSA_RS_LEAVE( ver );
 
     return( ret );
@@ -585,6 +585,42 @@ void mbedtls_ecp_group_free( mbedtls_ecp_group *grp )
     mbedtls_platform_zeroize( grp, sizeof( mbedtls_ecp_group ) );
 }
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+/*
+ * Discard the values that outlive an operation
+ */
+void mbedtls_ecp_scratch_discard( mbedtls_ecp_group *grp,
+                                  mbedtls_ecp_restart_ctx *rs_ctx )
+{
+    size_t i;
+
+    if( grp->T != NULL )
+    {
+        for( i = 0; i < grp->T_size; i++ )
+            mbedtls_ecp_point_free( &grp->T[i] );
+        mbedtls_free( grp->T );
+
+        grp->T = NULL;
+        grp->T_size = 0;
+    }
+
+#if defined(MBEDTLS_ECP_RESTARTABLE)
+    if( rs_ctx != NULL )
+    {
+        ecp_restart_rsm_free( rs_ctx->rsm );
+        mbedtls_free( rs_ctx->rsm );
+        rs_ctx->rsm = NULL;
+
+        ecp_restart_ma_free( rs_ctx->ma );
+        mbedtls_free( rs_ctx->ma );
+        rs_ctx->ma = NULL;
+    }
+#else
+    (void) rs_ctx;
+#endif
+}
+#endif /* MBEDTLS_MPI_SCRATCH */
+
 /*
  * Unallocate (the components of) a key pair
  */
@@ -19,6 +19,16 @@
  *  This file is part of mbed TLS (https://tls.mbed.org)
  */
 
+/*
+ * Ensure clock_gettime() is available even with -std=c99; must be defined
+ * before config.h, which pulls in glibc's features.h. Builds that select
+ * their own feature macros are left alone.
+ */
+#if !defined(_POSIX_C_SOURCE) && !defined(_XOPEN_SOURCE) && \
+    !defined(_GNU_SOURCE) && !defined(_DEFAULT_SOURCE) && !defined(_BSD_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #if !defined(MBEDTLS_CONFIG_FILE)
 #include "mbedtls/config.h"
 #else
@@ -47,6 +57,11 @@
 #include "mbedtls/platform.h"
 #endif
 
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #if defined(MBEDTLS_SELF_TEST)
 #if defined(MBEDTLS_PLATFORM_C)
 #include "mbedtls/platform.h"
@@ -72,6 +87,12 @@ void mbedtls_entropy_init( mbedtls_entropy_context *ctx )
 #endif
 
     ctx->accumulator_started = 0;
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+    ctx->bg_running = 0;
+    ctx->bg_ready_count = 0;
+    memset( &ctx->bg_stats, 0, sizeof( ctx->bg_stats ) );
+    ctx->bg_next = NULL;
+#endif
 #if defined(MBEDTLS_ENTROPY_SHA512_ACCUMULATOR)
     mbedtls_sha512_init( &ctx->accumulator );
 #else
@@ -121,6 +142,9 @@ void mbedtls_entropy_init( mbedtls_entropy_context *ctx )
 
 void mbedtls_entropy_free( mbedtls_entropy_context *ctx )
 {
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+    mbedtls_entropy_background_stop( ctx );
+#endif
 #if defined(MBEDTLS_HAVEGE_C)
     mbedtls_havege_free( &ctx->havege_data );
 #endif
@@ -323,27 +347,15 @@ int mbedtls_entropy_gather( mbedtls_entropy_context *ctx )
     return( ret );
 }
 
-int mbedtls_entropy_func( void *data, unsigned char *output, size_t len )
+/*
+ * Gather entropy until the thresholds are met and extract a block
+ */
+static int entropy_func_internal( mbedtls_entropy_context *ctx,
+                                  unsigned char *output, size_t len )
 {
     int ret, count = 0, i, done;
-    mbedtls_entropy_context *ctx = (mbedtls_entropy_context *) data;
     unsigned char buf[MBEDTLS_ENTROPY_BLOCK_SIZE];
 
-    if( len > MBEDTLS_ENTROPY_BLOCK_SIZE )
-        return( MBEDTLS_ERR_ENTROPY_SOURCE_FAILED );
-
-#if defined(MBEDTLS_ENTROPY_NV_SEED)
-    /* Update the NV entropy seed before generating any entropy for outside
-     * use.
-     */
-    if( ctx->initial_entropy_run == 0 )
-    {
-        ctx->initial_entropy_run = 1;
-        if( ( ret = mbedtls_entropy_update_nv_seed( ctx ) ) != 0 )
-            return( ret );
-    }
-#endif
-
 #if defined(MBEDTLS_THREADING_C)
     if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
         return( ret );
@@ -439,6 +451,287 @@ exit:
     return( ret );
 }
 
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+/*
+ * The background thread fills the ready pool with blocks extracted as by
+ * entropy_func_internal(), and waits on bg_cond while the pool is full.
+ * Consumers take the last block, and signal bg_cond to have it replaced.
+ *
+ * Contexts with a running thread are listed so that fork() handlers can
+ * hold their mutexes across fork(): otherwise a child forked while the
+ * thread polls the sources would inherit ctx->mutex locked for good.
+ */
+static pthread_once_t entropy_background_once = PTHREAD_ONCE_INIT;
+static int entropy_background_atfork_ret;
+static pthread_mutex_t entropy_background_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static mbedtls_entropy_context *entropy_background_list;
+
+static void entropy_background_fork_prepare( void )
+{
+    mbedtls_entropy_context *ctx;
+
+    pthread_mutex_lock( &entropy_background_list_mutex );
+
+    for( ctx = entropy_background_list; ctx != NULL; ctx = ctx->bg_next )
+    {
+        mbedtls_mutex_lock( &ctx->mutex );
+        pthread_mutex_lock( &ctx->bg_mutex );
+    }
+}
+
+static void entropy_background_fork_done( void )
+{
+    mbedtls_entropy_context *ctx;
+
+    for( ctx = entropy_background_list; ctx != NULL; ctx = ctx->bg_next )
+    {
+        pthread_mutex_unlock( &ctx->bg_mutex );
+        mbedtls_mutex_unlock( &ctx->mutex );
+    }
+
+    pthread_mutex_unlock( &entropy_background_list_mutex );
+}
+
+static void entropy_background_register_atfork( void )
+{
+    entropy_background_atfork_ret =
+        pthread_atfork( entropy_background_fork_prepare,
+                        entropy_background_fork_done,
+                        entropy_background_fork_done );
+}
+
+static void entropy_background_unlist( mbedtls_entropy_context *ctx )
+{
+    mbedtls_entropy_context **prv;
+
+    pthread_mutex_lock( &entropy_background_list_mutex );
+
+    for( prv = &entropy_background_list; *prv != NULL; prv = &(*prv)->bg_next )
+    {
+        if( *prv == ctx )
+        {
+            *prv = ctx->bg_next;
+            break;
+        }
+    }
+
+    ctx->bg_next = NULL;
+
+    pthread_mutex_unlock( &entropy_background_list_mutex );
+}
+
+static void *entropy_background_main( void *arg )
+{
+    mbedtls_entropy_context *ctx = (mbedtls_entropy_context *) arg;
+    unsigned char block[MBEDTLS_ENTROPY_BLOCK_SIZE];
+    int ret = 0;
+
+    pthread_mutex_lock( &ctx->bg_mutex );
+
+    while( ctx->bg_stop == 0 )
+    {
+        if( ctx->bg_ready_count == MBEDTLS_ENTROPY_BACKGROUND_BLOCKS )
+        {
+            pthread_cond_wait( &ctx->bg_cond, &ctx->bg_mutex );
+            continue;
+        }
+
+        pthread_mutex_unlock( &ctx->bg_mutex );
+        ret = entropy_func_internal( ctx, block, sizeof( block ) );
+        pthread_mutex_lock( &ctx->bg_mutex );
+
+        /* On failure, leave it to consumers to gather and report errors */
+        if( ret != 0 )
+            break;
+
+        memcpy( ctx->bg_ready[ctx->bg_ready_count++], block, sizeof( block ) );
+    }
+
+    pthread_mutex_unlock( &ctx->bg_mutex );
+
+    mbedtls_platform_zeroize( block, sizeof( block ) );
+
+    return( NULL );
+}
+
+static uint64_t entropy_background_usec( void )
+{
+    struct timespec ts;
+
+    if( clock_gettime( CLOCK_MONOTONIC, &ts ) != 0 )
+        return( 0 );
+
+    return( (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+/*
+ * Take a ready block, or gather entropy now if there is none
+ */
+static int entropy_background_take( mbedtls_entropy_context *ctx,
+                                    unsigned char *output, size_t len )
+{
+    int ret;
+    uint64_t start;
+    unsigned char *block;
+
+    /* In a forked child, the thread is gone */
+    if( ctx->bg_pid != (long) getpid() )
+    {
+        mbedtls_platform_zeroize( ctx->bg_ready, sizeof( ctx->bg_ready ) );
+        ctx->bg_ready_count = 0;
+        ctx->bg_running = 0;
+        entropy_background_unlist( ctx );
+        return( entropy_func_internal( ctx, output, len ) );
+    }
+
+    if( pthread_mutex_lock( &ctx->bg_mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+
+    if( ctx->bg_ready_count > 0 )
+    {
+        block = ctx->bg_ready[--ctx->bg_ready_count];
+        memcpy( output, block, len );
+        mbedtls_platform_zeroize( block, MBEDTLS_ENTROPY_BLOCK_SIZE );
+        ctx->bg_stats.served++;
+
+        pthread_cond_signal( &ctx->bg_cond );
+        pthread_mutex_unlock( &ctx->bg_mutex );
+
+        return( 0 );
+    }
+
+    ctx->bg_stats.stalls++;
+    pthread_mutex_unlock( &ctx->bg_mutex );
+
+    start = entropy_background_usec();
+    ret = entropy_func_internal( ctx, output, len );
+
+    pthread_mutex_lock( &ctx->bg_mutex );
+    ctx->bg_stats.stall_usec += entropy_background_usec() - start;
+    pthread_mutex_unlock( &ctx->bg_mutex );
+
+    return( ret );
+}
+
+int mbedtls_entropy_background_start( mbedtls_entropy_context *ctx )
+{
+    if( ctx->bg_running )
+        return( 0 );
+
+    if( pthread_once( &entropy_background_once,
+                      entropy_background_register_atfork ) != 0 ||
+        entropy_background_atfork_ret != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+
+    if( pthread_mutex_init( &ctx->bg_mutex, NULL ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+
+    if( pthread_cond_init( &ctx->bg_cond, NULL ) != 0 )
+    {
+        pthread_mutex_destroy( &ctx->bg_mutex );
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+    }
+
+    ctx->bg_stop = 0;
+    ctx->bg_ready_count = 0;
+    ctx->bg_pid = (long) getpid();
+    memset( &ctx->bg_stats, 0, sizeof( ctx->bg_stats ) );
+
+    /* Listed before the thread can lock anything */
+    pthread_mutex_lock( &entropy_background_list_mutex );
+    ctx->bg_next = entropy_background_list;
+    entropy_background_list = ctx;
+    pthread_mutex_unlock( &entropy_background_list_mutex );
+
+    if( pthread_create( &ctx->bg_thread, NULL,
+                        entropy_background_main, ctx ) != 0 )
+    {
+        entropy_background_unlist( ctx );
+        pthread_cond_destroy( &ctx->bg_cond );
+        pthread_mutex_destroy( &ctx->bg_mutex );
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+    }
+
+    ctx->bg_running = 1;
+
+    return( 0 );
+}
+
+void mbedtls_entropy_background_stop( mbedtls_entropy_context *ctx )
+{
+    if( ctx->bg_running == 0 )
+        return;
+
+    ctx->bg_running = 0;
+
+    /* A forked child only has a copy of the thread's state to wipe */
+    if( ctx->bg_pid == (long) getpid() )
+    {
+        pthread_mutex_lock( &ctx->bg_mutex );
+        ctx->bg_stop = 1;
+        pthread_cond_signal( &ctx->bg_cond );
+        pthread_mutex_unlock( &ctx->bg_mutex );
+
+        pthread_join( ctx->bg_thread, NULL );
+
+        pthread_cond_destroy( &ctx->bg_cond );
+        pthread_mutex_destroy( &ctx->bg_mutex );
+    }
+
+    entropy_background_unlist( ctx );
+
+    mbedtls_platform_zeroize( ctx->bg_ready, sizeof( ctx->bg_ready ) );
+    ctx->bg_ready_count = 0;
+}
+
+void mbedtls_entropy_background_get_stats( mbedtls_entropy_context *ctx,
+                                           mbedtls_entropy_background_stats *stats )
+{
+    if( ctx->bg_running == 0 || ctx->bg_pid != (long) getpid() ||
+        pthread_mutex_lock( &ctx->bg_mutex ) != 0 )
+    {
+        memcpy( stats, &ctx->bg_stats, sizeof( *stats ) );
+        stats->ready = 0;
+        return;
+    }
+
+    memcpy( stats, &ctx->bg_stats, sizeof( *stats ) );
+    stats->ready = ctx->bg_ready_count;
+
+    pthread_mutex_unlock( &ctx->bg_mutex );
+}
+#endif /* MBEDTLS_ENTROPY_BACKGROUND */
+
+int mbedtls_entropy_func( void *data, unsigned char *output, size_t len )
+{
+    mbedtls_entropy_context *ctx = (mbedtls_entropy_context *) data;
+#if defined(MBEDTLS_ENTROPY_NV_SEED)
+    int ret;
+#endif
+
+    if( len > MBEDTLS_ENTROPY_BLOCK_SIZE )
+        return( MBEDTLS_ERR_ENTROPY_SOURCE_FAILED );
+
+#if defined(MBEDTLS_ENTROPY_NV_SEED)
+    /* Update the NV entropy seed before generating any entropy for outside
+     * use.
+     */
+    if( ctx->initial_entropy_run == 0 )
+    {
+        ctx->initial_entropy_run = 1;
+        if( ( ret = mbedtls_entropy_update_nv_seed( ctx ) ) != 0 )
+            return( ret );
+    }
+#endif
+
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+    if( ctx->bg_running )
+        return( entropy_background_take( ctx, output, len ) );
+#endif
+
+    return( entropy_func_internal( ctx, output, len ) );
+}
+
 #if defined(MBEDTLS_ENTROPY_NV_SEED)
 int mbedtls_entropy_update_nv_seed( mbedtls_entropy_context *ctx )
 {
@@ -728,6 +728,8 @@ void mbedtls_strerror( int ret, char *buf, size_t buflen )
         mbedtls_snprintf( buf, buflen, "CTR_DRBG - The input (entropy + additional data) is too large" );
     if( use_ret == -(MBEDTLS_ERR_CTR_DRBG_FILE_IO_ERROR) )
         mbedtls_snprintf( buf, buflen, "CTR_DRBG - Read or write error in file" );
+    if( use_ret == -(MBEDTLS_ERR_CTR_DRBG_ALLOC_FAILED) )
+        mbedtls_snprintf( buf, buflen, "CTR_DRBG - Failed to allocate memory" );
 #endif /* MBEDTLS_CTR_DRBG_C */
 
 #if defined(MBEDTLS_DES_C)
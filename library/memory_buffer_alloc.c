@@ -43,6 +43,32 @@
 #include "mbedtls/threading.h"
 #endif
 
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+#include <stdint.h>
+#endif
+
+/*
+ * With MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS, free blocks are kept in one list
+ * per power of two of their size, with a bitmap of the non-empty lists, so
+ * that a fitting block is found without walking every free block. With
+ * pthreads, the buffer is also split into arenas, each with its own block
+ * chain and mutex. Each thread is assigned an arena on its first allocation
+ * and falls back to the other arenas when its own is full. Blocks are
+ * returned to the arena they belong to, found from their address.
+ */
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+#define MEMORY_CLASSES  32
+#if defined(MBEDTLS_THREADING_PTHREAD)
+#include <pthread.h>
+#define MEMORY_THREAD_ARENAS
+#define MEMORY_ARENAS   MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS_MAX
+#endif
+#endif /* MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS */
+
+#if !defined(MEMORY_ARENAS)
+#define MEMORY_ARENAS   1
+#endif
+
 #define MAGIC1       0xFF00AA55
 #define MAGIC2       0xEE119966
 #define MAX_BT 20
@@ -69,7 +95,25 @@ typedef struct
     unsigned char   *buf;
     size_t          len;
     memory_header   *first;
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    memory_header   *free_lists[MEMORY_CLASSES];
+    uint32_t        free_map;
+#else
     memory_header   *first_free;
+#endif
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t   mutex;
+#endif
+}
+buffer_alloc_arena;
+
+typedef struct
+{
+    unsigned char   *buf;
+    size_t          len;
+    buffer_alloc_arena arenas[MEMORY_ARENAS];
+    size_t          arena_count;
+    size_t          arena_len;
     int             verify;
 #if defined(MBEDTLS_MEMORY_DEBUG)
     size_t          alloc_count;
@@ -79,14 +123,134 @@ typedef struct
     size_t          header_count;
     size_t          maximum_header_count;
 #endif
-#if defined(MBEDTLS_THREADING_C)
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS) && defined(MBEDTLS_THREADING_C)
     mbedtls_threading_mutex_t   mutex;
 #endif
+#if defined(MEMORY_THREAD_ARENAS)
+    pthread_key_t   key;
+    int             key_created;
+    size_t          next_arena;
+#endif
 }
 buffer_alloc_ctx;
 
 static buffer_alloc_ctx heap;
 
+/*
+ * The statistics are shared by all arenas, so they need a lock of their own
+ * when there is more than one.
+ */
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS) && defined(MBEDTLS_THREADING_C)
+#define MEMORY_STATS_LOCK()     (void) mbedtls_mutex_lock( &heap.mutex )
+#define MEMORY_STATS_UNLOCK()   (void) mbedtls_mutex_unlock( &heap.mutex )
+#else
+#define MEMORY_STATS_LOCK()
+#define MEMORY_STATS_UNLOCK()
+#endif
+
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+static size_t memory_size_class( size_t size )
+{
+    size_t c = 0;
+
+    while( size > 1 && c < MEMORY_CLASSES - 1 )
+    {
+        size >>= 1;
+        c++;
+    }
+
+    return( c );
+}
+#endif /* MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS */
+
+/*
+ * Free list a free block of the given size belongs to
+ */
+static memory_header **free_list_head( buffer_alloc_arena *arena, size_t size )
+{
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    return( &arena->free_lists[memory_size_class( size )] );
+#else
+    (void) size;
+    return( &arena->first_free );
+#endif
+}
+
+static void free_list_insert( buffer_alloc_arena *arena, memory_header *hdr )
+{
+    memory_header **head = free_list_head( arena, hdr->size );
+
+    hdr->prev_free = NULL;
+    hdr->next_free = *head;
+    if( *head != NULL )
+        (*head)->prev_free = hdr;
+    *head = hdr;
+
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    arena->free_map |= (uint32_t) 1 << memory_size_class( hdr->size );
+#endif
+}
+
+static void free_list_remove( buffer_alloc_arena *arena, memory_header *hdr )
+{
+    memory_header **head = free_list_head( arena, hdr->size );
+
+    if( hdr->prev_free != NULL )
+        hdr->prev_free->next_free = hdr->next_free;
+    else
+        *head = hdr->next_free;
+
+    if( hdr->next_free != NULL )
+        hdr->next_free->prev_free = hdr->prev_free;
+
+    hdr->prev_free = NULL;
+    hdr->next_free = NULL;
+
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    if( *head == NULL )
+        arena->free_map &= ~( (uint32_t) 1 << memory_size_class( hdr->size ) );
+#endif
+}
+
+/*
+ * Find a free block of at least len bytes
+ */
+static memory_header *free_list_find( buffer_alloc_arena *arena, size_t len )
+{
+    memory_header *cur;
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    size_t c = memory_size_class( len );
+    uint32_t map;
+
+    /* The first block of the list for len may be large enough */
+    cur = arena->free_lists[c];
+    if( cur != NULL && cur->size >= len )
+        return( cur );
+
+    /* Any block of a larger class is */
+    map = c + 1 < MEMORY_CLASSES ? arena->free_map >> ( c + 1 ) : 0;
+    if( map != 0 )
+    {
+        for( c++; ( map & 1 ) == 0; c++ )
+            map >>= 1;
+
+        return( arena->free_lists[c] );
+    }
+#else
+    cur = arena->first_free;
+#endif
+
+    while( cur != NULL )
+    {
+        if( cur->size >= len )
+            break;
+
+        cur = cur->next_free;
+    }
+
+    return( cur );
+}
+
 #if defined(MBEDTLS_MEMORY_DEBUG)
 static void debug_header( memory_header *hdr )
 {
@@ -109,9 +273,12 @@ static void debug_header( memory_header *hdr )
 #endif
 }
 
-static void debug_chain( void )
+static void debug_chain( buffer_alloc_arena *arena )
 {
-    memory_header *cur = heap.first;
+    memory_header *cur = arena->first;
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    size_t c;
+#endif
 
     mbedtls_fprintf( stderr, "\nBlock list\n" );
     while( cur != NULL )
@@ -121,13 +288,21 @@ static void debug_chain( void )
     }
 
     mbedtls_fprintf( stderr, "Free list\n" );
-    cur = heap.first_free;
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    for( c = 0; c < MEMORY_CLASSES; c++ )
+    {
+        for( cur = arena->free_lists[c]; cur != NULL; cur = cur->next_free )
+            debug_header( cur );
+    }
+#else
+    cur = arena->first_free;
 
     while( cur != NULL )
     {
         debug_header( cur );
         cur = cur->next_free;
     }
+#endif
 }
 #endif /* MBEDTLS_MEMORY_DEBUG */
 
@@ -176,9 +351,9 @@ static int verify_header( memory_header *hdr )
     return( 0 );
 }
 
-static int verify_chain( void )
+static int verify_chain( buffer_alloc_arena *arena )
 {
-    memory_header *prv = heap.first, *cur;
+    memory_header *prv = arena->first, *cur;
 
     if( prv == NULL || verify_header( prv ) != 0 )
     {
@@ -189,7 +364,7 @@ static int verify_chain( void )
         return( 1 );
     }
 
-    if( heap.first->prev != NULL )
+    if( arena->first->prev != NULL )
     {
 #if defined(MBEDTLS_MEMORY_DEBUG)
         mbedtls_fprintf( stderr, "FATAL: verification failed: "
@@ -198,7 +373,7 @@ static int verify_chain( void )
         return( 1 );
     }
 
-    cur = heap.first->next;
+    cur = arena->first->next;
 
     while( cur != NULL )
     {
@@ -227,42 +402,25 @@ static int verify_chain( void )
     return( 0 );
 }
 
-static void *buffer_alloc_calloc( size_t n, size_t size )
+/*
+ * Allocate len bytes, a multiple of MBEDTLS_MEMORY_ALIGN_MULTIPLE, from an
+ * arena. The caller holds the arena mutex and clears the memory.
+ */
+static void *arena_alloc( buffer_alloc_arena *arena, size_t len )
 {
-    memory_header *new, *cur = heap.first_free;
+    memory_header *new, *cur;
     unsigned char *p;
-    void *ret;
-    size_t original_len, len;
+#if defined(MBEDTLS_MEMORY_DEBUG)
+    size_t new_headers = 0;
+#endif
 #if defined(MBEDTLS_MEMORY_BACKTRACE)
     void *trace_buffer[MAX_BT];
     size_t trace_cnt;
 #endif
 
-    if( heap.buf == NULL || heap.first == NULL )
-        return( NULL );
-
-    original_len = len = n * size;
-
-    if( n == 0 || size == 0 || len / n != size )
-        return( NULL );
-    else if( len > (size_t)-MBEDTLS_MEMORY_ALIGN_MULTIPLE )
-        return( NULL );
-
-    if( len % MBEDTLS_MEMORY_ALIGN_MULTIPLE )
-    {
-        len -= len % MBEDTLS_MEMORY_ALIGN_MULTIPLE;
-        len += MBEDTLS_MEMORY_ALIGN_MULTIPLE;
-    }
-
     // Find block that fits
     //
-    while( cur != NULL )
-    {
-        if( cur->size >= len )
-            break;
-
-        cur = cur->next_free;
-    }
+    cur = free_list_find( arena, len );
 
     if( cur == NULL )
         return( NULL );
@@ -276,92 +434,51 @@ static void *buffer_alloc_calloc( size_t n, size_t size )
         mbedtls_exit( 1 );
     }
 
-#if defined(MBEDTLS_MEMORY_DEBUG)
-    heap.alloc_count++;
-#endif
+    free_list_remove( arena, cur );
 
     // Found location, split block if > memory_header + 4 room left
     //
-    if( cur->size - len < sizeof(memory_header) +
-                          MBEDTLS_MEMORY_ALIGN_MULTIPLE )
+    if( cur->size - len >= sizeof(memory_header) +
+                           MBEDTLS_MEMORY_ALIGN_MULTIPLE )
     {
-        cur->alloc = 1;
-
-        // Remove from free_list
-        //
-        if( cur->prev_free != NULL )
-            cur->prev_free->next_free = cur->next_free;
-        else
-            heap.first_free = cur->next_free;
-
-        if( cur->next_free != NULL )
-            cur->next_free->prev_free = cur->prev_free;
+        p = ( (unsigned char *) cur ) + sizeof(memory_header) + len;
+        new = (memory_header *) p;
 
-        cur->prev_free = NULL;
-        cur->next_free = NULL;
-
-#if defined(MBEDTLS_MEMORY_DEBUG)
-        heap.total_used += cur->size;
-        if( heap.total_used > heap.maximum_used )
-            heap.maximum_used = heap.total_used;
-#endif
+        new->size = cur->size - len - sizeof(memory_header);
+        new->alloc = 0;
+        new->prev = cur;
+        new->next = cur->next;
 #if defined(MBEDTLS_MEMORY_BACKTRACE)
-        trace_cnt = backtrace( trace_buffer, MAX_BT );
-        cur->trace = backtrace_symbols( trace_buffer, trace_cnt );
-        cur->trace_count = trace_cnt;
+        new->trace = NULL;
+        new->trace_count = 0;
 #endif
+        new->magic1 = MAGIC1;
+        new->magic2 = MAGIC2;
 
-        if( ( heap.verify & MBEDTLS_MEMORY_VERIFY_ALLOC ) && verify_chain() != 0 )
-            mbedtls_exit( 1 );
-
-        ret = (unsigned char *) cur + sizeof( memory_header );
-        memset( ret, 0, original_len );
-
-        return( ret );
-    }
+        if( new->next != NULL )
+            new->next->prev = new;
 
-    p = ( (unsigned char *) cur ) + sizeof(memory_header) + len;
-    new = (memory_header *) p;
+        free_list_insert( arena, new );
 
-    new->size = cur->size - len - sizeof(memory_header);
-    new->alloc = 0;
-    new->prev = cur;
-    new->next = cur->next;
-#if defined(MBEDTLS_MEMORY_BACKTRACE)
-    new->trace = NULL;
-    new->trace_count = 0;
+        cur->size = len;
+        cur->next = new;
+#if defined(MBEDTLS_MEMORY_DEBUG)
+        new_headers = 1;
 #endif
-    new->magic1 = MAGIC1;
-    new->magic2 = MAGIC2;
-
-    if( new->next != NULL )
-        new->next->prev = new;
-
-    // Replace cur with new in free_list
-    //
-    new->prev_free = cur->prev_free;
-    new->next_free = cur->next_free;
-    if( new->prev_free != NULL )
-        new->prev_free->next_free = new;
-    else
-        heap.first_free = new;
-
-    if( new->next_free != NULL )
-        new->next_free->prev_free = new;
+    }
 
     cur->alloc = 1;
-    cur->size = len;
-    cur->next = new;
-    cur->prev_free = NULL;
-    cur->next_free = NULL;
 
 #if defined(MBEDTLS_MEMORY_DEBUG)
-    heap.header_count++;
+    MEMORY_STATS_LOCK();
+    heap.alloc_count++;
+    heap.header_count += new_headers;
     if( heap.header_count > heap.maximum_header_count )
         heap.maximum_header_count = heap.header_count;
     heap.total_used += cur->size;
     if( heap.total_used > heap.maximum_used )
         heap.maximum_used = heap.total_used;
+    MEMORY_STATS_UNLOCK();
 #endif
 #if defined(MBEDTLS_MEMORY_BACKTRACE)
     trace_cnt = backtrace( trace_buffer, MAX_BT );
@@ -369,34 +486,18 @@ static void *buffer_alloc_calloc( size_t n, size_t size )
     cur->trace_count = trace_cnt;
 #endif
 
-    if( ( heap.verify & MBEDTLS_MEMORY_VERIFY_ALLOC ) && verify_chain() != 0 )
+    if( ( heap.verify & MBEDTLS_MEMORY_VERIFY_ALLOC ) && verify_chain( arena ) != 0 )
         mbedtls_exit( 1 );
 
-    ret = (unsigned char *) cur + sizeof( memory_header );
-    memset( ret, 0, original_len );
-
-    return( ret );
+    return( (unsigned char *) cur + sizeof( memory_header ) );
 }
 
-static void buffer_alloc_free( void *ptr )
+/*
+ * Free a block of an arena. The caller holds the arena mutex.
+ */
+static void arena_free( buffer_alloc_arena *arena, memory_header *hdr )
 {
-    memory_header *hdr, *old = NULL;
-    unsigned char *p = (unsigned char *) ptr;
-
-    if( ptr == NULL || heap.buf == NULL || heap.first == NULL )
-        return;
-
-    if( p < heap.buf || p >= heap.buf + heap.len )
-    {
-#if defined(MBEDTLS_MEMORY_DEBUG)
-        mbedtls_fprintf( stderr, "FATAL: mbedtls_free() outside of managed "
-                                  "space\n" );
-#endif
-        mbedtls_exit( 1 );
-    }
-
-    p -= sizeof(memory_header);
-    hdr = (memory_header *) p;
+    memory_header *old;
 
     if( verify_header( hdr ) != 0 )
         mbedtls_exit( 1 );
@@ -413,8 +514,14 @@ static void buffer_alloc_free( void *ptr )
     hdr->alloc = 0;
 
 #if defined(MBEDTLS_MEMORY_DEBUG)
+    MEMORY_STATS_LOCK();
     heap.free_count++;
     heap.total_used -= hdr->size;
+    if( hdr->prev != NULL && hdr->prev->alloc == 0 )
+        heap.header_count--;
+    if( hdr->next != NULL && hdr->next->alloc == 0 )
+        heap.header_count--;
+    MEMORY_STATS_UNLOCK();
 #endif
 
 #if defined(MBEDTLS_MEMORY_BACKTRACE)
@@ -427,9 +534,8 @@ static void buffer_alloc_free( void *ptr )
     //
     if( hdr->prev != NULL && hdr->prev->alloc == 0 )
     {
-#if defined(MBEDTLS_MEMORY_DEBUG)
-        heap.header_count--;
-#endif
+        free_list_remove( arena, hdr->prev );
+
         hdr->prev->size += sizeof(memory_header) + hdr->size;
         hdr->prev->next = hdr->next;
         old = hdr;
@@ -445,54 +551,135 @@ static void buffer_alloc_free( void *ptr )
     //
     if( hdr->next != NULL && hdr->next->alloc == 0 )
     {
-#if defined(MBEDTLS_MEMORY_DEBUG)
-        heap.header_count--;
-#endif
+        free_list_remove( arena, hdr->next );
+
         hdr->size += sizeof(memory_header) + hdr->next->size;
         old = hdr->next;
         hdr->next = hdr->next->next;
 
-        if( hdr->prev_free != NULL || hdr->next_free != NULL )
-        {
-            if( hdr->prev_free != NULL )
-                hdr->prev_free->next_free = hdr->next_free;
-            else
-                heap.first_free = hdr->next_free;
-
-            if( hdr->next_free != NULL )
-                hdr->next_free->prev_free = hdr->prev_free;
-        }
-
-        hdr->prev_free = old->prev_free;
-        hdr->next_free = old->next_free;
-
-        if( hdr->prev_free != NULL )
-            hdr->prev_free->next_free = hdr;
-        else
-            heap.first_free = hdr;
-
-        if( hdr->next_free != NULL )
-            hdr->next_free->prev_free = hdr;
-
         if( hdr->next != NULL )
             hdr->next->prev = hdr;
 
         memset( old, 0, sizeof(memory_header) );
     }
 
-    // Prepend to free_list if we have not merged
+    // Prepend to free_list
     // (Does not have to stay in same order as prev / next list)
     //
-    if( old == NULL )
+    free_list_insert( arena, hdr );
+
+    if( ( heap.verify & MBEDTLS_MEMORY_VERIFY_FREE ) && verify_chain( arena ) != 0 )
+        mbedtls_exit( 1 );
+}
+
+#if defined(MEMORY_THREAD_ARENAS)
+/*
+ * Arena of the calling thread, assigned in turn on its first allocation.
+ * The thread-specific value is the arena index plus one.
+ */
+static buffer_alloc_arena *buffer_alloc_thread_arena( void )
+{
+    size_t i = (size_t) pthread_getspecific( heap.key );
+
+    if( i == 0 || i > heap.arena_count )
+    {
+        if( mbedtls_mutex_lock( &heap.mutex ) != 0 )
+            return( &heap.arenas[0] );
+        i = heap.next_arena++ % heap.arena_count + 1;
+        (void) mbedtls_mutex_unlock( &heap.mutex );
+
+        (void) pthread_setspecific( heap.key, (void *) i );
+    }
+
+    return( &heap.arenas[i - 1] );
+}
+#endif /* MEMORY_THREAD_ARENAS */
+
+static void *buffer_alloc_calloc( size_t n, size_t size )
+{
+    buffer_alloc_arena *arena;
+    void *ret = NULL;
+    size_t original_len, len, i;
+
+    if( heap.buf == NULL || heap.arena_count == 0 )
+        return( NULL );
+
+    original_len = len = n * size;
+
+    if( n == 0 || size == 0 || len / n != size )
+        return( NULL );
+    else if( len > (size_t)-MBEDTLS_MEMORY_ALIGN_MULTIPLE )
+        return( NULL );
+
+    if( len % MBEDTLS_MEMORY_ALIGN_MULTIPLE )
     {
-        hdr->next_free = heap.first_free;
-        if( heap.first_free != NULL )
-            heap.first_free->prev_free = hdr;
-        heap.first_free = hdr;
+        len -= len % MBEDTLS_MEMORY_ALIGN_MULTIPLE;
+        len += MBEDTLS_MEMORY_ALIGN_MULTIPLE;
     }
 
-    if( ( heap.verify & MBEDTLS_MEMORY_VERIFY_FREE ) && verify_chain() != 0 )
+#if defined(MEMORY_THREAD_ARENAS)
+    arena = buffer_alloc_thread_arena();
+#else
+    arena = &heap.arenas[0];
+#endif
+
+    /* Fall back to the other arenas when the thread's own one is full */
+    for( i = 0; i < heap.arena_count && ret == NULL; i++ )
+    {
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_lock( &arena->mutex ) != 0 )
+            return( NULL );
+#endif
+        ret = arena_alloc( arena, len );
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_unlock( &arena->mutex ) != 0 )
+            return( NULL );
+#endif
+
+        if( ++arena == heap.arenas + heap.arena_count )
+            arena = heap.arenas;
+    }
+
+    if( ret != NULL )
+        memset( ret, 0, original_len );
+
+    return( ret );
+}
+
+static void buffer_alloc_free( void *ptr )
+{
+    buffer_alloc_arena *arena;
+    unsigned char *p = (unsigned char *) ptr;
+    size_t i;
+
+    if( ptr == NULL || heap.buf == NULL || heap.arena_count == 0 )
+        return;
+
+    if( p < heap.buf || p >= heap.buf + heap.len )
+    {
+#if defined(MBEDTLS_MEMORY_DEBUG)
+        mbedtls_fprintf( stderr, "FATAL: mbedtls_free() outside of managed "
+                                  "space\n" );
+#endif
         mbedtls_exit( 1 );
+    }
+
+    /* The last arena also holds the remainder of the buffer */
+    i = (size_t) ( p - heap.buf ) / heap.arena_len;
+    if( i >= heap.arena_count )
+        i = heap.arena_count - 1;
+    arena = &heap.arenas[i];
+
+#if defined(MBEDTLS_THREADING_C)
+    /* We have to good option here, but corrupting the heap seems
+     * worse than loosing memory. */
+    if( mbedtls_mutex_lock( &arena->mutex ) )
+        return;
+#endif
+    arena_free( arena, (memory_header *) ( p - sizeof(memory_header) ) );
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock( &arena->mutex );
+#endif
 }
 
 void mbedtls_memory_buffer_set_verify( int verify )
@@ -502,12 +689,26 @@ void mbedtls_memory_buffer_set_verify( int verify )
 
 int mbedtls_memory_buffer_alloc_verify( void )
 {
-    return verify_chain();
+    size_t i;
+
+    if( heap.arena_count == 0 )
+        return( verify_chain( &heap.arenas[0] ) );
+
+    for( i = 0; i < heap.arena_count; i++ )
+    {
+        if( verify_chain( &heap.arenas[i] ) != 0 )
+            return( 1 );
+    }
+
+    return( 0 );
 }
 
 #if defined(MBEDTLS_MEMORY_DEBUG)
 void mbedtls_memory_buffer_alloc_status( void )
 {
+    size_t i;
+    int all_free = 1;
+
     mbedtls_fprintf( stderr,
                       "Current use: %zu blocks / %zu bytes, max: %zu blocks / "
                       "%zu bytes (total %zu bytes), alloc / free: %zu / %zu\n",
@@ -517,14 +718,21 @@ void mbedtls_memory_buffer_alloc_status( void )
                       + heap.maximum_used,
                       heap.alloc_count, heap.free_count );
 
-    if( heap.first->next == NULL )
+    for( i = 0; i < heap.arena_count; i++ )
+    {
+        if( heap.arenas[i].first->next != NULL )
+            all_free = 0;
+    }
+
+    if( all_free )
     {
         mbedtls_fprintf( stderr, "All memory de-allocated in stack buffer\n" );
     }
     else
     {
         mbedtls_fprintf( stderr, "Memory currently allocated:\n" );
-        debug_chain();
+        for( i = 0; i < heap.arena_count; i++ )
+            debug_chain( &heap.arenas[i] );
     }
 }
 
@@ -547,40 +755,24 @@ void mbedtls_memory_buffer_alloc_cur_get( size_t *cur_used, size_t *cur_blocks )
 }
 #endif /* MBEDTLS_MEMORY_DEBUG */
 
-#if defined(MBEDTLS_THREADING_C)
-static void *buffer_alloc_calloc_mutexed( size_t n, size_t size )
-{
-    void *buf;
-    if( mbedtls_mutex_lock( &heap.mutex ) != 0 )
-        return( NULL );
-    buf = buffer_alloc_calloc( n, size );
-    if( mbedtls_mutex_unlock( &heap.mutex ) )
-        return( NULL );
-    return( buf );
-}
-
-static void buffer_alloc_free_mutexed( void *ptr )
-{
-    /* We have to good option here, but corrupting the heap seems
-     * worse than loosing memory. */
-    if( mbedtls_mutex_lock( &heap.mutex ) )
-        return;
-    buffer_alloc_free( ptr );
-    (void) mbedtls_mutex_unlock( &heap.mutex );
-}
-#endif /* MBEDTLS_THREADING_C */
-
 void mbedtls_memory_buffer_alloc_init( unsigned char *buf, size_t len )
 {
+    buffer_alloc_arena *arena;
+    size_t i;
+
     memset( &heap, 0, sizeof( buffer_alloc_ctx ) );
 
 #if defined(MBEDTLS_THREADING_C)
+    for( i = 0; i < MEMORY_ARENAS; i++ )
+        mbedtls_mutex_init( &heap.arenas[i].mutex );
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
     mbedtls_mutex_init( &heap.mutex );
-    mbedtls_platform_set_calloc_free( buffer_alloc_calloc_mutexed,
-                              buffer_alloc_free_mutexed );
-#else
-    mbedtls_platform_set_calloc_free( buffer_alloc_calloc, buffer_alloc_free );
 #endif
+#endif
+#if defined(MEMORY_THREAD_ARENAS)
+    heap.key_created = ( pthread_key_create( &heap.key, NULL ) == 0 );
+#endif
+    mbedtls_platform_set_calloc_free( buffer_alloc_calloc, buffer_alloc_free );
 
     if( len < sizeof( memory_header ) + MBEDTLS_MEMORY_ALIGN_MULTIPLE )
         return;
@@ -598,17 +790,49 @@ void mbedtls_memory_buffer_alloc_init( unsigned char *buf, size_t len )
     heap.buf = buf;
     heap.len = len;
 
-    heap.first = (memory_header *)buf;
-    heap.first->size = len - sizeof( memory_header );
-    heap.first->magic1 = MAGIC1;
-    heap.first->magic2 = MAGIC2;
-    heap.first_free = heap.first;
+    /* Only split buffers large enough for every arena to be useful */
+    heap.arena_count = 1;
+#if defined(MEMORY_THREAD_ARENAS)
+    if( heap.key_created )
+    {
+        heap.arena_count = MEMORY_ARENAS;
+        while( heap.arena_count > 1 &&
+               len / heap.arena_count < MBEDTLS_MEMORY_BUFFER_ALLOC_ARENA_MIN_SIZE )
+            heap.arena_count--;
+    }
+#endif
+    heap.arena_len = len / heap.arena_count;
+    heap.arena_len -= heap.arena_len % MBEDTLS_MEMORY_ALIGN_MULTIPLE;
+
+    for( i = 0; i < heap.arena_count; i++ )
+    {
+        arena = &heap.arenas[i];
+        arena->buf = buf + i * heap.arena_len;
+        arena->len = i + 1 < heap.arena_count ? heap.arena_len :
+                     len - i * heap.arena_len;
+
+        arena->first = (memory_header *) arena->buf;
+        arena->first->size = arena->len - sizeof( memory_header );
+        arena->first->magic1 = MAGIC1;
+        arena->first->magic2 = MAGIC2;
+        free_list_insert( arena, arena->first );
+    }
 }
 
 void mbedtls_memory_buffer_alloc_free( void )
 {
 #if defined(MBEDTLS_THREADING_C)
+    size_t i;
+
+    for( i = 0; i < MEMORY_ARENAS; i++ )
+        mbedtls_mutex_free( &heap.arenas[i].mutex );
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
     mbedtls_mutex_free( &heap.mutex );
+#endif
+#endif
+#if defined(MEMORY_THREAD_ARENAS)
+    if( heap.key_created )
+        (void) pthread_key_delete( heap.key );
 #endif
     mbedtls_platform_zeroize( &heap, sizeof(buffer_alloc_ctx) );
 }
@@ -627,14 +851,22 @@ static int check_pointer( void *p )
 
 static int check_all_free( void )
 {
-    if(
+    size_t i;
+    buffer_alloc_arena *arena;
+
 #if defined(MBEDTLS_MEMORY_DEBUG)
-        heap.total_used != 0 ||
+    if( heap.total_used != 0 )
+        return( -1 );
 #endif
-        heap.first != heap.first_free ||
-        (void *) heap.first != (void *) heap.buf )
+
+    for( i = 0; i < heap.arena_count; i++ )
     {
-        return( -1 );
+        arena = &heap.arenas[i];
+        if( arena->first->next != NULL || arena->first->alloc != 0 ||
+            (void *) arena->first != (void *) arena->buf )
+        {
+            return( -1 );
+        }
     }
 
     return( 0 );
@@ -232,7 +232,7 @@ int mbedtls_pem_read_buffer( mbedtls_pem_context *ctx, const char *header, const
                      size_t pwdlen, size_t *use_len )
 {
     int ret, enc;
-    size_t len;
+    size_t len, buflen;
     unsigned char *buf;
     const unsigned char *s1, *s2, *end;
 #if defined(MBEDTLS_MD5_C) && defined(MBEDTLS_CIPHER_MODE_CBC) &&         \
@@ -345,17 +345,18 @@ int mbedtls_pem_read_buffer( mbedtls_pem_context *ctx, const char *header, const
     if( s1 >= s2 )
         return( MBEDTLS_ERR_PEM_INVALID_DATA );
 
-    ret = mbedtls_base64_decode( NULL, 0, &len, s1, s2 - s1 );
-
-    if( ret == MBEDTLS_ERR_BASE64_INVALID_CHARACTER )
-        return( MBEDTLS_ERR_PEM_INVALID_DATA + ret );
+    /*
+     * The decoded data is at most 3/4 of the encoded size: allocate that
+     * rather than going through the input once more to get the exact size.
+     */
+    buflen = ( ( s2 - s1 ) / 4 ) * 3 + 3;
 
-    if( ( buf = mbedtls_calloc( 1, len ) ) == NULL )
+    if( ( buf = mbedtls_calloc( 1, buflen ) ) == NULL )
         return( MBEDTLS_ERR_PEM_ALLOC_FAILED );
 
-    if( ( ret = mbedtls_base64_decode( buf, len, &len, s1, s2 - s1 ) ) != 0 )
+    if( ( ret = mbedtls_base64_decode( buf, buflen, &len, s1, s2 - s1 ) ) != 0 )
     {
-        mbedtls_platform_zeroize( buf, len );
+        mbedtls_platform_zeroize( buf, buflen );
         mbedtls_free( buf );
         return( MBEDTLS_ERR_PEM_INVALID_DATA + ret );
     }
@@ -50,6 +50,9 @@
 /* Include internal declarations that are useful for implementing persistently
  * stored keys. */
 #include "psa_crypto_storage.h"
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+#include "psa_crypto_storage_backend.h"
+#endif
 
 #include <stdlib.h>
 #include <string.h>
@@ -850,6 +853,9 @@ psa_status_t psa_destroy_key( psa_key_handle_t handle )
     {
         storage_status =
             psa_destroy_persistent_key( slot->persistent_storage_id );
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+        psa_forget_cached_key( slot->persistent_storage_id );
+#endif
     }
 #endif /* defined(MBEDTLS_PSA_CRYPTO_STORAGE_C) */
     status = psa_wipe_key_slot( slot );
@@ -859,7 +865,7 @@ psa_status_t psa_destroy_key( psa_key_handle_t handle )
 }
 
 /* Return the size of the key in the given slot, in bits. */
-static size_t psa_get_key_bits( const psa_key_slot_t *slot )
+size_t psa_get_key_bits( const psa_key_slot_t *slot )
 {
     if( key_type_is_raw_bytes( slot->type ) )
         return( slot->data.raw.bytes * 8 );
@@ -4350,6 +4356,47 @@ psa_status_t psa_generate_key( psa_key_handle_t handle,
 }
 
 
+/****************************************************************/
+/* Persistent key batches */
+/****************************************************************/
+
+psa_status_t mbedtls_psa_storage_begin_batch( void )
+{
+    if( global_data.initialized == 0 )
+        return( PSA_ERROR_BAD_STATE );
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+    return( psa_crypto_storage_log_begin_batch( ) );
+#else
+    return( PSA_ERROR_NOT_SUPPORTED );
+#endif
+}
+
+psa_status_t mbedtls_psa_storage_commit_batch( void )
+{
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+    psa_status_t status;
+#endif
+
+    if( global_data.initialized == 0 )
+        return( PSA_ERROR_BAD_STATE );
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+    status = psa_crypto_storage_log_commit_batch( );
+
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    /* Keys of the batch may be gone from storage */
+    if( status != PSA_SUCCESS )
+        psa_forget_cached_keys( );
+#endif
+
+    return( status );
+#else
+    return( PSA_ERROR_NOT_SUPPORTED );
+#endif
+}
+
+
 /****************************************************************/
 /* Module setup */
 /****************************************************************/
@@ -4373,6 +4420,9 @@ void mbedtls_psa_crypto_free( void )
         mbedtls_ctr_drbg_free( &global_data.ctr_drbg );
         global_data.entropy_free( &global_data.entropy );
     }
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+    psa_crypto_storage_log_close( );
+#endif
     /* Wipe all remaining data, including configuration.
      * In particular, this sets all state indicator to the value
      * indicating "uninitialized". */
@@ -72,6 +72,9 @@ typedef struct
  */
 psa_status_t psa_wipe_key_slot( psa_key_slot_t *slot );
 
+/** Return the size of the key in the given slot, in bits. */
+size_t psa_get_key_bits( const psa_key_slot_t *slot );
+
 /** Import key data into a slot.
  *
  * `slot->type` must have been set previously.
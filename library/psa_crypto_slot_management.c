@@ -32,6 +32,9 @@
 #include "psa_crypto_core.h"
 #include "psa_crypto_slot_management.h"
 #include "psa_crypto_storage.h"
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+#include "psa_crypto_storage_backend.h"
+#endif
 
 #include <stdlib.h>
 #include <string.h>
@@ -44,9 +47,31 @@
 
 #define ARRAY_LENGTH( array ) ( sizeof( array ) / sizeof( *( array ) ) )
 
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+/* A persistent key that is not open, kept in memory until evicted. Entries
+ * are in a hash table by key identifier, and in a list from the most to the
+ * least recently closed. */
+typedef struct psa_key_cache_entry_s
+{
+    psa_key_slot_t slot;
+    size_t bytes;
+    struct psa_key_cache_entry_s *hash_next;
+    struct psa_key_cache_entry_s *prev;
+    struct psa_key_cache_entry_s *next;
+} psa_key_cache_entry_t;
+
+#define PSA_KEY_CACHE_BUCKET_BITS 8
+#endif /* MBEDTLS_PSA_CRYPTO_KEY_CACHE */
+
 typedef struct
 {
     psa_key_slot_t key_slots[PSA_KEY_SLOT_COUNT];
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    psa_key_cache_entry_t *cache_buckets[1 << PSA_KEY_CACHE_BUCKET_BITS];
+    psa_key_cache_entry_t *cache_head;
+    psa_key_cache_entry_t *cache_tail;
+    mbedtls_psa_key_cache_stats_t cache_stats;
+#endif
     unsigned key_slots_initialized : 1;
 } psa_global_data_t;
 
@@ -87,6 +112,142 @@ psa_status_t psa_initialize_key_slots( void )
     return( PSA_SUCCESS );
 }
 
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+static psa_key_cache_entry_t **psa_key_cache_bucket( psa_key_id_t id )
+{
+    uint32_t hash = (uint32_t) id * 0x9E3779B1u;
+    return( &global_data.cache_buckets[hash >> ( 32 - PSA_KEY_CACHE_BUCKET_BITS )] );
+}
+
+static psa_key_cache_entry_t *psa_key_cache_find( psa_key_id_t id )
+{
+    psa_key_cache_entry_t *entry = *psa_key_cache_bucket( id );
+
+    while( entry != NULL && entry->slot.persistent_storage_id != id )
+        entry = entry->hash_next;
+
+    return( entry );
+}
+
+static void psa_key_cache_unlink( psa_key_cache_entry_t *entry )
+{
+    psa_key_cache_entry_t **p;
+
+    p = psa_key_cache_bucket( entry->slot.persistent_storage_id );
+    while( *p != entry )
+        p = &( *p )->hash_next;
+    *p = entry->hash_next;
+
+    if( entry->prev != NULL )
+        entry->prev->next = entry->next;
+    else
+        global_data.cache_head = entry->next;
+    if( entry->next != NULL )
+        entry->next->prev = entry->prev;
+    else
+        global_data.cache_tail = entry->prev;
+
+    global_data.cache_stats.keys--;
+    global_data.cache_stats.bytes -= entry->bytes;
+}
+
+static void psa_key_cache_drop( psa_key_cache_entry_t *entry )
+{
+    psa_key_cache_unlink( entry );
+    (void) psa_wipe_key_slot( &entry->slot );
+    mbedtls_free( entry );
+}
+
+/** Move a closed persistent key into the cache.
+ *
+ * The slot is left empty, whether or not the key could be cached. */
+static void psa_key_cache_put( psa_key_slot_t *slot )
+{
+    psa_key_cache_entry_t *entry = NULL, **bucket;
+    size_t bytes;
+
+    /* Count the key at its size in export format, which is close to the
+     * memory it uses for most key types */
+    bytes = sizeof( psa_key_cache_entry_t ) +
+            PSA_KEY_EXPORT_MAX_SIZE( slot->type, psa_get_key_bits( slot ) );
+
+    if( bytes <= MBEDTLS_PSA_CRYPTO_KEY_CACHE_SIZE &&
+        psa_key_cache_find( slot->persistent_storage_id ) == NULL )
+        entry = mbedtls_calloc( 1, sizeof( psa_key_cache_entry_t ) );
+
+    if( entry == NULL )
+    {
+        (void) psa_wipe_key_slot( slot );
+        return;
+    }
+
+    entry->slot = *slot;
+    entry->bytes = bytes;
+    memset( slot, 0, sizeof( *slot ) );
+
+    bucket = psa_key_cache_bucket( entry->slot.persistent_storage_id );
+    entry->hash_next = *bucket;
+    *bucket = entry;
+
+    entry->next = global_data.cache_head;
+    if( entry->next != NULL )
+        entry->next->prev = entry;
+    else
+        global_data.cache_tail = entry;
+    global_data.cache_head = entry;
+
+    global_data.cache_stats.keys++;
+    global_data.cache_stats.bytes += bytes;
+
+    while( global_data.cache_stats.bytes > MBEDTLS_PSA_CRYPTO_KEY_CACHE_SIZE )
+    {
+        psa_key_cache_drop( global_data.cache_tail );
+        global_data.cache_stats.evictions++;
+    }
+}
+
+/** Move a persistent key from the cache into a freshly allocated slot.
+ *
+ * \return 1 if the key was in the cache, 0 otherwise. */
+static int psa_key_cache_take( psa_key_id_t id, psa_key_slot_t *slot )
+{
+    psa_key_cache_entry_t *entry = psa_key_cache_find( id );
+
+    if( entry == NULL )
+        return( 0 );
+
+    psa_key_cache_unlink( entry );
+    *slot = entry->slot;
+    slot->allocated = 1;
+    mbedtls_free( entry );
+
+    return( 1 );
+}
+
+void psa_forget_cached_key( psa_key_id_t id )
+{
+    psa_key_cache_entry_t *entry = psa_key_cache_find( id );
+
+    if( entry != NULL )
+        psa_key_cache_drop( entry );
+}
+
+void psa_forget_cached_keys( void )
+{
+    while( global_data.cache_head != NULL )
+        psa_key_cache_drop( global_data.cache_head );
+}
+#endif /* MBEDTLS_PSA_CRYPTO_KEY_CACHE */
+
+void mbedtls_psa_get_key_cache_stats( mbedtls_psa_key_cache_stats_t *stats )
+{
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    *stats = global_data.cache_stats;
+#else
+    memset( stats, 0, sizeof( *stats ) );
+#endif
+}
+
 void psa_wipe_all_key_slots( void )
 {
     psa_key_handle_t key;
@@ -95,6 +256,10 @@ void psa_wipe_all_key_slots( void )
         psa_key_slot_t *slot = &global_data.key_slots[key - 1];
         (void) psa_wipe_key_slot( slot );
     }
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    psa_forget_cached_keys( );
+    memset( &global_data.cache_stats, 0, sizeof( global_data.cache_stats ) );
+#endif
     global_data.key_slots_initialized = 0;
 }
 
@@ -139,6 +304,17 @@ static psa_status_t psa_internal_release_key_slot( psa_key_handle_t handle )
     if( status != PSA_SUCCESS )
         return( status );
 
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    /* The key may have been destroyed through another handle */
+    if( slot->lifetime == PSA_KEY_LIFETIME_PERSISTENT &&
+        slot->type != PSA_KEY_TYPE_NONE &&
+        psa_is_key_present_in_storage( slot->persistent_storage_id ) )
+    {
+        psa_key_cache_put( slot );
+        return( PSA_SUCCESS );
+    }
+#endif /* MBEDTLS_PSA_CRYPTO_KEY_CACHE */
+
     return( psa_wipe_key_slot( slot ) );
 }
 
@@ -160,6 +336,25 @@ static psa_status_t psa_load_persistent_key_into_slot( psa_key_slot_t *p_slot )
     uint8_t *key_data = NULL;
     size_t key_data_length = 0;
 
+#if defined(PSA_CRYPTO_STORAGE_HAS_MAP)
+    const uint8_t *stored_key_data;
+
+    /* Import straight from storage when possible */
+    status = psa_map_persistent_key( p_slot->persistent_storage_id,
+                                     &( p_slot )->type,
+                                     &( p_slot )->policy, &stored_key_data,
+                                     &key_data_length );
+    if( status == PSA_SUCCESS )
+    {
+        status = psa_import_key_into_slot( p_slot,
+                                           stored_key_data, key_data_length );
+        psa_unmap_persistent_key( stored_key_data );
+        return( status );
+    }
+    if( status != PSA_ERROR_NOT_SUPPORTED )
+        return( status );
+#endif /* PSA_CRYPTO_STORAGE_HAS_MAP */
+
     status = psa_load_persistent_key( p_slot->persistent_storage_id,
                                       &( p_slot )->type,
                                       &( p_slot )->policy, &key_data,
@@ -212,10 +407,23 @@ static psa_status_t psa_internal_make_key_persistent( psa_key_handle_t handle,
     if( status != PSA_SUCCESS )
         return( status );
 
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    if( psa_key_cache_take( id, slot ) )
+    {
+        global_data.cache_stats.hits++;
+        return( PSA_SUCCESS );
+    }
+#endif /* MBEDTLS_PSA_CRYPTO_KEY_CACHE */
+
     slot->lifetime = PSA_KEY_LIFETIME_PERSISTENT;
     slot->persistent_storage_id = id;
     status = psa_load_persistent_key_into_slot( slot );
 
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    if( status == PSA_SUCCESS )
+        global_data.cache_stats.misses++;
+#endif
+
     return( status );
 
 #else /* MBEDTLS_PSA_CRYPTO_STORAGE_C */
@@ -26,6 +26,12 @@
  * The value is a compile-time constant for now, for simplicity. */
 #define PSA_KEY_SLOT_COUNT 32
 
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+#if !defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE_SIZE)
+#define MBEDTLS_PSA_CRYPTO_KEY_CACHE_SIZE 65536
+#endif
+#endif
+
 /** Access a key slot at the given handle.
  *
  * \param handle        Key handle to query.
@@ -55,4 +61,18 @@ psa_status_t psa_initialize_key_slots( void );
  * This does not affect persistent storage. */
 void psa_wipe_all_key_slots( void );
 
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+/** Remove a persistent key from the cache of closed keys.
+ *
+ * This must be called when the key is destroyed, since the cache may hold
+ * a copy of it even while it is open.
+ *
+ * \param id            The persistent identifier of the key.
+ */
+void psa_forget_cached_key( psa_key_id_t id );
+
+/** Empty the cache of closed keys. */
+void psa_forget_cached_keys( void );
+#endif /* MBEDTLS_PSA_CRYPTO_KEY_CACHE */
+
 #endif /* PSA_CRYPTO_SLOT_MANAGEMENT_H */
@@ -106,12 +106,16 @@ static psa_status_t check_magic_header( const uint8_t *data )
     return( PSA_SUCCESS );
 }
 
-psa_status_t psa_parse_key_data_from_storage( const uint8_t *storage_data,
-                                              size_t storage_data_length,
-                                              uint8_t **key_data,
-                                              size_t *key_data_length,
-                                              psa_key_type_t *type,
-                                              psa_key_policy_t *policy )
+/*
+ * Parse storage data without copying the key data, which is returned as a
+ * pointer into storage_data
+ */
+static psa_status_t psa_parse_key_data_in_storage( const uint8_t *storage_data,
+                                                   size_t storage_data_length,
+                                                   const uint8_t **key_data,
+                                                   size_t *key_data_length,
+                                                   psa_key_type_t *type,
+                                                   psa_key_policy_t *policy )
 {
     psa_status_t status;
     const psa_persistent_key_storage_format *storage_format =
@@ -134,15 +138,36 @@ psa_status_t psa_parse_key_data_from_storage( const uint8_t *storage_data,
         *key_data_length > PSA_CRYPTO_MAX_STORAGE_SIZE )
         return( PSA_ERROR_STORAGE_FAILURE );
 
-    *key_data = mbedtls_calloc( 1, *key_data_length );
-    if( *key_data == NULL )
-        return( PSA_ERROR_INSUFFICIENT_MEMORY );
-
     GET_UINT32_LE(*type, storage_format->type, 0);
     GET_UINT32_LE(policy->usage, storage_format->policy, 0);
     GET_UINT32_LE(policy->alg, storage_format->policy, sizeof( uint32_t ));
 
-    memcpy( *key_data, storage_format->key_data, *key_data_length );
+    *key_data = storage_format->key_data;
+
+    return( PSA_SUCCESS );
+}
+
+psa_status_t psa_parse_key_data_from_storage( const uint8_t *storage_data,
+                                              size_t storage_data_length,
+                                              uint8_t **key_data,
+                                              size_t *key_data_length,
+                                              psa_key_type_t *type,
+                                              psa_key_policy_t *policy )
+{
+    psa_status_t status;
+    const uint8_t *stored_key_data;
+
+    status = psa_parse_key_data_in_storage( storage_data, storage_data_length,
+                                            &stored_key_data, key_data_length,
+                                            type, policy );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    *key_data = mbedtls_calloc( 1, *key_data_length );
+    if( *key_data == NULL )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    memcpy( *key_data, stored_key_data, *key_data_length );
 
     return( PSA_SUCCESS );
 }
@@ -216,4 +241,33 @@ exit:
     return( status );
 }
 
+#if defined(PSA_CRYPTO_STORAGE_HAS_MAP)
+psa_status_t psa_map_persistent_key( psa_key_id_t key,
+                                     psa_key_type_t *type,
+                                     psa_key_policy_t *policy,
+                                     const uint8_t **data,
+                                     size_t *data_length )
+{
+    psa_status_t status;
+    const uint8_t *storage_data;
+    size_t storage_data_length;
+
+    status = psa_crypto_storage_map( key, &storage_data, &storage_data_length );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    status = psa_parse_key_data_in_storage( storage_data, storage_data_length,
+                                            data, data_length, type, policy );
+    if( status != PSA_SUCCESS )
+        psa_crypto_storage_unmap( storage_data );
+
+    return( status );
+}
+
+void psa_unmap_persistent_key( const uint8_t *data )
+{
+    psa_crypto_storage_unmap( data );
+}
+#endif /* PSA_CRYPTO_STORAGE_HAS_MAP */
+
 #endif /* MBEDTLS_PSA_CRYPTO_STORAGE_C */
@@ -61,6 +61,11 @@ extern "C" {
  */
 #define PSA_MAX_PERSISTENT_KEY_IDENTIFIER 0xffff0000
 
+/* Storage backends that can give access to stored data in place */
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+#define PSA_CRYPTO_STORAGE_HAS_MAP
+#endif
+
 /**
  * \brief Format key data and metadata and save to a location for given key
  *        slot.
@@ -123,6 +128,48 @@ psa_status_t psa_load_persistent_key( psa_key_id_t key,
                                       uint8_t **data,
                                       size_t *data_length );
 
+#if defined(PSA_CRYPTO_STORAGE_HAS_MAP)
+/**
+ * \brief Parses key data and metadata for the given key slot number in
+ *        place in storage, without copying it.
+ *
+ * This is the same as psa_load_persistent_key(), except that the key data
+ * is not copied to a newly allocated buffer: \p data points to the key
+ * data in storage, and psa_unmap_persistent_key() must be called once it
+ * is no longer needed. Other keys may be loaded or mapped in the meantime,
+ * but mapping may fail with #PSA_ERROR_NOT_SUPPORTED while another key is
+ * mapped.
+ *
+ * \param key               Persistent identifier of the key to be loaded. This
+ *                          should be an occupied storage location.
+ * \param[out] type         On success, the key type (a \c PSA_KEY_TYPE_XXX
+ *                          value).
+ * \param[out] policy       On success, the key's policy.
+ * \param[out] data         On success, pointer to the key data.
+ * \param[out] data_length  The number of bytes that make up the key data.
+ *
+ * \retval PSA_SUCCESS
+ * \retval PSA_ERROR_NOT_SUPPORTED
+ *         The key cannot be accessed in place at the moment, for example
+ *         because another key is mapped: use psa_load_persistent_key()
+ *         instead.
+ * \retval PSA_ERROR_STORAGE_FAILURE
+ * \retval PSA_ERROR_EMPTY_SLOT
+ */
+psa_status_t psa_map_persistent_key( psa_key_id_t key,
+                                     psa_key_type_t *type,
+                                     psa_key_policy_t *policy,
+                                     const uint8_t **data,
+                                     size_t *data_length );
+
+/**
+ * \brief Release key data obtained with psa_map_persistent_key().
+ *
+ * \param[in] data      The key data returned by psa_map_persistent_key().
+ */
+void psa_unmap_persistent_key( const uint8_t *data );
+#endif /* PSA_CRYPTO_STORAGE_HAS_MAP */
+
 /**
  * \brief Remove persistent data for the given key slot number.
  *
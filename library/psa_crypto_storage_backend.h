@@ -107,6 +107,90 @@ int psa_is_key_present_in_storage( const psa_key_id_t key );
 psa_status_t psa_crypto_storage_get_data_length( const psa_key_id_t key,
                                                  size_t *data_length );
 
+#if defined(PSA_CRYPTO_STORAGE_HAS_MAP)
+/**
+ * \brief Get access to the persistent data for the given key slot number
+ *        in place, without copying it.
+ *
+ * The data remains accessible until psa_crypto_storage_unmap() is called.
+ * Other keys may be loaded or mapped in the meantime, but mapping may fail
+ * with #PSA_ERROR_NOT_SUPPORTED while another key is mapped, in which case
+ * psa_crypto_storage_load() must be used instead.
+ *
+ * \param key               Persistent identifier of the key to be mapped.
+ * \param[out] data         On success, the data of the key.
+ * \param[out] data_length  On success, the number of bytes that make up
+ *                          the data.
+ *
+ * \retval PSA_SUCCESS
+ * \retval PSA_ERROR_NOT_SUPPORTED
+ * \retval PSA_ERROR_STORAGE_FAILURE
+ * \retval PSA_ERROR_EMPTY_SLOT
+ */
+psa_status_t psa_crypto_storage_map( const psa_key_id_t key,
+                                     const uint8_t **data,
+                                     size_t *data_length );
+
+/**
+ * \brief Release data obtained with psa_crypto_storage_map().
+ *
+ * \param data          The data returned by psa_crypto_storage_map(), or
+ *                      any pointer within it.
+ */
+void psa_crypto_storage_unmap( const uint8_t *data );
+#endif /* PSA_CRYPTO_STORAGE_HAS_MAP */
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+/**
+ * \brief Synchronize the key log with the storage medium.
+ *
+ * Records are flushed to the operating system as soon as they are appended
+ * to the log, but only synchronized to the storage medium once every
+ * MBEDTLS_PSA_CRYPTO_STORAGE_LOG_SYNC_INTERVAL records. Call this function
+ * to make sure all keys stored or destroyed so far survive a power failure.
+ *
+ * \retval PSA_SUCCESS
+ * \retval PSA_ERROR_STORAGE_FAILURE
+ */
+psa_status_t psa_crypto_storage_log_sync( void );
+
+/**
+ * \brief Synchronize and close the key log, and free its index.
+ *
+ * The log is opened, and its index rebuilt, on the next access to
+ * persistent storage.
+ */
+void psa_crypto_storage_log_close( void );
+
+/**
+ * \brief Start a batch of changes to the key log.
+ *
+ * Keys stored and destroyed until psa_crypto_storage_log_commit_batch()
+ * is called are only taken into account when the log is next read if the
+ * batch was committed.
+ *
+ * \retval PSA_SUCCESS
+ * \retval PSA_ERROR_BAD_STATE
+ *         A batch is already open.
+ * \retval PSA_ERROR_STORAGE_FAILURE
+ */
+psa_status_t psa_crypto_storage_log_begin_batch( void );
+
+/**
+ * \brief Commit the open batch and synchronize the key log with the
+ *        storage medium.
+ *
+ * \retval PSA_SUCCESS
+ * \retval PSA_ERROR_BAD_STATE
+ *         No batch is open.
+ * \retval PSA_ERROR_STORAGE_FAILURE
+ *         The batch is no longer open. If writing to the log failed, none
+ *         of its changes are kept. If only synchronizing it failed, the log
+ *         is read again on next access to find out.
+ */
+psa_status_t psa_crypto_storage_log_commit_batch( void );
+#endif /* MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C */
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,1096 @@
+/*
+ *  PSA log storage backend for persistent keys
+ */
+/*  Copyright (C) 2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+/*
+ * All keys live in a single file to which records are only ever appended:
+ * storing a key appends its data, destroying a key appends a deletion
+ * record. Each record carries a CRC-32 of its header and data.
+ *
+ * The file is read once, on first access, to build an in-memory index from
+ * key identifiers to record offsets. After that, checking whether a key is
+ * present needs no file access and loading a key is one seek and one read.
+ *
+ * A crash can leave a partially written record at the end of the file:
+ * reading stops at the first record that is incomplete or fails its CRC,
+ * and the file is then truncated before it. A damaged record followed by
+ * valid ones is not a crash, though: the file is left as it is and every
+ * access fails, rather than losing the keys stored after it. The file is
+ * also rewritten
+ * with only the live records (compacted) when deleted records take up more
+ * space than live ones.
+ *
+ * With MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP, the file is also mapped in
+ * memory so that keys can be parsed in place. Since records are never
+ * modified once written, the mapping only needs to be extended, which is
+ * done lazily, when a key beyond its end is mapped and no other key is.
+ *
+ * Records can be grouped in batches, between a begin and a commit record.
+ * The records of a batch only take effect once its commit record is read,
+ * so a crash in the middle of a batch leaves none of its changes behind.
+ */
+
+/*
+ * Ensure fileno() and fsync() are available even with -std=c99; must be
+ * defined before config.h, which pulls in glibc's features.h.
+ */
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#if defined(MBEDTLS_CONFIG_FILE)
+#include MBEDTLS_CONFIG_FILE
+#else
+#include "mbedtls/config.h"
+#endif
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "psa/crypto.h"
+#include "psa_crypto_storage_backend.h"
+#include "mbedtls/platform_util.h"
+
+#if defined(MBEDTLS_PLATFORM_C)
+#include "mbedtls/platform.h"
+#else
+#include <stdlib.h>
+#define mbedtls_calloc    calloc
+#define mbedtls_free      free
+#endif
+
+#if !defined(_WIN32) && (defined(unix) || \
+    defined(__unix) || defined(__unix__) || (defined(__APPLE__) && \
+    defined(__MACH__)))
+#include <unistd.h>
+#define LOG_HAVE_FSYNC
+#define LOG_HAVE_FTRUNCATE
+#endif /* !_WIN32 && (unix || __unix || __unix__ ||
+        * (__APPLE__ && __MACH__)) */
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+#include <sys/mman.h>
+#endif
+
+/* This option sets where files are to be stored, as for the file backend. */
+#if !defined(CRYPTO_STORAGE_FILE_LOCATION)
+#define CRYPTO_STORAGE_FILE_LOCATION ""
+#endif
+
+#if !defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_SYNC_INTERVAL)
+#define MBEDTLS_PSA_CRYPTO_STORAGE_LOG_SYNC_INTERVAL    64
+#endif
+
+#if !defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_COMPACT_MIN)
+#define MBEDTLS_PSA_CRYPTO_STORAGE_LOG_COMPACT_MIN      65536
+#endif
+
+#define LOG_LOCATION        CRYPTO_STORAGE_FILE_LOCATION "psa_key_log"
+#define LOG_TEMP_LOCATION   CRYPTO_STORAGE_FILE_LOCATION "psa_key_log.tmp"
+
+/*
+ * File layout: an 8-byte header, then records made of a 16-byte header
+ * (key identifier, data length, record type, CRC-32 of the first 12 bytes
+ * and of the data, all little endian) followed by the data. Batch begin
+ * and commit records have key identifier 0 and no data.
+ */
+#define LOG_MAGIC_LEN           8
+#define LOG_RECORD_HDR_LEN      16
+
+#define LOG_RECORD_STORE        1
+#define LOG_RECORD_DESTROY      2
+#define LOG_RECORD_BATCH_BEGIN  3
+#define LOG_RECORD_BATCH_COMMIT 4
+
+/* Well above the largest key the core stores, with its metadata */
+#define LOG_MAX_DATA_LEN        ( 2 * PSA_CRYPTO_MAX_STORAGE_SIZE )
+
+#define LOG_RECORD_LEN( length )    ( LOG_RECORD_HDR_LEN + (long) ( length ) )
+
+static const unsigned char log_magic[LOG_MAGIC_LEN] =
+    { 'P', 'S', 'A', 'K', 'L', 'O', 'G', 1 };
+
+/*
+ * 32-bit integer manipulation macros (little endian)
+ */
+#ifndef GET_UINT32_LE
+#define GET_UINT32_LE(n,b,i)                            \
+{                                                       \
+    (n) = ( (uint32_t) (b)[(i)    ]       )             \
+        | ( (uint32_t) (b)[(i) + 1] <<  8 )             \
+        | ( (uint32_t) (b)[(i) + 2] << 16 )             \
+        | ( (uint32_t) (b)[(i) + 3] << 24 );            \
+}
+#endif
+
+#ifndef PUT_UINT32_LE
+#define PUT_UINT32_LE(n,b,i)                                    \
+{                                                               \
+    (b)[(i)    ] = (unsigned char) ( ( (n)       ) & 0xFF );    \
+    (b)[(i) + 1] = (unsigned char) ( ( (n) >>  8 ) & 0xFF );    \
+    (b)[(i) + 2] = (unsigned char) ( ( (n) >> 16 ) & 0xFF );    \
+    (b)[(i) + 3] = (unsigned char) ( ( (n) >> 24 ) & 0xFF );    \
+}
+#endif
+
+/* CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320) */
+static const uint32_t log_crc_table[256] =
+{
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA,
+    0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
+    0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+    0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
+    0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE,
+    0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC,
+    0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
+    0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+    0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
+    0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940,
+    0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116,
+    0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+    0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
+    0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A,
+    0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818,
+    0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
+    0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+    0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
+    0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C,
+    0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2,
+    0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
+    0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+    0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086,
+    0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4,
+    0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
+    0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+    0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
+    0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8,
+    0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE,
+    0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
+    0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+    0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
+    0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252,
+    0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60,
+    0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
+    0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+    0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
+    0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04,
+    0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A,
+    0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
+    0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+    0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
+    0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E,
+    0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C,
+    0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+    0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
+    0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0,
+    0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6,
+    0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
+    0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+    0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+static uint32_t log_crc32( uint32_t crc, const unsigned char *buf, size_t len )
+{
+    crc = ~crc;
+    while( len-- > 0 )
+        crc = log_crc_table[( crc ^ *buf++ ) & 0xFF] ^ ( crc >> 8 );
+    return( ~crc );
+}
+
+/*
+ * Index entry. Identifier 0 is not a valid persistent key identifier and
+ * marks empty buckets.
+ */
+typedef struct
+{
+    psa_key_id_t id;
+    uint32_t length;            /* length of the key data                */
+    long offset;                /* offset of the record in the file      */
+} log_index_entry;
+
+static struct
+{
+    FILE *file;
+    log_index_entry *index;     /* open addressing, linear probing       */
+    size_t index_size;          /* number of buckets, a power of two     */
+    size_t count;               /* number of keys present                */
+    long end;                   /* offset of the next record             */
+    long live;                  /* bytes of records of present keys      */
+    long dead;                  /* bytes of superseded records           */
+    unsigned int unsynced;      /* records appended since the last sync  */
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+    unsigned char *map;         /* read-only mapping of the file         */
+    size_t map_len;             /* length of the mapping                 */
+    unsigned int map_users;     /* keys currently mapped                 */
+#endif
+} log_ctx;
+
+/* Batch state, which outlives the file being closed after an error */
+#define LOG_BATCH_NONE          0
+#define LOG_BATCH_OPEN          1
+#define LOG_BATCH_FAILED        2   /* the open batch can't be committed */
+
+static int log_batch = LOG_BATCH_NONE;
+
+/* Record of a batch being read, applied once the batch is committed */
+typedef struct
+{
+    psa_key_id_t id;
+    uint32_t type;
+    uint32_t length;
+    long offset;
+} log_pending_record;
+
+static size_t log_hash( psa_key_id_t id )
+{
+    uint32_t h = id * 0x9E3779B1u;
+
+    return( ( h ^ ( h >> 16 ) ) & ( log_ctx.index_size - 1 ) );
+}
+
+static log_index_entry *log_index_find( psa_key_id_t id )
+{
+    size_t i;
+
+    if( log_ctx.index_size == 0 )
+        return( NULL );
+
+    for( i = log_hash( id ); log_ctx.index[i].id != 0;
+         i = ( i + 1 ) & ( log_ctx.index_size - 1 ) )
+    {
+        if( log_ctx.index[i].id == id )
+            return( &log_ctx.index[i] );
+    }
+
+    return( NULL );
+}
+
+/*
+ * Make room for one more key, keeping the load factor under 3/4, so that
+ * the following call to log_index_insert() cannot fail.
+ */
+static psa_status_t log_index_reserve( void )
+{
+    log_index_entry *old = log_ctx.index, *cur;
+    size_t old_size = log_ctx.index_size, i, j;
+
+    if( ( log_ctx.count + 1 ) * 4 <= old_size * 3 )
+        return( PSA_SUCCESS );
+
+    cur = mbedtls_calloc( old_size == 0 ? 64 : 2 * old_size,
+                          sizeof( log_index_entry ) );
+    if( cur == NULL )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    log_ctx.index = cur;
+    log_ctx.index_size = old_size == 0 ? 64 : 2 * old_size;
+
+    for( i = 0; i < old_size; i++ )
+    {
+        if( old[i].id == 0 )
+            continue;
+
+        for( j = log_hash( old[i].id ); cur[j].id != 0;
+             j = ( j + 1 ) & ( log_ctx.index_size - 1 ) )
+            ;
+        cur[j] = old[i];
+    }
+
+    mbedtls_free( old );
+
+    return( PSA_SUCCESS );
+}
+
+static void log_index_insert( psa_key_id_t id, uint32_t length, long offset )
+{
+    size_t i;
+
+    for( i = log_hash( id ); log_ctx.index[i].id != 0;
+         i = ( i + 1 ) & ( log_ctx.index_size - 1 ) )
+        ;
+
+    log_ctx.index[i].id = id;
+    log_ctx.index[i].length = length;
+    log_ctx.index[i].offset = offset;
+    log_ctx.count++;
+}
+
+/*
+ * Remove an entry, shifting back the entries that follow it in its probe
+ * sequence so that lookups never need to skip deleted buckets.
+ */
+static void log_index_remove( log_index_entry *entry )
+{
+    size_t mask = log_ctx.index_size - 1;
+    size_t i = (size_t) ( entry - log_ctx.index ), j = i, k;
+
+    for( ;; )
+    {
+        j = ( j + 1 ) & mask;
+        if( log_ctx.index[j].id == 0 )
+            break;
+
+        /* Leave the entry alone if its home bucket lies in ( i, j ] */
+        k = log_hash( log_ctx.index[j].id );
+        if( i <= j ? ( i < k && k <= j ) : ( i < k || k <= j ) )
+            continue;
+
+        log_ctx.index[i] = log_ctx.index[j];
+        i = j;
+    }
+
+    memset( &log_ctx.index[i], 0, sizeof( log_index_entry ) );
+    log_ctx.count--;
+}
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+static void log_unmap_file( void )
+{
+    if( log_ctx.map != NULL )
+        munmap( log_ctx.map, log_ctx.map_len );
+
+    log_ctx.map = NULL;
+    log_ctx.map_len = 0;
+}
+#endif /* MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP */
+
+/*
+ * Forget about the file, so that it is read again on next access
+ */
+static void log_reset( void )
+{
+    if( log_ctx.file != NULL )
+        fclose( log_ctx.file );
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+    log_unmap_file();
+#endif
+
+    mbedtls_free( log_ctx.index );
+    memset( &log_ctx, 0, sizeof( log_ctx ) );
+
+    /* Records of the open batch may be missing from the file */
+    if( log_batch == LOG_BATCH_OPEN )
+        log_batch = LOG_BATCH_FAILED;
+}
+
+static psa_status_t log_sync_file( FILE *file )
+{
+    if( fflush( file ) != 0 )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+#if defined(LOG_HAVE_FSYNC)
+    if( fsync( fileno( file ) ) != 0 )
+        return( PSA_ERROR_STORAGE_FAILURE );
+#endif
+
+    return( PSA_SUCCESS );
+}
+
+/*
+ * Rewrite the file with only the records of present keys
+ */
+static psa_status_t log_compact( void )
+{
+    psa_status_t status = PSA_SUCCESS;
+    FILE *tmp = NULL;
+    unsigned char *record;
+    size_t i, len;
+    long offset = LOG_MAGIC_LEN;
+
+    /* Records of an open batch must stay after its begin record */
+    if( log_batch == LOG_BATCH_OPEN )
+        return( PSA_SUCCESS );
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+    /* Mapped keys point into the current file: try again later */
+    if( log_ctx.map_users > 0 )
+        return( PSA_SUCCESS );
+#endif
+
+    record = mbedtls_calloc( 1, LOG_RECORD_HDR_LEN + LOG_MAX_DATA_LEN );
+    if( record == NULL )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    tmp = fopen( LOG_TEMP_LOCATION, "wb" );
+    if( tmp == NULL ||
+        fwrite( log_magic, 1, LOG_MAGIC_LEN, tmp ) != LOG_MAGIC_LEN )
+    {
+        status = PSA_ERROR_STORAGE_FAILURE;
+        goto exit;
+    }
+
+    for( i = 0; i < log_ctx.index_size; i++ )
+    {
+        if( log_ctx.index[i].id == 0 )
+            continue;
+
+        len = (size_t) LOG_RECORD_LEN( log_ctx.index[i].length );
+        if( fseek( log_ctx.file, log_ctx.index[i].offset, SEEK_SET ) != 0 ||
+            fread( record, 1, len, log_ctx.file ) != len ||
+            fwrite( record, 1, len, tmp ) != len )
+        {
+            status = PSA_ERROR_STORAGE_FAILURE;
+            goto exit;
+        }
+    }
+
+    status = log_sync_file( tmp );
+    if( fclose( tmp ) != 0 && status == PSA_SUCCESS )
+        status = PSA_ERROR_STORAGE_FAILURE;
+    tmp = NULL;
+    if( status != PSA_SUCCESS )
+        goto exit;
+
+    if( rename( LOG_TEMP_LOCATION, LOG_LOCATION ) != 0 )
+    {
+        status = PSA_ERROR_STORAGE_FAILURE;
+        goto exit;
+    }
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+    log_unmap_file();
+#endif
+    fclose( log_ctx.file );
+    log_ctx.file = fopen( LOG_LOCATION, "r+b" );
+    if( log_ctx.file == NULL )
+    {
+        /* Start over from the new file on next access */
+        log_reset();
+        status = PSA_ERROR_STORAGE_FAILURE;
+        goto exit;
+    }
+
+    /* Records were written in index order */
+    for( i = 0; i < log_ctx.index_size; i++ )
+    {
+        if( log_ctx.index[i].id == 0 )
+            continue;
+
+        log_ctx.index[i].offset = offset;
+        offset += LOG_RECORD_LEN( log_ctx.index[i].length );
+    }
+
+    log_ctx.end = offset;
+    log_ctx.live = offset - LOG_MAGIC_LEN;
+    log_ctx.dead = 0;
+    log_ctx.unsynced = 0;
+
+exit:
+    if( tmp != NULL )
+        fclose( tmp );
+    if( status != PSA_SUCCESS )
+        remove( LOG_TEMP_LOCATION );
+    mbedtls_platform_zeroize( record, LOG_RECORD_HDR_LEN + LOG_MAX_DATA_LEN );
+    mbedtls_free( record );
+    return( status );
+}
+
+static int log_record_is_valid( psa_key_id_t id, uint32_t type,
+                                uint32_t length, int in_batch )
+{
+    switch( type )
+    {
+        case LOG_RECORD_STORE:
+            return( id != 0 && length <= LOG_MAX_DATA_LEN );
+        case LOG_RECORD_DESTROY:
+            return( id != 0 && length == 0 );
+        case LOG_RECORD_BATCH_BEGIN:
+            return( id == 0 && length == 0 && ! in_batch );
+        case LOG_RECORD_BATCH_COMMIT:
+            return( id == 0 && length == 0 && in_batch );
+        default:
+            return( 0 );
+    }
+}
+
+/*
+ * Apply a store or destroy record read from the file to the index
+ */
+static psa_status_t log_replay_record( psa_key_id_t id, uint32_t type,
+                                       uint32_t length, long offset )
+{
+    psa_status_t status;
+    log_index_entry *entry;
+
+    if( ( entry = log_index_find( id ) ) != NULL )
+    {
+        log_ctx.live -= LOG_RECORD_LEN( entry->length );
+        log_ctx.dead += LOG_RECORD_LEN( entry->length );
+        log_index_remove( entry );
+    }
+
+    if( type == LOG_RECORD_STORE )
+    {
+        if( ( status = log_index_reserve() ) != PSA_SUCCESS )
+            return( status );
+
+        log_index_insert( id, length, offset );
+        log_ctx.live += LOG_RECORD_LEN( length );
+    }
+    else
+        log_ctx.dead += LOG_RECORD_LEN( length );
+
+    return( PSA_SUCCESS );
+}
+
+/*
+ * Is there a complete, valid record anywhere after the given offset?
+ */
+static int log_record_follows( long offset, unsigned char *data )
+{
+    unsigned char hdr[LOG_RECORD_HDR_LEN];
+    psa_key_id_t id;
+    uint32_t length, type, crc;
+    long size;
+
+    if( fseek( log_ctx.file, 0, SEEK_END ) != 0 ||
+        ( size = ftell( log_ctx.file ) ) < 0 )
+        return( 1 );
+
+    for( offset++; offset + LOG_RECORD_HDR_LEN <= size; offset++ )
+    {
+        if( fseek( log_ctx.file, offset, SEEK_SET ) != 0 ||
+            fread( hdr, 1, LOG_RECORD_HDR_LEN, log_ctx.file ) != LOG_RECORD_HDR_LEN )
+            return( 1 );
+
+        GET_UINT32_LE( id, hdr, 0 );
+        GET_UINT32_LE( length, hdr, 4 );
+        GET_UINT32_LE( type, hdr, 8 );
+        GET_UINT32_LE( crc, hdr, 12 );
+
+        if( ! log_record_is_valid( id, type, length,
+                                   type == LOG_RECORD_BATCH_COMMIT ) ||
+            length > size - offset - LOG_RECORD_HDR_LEN )
+            continue;
+
+        if( fread( data, 1, length, log_ctx.file ) != length )
+            return( 1 );
+
+        if( log_crc32( log_crc32( 0, hdr, 12 ), data, length ) == crc )
+            return( 1 );
+    }
+
+    return( 0 );
+}
+
+/*
+ * Drop everything from the given offset to the end of the file
+ */
+static psa_status_t log_truncate( long offset )
+{
+#if defined(LOG_HAVE_FTRUNCATE)
+    if( fflush( log_ctx.file ) != 0 ||
+        ftruncate( fileno( log_ctx.file ), offset ) != 0 )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    log_ctx.end = offset;
+
+    return( log_sync_file( log_ctx.file ) );
+#else
+    /* Only indexed records are rewritten */
+    (void) offset;
+    return( log_compact() );
+#endif
+}
+
+/*
+ * Build the index by reading the whole file
+ */
+static psa_status_t log_replay( void )
+{
+    psa_status_t status = PSA_SUCCESS;
+    unsigned char magic[LOG_MAGIC_LEN];
+    unsigned char hdr[LOG_RECORD_HDR_LEN];
+    unsigned char *data;
+    log_pending_record *pending = NULL, *grown;
+    size_t pending_count = 0, pending_size = 0, i;
+    psa_key_id_t id;
+    uint32_t length, type, crc;
+    size_t n;
+    int torn = 0, in_batch = 0;
+    long batch_offset = 0;
+
+    n = fread( magic, 1, LOG_MAGIC_LEN, log_ctx.file );
+    if( n == 0 && feof( log_ctx.file ) )
+    {
+        /* New file */
+        if( fseek( log_ctx.file, 0, SEEK_SET ) != 0 ||
+            fwrite( log_magic, 1, LOG_MAGIC_LEN, log_ctx.file ) != LOG_MAGIC_LEN ||
+            fflush( log_ctx.file ) != 0 )
+            return( PSA_ERROR_STORAGE_FAILURE );
+
+        log_ctx.end = LOG_MAGIC_LEN;
+        return( PSA_SUCCESS );
+    }
+
+    if( n != LOG_MAGIC_LEN || memcmp( magic, log_magic, LOG_MAGIC_LEN ) != 0 )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    data = mbedtls_calloc( 1, LOG_MAX_DATA_LEN );
+    if( data == NULL )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    log_ctx.end = LOG_MAGIC_LEN;
+
+    for( ;; )
+    {
+        n = fread( hdr, 1, LOG_RECORD_HDR_LEN, log_ctx.file );
+        if( n == 0 && feof( log_ctx.file ) )
+            break;
+
+        if( n != LOG_RECORD_HDR_LEN )
+        {
+            torn = 1;
+            break;
+        }
+
+        GET_UINT32_LE( id, hdr, 0 );
+        GET_UINT32_LE( length, hdr, 4 );
+        GET_UINT32_LE( type, hdr, 8 );
+        GET_UINT32_LE( crc, hdr, 12 );
+
+        if( ! log_record_is_valid( id, type, length, in_batch ) ||
+            fread( data, 1, length, log_ctx.file ) != length ||
+            log_crc32( log_crc32( 0, hdr, 12 ), data, length ) != crc )
+        {
+            torn = 1;
+            break;
+        }
+
+        if( type == LOG_RECORD_BATCH_BEGIN )
+        {
+            in_batch = 1;
+            batch_offset = log_ctx.end;
+            log_ctx.dead += LOG_RECORD_HDR_LEN;
+        }
+        else if( type == LOG_RECORD_BATCH_COMMIT )
+        {
+            for( i = 0; i < pending_count; i++ )
+            {
+                status = log_replay_record( pending[i].id, pending[i].type,
+                                            pending[i].length,
+                                            pending[i].offset );
+                if( status != PSA_SUCCESS )
+                    goto exit;
+            }
+
+            in_batch = 0;
+            pending_count = 0;
+            log_ctx.dead += LOG_RECORD_HDR_LEN;
+        }
+        else if( in_batch )
+        {
+            if( pending_count == pending_size )
+            {
+                pending_size = pending_size == 0 ? 64 : 2 * pending_size;
+                grown = mbedtls_calloc( pending_size,
+                                        sizeof( log_pending_record ) );
+                if( grown == NULL )
+                {
+                    status = PSA_ERROR_INSUFFICIENT_MEMORY;
+                    goto exit;
+                }
+
+                if( pending_count > 0 )
+                    memcpy( grown, pending,
+                            pending_count * sizeof( log_pending_record ) );
+                mbedtls_free( pending );
+                pending = grown;
+            }
+
+            pending[pending_count].id = id;
+            pending[pending_count].type = type;
+            pending[pending_count].length = length;
+            pending[pending_count].offset = log_ctx.end;
+            pending_count++;
+        }
+        else if( ( status = log_replay_record( id, type, length,
+                                               log_ctx.end ) ) != PSA_SUCCESS )
+            goto exit;
+
+        log_ctx.end += LOG_RECORD_LEN( length );
+    }
+
+    if( ferror( log_ctx.file ) )
+    {
+        status = PSA_ERROR_STORAGE_FAILURE;
+        goto exit;
+    }
+
+    /* Only a damaged tail can be left by a crash while appending */
+    if( torn && log_record_follows( log_ctx.end, data ) )
+    {
+        status = PSA_ERROR_STORAGE_FAILURE;
+        goto exit;
+    }
+
+    /* Drop the incomplete record or batch */
+    if( in_batch )
+    {
+        log_ctx.dead -= LOG_RECORD_HDR_LEN;
+        status = log_truncate( batch_offset );
+    }
+    else if( torn )
+        status = log_truncate( log_ctx.end );
+
+exit:
+    mbedtls_platform_zeroize( data, LOG_MAX_DATA_LEN );
+    mbedtls_free( data );
+    mbedtls_free( pending );
+    return( status );
+}
+
+static psa_status_t log_open( void )
+{
+    psa_status_t status;
+    FILE *file;
+
+    if( log_ctx.file != NULL )
+        return( PSA_SUCCESS );
+
+    /* Create the file if needed, without ever truncating it */
+    if( ( file = fopen( LOG_LOCATION, "ab" ) ) == NULL )
+        return( PSA_ERROR_STORAGE_FAILURE );
+    fclose( file );
+
+    if( ( log_ctx.file = fopen( LOG_LOCATION, "r+b" ) ) == NULL )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    if( ( status = log_replay() ) != PSA_SUCCESS )
+        log_reset();
+
+    return( status );
+}
+
+static psa_status_t log_append( psa_key_id_t id, uint32_t type,
+                                const uint8_t *data, size_t length )
+{
+    unsigned char hdr[LOG_RECORD_HDR_LEN];
+    uint32_t crc;
+
+    if( log_ctx.end > LONG_MAX - LOG_RECORD_LEN( length ) )
+        return( PSA_ERROR_INSUFFICIENT_STORAGE );
+
+    PUT_UINT32_LE( id, hdr, 0 );
+    PUT_UINT32_LE( (uint32_t) length, hdr, 4 );
+    PUT_UINT32_LE( type, hdr, 8 );
+    crc = log_crc32( log_crc32( 0, hdr, 12 ), data, length );
+    PUT_UINT32_LE( crc, hdr, 12 );
+
+    if( fseek( log_ctx.file, log_ctx.end, SEEK_SET ) != 0 ||
+        fwrite( hdr, 1, LOG_RECORD_HDR_LEN, log_ctx.file ) != LOG_RECORD_HDR_LEN ||
+        ( length > 0 && fwrite( data, 1, length, log_ctx.file ) != length ) ||
+        fflush( log_ctx.file ) != 0 )
+    {
+        /* Part of the record may have reached the file: read it again */
+        log_reset();
+        return( PSA_ERROR_STORAGE_FAILURE );
+    }
+
+    log_ctx.end += LOG_RECORD_LEN( length );
+    log_ctx.unsynced++;
+
+    return( PSA_SUCCESS );
+}
+
+/*
+ * Appended records are flushed to the operating system right away, but
+ * only synchronized to the storage medium once every few records.
+ */
+static psa_status_t log_sync_periodic( void )
+{
+    /* Batches are synchronized when committed */
+    if( log_batch == LOG_BATCH_OPEN ||
+        log_ctx.unsynced < MBEDTLS_PSA_CRYPTO_STORAGE_LOG_SYNC_INTERVAL )
+        return( PSA_SUCCESS );
+
+    return( psa_crypto_storage_log_sync() );
+}
+
+psa_status_t psa_crypto_storage_load( const psa_key_id_t key, uint8_t *data,
+                                      size_t data_size )
+{
+    psa_status_t status;
+    log_index_entry *entry;
+    unsigned char hdr[LOG_RECORD_HDR_LEN];
+    uint32_t crc;
+
+    if( ( status = log_open() ) != PSA_SUCCESS )
+        return( status );
+
+    if( ( entry = log_index_find( key ) ) == NULL )
+        return( PSA_ERROR_EMPTY_SLOT );
+
+    if( data_size > entry->length ||
+        fseek( log_ctx.file, entry->offset, SEEK_SET ) != 0 ||
+        fread( hdr, 1, LOG_RECORD_HDR_LEN, log_ctx.file ) != LOG_RECORD_HDR_LEN ||
+        ( data_size > 0 &&
+          fread( data, 1, data_size, log_ctx.file ) != data_size ) )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    /* The CRC can only be checked when reading the whole record */
+    if( data_size == entry->length )
+    {
+        GET_UINT32_LE( crc, hdr, 12 );
+        if( log_crc32( log_crc32( 0, hdr, 12 ), data, data_size ) != crc )
+        {
+            mbedtls_platform_zeroize( data, data_size );
+            return( PSA_ERROR_STORAGE_FAILURE );
+        }
+    }
+
+    return( PSA_SUCCESS );
+}
+
+int psa_is_key_present_in_storage( const psa_key_id_t key )
+{
+    if( log_open() != PSA_SUCCESS )
+        return( 0 );
+
+    return( log_index_find( key ) != NULL );
+}
+
+psa_status_t psa_crypto_storage_store( const psa_key_id_t key,
+                                       const uint8_t *data,
+                                       size_t data_length )
+{
+    psa_status_t status;
+
+    if( log_batch == LOG_BATCH_FAILED )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    if( ( status = log_open() ) != PSA_SUCCESS )
+        return( status );
+
+    if( key == 0 )
+        return( PSA_ERROR_INVALID_ARGUMENT );
+
+    if( log_index_find( key ) != NULL )
+        return( PSA_ERROR_OCCUPIED_SLOT );
+
+    if( data_length > LOG_MAX_DATA_LEN )
+        return( PSA_ERROR_INSUFFICIENT_STORAGE );
+
+    if( ( status = log_index_reserve() ) != PSA_SUCCESS )
+        return( status );
+
+    status = log_append( key, LOG_RECORD_STORE, data, data_length );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    log_index_insert( key, (uint32_t) data_length,
+                      log_ctx.end - LOG_RECORD_LEN( data_length ) );
+    log_ctx.live += LOG_RECORD_LEN( data_length );
+
+    return( log_sync_periodic() );
+}
+
+psa_status_t psa_destroy_persistent_key( const psa_key_id_t key )
+{
+    psa_status_t status;
+    log_index_entry *entry;
+
+    if( log_batch == LOG_BATCH_FAILED )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    if( ( status = log_open() ) != PSA_SUCCESS )
+        return( status );
+
+    if( ( entry = log_index_find( key ) ) == NULL )
+        return( PSA_SUCCESS );
+
+    status = log_append( key, LOG_RECORD_DESTROY, NULL, 0 );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    log_ctx.live -= LOG_RECORD_LEN( entry->length );
+    log_ctx.dead += LOG_RECORD_LEN( entry->length ) + LOG_RECORD_HDR_LEN;
+    log_index_remove( entry );
+
+    /* The key is gone whether or not this succeeds */
+    if( log_ctx.dead >= MBEDTLS_PSA_CRYPTO_STORAGE_LOG_COMPACT_MIN &&
+        log_ctx.dead > log_ctx.live )
+        (void) log_compact();
+
+    return( log_sync_periodic() );
+}
+
+psa_status_t psa_crypto_storage_get_data_length( const psa_key_id_t key,
+                                                 size_t *data_length )
+{
+    psa_status_t status;
+    log_index_entry *entry;
+
+    if( ( status = log_open() ) != PSA_SUCCESS )
+        return( status );
+
+    if( ( entry = log_index_find( key ) ) == NULL )
+        return( PSA_ERROR_EMPTY_SLOT );
+
+    *data_length = entry->length;
+
+    return( PSA_SUCCESS );
+}
+
+psa_status_t psa_crypto_storage_log_sync( void )
+{
+    if( log_ctx.file == NULL || log_ctx.unsynced == 0 )
+        return( PSA_SUCCESS );
+
+    if( log_sync_file( log_ctx.file ) != PSA_SUCCESS )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    log_ctx.unsynced = 0;
+
+    return( PSA_SUCCESS );
+}
+
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+psa_status_t psa_crypto_storage_map( const psa_key_id_t key,
+                                     const uint8_t **data,
+                                     size_t *data_length )
+{
+    psa_status_t status;
+    log_index_entry *entry;
+    const unsigned char *record;
+    size_t end;
+    uint32_t crc;
+    void *map;
+
+    if( ( status = log_open() ) != PSA_SUCCESS )
+        return( status );
+
+    if( ( entry = log_index_find( key ) ) == NULL )
+        return( PSA_ERROR_EMPTY_SLOT );
+
+    end = (size_t) ( entry->offset + LOG_RECORD_LEN( entry->length ) );
+    if( end > log_ctx.map_len )
+    {
+        if( log_ctx.map_users > 0 )
+            return( PSA_ERROR_NOT_SUPPORTED );
+
+        log_unmap_file();
+
+        /* Leave room for the records appended in the meantime. Pages past
+         * the end of the file are only accessed once it has grown. */
+        end = (size_t) log_ctx.end + (size_t) log_ctx.end / 4 + 65536;
+        map = mmap( NULL, end, PROT_READ, MAP_SHARED,
+                    fileno( log_ctx.file ), 0 );
+        if( map == MAP_FAILED )
+            return( PSA_ERROR_NOT_SUPPORTED );
+
+        log_ctx.map = map;
+        log_ctx.map_len = end;
+    }
+
+    record = log_ctx.map + entry->offset;
+    GET_UINT32_LE( crc, record, 12 );
+    if( log_crc32( log_crc32( 0, record, 12 ),
+                   record + LOG_RECORD_HDR_LEN, entry->length ) != crc )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    *data = record + LOG_RECORD_HDR_LEN;
+    *data_length = entry->length;
+    log_ctx.map_users++;
+
+    return( PSA_SUCCESS );
+}
+
+void psa_crypto_storage_unmap( const uint8_t *data )
+{
+    (void) data;
+
+    if( log_ctx.map_users > 0 )
+        log_ctx.map_users--;
+}
+#endif /* MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP */
+
+psa_status_t psa_crypto_storage_log_begin_batch( void )
+{
+    psa_status_t status;
+
+    if( log_batch != LOG_BATCH_NONE )
+        return( PSA_ERROR_BAD_STATE );
+
+    if( ( status = log_open() ) != PSA_SUCCESS )
+        return( status );
+
+    status = log_append( 0, LOG_RECORD_BATCH_BEGIN, NULL, 0 );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    log_ctx.dead += LOG_RECORD_HDR_LEN;
+    log_batch = LOG_BATCH_OPEN;
+
+    return( PSA_SUCCESS );
+}
+
+psa_status_t psa_crypto_storage_log_commit_batch( void )
+{
+    psa_status_t status;
+    int batch = log_batch;
+
+    log_batch = LOG_BATCH_NONE;
+
+    if( batch == LOG_BATCH_NONE )
+        return( PSA_ERROR_BAD_STATE );
+
+    if( batch == LOG_BATCH_FAILED )
+        return( PSA_ERROR_STORAGE_FAILURE );
+
+    status = log_append( 0, LOG_RECORD_BATCH_COMMIT, NULL, 0 );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    log_ctx.dead += LOG_RECORD_HDR_LEN;
+
+    /* Whether the commit record made it or not, the file will tell */
+    if( ( status = psa_crypto_storage_log_sync() ) != PSA_SUCCESS )
+        log_reset();
+
+    return( status );
+}
+
+void psa_crypto_storage_log_close( void )
+{
+    (void) psa_crypto_storage_log_sync();
+    log_reset();
+
+    /* An open batch is dropped when the file is next read */
+    log_batch = LOG_BATCH_NONE;
+}
+
+#endif /* MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C */
@@ -842,6 +842,10 @@ int mbedtls_rsa_private( mbedtls_rsa_context *ctx,
         return( ret );
 #endif
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    mbedtls_mpi_scratch_push();
+#endif
+
     /* MPI Initialization */
     mbedtls_mpi_init( &T );
 
@@ -979,11 +983,6 @@ int mbedtls_rsa_private( mbedtls_rsa_context *ctx,
     MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &T, output, olen ) );
 
 cleanup:
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif
-
     mbedtls_mpi_free( &P1 );
     mbedtls_mpi_free( &Q1 );
     mbedtls_mpi_free( &R );
@@ -1007,6 +1006,23 @@ cleanup:
     mbedtls_mpi_free( &C );
     mbedtls_mpi_free( &I );
 
+#if defined(MBEDTLS_MPI_SCRATCH)
+    /* Values cached in the context are moved out of the arena while the
+     * context is still locked */
+    if( mbedtls_mpi_scratch_pop() != 0 )
+    {
+        /* The blinding values may have been lost: draw new ones */
+        mbedtls_mpi_free( &ctx->Vi );
+        mbedtls_mpi_free( &ctx->Vf );
+        ret = MBEDTLS_ERR_MPI_ALLOC_FAILED;
+    }
+#endif
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
     if( ret != 0 )
         return( MBEDTLS_ERR_RSA_PRIVATE_FAILED + ret );
 
@@ -19,8 +19,10 @@
  *  This file is part of mbed TLS (https://tls.mbed.org)
  */
 /*
- * These session callbacks use a simple chained list
- * to store and retrieve the session information.
+ * Each cookie is computed from copies of hash states set up once per key,
+ * so generating and checking cookies takes no lock and threads never write
+ * to shared memory. Keys are rotated by writing a new key to a slot that is
+ * not in use and publishing its generation number.
  */
 
 #if !defined(MBEDTLS_CONFIG_FILE)
@@ -48,32 +50,80 @@
  * If DTLS is in use, then at least one of SHA-1, SHA-256, SHA-512 is
  * available. Try SHA-256 first, 512 wastes resources since we need to stay
  * with max 32 bytes of cookie for DTLS 1.0
+ *
+ * The HMAC is computed with the hash functions directly rather than through
+ * the MD layer, so that the hash states for the key can be copied to the
+ * stack instead of being shared between threads.
  */
 #if defined(MBEDTLS_SHA256_C)
-#define COOKIE_MD           MBEDTLS_MD_SHA224
 #define COOKIE_MD_OUTLEN    32
-#define COOKIE_HMAC_LEN     28
+#define COOKIE_MD_DIGESTLEN 28
+#define COOKIE_MD_BLOCKLEN  64
+#define COOKIE_HMAC_LEN     27
+typedef mbedtls_sha256_context cookie_md_context;
+#define cookie_md_init      mbedtls_sha256_init
+#define cookie_md_free      mbedtls_sha256_free
+#define cookie_md_clone     mbedtls_sha256_clone
+#define cookie_md_starts( ctx )     mbedtls_sha256_starts_ret( ctx, 1 )
+#define cookie_md_update    mbedtls_sha256_update_ret
+#define cookie_md_finish    mbedtls_sha256_finish_ret
 #elif defined(MBEDTLS_SHA512_C)
-#define COOKIE_MD           MBEDTLS_MD_SHA384
 #define COOKIE_MD_OUTLEN    48
-#define COOKIE_HMAC_LEN     28
+#define COOKIE_MD_DIGESTLEN 48
+#define COOKIE_MD_BLOCKLEN  128
+#define COOKIE_HMAC_LEN     27
+typedef mbedtls_sha512_context cookie_md_context;
+#define cookie_md_init      mbedtls_sha512_init
+#define cookie_md_free      mbedtls_sha512_free
+#define cookie_md_clone     mbedtls_sha512_clone
+#define cookie_md_starts( ctx )     mbedtls_sha512_starts_ret( ctx, 1 )
+#define cookie_md_update    mbedtls_sha512_update_ret
+#define cookie_md_finish    mbedtls_sha512_finish_ret
 #elif defined(MBEDTLS_SHA1_C)
-#define COOKIE_MD           MBEDTLS_MD_SHA1
 #define COOKIE_MD_OUTLEN    20
-#define COOKIE_HMAC_LEN     20
+#define COOKIE_MD_DIGESTLEN 20
+#define COOKIE_MD_BLOCKLEN  64
+#define COOKIE_HMAC_LEN     19
+typedef mbedtls_sha1_context cookie_md_context;
+#define cookie_md_init      mbedtls_sha1_init
+#define cookie_md_free      mbedtls_sha1_free
+#define cookie_md_clone     mbedtls_sha1_clone
+#define cookie_md_starts( ctx )     mbedtls_sha1_starts_ret( ctx )
+#define cookie_md_update    mbedtls_sha1_update_ret
+#define cookie_md_finish    mbedtls_sha1_finish_ret
 #else
 #error "DTLS hello verify needs SHA-1 or SHA-2"
 #endif
 
 /*
- * Cookies are formed of a 4-bytes timestamp (or serial number) and
- * an HMAC of timestemp and client ID.
+ * Cookies are formed of a 4-bytes timestamp (or serial number), the low
+ * byte of the key generation and an HMAC of both and of the client ID.
  */
-#define COOKIE_LEN      ( 4 + COOKIE_HMAC_LEN )
+#define COOKIE_HDR_LEN  5
+#define COOKIE_LEN      ( COOKIE_HDR_LEN + COOKIE_HMAC_LEN )
+
+#define COOKIE_KEYS     3
+
+/*
+ * The key generation is published with a release store once the new key is
+ * written, and read with an acquire load, so that a thread seeing the new
+ * generation also sees its key. Without compiler support for atomics, the
+ * mutex is taken around these accesses instead.
+ */
+#if defined(MBEDTLS_THREADING_C) && defined(__ATOMIC_ACQUIRE)
+#define COOKIE_ATOMIC_GENERATION
+#endif
 
 void mbedtls_ssl_cookie_init( mbedtls_ssl_cookie_ctx *ctx )
 {
-    mbedtls_md_init( &ctx->hmac_ctx );
+    int i;
+
+    for( i = 0; i < COOKIE_KEYS; i++ )
+    {
+        cookie_md_init( &ctx->keys[i].inner );
+        cookie_md_init( &ctx->keys[i].outer );
+    }
+    ctx->generation = 0;
 #if !defined(MBEDTLS_HAVE_TIME)
     ctx->serial = 0;
 #endif
@@ -91,7 +141,13 @@ void mbedtls_ssl_cookie_set_timeout( mbedtls_ssl_cookie_ctx *ctx, unsigned long
 
 void mbedtls_ssl_cookie_free( mbedtls_ssl_cookie_ctx *ctx )
 {
-    mbedtls_md_free( &ctx->hmac_ctx );
+    int i;
+
+    for( i = 0; i < COOKIE_KEYS; i++ )
+    {
+        cookie_md_free( &ctx->keys[i].inner );
+        cookie_md_free( &ctx->keys[i].outer );
+    }
 
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_mutex_free( &ctx->mutex );
@@ -100,54 +156,155 @@ void mbedtls_ssl_cookie_free( mbedtls_ssl_cookie_ctx *ctx )
     mbedtls_platform_zeroize( ctx, sizeof( mbedtls_ssl_cookie_ctx ) );
 }
 
+/*
+ * Draw a new key and absorb the HMAC pads derived from it
+ */
+static int ssl_cookie_new_key( mbedtls_ssl_cookie_key *key,
+                               int (*f_rng)(void *, unsigned char *, size_t),
+                               void *p_rng )
+{
+    int ret;
+    size_t i;
+    unsigned char secret[COOKIE_MD_OUTLEN];
+    unsigned char pad[COOKIE_MD_BLOCKLEN];
+
+    if( ( ret = f_rng( p_rng, secret, sizeof( secret ) ) ) != 0 )
+        return( ret );
+
+    memset( pad, 0x36, sizeof( pad ) );
+    for( i = 0; i < sizeof( secret ); i++ )
+        pad[i] ^= secret[i];
+
+    if( ( ret = cookie_md_starts( &key->inner ) ) != 0 ||
+        ( ret = cookie_md_update( &key->inner, pad, sizeof( pad ) ) ) != 0 )
+        goto exit;
+
+    memset( pad, 0x5C, sizeof( pad ) );
+    for( i = 0; i < sizeof( secret ); i++ )
+        pad[i] ^= secret[i];
+
+    if( ( ret = cookie_md_starts( &key->outer ) ) != 0 ||
+        ( ret = cookie_md_update( &key->outer, pad, sizeof( pad ) ) ) != 0 )
+        goto exit;
+
+exit:
+    mbedtls_platform_zeroize( secret, sizeof( secret ) );
+    mbedtls_platform_zeroize( pad, sizeof( pad ) );
+
+    return( ret );
+}
+
+static int ssl_cookie_get_generation( mbedtls_ssl_cookie_ctx *ctx,
+                                      unsigned long *generation )
+{
+#if defined(COOKIE_ATOMIC_GENERATION)
+    *generation = __atomic_load_n( &ctx->generation, __ATOMIC_ACQUIRE );
+#elif defined(MBEDTLS_THREADING_C)
+    int ret;
+
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR + ret );
+
+    *generation = ctx->generation;
+
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR +
+                MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#else
+    *generation = ctx->generation;
+#endif
+
+    return( 0 );
+}
+
 int mbedtls_ssl_cookie_setup( mbedtls_ssl_cookie_ctx *ctx,
                       int (*f_rng)(void *, unsigned char *, size_t),
                       void *p_rng )
+{
+    ctx->generation = 0;
+
+    return( ssl_cookie_new_key( &ctx->keys[0], f_rng, p_rng ) );
+}
+
+int mbedtls_ssl_cookie_rotate( mbedtls_ssl_cookie_ctx *ctx,
+                               int (*f_rng)(void *, unsigned char *, size_t),
+                               void *p_rng )
 {
     int ret;
-    unsigned char key[COOKIE_MD_OUTLEN];
+    unsigned long next;
 
-    if( ( ret = f_rng( p_rng, key, sizeof( key ) ) ) != 0 )
-        return( ret );
+#if defined(MBEDTLS_THREADING_C)
+    /* Only serializes rotations, and readers without atomics */
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR + ret );
+#endif
 
-    ret = mbedtls_md_setup( &ctx->hmac_ctx, mbedtls_md_info_from_type( COOKIE_MD ), 1 );
-    if( ret != 0 )
-        return( ret );
+    /* Threads may still be using the current and previous keys, but not
+     * the one before, which is the one replaced */
+    next = ctx->generation + 1;
+    ret = ssl_cookie_new_key( &ctx->keys[next % COOKIE_KEYS], f_rng, p_rng );
 
-    ret = mbedtls_md_hmac_starts( &ctx->hmac_ctx, key, sizeof( key ) );
-    if( ret != 0 )
-        return( ret );
+    if( ret == 0 )
+    {
+#if defined(COOKIE_ATOMIC_GENERATION)
+        __atomic_store_n( &ctx->generation, next, __ATOMIC_RELEASE );
+#else
+        ctx->generation = next;
+#endif
+    }
 
-    mbedtls_platform_zeroize( key, sizeof( key ) );
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR +
+                MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
 
-    return( 0 );
+    return( ret );
 }
 
 /*
- * Generate the HMAC part of a cookie
+ * Generate the HMAC part of a cookie, from copies of the key states
  */
-static int ssl_cookie_hmac( mbedtls_md_context_t *hmac_ctx,
-                            const unsigned char time[4],
+static int ssl_cookie_hmac( const mbedtls_ssl_cookie_key *key,
+                            const unsigned char hdr[COOKIE_HDR_LEN],
                             unsigned char **p, unsigned char *end,
                             const unsigned char *cli_id, size_t cli_id_len )
 {
+    int ret;
+    cookie_md_context md_ctx;
     unsigned char hmac_out[COOKIE_MD_OUTLEN];
 
     if( (size_t)( end - *p ) < COOKIE_HMAC_LEN )
         return( MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL );
 
-    if( mbedtls_md_hmac_reset(  hmac_ctx ) != 0 ||
-        mbedtls_md_hmac_update( hmac_ctx, time, 4 ) != 0 ||
-        mbedtls_md_hmac_update( hmac_ctx, cli_id, cli_id_len ) != 0 ||
-        mbedtls_md_hmac_finish( hmac_ctx, hmac_out ) != 0 )
+    cookie_md_init( &md_ctx );
+
+    cookie_md_clone( &md_ctx, &key->inner );
+    if( cookie_md_update( &md_ctx, hdr, COOKIE_HDR_LEN ) != 0 ||
+        cookie_md_update( &md_ctx, cli_id, cli_id_len ) != 0 ||
+        cookie_md_finish( &md_ctx, hmac_out ) != 0 )
     {
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+        ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        goto exit;
+    }
+
+    cookie_md_clone( &md_ctx, &key->outer );
+    if( cookie_md_update( &md_ctx, hmac_out, COOKIE_MD_DIGESTLEN ) != 0 ||
+        cookie_md_finish( &md_ctx, hmac_out ) != 0 )
+    {
+        ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        goto exit;
     }
 
     memcpy( *p, hmac_out, COOKIE_HMAC_LEN );
     *p += COOKIE_HMAC_LEN;
+    ret = 0;
 
-    return( 0 );
+exit:
+    cookie_md_free( &md_ctx );
+    mbedtls_platform_zeroize( hmac_out, sizeof( hmac_out ) );
+
+    return( ret );
 }
 
 /*
@@ -159,7 +316,7 @@ int mbedtls_ssl_cookie_write( void *p_ctx,
 {
     int ret;
     mbedtls_ssl_cookie_ctx *ctx = (mbedtls_ssl_cookie_ctx *) p_ctx;
-    unsigned long t;
+    unsigned long t, generation;
 
     if( ctx == NULL || cli_id == NULL )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
@@ -167,6 +324,9 @@ int mbedtls_ssl_cookie_write( void *p_ctx,
     if( (size_t)( end - *p ) < COOKIE_LEN )
         return( MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL );
 
+    if( ( ret = ssl_cookie_get_generation( ctx, &generation ) ) != 0 )
+        return( ret );
+
 #if defined(MBEDTLS_HAVE_TIME)
     t = (unsigned long) mbedtls_time( NULL );
 #else
@@ -177,23 +337,12 @@ int mbedtls_ssl_cookie_write( void *p_ctx,
     (*p)[1] = (unsigned char)( t >> 16 );
     (*p)[2] = (unsigned char)( t >>  8 );
     (*p)[3] = (unsigned char)( t       );
-    *p += 4;
-
-#if defined(MBEDTLS_THREADING_C)
-    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR + ret );
-#endif
+    (*p)[4] = (unsigned char)( generation );
+    *p += COOKIE_HDR_LEN;
 
-    ret = ssl_cookie_hmac( &ctx->hmac_ctx, *p - 4,
-                           p, end, cli_id, cli_id_len );
-
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR +
-                MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif
-
-    return( ret );
+    return( ssl_cookie_hmac( &ctx->keys[generation % COOKIE_KEYS],
+                             *p - COOKIE_HDR_LEN,
+                             p, end, cli_id, cli_id_len ) );
 }
 
 /*
@@ -207,7 +356,7 @@ int mbedtls_ssl_cookie_check( void *p_ctx,
     int ret = 0;
     unsigned char *p = ref_hmac;
     mbedtls_ssl_cookie_ctx *ctx = (mbedtls_ssl_cookie_ctx *) p_ctx;
-    unsigned long cur_time, cookie_time;
+    unsigned long cur_time, cookie_time, generation;
 
     if( ctx == NULL || cli_id == NULL )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
@@ -215,26 +364,26 @@ int mbedtls_ssl_cookie_check( void *p_ctx,
     if( cookie_len != COOKIE_LEN )
         return( -1 );
 
-#if defined(MBEDTLS_THREADING_C)
-    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR + ret );
-#endif
+    if( ( ret = ssl_cookie_get_generation( ctx, &generation ) ) != 0 )
+        return( ret );
 
-    if( ssl_cookie_hmac( &ctx->hmac_ctx, cookie,
-                         &p, p + sizeof( ref_hmac ),
-                         cli_id, cli_id_len ) != 0 )
-        ret = -1;
+    /* Only the current and previous keys are accepted */
+    if( cookie[4] != (unsigned char) generation )
+    {
+        if( generation == 0 ||
+            cookie[4] != (unsigned char)( generation - 1 ) )
+            return( -1 );
 
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR +
-                MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif
+        generation--;
+    }
 
-    if( ret != 0 )
-        return( ret );
+    if( ssl_cookie_hmac( &ctx->keys[generation % COOKIE_KEYS], cookie,
+                         &p, p + sizeof( ref_hmac ),
+                         cli_id, cli_id_len ) != 0 )
+        return( -1 );
 
-    if( mbedtls_ssl_safer_memcmp( cookie + 4, ref_hmac, sizeof( ref_hmac ) ) != 0 )
+    if( mbedtls_ssl_safer_memcmp( cookie + COOKIE_HDR_LEN, ref_hmac,
+                                  sizeof( ref_hmac ) ) != 0 )
         return( -1 );
 
 #if defined(MBEDTLS_HAVE_TIME)
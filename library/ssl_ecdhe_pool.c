@@ -0,0 +1,294 @@
+/*
+ *  Pool of pre-generated ECDHE key pairs for SSL servers
+ *
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+/*
+ * Key pairs are kept in a list per curve. Generation happens outside the
+ * mutex, which only protects the lists and counters: the number of key pairs
+ * being generated for each curve is recorded so that concurrent fillers do
+ * not overshoot the target.
+ */
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+
+#if defined(MBEDTLS_PLATFORM_C)
+#include "mbedtls/platform.h"
+#else
+#include <stdlib.h>
+#define mbedtls_calloc    calloc
+#define mbedtls_free      free
+#endif
+
+#include "mbedtls/ssl_ecdhe_pool.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+struct mbedtls_ssl_ecdhe_pool_key
+{
+    mbedtls_mpi d;
+    mbedtls_ecp_point Q;
+    mbedtls_ssl_ecdhe_pool_key *next;
+};
+
+static void ssl_ecdhe_pool_key_free( mbedtls_ssl_ecdhe_pool_key *key )
+{
+    mbedtls_mpi_free( &key->d );
+    mbedtls_ecp_point_free( &key->Q );
+    mbedtls_free( key );
+}
+
+void mbedtls_ssl_ecdhe_pool_init( mbedtls_ssl_ecdhe_pool_context *pool )
+{
+    memset( pool, 0, sizeof( mbedtls_ssl_ecdhe_pool_context ) );
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init( &pool->mutex );
+#endif
+}
+
+int mbedtls_ssl_ecdhe_pool_setup( mbedtls_ssl_ecdhe_pool_context *pool,
+                                  const mbedtls_ecp_group_id *curves,
+                                  size_t keys )
+{
+    size_t n;
+
+    for( n = 0; curves[n] != MBEDTLS_ECP_DP_NONE; n++ )
+    {
+        if( n == MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES ||
+            mbedtls_ecp_curve_info_from_grp_id( curves[n] ) == NULL )
+            return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+        pool->curves[n].grp_id = curves[n];
+    }
+
+    pool->curve_count = n;
+    pool->keys_per_curve = keys;
+
+    return( 0 );
+}
+
+int mbedtls_ssl_ecdhe_pool_fill( mbedtls_ssl_ecdhe_pool_context *pool,
+                                 int (*f_rng)(void *, unsigned char *, size_t),
+                                 void *p_rng,
+                                 size_t max )
+{
+    int ret = 0;
+    size_t i, best, done = 0;
+    mbedtls_ssl_ecdhe_pool_curve *cur;
+    mbedtls_ssl_ecdhe_pool_key *key = NULL;
+    mbedtls_ecp_group grp[MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES];
+
+    for( i = 0; i < MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES; i++ )
+        mbedtls_ecp_group_init( &grp[i] );
+
+    while( max == 0 || done < max )
+    {
+#if defined(MBEDTLS_THREADING_C)
+        if( ( ret = mbedtls_mutex_lock( &pool->mutex ) ) != 0 )
+            break;
+#endif
+
+        /* Pick the curve furthest from its target */
+        best = pool->curve_count;
+        for( i = 0; i < pool->curve_count; i++ )
+        {
+            cur = &pool->curves[i];
+            if( cur->ready + cur->pending >= pool->keys_per_curve )
+                continue;
+
+            if( best == pool->curve_count ||
+                cur->ready + cur->pending <
+                pool->curves[best].ready + pool->curves[best].pending )
+                best = i;
+        }
+
+        if( best != pool->curve_count )
+            pool->curves[best].pending++;
+
+#if defined(MBEDTLS_THREADING_C)
+        if( ( ret = mbedtls_mutex_unlock( &pool->mutex ) ) != 0 )
+            break;
+#endif
+
+        if( best == pool->curve_count )
+            break;
+
+        cur = &pool->curves[best];
+
+        if( key == NULL )
+        {
+            key = mbedtls_calloc( 1, sizeof( mbedtls_ssl_ecdhe_pool_key ) );
+            if( key == NULL )
+                ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            else
+            {
+                mbedtls_mpi_init( &key->d );
+                mbedtls_ecp_point_init( &key->Q );
+            }
+        }
+
+        if( ret == 0 && grp[best].pbits == 0 )
+            ret = mbedtls_ecp_group_load( &grp[best], cur->grp_id );
+
+        if( ret == 0 )
+            ret = mbedtls_ecdh_gen_public( &grp[best], &key->d, &key->Q,
+                                           f_rng, p_rng );
+
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        {
+            ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+            break;
+        }
+#endif
+
+        cur->pending--;
+        if( ret == 0 )
+        {
+            key->next = cur->keys;
+            cur->keys = key;
+            cur->ready++;
+            key = NULL;
+        }
+
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_unlock( &pool->mutex ) != 0 && ret == 0 )
+            ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif
+
+        if( ret != 0 )
+            break;
+
+        done++;
+    }
+
+    if( key != NULL )
+        ssl_ecdhe_pool_key_free( key );
+
+    for( i = 0; i < MBEDTLS_SSL_ECDHE_POOL_MAX_CURVES; i++ )
+        mbedtls_ecp_group_free( &grp[i] );
+
+    return( ret != 0 ? ret : (int) done );
+}
+
+int mbedtls_ssl_ecdhe_pool_take( mbedtls_ssl_ecdhe_pool_context *pool,
+                                 mbedtls_ecp_group_id grp_id,
+                                 mbedtls_mpi *d, mbedtls_ecp_point *Q )
+{
+    size_t i;
+    mbedtls_ssl_ecdhe_pool_curve *cur;
+    mbedtls_ssl_ecdhe_pool_key *key = NULL;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return( 1 );
+#endif
+
+    for( i = 0; i < pool->curve_count; i++ )
+    {
+        cur = &pool->curves[i];
+        if( cur->grp_id != grp_id || cur->keys == NULL )
+            continue;
+
+        key = cur->keys;
+        cur->keys = key->next;
+        cur->ready--;
+        break;
+    }
+
+    if( key != NULL )
+        pool->hits++;
+    else
+        pool->misses++;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock( &pool->mutex );
+#endif
+
+    if( key == NULL )
+        return( 1 );
+
+    /* Swapping hands the key over without copying it or allocating */
+    mbedtls_mpi_swap( d, &key->d );
+    mbedtls_mpi_swap( &Q->X, &key->Q.X );
+    mbedtls_mpi_swap( &Q->Y, &key->Q.Y );
+    mbedtls_mpi_swap( &Q->Z, &key->Q.Z );
+
+    ssl_ecdhe_pool_key_free( key );
+
+    return( 0 );
+}
+
+void mbedtls_ssl_ecdhe_pool_get_stats( mbedtls_ssl_ecdhe_pool_context *pool,
+                                       mbedtls_ssl_ecdhe_pool_stats *stats )
+{
+    size_t i;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+    {
+        memset( stats, 0, sizeof( mbedtls_ssl_ecdhe_pool_stats ) );
+        return;
+    }
+#endif
+
+    stats->hits = pool->hits;
+    stats->misses = pool->misses;
+    stats->ready = 0;
+    for( i = 0; i < pool->curve_count; i++ )
+        stats->ready += pool->curves[i].ready;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock( &pool->mutex );
+#endif
+}
+
+void mbedtls_ssl_ecdhe_pool_free( mbedtls_ssl_ecdhe_pool_context *pool )
+{
+    size_t i;
+    mbedtls_ssl_ecdhe_pool_key *key;
+
+    if( pool == NULL )
+        return;
+
+    for( i = 0; i < pool->curve_count; i++ )
+    {
+        while( ( key = pool->curves[i].keys ) != NULL )
+        {
+            pool->curves[i].keys = key->next;
+            ssl_ecdhe_pool_key_free( key );
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free( &pool->mutex );
+#endif
+
+    mbedtls_platform_zeroize( pool, sizeof( mbedtls_ssl_ecdhe_pool_context ) );
+}
+
+#endif /* MBEDTLS_SSL_ECDHE_POOL_C */
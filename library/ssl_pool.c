@@ -0,0 +1,295 @@
+/*
+ *  SSL/TLS pool for record buffers and per-connection structures
+ *
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+/*
+ * Objects of each class are carved from slabs of a fixed number of objects.
+ * Released objects are wiped and kept on a per-class free list until the
+ * pool itself is freed, so that steady-state connection churn never reaches
+ * the general-purpose allocator.
+ */
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_SSL_POOL_C)
+
+#if defined(MBEDTLS_PLATFORM_C)
+#include "mbedtls/platform.h"
+#else
+#include <stdlib.h>
+#define mbedtls_calloc    calloc
+#define mbedtls_free      free
+#endif
+
+#include "mbedtls/ssl_pool.h"
+#include "mbedtls/ssl_internal.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+/*
+ * Slab header, followed by slab_objects objects of the class size.
+ * The union makes sure objects following the header are suitably aligned.
+ */
+struct mbedtls_ssl_pool_slab
+{
+    union
+    {
+        struct
+        {
+            mbedtls_ssl_pool_slab *next;
+            size_t objects;
+        } hdr;
+        unsigned long long ull;
+        long double ld;
+    } u;
+};
+
+#define SSL_POOL_ALIGN  sizeof( mbedtls_ssl_pool_slab )
+#define SSL_POOL_ROUND( len )                                       \
+    ( ( ( len ) + SSL_POOL_ALIGN - 1 ) / SSL_POOL_ALIGN * SSL_POOL_ALIGN )
+
+static size_t ssl_pool_object_size( mbedtls_ssl_pool_class cls )
+{
+    switch( cls )
+    {
+        case MBEDTLS_SSL_POOL_IN_BUF:
+            return( SSL_POOL_ROUND( MBEDTLS_SSL_IN_BUFFER_LEN ) );
+        case MBEDTLS_SSL_POOL_OUT_BUF:
+            return( SSL_POOL_ROUND( MBEDTLS_SSL_OUT_BUFFER_LEN ) );
+        case MBEDTLS_SSL_POOL_TRANSFORM:
+            return( SSL_POOL_ROUND( sizeof( mbedtls_ssl_transform ) ) );
+        case MBEDTLS_SSL_POOL_HANDSHAKE:
+            return( SSL_POOL_ROUND( sizeof( mbedtls_ssl_handshake_params ) ) );
+        default:
+            return( 0 );
+    }
+}
+
+void mbedtls_ssl_pool_init( mbedtls_ssl_pool_context *pool )
+{
+    memset( pool, 0, sizeof( mbedtls_ssl_pool_context ) );
+
+    pool->slab_objects = MBEDTLS_SSL_POOL_DEFAULT_SLAB_OBJECTS;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init( &pool->mutex );
+#endif
+}
+
+void mbedtls_ssl_pool_set_slab_objects( mbedtls_ssl_pool_context *pool,
+                                        size_t objects )
+{
+    pool->slab_objects = ( objects == 0 ) ? 1 : objects;
+}
+
+/*
+ * Allocate a new slab for the given class and thread its objects onto the
+ * free list. Must be called with the mutex held.
+ */
+static int ssl_pool_grow( mbedtls_ssl_pool_context *pool,
+                          mbedtls_ssl_pool_class cls, size_t objects )
+{
+    size_t obj_len = ssl_pool_object_size( cls );
+    mbedtls_ssl_pool_slab *slab;
+    unsigned char *p;
+    size_t i;
+
+    if( objects > ( (size_t) -1 - SSL_POOL_ALIGN ) / obj_len )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    slab = mbedtls_calloc( 1, SSL_POOL_ALIGN + objects * obj_len );
+    if( slab == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    slab->u.hdr.next = pool->slabs[cls];
+    slab->u.hdr.objects = objects;
+    pool->slabs[cls] = slab;
+
+    p = (unsigned char *) slab + SSL_POOL_ALIGN;
+    for( i = 0; i < objects; i++, p += obj_len )
+    {
+        memcpy( p, &pool->free_list[cls], sizeof( void * ) );
+        pool->free_list[cls] = p;
+    }
+
+    pool->stats[cls].cached += objects;
+
+    return( 0 );
+}
+
+int mbedtls_ssl_pool_reserve( mbedtls_ssl_pool_context *pool,
+                              size_t connections )
+{
+    int ret = 0;
+    int cls;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+#endif
+
+    for( cls = 0; cls < MBEDTLS_SSL_POOL_CLASSES; cls++ )
+    {
+        mbedtls_ssl_pool_stats *st = &pool->stats[cls];
+        size_t have = st->cached + st->in_use;
+
+        if( have >= connections )
+            continue;
+
+        if( ( ret = ssl_pool_grow( pool, (mbedtls_ssl_pool_class) cls,
+                                   connections - have ) ) != 0 )
+            break;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &pool->mutex ) != 0 )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+#endif
+
+    return( ret );
+}
+
+void *mbedtls_ssl_pool_alloc( mbedtls_ssl_pool_context *pool,
+                              mbedtls_ssl_pool_class cls )
+{
+    unsigned char *obj = NULL;
+
+    if( (int) cls < 0 || cls >= MBEDTLS_SSL_POOL_CLASSES )
+        return( NULL );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return( NULL );
+#endif
+
+    if( pool->free_list[cls] != NULL )
+    {
+        pool->stats[cls].hits++;
+    }
+    else
+    {
+        pool->stats[cls].misses++;
+
+        if( ssl_pool_grow( pool, cls, pool->slab_objects ) != 0 )
+            goto exit;
+    }
+
+    obj = pool->free_list[cls];
+    memcpy( &pool->free_list[cls], obj, sizeof( void * ) );
+
+    /* The rest of the object was wiped on release or is fresh from calloc */
+    memset( obj, 0, sizeof( void * ) );
+
+    pool->stats[cls].cached--;
+    pool->stats[cls].in_use++;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    /* The object is off the free list by now: hand it out rather than lose
+     * it if unlocking fails, as mbedtls_ssl_pool_release() does */
+    mbedtls_mutex_unlock( &pool->mutex );
+#endif
+
+    return( obj );
+}
+
+void mbedtls_ssl_pool_release( mbedtls_ssl_pool_context *pool,
+                               mbedtls_ssl_pool_class cls, void *obj )
+{
+    if( obj == NULL || (int) cls < 0 || cls >= MBEDTLS_SSL_POOL_CLASSES )
+        return;
+
+    /* Wipe outside the lock: the object is not shared yet */
+    mbedtls_platform_zeroize( obj, ssl_pool_object_size( cls ) );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return;
+#endif
+
+    memcpy( obj, &pool->free_list[cls], sizeof( void * ) );
+    pool->free_list[cls] = obj;
+
+    pool->stats[cls].cached++;
+    pool->stats[cls].in_use--;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock( &pool->mutex );
+#endif
+}
+
+void mbedtls_ssl_pool_get_stats( mbedtls_ssl_pool_context *pool,
+                                 mbedtls_ssl_pool_class cls,
+                                 mbedtls_ssl_pool_stats *stats )
+{
+    memset( stats, 0, sizeof( mbedtls_ssl_pool_stats ) );
+
+    if( (int) cls < 0 || cls >= MBEDTLS_SSL_POOL_CLASSES )
+        return;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return;
+#endif
+
+    *stats = pool->stats[cls];
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock( &pool->mutex );
+#endif
+}
+
+void mbedtls_ssl_pool_free( mbedtls_ssl_pool_context *pool )
+{
+    mbedtls_ssl_pool_slab *slab, *next;
+    int cls;
+
+    if( pool == NULL )
+        return;
+
+    for( cls = 0; cls < MBEDTLS_SSL_POOL_CLASSES; cls++ )
+    {
+        size_t obj_len = ssl_pool_object_size( (mbedtls_ssl_pool_class) cls );
+
+        slab = pool->slabs[cls];
+        while( slab != NULL )
+        {
+            next = slab->u.hdr.next;
+
+            mbedtls_platform_zeroize( slab,
+                                SSL_POOL_ALIGN + slab->u.hdr.objects * obj_len );
+            mbedtls_free( slab );
+
+            slab = next;
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free( &pool->mutex );
+#endif
+
+    mbedtls_platform_zeroize( pool, sizeof( mbedtls_ssl_pool_context ) );
+}
+
+#endif /* MBEDTLS_SSL_POOL_C */
@@ -46,6 +46,10 @@
 #include "mbedtls/ecp.h"
 #endif
 
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+#include "mbedtls/ssl_ecdhe_pool.h"
+#endif
+
 #if defined(MBEDTLS_HAVE_TIME)
 #include "mbedtls/platform_time.h"
 #endif
@@ -842,23 +846,15 @@ static int ssl_pick_cert( mbedtls_ssl_context *ssl,
  * Check if a given ciphersuite is suitable for use with our config/keys/etc
  * Sets ciphersuite_info only if the suite matches.
  */
-static int ssl_ciphersuite_match( mbedtls_ssl_context *ssl, int suite_id,
-                                  const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
+static int ssl_ciphersuite_match_info( mbedtls_ssl_context *ssl,
+                            const mbedtls_ssl_ciphersuite_t *suite_info,
+                            const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
 {
-    const mbedtls_ssl_ciphersuite_t *suite_info;
-
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2) && \
     defined(MBEDTLS_KEY_EXCHANGE__WITH_CERT__ENABLED)
     mbedtls_pk_type_t sig_type;
 #endif
 
-    suite_info = mbedtls_ssl_ciphersuite_from_id( suite_id );
-    if( suite_info == NULL )
-    {
-        MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
-    }
-
     MBEDTLS_SSL_DEBUG_MSG( 3, ( "trying ciphersuite: %s", suite_info->name ) );
 
     if( suite_info->min_minor_ver > ssl->minor_ver ||
@@ -955,6 +951,141 @@ static int ssl_ciphersuite_match( mbedtls_ssl_context *ssl, int suite_id,
     return( 0 );
 }
 
+static int ssl_ciphersuite_match( mbedtls_ssl_context *ssl, int suite_id,
+                                  const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
+{
+    const mbedtls_ssl_ciphersuite_t *suite_info;
+
+    suite_info = mbedtls_ssl_ciphersuite_from_id( suite_id );
+    if( suite_info == NULL )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+    }
+
+    return( ssl_ciphersuite_match_info( ssl, suite_info, ciphersuite_info ) );
+}
+
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+/*
+ * Choose a ciphersuite with the index of our list: map the client's offer
+ * onto it in one pass, rule out with the capability bitsets whatever this
+ * connection can't use, and only run the full checks on what's left, in
+ * order of preference.
+ * Sets ciphersuite_info only if a suite matches.
+ */
+static int ssl_ciphersuite_choose( mbedtls_ssl_context *ssl,
+                            const mbedtls_ssl_ciphersuite_index *index,
+                            const unsigned char *offer, size_t offer_len,
+                            int *got_common_suite,
+                            const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
+{
+    int ret, pos;
+    size_t i, w;
+    uint32_t usable[( MBEDTLS_SSL_CIPHERSUITE_INDEX_MAX + 31 ) / 32];
+    const uint32_t *caps = index->caps;
+    const size_t words = index->words;
+
+    memset( usable, 0, sizeof( usable ) );
+
+    for( i = 0; i + 1 < offer_len; i += 2 )
+    {
+        pos = mbedtls_ssl_ciphersuite_index_find( index,
+                                        ( offer[i] << 8 ) | offer[i + 1] );
+        if( pos >= 0 )
+            usable[pos / 32] |= (uint32_t) 1 << ( pos % 32 );
+    }
+
+    for( w = 0; w < words; w++ )
+    {
+        if( usable[w] != 0 )
+            *got_common_suite = 1;
+
+        usable[w] &= caps[( MBEDTLS_SSL_CS_MINOR_VERSION_0 +
+                            ssl->minor_ver ) * words + w];
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        if( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM )
+            usable[w] &= ~caps[MBEDTLS_SSL_CS_NODTLS * words + w];
+#endif
+#if defined(MBEDTLS_ARC4_C)
+        if( ssl->conf->arc4_disabled == MBEDTLS_SSL_ARC4_DISABLED )
+            usable[w] &= ~caps[MBEDTLS_SSL_CS_ARC4 * words + w];
+#endif
+#if defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
+        if( ( ssl->handshake->cli_exts & MBEDTLS_TLS_EXT_ECJPAKE_KKPP_OK ) == 0 )
+            usable[w] &= ~caps[MBEDTLS_SSL_CS_ECJPAKE * words + w];
+#endif
+#if defined(MBEDTLS_ECDH_C) || defined(MBEDTLS_ECDSA_C)
+        if( ssl->handshake->curves == NULL ||
+            ssl->handshake->curves[0] == NULL )
+            usable[w] &= ~caps[MBEDTLS_SSL_CS_EC * words + w];
+#endif
+#if defined(MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED)
+        if( ssl_conf_has_psk_or_cb( ssl->conf ) == 0 )
+            usable[w] &= ~caps[MBEDTLS_SSL_CS_PSK * words + w];
+#endif
+    }
+
+#if defined(MBEDTLS_SSL_SRV_RESPECT_CLIENT_PREFERENCE)
+    for( i = 0; i + 1 < offer_len; i += 2 )
+    {
+        pos = mbedtls_ssl_ciphersuite_index_find( index,
+                                        ( offer[i] << 8 ) | offer[i + 1] );
+#else
+    for( pos = 0; pos < (int) index->count; pos++ )
+    {
+#endif
+        if( pos < 0 ||
+            ( usable[pos / 32] & ( (uint32_t) 1 << ( pos % 32 ) ) ) == 0 )
+            continue;
+
+        /* Try each ciphersuite once */
+        usable[pos / 32] &= ~( (uint32_t) 1 << ( pos % 32 ) );
+
+        if( ( ret = ssl_ciphersuite_match_info( ssl, index->info[pos],
+                                                ciphersuite_info ) ) != 0 )
+            return( ret );
+
+        if( *ciphersuite_info != NULL )
+            break;
+    }
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_CIPHERSUITE_INDEX */
+
+/*
+ * Hash the rest of the handshake with the digest of the ciphersuite only.
+ * A TLS 1.2 client may sign CertificateVerify with another digest, though:
+ * if it can be asked for a certificate, keep the transcript until
+ * ssl_parse_certificate_verify() knows which one.
+ */
+static void ssl_optimize_checksum( mbedtls_ssl_context *ssl,
+                            const mbedtls_ssl_ciphersuite_t *ciphersuite_info )
+{
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2) && \
+    defined(MBEDTLS_KEY_EXCHANGE__CERT_REQ_ALLOWED__ENABLED)
+    int authmode;
+
+#if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
+    if( ssl->handshake->sni_authmode != MBEDTLS_SSL_VERIFY_UNSET )
+        authmode = ssl->handshake->sni_authmode;
+    else
+#endif
+        authmode = ssl->conf->authmode;
+
+    if( ssl->minor_ver == MBEDTLS_SSL_MINOR_VERSION_3 &&
+        authmode != MBEDTLS_SSL_VERIFY_NONE &&
+        mbedtls_ssl_ciphersuite_cert_req_allowed( ciphersuite_info ) )
+    {
+        return;
+    }
+#endif
+
+    mbedtls_ssl_optimize_checksum( ssl, ciphersuite_info );
+}
+
 #if defined(MBEDTLS_SSL_SRV_SUPPORT_SSLV2_CLIENT_HELLO)
 static int ssl_parse_client_hello_v2( mbedtls_ssl_context *ssl )
 {
@@ -1196,6 +1327,7 @@ have_ciphersuite_v2:
 
     ssl->session_negotiate->ciphersuite = ciphersuites[i];
     ssl->transform_negotiate->ciphersuite_info = ciphersuite_info;
+    ssl_optimize_checksum( ssl, ciphersuite_info );
 
     /*
      * SSLv2 Client Hello relevant renegotiation security checks
@@ -1237,6 +1369,9 @@ static int ssl_parse_client_hello( mbedtls_ssl_context *ssl )
     int handshake_failure = 0;
     const int *ciphersuites;
     const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    const mbedtls_ssl_ciphersuite_index *index;
+#endif
     int major, minor;
 
     /* If there is no signature-algorithm extension present,
@@ -1997,6 +2132,23 @@ read_record_header:
     got_common_suite = 0;
     ciphersuites = ssl->conf->ciphersuite_list[ssl->minor_ver];
     ciphersuite_info = NULL;
+
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    index = ssl->conf->ciphersuite_index[ssl->minor_ver];
+    if( index != NULL && index->list == ciphersuites )
+    {
+        if( ( ret = ssl_ciphersuite_choose( ssl, index, buf + ciph_offset + 2,
+                                            ciph_len, &got_common_suite,
+                                            &ciphersuite_info ) ) != 0 )
+            return( ret );
+
+        if( ciphersuite_info != NULL )
+            goto have_ciphersuite;
+
+        goto no_ciphersuite;
+    }
+#endif
+
 #if defined(MBEDTLS_SSL_SRV_RESPECT_CLIENT_PREFERENCE)
     for( j = 0, p = buf + ciph_offset + 2; j < ciph_len; j += 2, p += 2 )
         for( i = 0; ciphersuites[i] != 0; i++ )
@@ -2019,6 +2171,9 @@ read_record_header:
                 goto have_ciphersuite;
         }
 
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+no_ciphersuite:
+#endif
     if( got_common_suite )
     {
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "got ciphersuites in common, "
@@ -2038,8 +2193,9 @@ read_record_header:
 have_ciphersuite:
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "selected ciphersuite: %s", ciphersuite_info->name ) );
 
-    ssl->session_negotiate->ciphersuite = ciphersuites[i];
+    ssl->session_negotiate->ciphersuite = ciphersuite_info->id;
     ssl->transform_negotiate->ciphersuite_info = ciphersuite_info;
+    ssl_optimize_checksum( ssl, ciphersuite_info );
 
     ssl->state++;
 
@@ -2932,6 +3088,45 @@ static int ssl_resume_server_key_exchange( mbedtls_ssl_context *ssl,
 #endif /* defined(MBEDTLS_KEY_EXCHANGE__WITH_SERVER_SIGNATURE__ENABLED) &&
           defined(MBEDTLS_SSL_ASYNC_PRIVATE) */
 
+#if defined(MBEDTLS_KEY_EXCHANGE__SOME__ECDHE_ENABLED)
+/*
+ * Generate the ECDHE key pair for the ECDH context's group and write the
+ * ServerECDHParams, using a pre-generated key pair if one is ready.
+ */
+static int ssl_ecdh_make_params( mbedtls_ssl_context *ssl, size_t *olen,
+                                 unsigned char *buf, size_t blen )
+{
+    mbedtls_ecdh_context *ecdh = &ssl->handshake->ecdh_ctx;
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+    int ret;
+    size_t grp_len, pt_len;
+
+    if( ssl->conf->p_ecdhe_pool != NULL &&
+        mbedtls_ssl_ecdhe_pool_take( ssl->conf->p_ecdhe_pool, ecdh->grp.id,
+                                     &ecdh->d, &ecdh->Q ) == 0 )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 3, ( "using a pre-generated ECDHE key pair" ) );
+
+        if( ( ret = mbedtls_ecp_tls_write_group( &ecdh->grp, &grp_len,
+                                                 buf, blen ) ) != 0 )
+            return( ret );
+
+        if( ( ret = mbedtls_ecp_tls_write_point( &ecdh->grp, &ecdh->Q,
+                                                 ecdh->point_format, &pt_len,
+                                                 buf + grp_len,
+                                                 blen - grp_len ) ) != 0 )
+            return( ret );
+
+        *olen = grp_len + pt_len;
+        return( 0 );
+    }
+#endif /* MBEDTLS_SSL_ECDHE_POOL_C */
+
+    return( mbedtls_ecdh_make_params( ecdh, olen, buf, blen,
+                                      ssl->conf->f_rng, ssl->conf->p_rng ) );
+}
+#endif /* MBEDTLS_KEY_EXCHANGE__SOME__ECDHE_ENABLED */
+
 /* Prepare the ServerKeyExchange message, up to and including
  * calculating the signature if any, but excluding formatting the
  * signature and sending the message. */
@@ -3095,11 +3290,9 @@ curve_matching_done:
             return( ret );
         }
 
-        if( ( ret = mbedtls_ecdh_make_params(
-                  &ssl->handshake->ecdh_ctx, &len,
+        if( ( ret = ssl_ecdh_make_params( ssl, &len,
                   ssl->out_msg + ssl->out_msglen,
-                  MBEDTLS_SSL_OUT_CONTENT_LEN - ssl->out_msglen,
-                  ssl->conf->f_rng, ssl->conf->p_rng ) ) != 0 )
+                  MBEDTLS_SSL_OUT_CONTENT_LEN - ssl->out_msglen ) ) != 0 )
         {
             MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ecdh_make_params", ret );
             return( ret );
@@ -4096,6 +4289,7 @@ static int ssl_parse_certificate_verify( mbedtls_ssl_context *ssl )
         ssl->session_negotiate->peer_cert == NULL )
     {
         MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= skip parse certificate verify" ) );
+        mbedtls_ssl_optimize_checksum( ssl, ciphersuite_info );
         ssl->state++;
         return( 0 );
     }
@@ -4222,6 +4416,7 @@ static int ssl_parse_certificate_verify( mbedtls_ssl_context *ssl )
 
     /* Calculate hash and verify signature */
     ssl->handshake->calc_verify( ssl, hash );
+    mbedtls_ssl_optimize_checksum( ssl, ciphersuite_info );
 
     if( ( ret = mbedtls_pk_verify( &ssl->session_negotiate->peer_cert->pk,
                            md_alg, hash_start, hashlen,
@@ -54,6 +54,56 @@
 #include "mbedtls/oid.h"
 #endif
 
+#if defined(MBEDTLS_SSL_POOL_C)
+#include "mbedtls/ssl_pool.h"
+#define SSL_OBJ_IN_BUF      MBEDTLS_SSL_POOL_IN_BUF
+#define SSL_OBJ_OUT_BUF     MBEDTLS_SSL_POOL_OUT_BUF
+#define SSL_OBJ_TRANSFORM   MBEDTLS_SSL_POOL_TRANSFORM
+#define SSL_OBJ_HANDSHAKE   MBEDTLS_SSL_POOL_HANDSHAKE
+#else
+#define SSL_OBJ_IN_BUF      0
+#define SSL_OBJ_OUT_BUF     1
+#define SSL_OBJ_TRANSFORM   2
+#define SSL_OBJ_HANDSHAKE   3
+#endif
+
+/*
+ * Allocate a zeroed record buffer or sub-context, from the pool attached to
+ * the configuration if there is one.
+ */
+static void *ssl_obj_alloc( const mbedtls_ssl_config *conf, int cls,
+                            size_t len )
+{
+#if defined(MBEDTLS_SSL_POOL_C)
+    if( conf->p_pool != NULL )
+        return( mbedtls_ssl_pool_alloc( conf->p_pool,
+                                        (mbedtls_ssl_pool_class) cls ) );
+#else
+    ((void) conf);
+    ((void) cls);
+#endif
+    return( mbedtls_calloc( 1, len ) );
+}
+
+/*
+ * Release an object obtained from ssl_obj_alloc().
+ */
+static void ssl_obj_free( const mbedtls_ssl_config *conf, int cls, void *obj )
+{
+#if defined(MBEDTLS_SSL_POOL_C)
+    if( conf != NULL && conf->p_pool != NULL )
+    {
+        mbedtls_ssl_pool_release( conf->p_pool,
+                                  (mbedtls_ssl_pool_class) cls, obj );
+        return;
+    }
+#else
+    ((void) conf);
+    ((void) cls);
+#endif
+    mbedtls_free( obj );
+}
+
 static void ssl_reset_in_out_pointers( mbedtls_ssl_context *ssl );
 static uint32_t ssl_get_hs_total_len( mbedtls_ssl_context const *ssl );
 
@@ -576,7 +626,19 @@ static int tls_prf_sha384( const unsigned char *secret, size_t slen,
 #endif /* MBEDTLS_SHA512_C */
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
+/*
+ * Digests run over the handshake messages, see ssl_update_checksum_start()
+ */
+#define SSL_CHECKSUM_MD5SHA1    0x01
+#define SSL_CHECKSUM_SHA256     0x02
+#define SSL_CHECKSUM_SHA384     0x04
+#define SSL_CHECKSUM_ALL        0x07
+#define SSL_CHECKSUM_BUFFERED   0x80    /* messages still kept in transcript */
+
+#define SSL_TRANSCRIPT_MIN_SIZE 512
+
 static void ssl_update_checksum_start( mbedtls_ssl_context *, const unsigned char *, size_t );
+static void ssl_checksum_enable( mbedtls_ssl_context *, int );
 
 #if defined(MBEDTLS_SSL_PROTO_SSL3) || defined(MBEDTLS_SSL_PROTO_TLS1) || \
     defined(MBEDTLS_SSL_PROTO_TLS1_1)
@@ -1218,6 +1280,12 @@ int mbedtls_ssl_derive_keys( mbedtls_ssl_context *ssl )
         return( ret );
     }
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    /* Keep the key around to set up the contexts of asynchronous records */
+    if( transform->keylen <= sizeof( transform->key_enc ) )
+        memcpy( transform->key_enc, key1, transform->keylen );
+#endif
+
     if( ( ret = mbedtls_cipher_setkey( &transform->cipher_ctx_dec, key2,
                                cipher_info->key_bitlen,
                                MBEDTLS_DECRYPT ) ) != 0 )
@@ -1297,6 +1365,7 @@ void ssl_calc_verify_ssl( mbedtls_ssl_context *ssl, unsigned char hash[36] )
     mbedtls_md5_init( &md5 );
     mbedtls_sha1_init( &sha1 );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_MD5SHA1 );
     mbedtls_md5_clone( &md5, &ssl->handshake->fin_md5 );
     mbedtls_sha1_clone( &sha1, &ssl->handshake->fin_sha1 );
 
@@ -1344,6 +1413,7 @@ void ssl_calc_verify_tls( mbedtls_ssl_context *ssl, unsigned char hash[36] )
     mbedtls_md5_init( &md5 );
     mbedtls_sha1_init( &sha1 );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_MD5SHA1 );
     mbedtls_md5_clone( &md5, &ssl->handshake->fin_md5 );
     mbedtls_sha1_clone( &sha1, &ssl->handshake->fin_sha1 );
 
@@ -1370,6 +1440,7 @@ void ssl_calc_verify_tls_sha256( mbedtls_ssl_context *ssl, unsigned char hash[32
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> calc verify sha256" ) );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_SHA256 );
     mbedtls_sha256_clone( &sha256, &ssl->handshake->fin_sha256 );
     mbedtls_sha256_finish_ret( &sha256, hash );
 
@@ -1391,6 +1462,7 @@ void ssl_calc_verify_tls_sha384( mbedtls_ssl_context *ssl, unsigned char hash[48
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> calc verify sha384" ) );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_SHA384 );
     mbedtls_sha512_clone( &sha512, &ssl->handshake->fin_sha512 );
     mbedtls_sha512_finish_ret( &sha512, hash );
 
@@ -2678,6 +2750,51 @@ static int ssl_resend_hello_request( mbedtls_ssl_context *ssl )
 #endif
 #endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_RENEGOTIATION */
 
+#if defined(MBEDTLS_SSL_PROTO_DTLS) || defined(MBEDTLS_SSL_READ_AHEAD)
+/*
+ * Drop the record that has just been processed, moving data read past its
+ * end (further records of the same datagram, or read-ahead data) to in_hdr.
+ */
+static int ssl_move_to_next_record( mbedtls_ssl_context *ssl )
+{
+    if( ssl->next_record_offset == 0 )
+        return( 0 );
+
+    if( ssl->in_left < ssl->next_record_offset )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+    }
+
+    ssl->in_left -= ssl->next_record_offset;
+
+    if( ssl->in_left != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "next record already read, offset: %d",
+                                    ssl->next_record_offset ) );
+        memmove( ssl->in_hdr,
+                 ssl->in_hdr + ssl->next_record_offset,
+                 ssl->in_left );
+    }
+
+    ssl->next_record_offset = 0;
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_PROTO_DTLS || MBEDTLS_SSL_READ_AHEAD */
+
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+/*
+ * Should we read past the end of the current record?
+ */
+static int ssl_read_ahead_applies( const mbedtls_ssl_context *ssl )
+{
+    return( ssl->conf->read_ahead != 0 &&
+            ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+            ssl->state == MBEDTLS_SSL_HANDSHAKE_OVER );
+}
+#endif /* MBEDTLS_SSL_READ_AHEAD */
+
 /*
  * Fill the input message buffer by appending data to it.
  * The amount of data already fetched is in ssl->in_left.
@@ -2736,27 +2853,8 @@ int mbedtls_ssl_fetch_input( mbedtls_ssl_context *ssl, size_t nb_want )
         /*
          * Move to the next record in the already read datagram if applicable
          */
-        if( ssl->next_record_offset != 0 )
-        {
-            if( ssl->in_left < ssl->next_record_offset )
-            {
-                MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
-                return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
-            }
-
-            ssl->in_left -= ssl->next_record_offset;
-
-            if( ssl->in_left != 0 )
-            {
-                MBEDTLS_SSL_DEBUG_MSG( 2, ( "next record in same datagram, offset: %d",
-                                    ssl->next_record_offset ) );
-                memmove( ssl->in_hdr,
-                         ssl->in_hdr + ssl->next_record_offset,
-                         ssl->in_left );
-            }
-
-            ssl->next_record_offset = 0;
-        }
+        if( ( ret = ssl_move_to_next_record( ssl ) ) != 0 )
+            return( ret );
 
         MBEDTLS_SSL_DEBUG_MSG( 2, ( "in_left: %d, nb_want: %d",
                        ssl->in_left, nb_want ) );
@@ -2858,6 +2956,11 @@ int mbedtls_ssl_fetch_input( mbedtls_ssl_context *ssl, size_t nb_want )
     else
 #endif
     {
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+        if( ( ret = ssl_move_to_next_record( ssl ) ) != 0 )
+            return( ret );
+#endif
+
         MBEDTLS_SSL_DEBUG_MSG( 2, ( "in_left: %d, nb_want: %d",
                        ssl->in_left, nb_want ) );
 
@@ -2865,6 +2968,18 @@ int mbedtls_ssl_fetch_input( mbedtls_ssl_context *ssl, size_t nb_want )
         {
             len = nb_want - ssl->in_left;
 
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+            /* Ask for whatever the transport already has, within budget */
+            if( ssl_read_ahead_applies( ssl ) && len < ssl->conf->read_ahead )
+            {
+                size_t room = MBEDTLS_SSL_IN_BUFFER_LEN - ssl->in_left -
+                              (size_t)( ssl->in_hdr - ssl->in_buf );
+
+                len = ( ssl->conf->read_ahead < room ) ?
+                      ssl->conf->read_ahead : room;
+            }
+#endif
+
             if( ssl_check_timer( ssl ) != 0 )
                 ret = MBEDTLS_ERR_SSL_TIMEOUT;
             else
@@ -2909,29 +3024,48 @@ int mbedtls_ssl_fetch_input( mbedtls_ssl_context *ssl, size_t nb_want )
     return( 0 );
 }
 
+#if defined(MBEDTLS_SSL_WRITE_CORK)
 /*
- * Flush any data not yet written
+ * Protect the open application record built by corked writes, leaving it
+ * in the output buffer behind any other record not yet sent.
  */
-int mbedtls_ssl_flush_output( mbedtls_ssl_context *ssl )
+static int ssl_cork_seal( mbedtls_ssl_context *ssl )
 {
     int ret;
-    unsigned char *buf;
 
-    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> flush output" ) );
+    if( ssl->out_cork_len == 0 )
+        return( 0 );
 
-    if( ssl->f_send == NULL )
+    MBEDTLS_SSL_DEBUG_MSG( 3, ( "seal corked record, %d bytes",
+                                (int) ssl->out_cork_len ) );
+
+    ssl->out_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    ssl->out_msglen  = ssl->out_cork_len;
+    ssl->out_cork_len = 0;
+
+    if( ( ret = mbedtls_ssl_write_record( ssl, SSL_DONT_FORCE_FLUSH ) ) != 0 )
     {
-        MBEDTLS_SSL_DEBUG_MSG( 1, ( "Bad usage of mbedtls_ssl_set_bio() "
-                            "or mbedtls_ssl_set_bio()" ) );
-        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_write_record", ret );
+        return( ret );
     }
 
+    ssl->out_cork_pending = 1;
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_WRITE_CORK */
+
+/*
+ * Hand the records in the output buffer to the send callback
+ */
+static int ssl_flush_out_buf( mbedtls_ssl_context *ssl )
+{
+    int ret;
+    unsigned char *buf;
+
     /* Avoid incrementing counter if data is flushed */
     if( ssl->out_left == 0 )
-    {
-        MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= flush output" ) );
         return( 0 );
-    }
 
     while( ssl->out_left > 0 )
     {
@@ -2957,6 +3091,10 @@ int mbedtls_ssl_flush_output( mbedtls_ssl_context *ssl )
         ssl->out_left -= ret;
     }
 
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    ssl->out_cork_pending = 0;
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM )
     {
@@ -2969,11 +3107,223 @@ int mbedtls_ssl_flush_output( mbedtls_ssl_context *ssl )
     }
     ssl_update_out_pointers( ssl, ssl->transform_out );
 
+    return( 0 );
+}
+
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+/*
+ * States of an asynchronous record slot
+ */
+#define SSL_ASYNC_RECORD_IDLE       0
+#define SSL_ASYNC_RECORD_RUNNING    1
+#define SSL_ASYNC_RECORD_DONE       2
+
+/*
+ * Encrypt and authenticate a record in place (called by the worker)
+ */
+int mbedtls_ssl_async_record_protect( mbedtls_ssl_async_record *record )
+{
+    unsigned char *msg = record->buf + record->hdr_len;
+    size_t olen = 0;
+
+    record->ret = mbedtls_cipher_auth_encrypt( &record->cipher,
+                                       record->iv, sizeof( record->iv ),
+                                       record->add_data,
+                                       sizeof( record->add_data ),
+                                       msg, record->len,
+                                       msg, &olen,
+                                       msg + record->len, record->taglen );
+
+    if( record->ret == 0 && olen != record->len )
+        record->ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+
+    return( record->ret );
+}
+
+void *mbedtls_ssl_async_record_get_data( const mbedtls_ssl_async_record *record )
+{
+    return( record->user_data );
+}
+
+void mbedtls_ssl_async_record_set_data( mbedtls_ssl_async_record *record,
+                                        void *ctx )
+{
+    record->user_data = ctx;
+}
+
+/*
+ * Move the records at the head of the queue to the output buffer, in order,
+ * sending the buffer whenever it is full. Stop at the first record that is
+ * still being protected.
+ */
+static int ssl_async_record_send( mbedtls_ssl_context *ssl )
+{
+    int ret;
+
+    while( ssl->async_rec_count != 0 )
+    {
+        mbedtls_ssl_async_record *rec = &ssl->async_rec[ssl->async_rec_head];
+        size_t rec_len = rec->hdr_len + rec->len + rec->taglen;
+
+        if( rec->state == SSL_ASYNC_RECORD_RUNNING )
+        {
+            ret = ssl->conf->f_async_record_resume( ssl, rec );
+            if( ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS )
+                return( ret );
+
+            rec->state = SSL_ASYNC_RECORD_DONE;
+            rec->user_data = NULL;
+
+            if( ret != 0 )
+            {
+                MBEDTLS_SSL_DEBUG_RET( 1, "f_async_record_resume", ret );
+                return( ret );
+            }
+        }
+
+        if( rec->ret != 0 )
+        {
+            MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_async_record_protect",
+                                   rec->ret );
+            return( rec->ret );
+        }
+
+        if( rec_len > MBEDTLS_SSL_OUT_BUFFER_LEN -
+                      (size_t)( ssl->out_hdr - ssl->out_buf ) )
+        {
+            if( ( ret = ssl_flush_out_buf( ssl ) ) != 0 )
+                return( ret );
+        }
+
+        MBEDTLS_SSL_DEBUG_BUF( 4, "output record sent to network",
+                               rec->buf, rec_len );
+
+        memcpy( ssl->out_hdr, rec->buf, rec_len );
+        ssl->out_left += rec_len;
+        ssl->out_hdr  += rec_len;
+        ssl_update_out_pointers( ssl, ssl->transform_out );
+
+        rec->state = SSL_ASYNC_RECORD_IDLE;
+        ssl->async_rec_head = ( ssl->async_rec_head + 1 ) %
+                              MBEDTLS_SSL_ASYNC_RECORD_SLOTS;
+        ssl->async_rec_count--;
+    }
+
+    return( 0 );
+}
+
+/*
+ * Free the record slots, waiting for the records in flight
+ */
+static void ssl_async_record_free( mbedtls_ssl_context *ssl )
+{
+    size_t i;
+
+    if( ssl->async_rec == NULL )
+        return;
+
+    for( i = 0; i < MBEDTLS_SSL_ASYNC_RECORD_SLOTS; i++ )
+    {
+        mbedtls_ssl_async_record *rec = &ssl->async_rec[i];
+
+        if( rec->state == SSL_ASYNC_RECORD_RUNNING )
+        {
+            if( ssl->conf->f_async_record_cancel != NULL )
+                ssl->conf->f_async_record_cancel( ssl, rec );
+            else
+                while( ssl->conf->f_async_record_resume( ssl, rec ) ==
+                       MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS )
+                    ;
+        }
+
+        mbedtls_cipher_free( &rec->cipher );
+
+        if( rec->buf != NULL )
+        {
+            mbedtls_platform_zeroize( rec->buf, MBEDTLS_SSL_OUT_BUFFER_LEN );
+            mbedtls_free( rec->buf );
+        }
+    }
+
+    mbedtls_platform_zeroize( ssl->async_rec, MBEDTLS_SSL_ASYNC_RECORD_SLOTS *
+                              sizeof( mbedtls_ssl_async_record ) );
+    mbedtls_free( ssl->async_rec );
+
+    ssl->async_rec = NULL;
+    ssl->async_rec_head = 0;
+    ssl->async_rec_count = 0;
+}
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
+
+/*
+ * Flush any data not yet written
+ */
+int mbedtls_ssl_flush_output( mbedtls_ssl_context *ssl )
+{
+    int ret;
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    int async_ret;
+#endif
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> flush output" ) );
+
+    if( ssl->f_send == NULL )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "Bad usage of mbedtls_ssl_set_bio() "
+                            "or mbedtls_ssl_set_bio()" ) );
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    /* Records still being protected are left for a later call */
+    async_ret = ssl_async_record_send( ssl );
+    if( async_ret != 0 && async_ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS )
+        return( async_ret );
+#endif
+
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    if( ( ret = ssl_cork_seal( ssl ) ) != 0 )
+        return( ret );
+#endif
+
+    if( ( ret = ssl_flush_out_buf( ssl ) ) != 0 )
+        return( ret );
+
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    if( async_ret != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= flush output (async in progress)" ) );
+        return( async_ret );
+    }
+#endif
+
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= flush output" ) );
 
     return( 0 );
 }
 
+#if defined(MBEDTLS_SSL_WRITE_CORK) || defined(MBEDTLS_SSL_ASYNC_RECORD)
+/*
+ * Send out corked or asynchronously protected application data before
+ * anything else is written to ssl->out_msg, so that it is neither
+ * overwritten nor reordered.
+ */
+static int ssl_flush_pending_app_data( mbedtls_ssl_context *ssl )
+{
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    if( ssl->out_cork_len != 0 || ssl->out_cork_pending != 0 )
+        return( mbedtls_ssl_flush_output( ssl ) );
+#endif
+
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    if( ssl->async_rec_count != 0 )
+        return( mbedtls_ssl_flush_output( ssl ) );
+#endif
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_WRITE_CORK || MBEDTLS_SSL_ASYNC_RECORD */
+
 /*
  * Functions to handle the DTLS retransmission state machine
  */
@@ -3539,6 +3889,18 @@ int mbedtls_ssl_write_record( mbedtls_ssl_context *ssl, uint8_t force_flush )
     {
         unsigned i;
         size_t protected_record_size;
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+        /* With TLS, the implicit sequence number is stored in the 8 bytes
+         * before the header, which belong to the previous record if it has
+         * not been sent yet: save them and put them back once done. */
+        unsigned char prev_tail[8];
+        const int restore_tail =
+            ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+            ssl->out_left != 0;
+
+        if( restore_tail )
+            memcpy( prev_tail, ssl->out_ctr, 8 );
+#endif /* MBEDTLS_SSL_WRITE_CORK */
 
         ssl->out_hdr[0] = (unsigned char) ssl->out_msgtype;
         mbedtls_ssl_write_version( ssl->major_ver, ssl->minor_ver,
@@ -3561,6 +3923,11 @@ int mbedtls_ssl_write_record( mbedtls_ssl_context *ssl, uint8_t force_flush )
             ssl->out_len[1] = (unsigned char)( len      );
         }
 
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+        if( restore_tail )
+            memcpy( ssl->out_ctr, prev_tail, 8 );
+#endif
+
         protected_record_size = len + mbedtls_ssl_hdr_len( ssl );
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -5201,7 +5568,14 @@ static int ssl_get_next_record( mbedtls_ssl_context *ssl )
     }
     else
 #endif
+    {
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+        /* Keep any read-ahead data for the next call to fetch_input() */
+        ssl->next_record_offset = ssl->in_msglen + mbedtls_ssl_hdr_len( ssl );
+#else
         ssl->in_left = 0;
+#endif
+    }
 
     if( ( ret = ssl_prepare_record_content( ssl ) ) != 0 )
     {
@@ -5413,6 +5787,11 @@ int mbedtls_ssl_send_alert_message( mbedtls_ssl_context *ssl,
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> send alert message" ) );
     MBEDTLS_SSL_DEBUG_MSG( 3, ( "send alert level=%u message=%u", level, message ));
 
+#if defined(MBEDTLS_SSL_WRITE_CORK) || defined(MBEDTLS_SSL_ASYNC_RECORD)
+    if( ( ret = ssl_flush_pending_app_data( ssl ) ) != 0 )
+        return( ret );
+#endif
+
     ssl->out_msgtype = MBEDTLS_SSL_MSG_ALERT;
     ssl->out_msglen = 2;
     ssl->out_msg[0] = level;
@@ -5555,6 +5934,24 @@ int mbedtls_ssl_write_certificate( mbedtls_ssl_context *ssl )
     i = 7;
     crt = mbedtls_ssl_own_cert( ssl );
 
+#if defined(MBEDTLS_SSL_CERT_MSG_CACHE)
+    {
+        const mbedtls_ssl_key_cert *key_cert = ssl->handshake->key_cert != NULL ?
+                                               ssl->handshake->key_cert :
+                                               ssl->conf->key_cert;
+
+        if( key_cert != NULL && key_cert->cert_msg != NULL )
+        {
+            MBEDTLS_SSL_DEBUG_MSG( 3, ( "using cached certificate message" ) );
+
+            memcpy( ssl->out_msg + 4, key_cert->cert_msg,
+                    key_cert->cert_msg_len );
+            i = 4 + key_cert->cert_msg_len;
+            crt = NULL;
+        }
+    }
+#endif /* MBEDTLS_SSL_CERT_MSG_CACHE */
+
     while( crt != NULL )
     {
         n = crt->raw.len;
@@ -5907,6 +6304,17 @@ crt_verify:
         /*
          * Main check: verify certificate
          */
+#if defined(MBEDTLS_X509_CRT_STORE)
+        if( ssl->conf->ca_store != NULL && ca_chain == ssl->conf->ca_chain )
+            ret = mbedtls_x509_crt_verify_with_store_restartable(
+                                ssl->session_negotiate->peer_cert,
+                                ssl->conf->ca_store, ca_crl,
+                                ssl->conf->cert_profile,
+                                ssl->hostname,
+                               &ssl->session_negotiate->verify_result,
+                                ssl->conf->f_vrfy, ssl->conf->p_vrfy, rs_ctx );
+        else
+#endif
         ret = mbedtls_x509_crt_verify_restartable(
                                 ssl->session_negotiate->peer_cert,
                                 ca_chain, ca_crl,
@@ -6131,26 +6539,148 @@ int mbedtls_ssl_parse_change_cipher_spec( mbedtls_ssl_context *ssl )
     return( 0 );
 }
 
-void mbedtls_ssl_optimize_checksum( mbedtls_ssl_context *ssl,
-                            const mbedtls_ssl_ciphersuite_t *ciphersuite_info )
+/*
+ * Until the ciphersuite is known, handshake messages are only appended to
+ * a transcript. Each digest is started from it when first needed, so that
+ * the messages only go through the digests the handshake actually uses.
+ */
+static void ssl_transcript_free( mbedtls_ssl_handshake_params *handshake )
 {
-    ((void) ciphersuite_info);
+    if( handshake->transcript != NULL )
+    {
+        mbedtls_platform_zeroize( handshake->transcript,
+                                  handshake->transcript_size );
+        mbedtls_free( handshake->transcript );
+    }
 
-#if defined(MBEDTLS_SSL_PROTO_SSL3) || defined(MBEDTLS_SSL_PROTO_TLS1) || \
-    defined(MBEDTLS_SSL_PROTO_TLS1_1)
-    if( ssl->minor_ver < MBEDTLS_SSL_MINOR_VERSION_3 )
-        ssl->handshake->update_checksum = ssl_update_checksum_md5sha1;
-    else
-#endif
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-#if defined(MBEDTLS_SHA512_C)
-    if( ciphersuite_info->mac == MBEDTLS_MD_SHA384 )
-        ssl->handshake->update_checksum = ssl_update_checksum_sha384;
-    else
-#endif
-#if defined(MBEDTLS_SHA256_C)
-    if( ciphersuite_info->mac != MBEDTLS_MD_SHA384 )
-        ssl->handshake->update_checksum = ssl_update_checksum_sha256;
+    handshake->transcript = NULL;
+    handshake->transcript_len = 0;
+    handshake->transcript_size = 0;
+    handshake->checksums &= ~SSL_CHECKSUM_BUFFERED;
+}
+
+static int ssl_transcript_append( mbedtls_ssl_handshake_params *handshake,
+                                  const unsigned char *buf, size_t len )
+{
+    unsigned char *transcript;
+    size_t size = handshake->transcript_size;
+
+    if( len > size - handshake->transcript_len )
+    {
+        if( size == 0 )
+            size = SSL_TRANSCRIPT_MIN_SIZE;
+
+        while( len > size - handshake->transcript_len )
+        {
+            if( size > (size_t) -1 / 2 )
+                return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+            size *= 2;
+        }
+
+        if( ( transcript = mbedtls_calloc( 1, size ) ) == NULL )
+            return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+        if( handshake->transcript != NULL )
+        {
+            memcpy( transcript, handshake->transcript,
+                    handshake->transcript_len );
+            mbedtls_platform_zeroize( handshake->transcript,
+                                      handshake->transcript_size );
+            mbedtls_free( handshake->transcript );
+        }
+
+        handshake->transcript = transcript;
+        handshake->transcript_size = size;
+    }
+
+    memcpy( handshake->transcript + handshake->transcript_len, buf, len );
+    handshake->transcript_len += len;
+
+    return( 0 );
+}
+
+static void ssl_update_checksum_digests( mbedtls_ssl_context *ssl,
+                                         int checksums,
+                                         const unsigned char *buf, size_t len )
+{
+    ((void) ssl);
+    ((void) checksums);
+    ((void) buf);
+    ((void) len);
+
+#if defined(MBEDTLS_SSL_PROTO_SSL3) || defined(MBEDTLS_SSL_PROTO_TLS1) || \
+    defined(MBEDTLS_SSL_PROTO_TLS1_1)
+    if( ( checksums & SSL_CHECKSUM_MD5SHA1 ) != 0 )
+    {
+         mbedtls_md5_update_ret( &ssl->handshake->fin_md5 , buf, len );
+        mbedtls_sha1_update_ret( &ssl->handshake->fin_sha1, buf, len );
+    }
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+#if defined(MBEDTLS_SHA256_C)
+    if( ( checksums & SSL_CHECKSUM_SHA256 ) != 0 )
+        mbedtls_sha256_update_ret( &ssl->handshake->fin_sha256, buf, len );
+#endif
+#if defined(MBEDTLS_SHA512_C)
+    if( ( checksums & SSL_CHECKSUM_SHA384 ) != 0 )
+        mbedtls_sha512_update_ret( &ssl->handshake->fin_sha512, buf, len );
+#endif
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+}
+
+/*
+ * Make sure the given digests cover all the messages so far
+ */
+static void ssl_checksum_enable( mbedtls_ssl_context *ssl, int checksums )
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+
+    checksums &= ~handshake->checksums & SSL_CHECKSUM_ALL;
+    if( checksums == 0 )
+        return;
+
+    if( ( handshake->checksums & SSL_CHECKSUM_BUFFERED ) == 0 )
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
+    else
+        ssl_update_checksum_digests( ssl, checksums, handshake->transcript,
+                                     handshake->transcript_len );
+
+    handshake->checksums |= checksums;
+}
+
+void mbedtls_ssl_optimize_checksum( mbedtls_ssl_context *ssl,
+                            const mbedtls_ssl_ciphersuite_t *ciphersuite_info )
+{
+    int checksum;
+    void (*update_checksum)( mbedtls_ssl_context *,
+                             const unsigned char *, size_t );
+
+    ((void) ciphersuite_info);
+
+#if defined(MBEDTLS_SSL_PROTO_SSL3) || defined(MBEDTLS_SSL_PROTO_TLS1) || \
+    defined(MBEDTLS_SSL_PROTO_TLS1_1)
+    if( ssl->minor_ver < MBEDTLS_SSL_MINOR_VERSION_3 )
+    {
+        checksum = SSL_CHECKSUM_MD5SHA1;
+        update_checksum = ssl_update_checksum_md5sha1;
+    }
+    else
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+#if defined(MBEDTLS_SHA512_C)
+    if( ciphersuite_info->mac == MBEDTLS_MD_SHA384 )
+    {
+        checksum = SSL_CHECKSUM_SHA384;
+        update_checksum = ssl_update_checksum_sha384;
+    }
+    else
+#endif
+#if defined(MBEDTLS_SHA256_C)
+    if( ciphersuite_info->mac != MBEDTLS_MD_SHA384 )
+    {
+        checksum = SSL_CHECKSUM_SHA256;
+        update_checksum = ssl_update_checksum_sha256;
+    }
     else
 #endif
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
@@ -6158,6 +6688,13 @@ void mbedtls_ssl_optimize_checksum( mbedtls_ssl_context *ssl,
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
         return;
     }
+
+    ssl_checksum_enable( ssl, checksum );
+    ssl_transcript_free( ssl->handshake );
+
+    /* Other digests may have been needed for CertificateVerify already */
+    if( ssl->handshake->checksums == checksum )
+        ssl->handshake->update_checksum = update_checksum;
 }
 
 void mbedtls_ssl_reset_checksum( mbedtls_ssl_context *ssl )
@@ -6175,24 +6712,25 @@ void mbedtls_ssl_reset_checksum( mbedtls_ssl_context *ssl )
     mbedtls_sha512_starts_ret( &ssl->handshake->fin_sha512, 1 );
 #endif
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+    ssl->handshake->transcript_len = 0;
 }
 
 static void ssl_update_checksum_start( mbedtls_ssl_context *ssl,
                                        const unsigned char *buf, size_t len )
 {
-#if defined(MBEDTLS_SSL_PROTO_SSL3) || defined(MBEDTLS_SSL_PROTO_TLS1) || \
-    defined(MBEDTLS_SSL_PROTO_TLS1_1)
-     mbedtls_md5_update_ret( &ssl->handshake->fin_md5 , buf, len );
-    mbedtls_sha1_update_ret( &ssl->handshake->fin_sha1, buf, len );
-#endif
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-#if defined(MBEDTLS_SHA256_C)
-    mbedtls_sha256_update_ret( &ssl->handshake->fin_sha256, buf, len );
-#endif
-#if defined(MBEDTLS_SHA512_C)
-    mbedtls_sha512_update_ret( &ssl->handshake->fin_sha512, buf, len );
-#endif
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+
+    if( ( handshake->checksums & SSL_CHECKSUM_BUFFERED ) != 0 &&
+        ssl_transcript_append( handshake, buf, len ) != 0 )
+    {
+        /* Too late to choose: run every digest from now on */
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "transcript allocation failed" ) );
+        ssl_checksum_enable( ssl, SSL_CHECKSUM_ALL );
+        ssl_transcript_free( handshake );
+    }
+
+    ssl_update_checksum_digests( ssl, handshake->checksums, buf, len );
 }
 
 #if defined(MBEDTLS_SSL_PROTO_SSL3) || defined(MBEDTLS_SSL_PROTO_TLS1) || \
@@ -6244,6 +6782,7 @@ static void ssl_calc_finished_ssl(
     mbedtls_md5_init( &md5 );
     mbedtls_sha1_init( &sha1 );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_MD5SHA1 );
     mbedtls_md5_clone( &md5, &ssl->handshake->fin_md5 );
     mbedtls_sha1_clone( &sha1, &ssl->handshake->fin_sha1 );
 
@@ -6327,6 +6866,7 @@ static void ssl_calc_finished_tls(
     mbedtls_md5_init( &md5 );
     mbedtls_sha1_init( &sha1 );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_MD5SHA1 );
     mbedtls_md5_clone( &md5, &ssl->handshake->fin_md5 );
     mbedtls_sha1_clone( &sha1, &ssl->handshake->fin_sha1 );
 
@@ -6385,6 +6925,7 @@ static void ssl_calc_finished_tls_sha256(
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> calc  finished tls sha256" ) );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_SHA256 );
     mbedtls_sha256_clone( &sha256, &ssl->handshake->fin_sha256 );
 
     /*
@@ -6434,6 +6975,7 @@ static void ssl_calc_finished_tls_sha384(
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> calc  finished tls sha384" ) );
 
+    ssl_checksum_enable( ssl, SSL_CHECKSUM_SHA384 );
     mbedtls_sha512_clone( &sha512, &ssl->handshake->fin_sha512 );
 
     /*
@@ -6475,7 +7017,7 @@ static void ssl_handshake_wrapup_free_hs_transform( mbedtls_ssl_context *ssl )
      * Free our handshake params
      */
     mbedtls_ssl_handshake_free( ssl );
-    mbedtls_free( ssl->handshake );
+    ssl_obj_free( ssl->conf, SSL_OBJ_HANDSHAKE, ssl->handshake );
     ssl->handshake = NULL;
 
     /*
@@ -6484,7 +7026,7 @@ static void ssl_handshake_wrapup_free_hs_transform( mbedtls_ssl_context *ssl )
     if( ssl->transform )
     {
         mbedtls_ssl_transform_free( ssl->transform );
-        mbedtls_free( ssl->transform );
+        ssl_obj_free( ssl->conf, SSL_OBJ_TRANSFORM, ssl->transform );
     }
     ssl->transform = ssl->transform_negotiate;
     ssl->transform_negotiate = NULL;
@@ -6779,6 +7321,7 @@ static void ssl_handshake_params_init( mbedtls_ssl_handshake_params *handshake )
 #endif
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
+    handshake->checksums = SSL_CHECKSUM_BUFFERED;
     handshake->update_checksum = ssl_update_checksum_start;
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2) && \
@@ -6841,7 +7384,8 @@ static int ssl_handshake_init( mbedtls_ssl_context *ssl )
      */
     if( ssl->transform_negotiate == NULL )
     {
-        ssl->transform_negotiate = mbedtls_calloc( 1, sizeof(mbedtls_ssl_transform) );
+        ssl->transform_negotiate = ssl_obj_alloc( ssl->conf, SSL_OBJ_TRANSFORM,
+                                                  sizeof(mbedtls_ssl_transform) );
     }
 
     if( ssl->session_negotiate == NULL )
@@ -6851,7 +7395,8 @@ static int ssl_handshake_init( mbedtls_ssl_context *ssl )
 
     if( ssl->handshake == NULL )
     {
-        ssl->handshake = mbedtls_calloc( 1, sizeof(mbedtls_ssl_handshake_params) );
+        ssl->handshake = ssl_obj_alloc( ssl->conf, SSL_OBJ_HANDSHAKE,
+                                        sizeof(mbedtls_ssl_handshake_params) );
     }
 
     /* All pointers should exist and can be directly freed without issue */
@@ -6861,8 +7406,8 @@ static int ssl_handshake_init( mbedtls_ssl_context *ssl )
     {
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "alloc() of ssl sub-contexts failed" ) );
 
-        mbedtls_free( ssl->handshake );
-        mbedtls_free( ssl->transform_negotiate );
+        ssl_obj_free( ssl->conf, SSL_OBJ_HANDSHAKE, ssl->handshake );
+        ssl_obj_free( ssl->conf, SSL_OBJ_TRANSFORM, ssl->transform_negotiate );
         mbedtls_free( ssl->session_negotiate );
 
         ssl->handshake = NULL;
@@ -7042,7 +7587,8 @@ int mbedtls_ssl_setup( mbedtls_ssl_context *ssl,
     /* Set to NULL in case of an error condition */
     ssl->out_buf = NULL;
 
-    ssl->in_buf = mbedtls_calloc( 1, MBEDTLS_SSL_IN_BUFFER_LEN );
+    ssl->in_buf = ssl_obj_alloc( conf, SSL_OBJ_IN_BUF,
+                                 MBEDTLS_SSL_IN_BUFFER_LEN );
     if( ssl->in_buf == NULL )
     {
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "alloc(%d bytes) failed", MBEDTLS_SSL_IN_BUFFER_LEN) );
@@ -7050,7 +7596,8 @@ int mbedtls_ssl_setup( mbedtls_ssl_context *ssl,
         goto error;
     }
 
-    ssl->out_buf = mbedtls_calloc( 1, MBEDTLS_SSL_OUT_BUFFER_LEN );
+    ssl->out_buf = ssl_obj_alloc( conf, SSL_OBJ_OUT_BUF,
+                                  MBEDTLS_SSL_OUT_BUFFER_LEN );
     if( ssl->out_buf == NULL )
     {
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "alloc(%d bytes) failed", MBEDTLS_SSL_OUT_BUFFER_LEN) );
@@ -7066,8 +7613,8 @@ int mbedtls_ssl_setup( mbedtls_ssl_context *ssl,
     return( 0 );
 
 error:
-    mbedtls_free( ssl->in_buf );
-    mbedtls_free( ssl->out_buf );
+    ssl_obj_free( conf, SSL_OBJ_IN_BUF, ssl->in_buf );
+    ssl_obj_free( conf, SSL_OBJ_OUT_BUF, ssl->out_buf );
 
     ssl->conf = NULL;
 
@@ -7125,8 +7672,13 @@ static int ssl_session_reset_int( mbedtls_ssl_context *ssl, int partial )
 
     ssl->in_msgtype = 0;
     ssl->in_msglen = 0;
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
+#if defined(MBEDTLS_SSL_PROTO_DTLS) || defined(MBEDTLS_SSL_READ_AHEAD)
     ssl->next_record_offset = 0;
+#endif
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+    ssl->read_ahead_ret = 0;
+#endif
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
     ssl->in_epoch = 0;
 #endif
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
@@ -7146,6 +7698,14 @@ static int ssl_session_reset_int( mbedtls_ssl_context *ssl, int partial )
         ssl->split_done = 0;
 #endif
 
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    ssl->out_cork_len = 0;
+    ssl->out_cork_pending = 0;
+#endif
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    ssl_async_record_free( ssl );
+#endif
+
     memset( ssl->cur_out_ctr, 0, sizeof( ssl->cur_out_ctr ) );
 
     ssl->transform_in = NULL;
@@ -7179,7 +7739,7 @@ static int ssl_session_reset_int( mbedtls_ssl_context *ssl, int partial )
     if( ssl->transform )
     {
         mbedtls_ssl_transform_free( ssl->transform );
-        mbedtls_free( ssl->transform );
+        ssl_obj_free( ssl->conf, SSL_OBJ_TRANSFORM, ssl->transform );
         ssl->transform = NULL;
     }
 
@@ -7220,12 +7780,149 @@ int mbedtls_ssl_session_reset( mbedtls_ssl_context *ssl )
     return( ssl_session_reset_int( ssl, 0 ) );
 }
 
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+/*
+ * Index a ciphersuite list: resolve the definition of each ciphersuite once,
+ * hash the IDs, and record what each ciphersuite needs as bitsets, so that
+ * servers can match the client's offer against the list in a single pass.
+ * Unknown and repeated IDs are left out.
+ */
+static mbedtls_ssl_ciphersuite_index *ssl_ciphersuite_index_build(
+                                                        const int *list )
+{
+    mbedtls_ssl_ciphersuite_index *index;
+    const mbedtls_ssl_ciphersuite_t *info;
+    uint32_t *caps, bit;
+    size_t n, i, h, pos, words, slots;
+    int minor;
+
+    for( n = 0; list[n] != 0; n++ )
+    {
+        if( n == MBEDTLS_SSL_CIPHERSUITE_INDEX_MAX )
+            return( NULL );
+    }
+
+    words = ( n + 31 ) / 32;
+    for( slots = 16; slots < 2 * n; slots *= 2 )
+        ;
+
+    index = mbedtls_calloc( 1, sizeof( mbedtls_ssl_ciphersuite_index ) +
+                    n * sizeof( const mbedtls_ssl_ciphersuite_t * ) +
+                    MBEDTLS_SSL_CS_CAPS * words * sizeof( uint32_t ) +
+                    slots * sizeof( uint16_t ) );
+    if( index == NULL )
+        return( NULL );
+
+    index->list = list;
+    index->words = words;
+    index->info = (const mbedtls_ssl_ciphersuite_t **) ( index + 1 );
+    index->caps = (uint32_t *) ( index->info + n );
+    index->slots = (uint16_t *) ( index->caps + MBEDTLS_SSL_CS_CAPS * words );
+    index->slot_mask = slots - 1;
+
+    for( i = 0; i < n; i++ )
+    {
+        if( ( info = mbedtls_ssl_ciphersuite_from_id( list[i] ) ) == NULL ||
+            mbedtls_ssl_ciphersuite_index_find( index, list[i] ) >= 0 )
+            continue;
+
+        pos = index->count++;
+        index->info[pos] = info;
+
+        h = MBEDTLS_SSL_CIPHERSUITE_HASH( list[i] ) & index->slot_mask;
+        while( index->slots[h] != 0 )
+            h = ( h + 1 ) & index->slot_mask;
+        index->slots[h] = (uint16_t) ( pos + 1 );
+
+        caps = index->caps + pos / 32;
+        bit = (uint32_t) 1 << ( pos % 32 );
+
+        for( minor = info->min_minor_ver;
+             minor <= info->max_minor_ver &&
+             minor <= MBEDTLS_SSL_MINOR_VERSION_3; minor++ )
+        {
+            caps[( MBEDTLS_SSL_CS_MINOR_VERSION_0 + minor ) * words] |= bit;
+        }
+
+        if( info->flags & MBEDTLS_CIPHERSUITE_NODTLS )
+            caps[MBEDTLS_SSL_CS_NODTLS * words] |= bit;
+        if( info->cipher == MBEDTLS_CIPHER_ARC4_128 )
+            caps[MBEDTLS_SSL_CS_ARC4 * words] |= bit;
+        if( info->key_exchange == MBEDTLS_KEY_EXCHANGE_ECJPAKE )
+            caps[MBEDTLS_SSL_CS_ECJPAKE * words] |= bit;
+#if defined(MBEDTLS_ECDH_C) || defined(MBEDTLS_ECDSA_C) || \
+    defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
+        if( mbedtls_ssl_ciphersuite_uses_ec( info ) )
+            caps[MBEDTLS_SSL_CS_EC * words] |= bit;
+#endif
+#if defined(MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED)
+        if( mbedtls_ssl_ciphersuite_uses_psk( info ) )
+            caps[MBEDTLS_SSL_CS_PSK * words] |= bit;
+#endif
+    }
+
+    return( index );
+}
+
+static void ssl_conf_ciphersuite_index_free( mbedtls_ssl_config *conf )
+{
+    int i, j;
+
+    for( i = 0; i < 4; i++ )
+    {
+        /* Versions with the same list share its index */
+        for( j = 0; j < i; j++ )
+            if( conf->ciphersuite_index[j] == conf->ciphersuite_index[i] )
+                break;
+
+        if( j == i )
+            mbedtls_free( conf->ciphersuite_index[i] );
+    }
+
+    memset( conf->ciphersuite_index, 0, sizeof( conf->ciphersuite_index ) );
+}
+
+/*
+ * Rebuild the indexes of the ciphersuite lists of a server configuration.
+ * Servers without an index (out of memory) search the lists themselves.
+ */
+static void ssl_conf_ciphersuite_index( mbedtls_ssl_config *conf )
+{
+    int i, j;
+
+    ssl_conf_ciphersuite_index_free( conf );
+
+    if( conf->endpoint != MBEDTLS_SSL_IS_SERVER )
+        return;
+
+    for( i = 0; i < 4; i++ )
+    {
+        if( conf->ciphersuite_list[i] == NULL )
+            continue;
+
+        for( j = 0; j < i; j++ )
+            if( conf->ciphersuite_list[j] == conf->ciphersuite_list[i] )
+                break;
+
+        if( j < i )
+            conf->ciphersuite_index[i] = conf->ciphersuite_index[j];
+        else
+            conf->ciphersuite_index[i] =
+                ssl_ciphersuite_index_build( conf->ciphersuite_list[i] );
+    }
+}
+#endif /* MBEDTLS_SSL_CIPHERSUITE_INDEX */
+
 /*
  * SSL set accessors
  */
 void mbedtls_ssl_conf_endpoint( mbedtls_ssl_config *conf, int endpoint )
 {
     conf->endpoint   = endpoint;
+
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    ssl_conf_ciphersuite_index( conf );
+#endif
 }
 
 void mbedtls_ssl_conf_transport( mbedtls_ssl_config *conf, int transport )
@@ -7318,6 +8015,13 @@ void mbedtls_ssl_conf_read_timeout( mbedtls_ssl_config *conf, uint32_t timeout )
     conf->read_timeout   = timeout;
 }
 
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+void mbedtls_ssl_conf_read_ahead( mbedtls_ssl_config *conf, size_t budget )
+{
+    conf->read_ahead = budget;
+}
+#endif
+
 void mbedtls_ssl_set_timer_cb( mbedtls_ssl_context *ssl,
                                void *p_timer,
                                mbedtls_ssl_set_timer_t *f_set_timer,
@@ -7343,6 +8047,22 @@ void mbedtls_ssl_conf_session_cache( mbedtls_ssl_config *conf,
 }
 #endif /* MBEDTLS_SSL_SRV_C */
 
+#if defined(MBEDTLS_SSL_POOL_C)
+void mbedtls_ssl_conf_pool( mbedtls_ssl_config *conf,
+                            mbedtls_ssl_pool_context *pool )
+{
+    conf->p_pool = pool;
+}
+#endif /* MBEDTLS_SSL_POOL_C */
+
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+void mbedtls_ssl_conf_ecdhe_pool( mbedtls_ssl_config *conf,
+                                  mbedtls_ssl_ecdhe_pool_context *pool )
+{
+    conf->p_ecdhe_pool = pool;
+}
+#endif /* MBEDTLS_SSL_ECDHE_POOL_C */
+
 #if defined(MBEDTLS_SSL_CLI_C)
 int mbedtls_ssl_set_session( mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session )
 {
@@ -7372,6 +8092,10 @@ void mbedtls_ssl_conf_ciphersuites( mbedtls_ssl_config *conf,
     conf->ciphersuite_list[MBEDTLS_SSL_MINOR_VERSION_1] = ciphersuites;
     conf->ciphersuite_list[MBEDTLS_SSL_MINOR_VERSION_2] = ciphersuites;
     conf->ciphersuite_list[MBEDTLS_SSL_MINOR_VERSION_3] = ciphersuites;
+
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    ssl_conf_ciphersuite_index( conf );
+#endif
 }
 
 void mbedtls_ssl_conf_ciphersuites_for_version( mbedtls_ssl_config *conf,
@@ -7385,6 +8109,10 @@ void mbedtls_ssl_conf_ciphersuites_for_version( mbedtls_ssl_config *conf,
         return;
 
     conf->ciphersuite_list[minor] = ciphersuites;
+
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    ssl_conf_ciphersuite_index( conf );
+#endif
 }
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
@@ -7425,11 +8153,69 @@ static int ssl_append_key_cert( mbedtls_ssl_key_cert **head,
     return( 0 );
 }
 
+#if defined(MBEDTLS_SSL_CERT_MSG_CACHE)
+/*
+ * Serialize the body of the Certificate message for a chain, as written by
+ * mbedtls_ssl_write_certificate(). If the chain does not fit in a message,
+ * or on allocation failure, nothing is cached and the message is serialized
+ * at each handshake, where errors are reported.
+ */
+static void ssl_key_cert_cache_msg( mbedtls_ssl_key_cert *key_cert )
+{
+    const mbedtls_x509_crt *crt;
+    unsigned char *p;
+    size_t len = 3;
+
+    for( crt = key_cert->cert; crt != NULL; crt = crt->next )
+    {
+        if( 3 + crt->raw.len > MBEDTLS_SSL_OUT_CONTENT_LEN - 4 - len )
+            return;
+
+        len += 3 + crt->raw.len;
+    }
+
+    if( ( p = mbedtls_calloc( 1, len ) ) == NULL )
+        return;
+
+    key_cert->cert_msg = p;
+    key_cert->cert_msg_len = len;
+
+    *p++ = (unsigned char)( ( len - 3 ) >> 16 );
+    *p++ = (unsigned char)( ( len - 3 ) >>  8 );
+    *p++ = (unsigned char)( ( len - 3 )       );
+
+    for( crt = key_cert->cert; crt != NULL; crt = crt->next )
+    {
+        *p++ = (unsigned char)( crt->raw.len >> 16 );
+        *p++ = (unsigned char)( crt->raw.len >>  8 );
+        *p++ = (unsigned char)( crt->raw.len       );
+
+        memcpy( p, crt->raw.p, crt->raw.len );
+        p += crt->raw.len;
+    }
+}
+#endif /* MBEDTLS_SSL_CERT_MSG_CACHE */
+
 int mbedtls_ssl_conf_own_cert( mbedtls_ssl_config *conf,
                               mbedtls_x509_crt *own_cert,
                               mbedtls_pk_context *pk_key )
 {
+#if defined(MBEDTLS_SSL_CERT_MSG_CACHE)
+    int ret;
+    mbedtls_ssl_key_cert *cur;
+
+    if( ( ret = ssl_append_key_cert( &conf->key_cert, own_cert, pk_key ) ) != 0 )
+        return( ret );
+
+    for( cur = conf->key_cert; cur->next != NULL; cur = cur->next )
+        ;
+
+    ssl_key_cert_cache_msg( cur );
+
+    return( 0 );
+#else
     return( ssl_append_key_cert( &conf->key_cert, own_cert, pk_key ) );
+#endif /* MBEDTLS_SSL_CERT_MSG_CACHE */
 }
 
 void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config *conf,
@@ -7438,7 +8224,21 @@ void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config *conf,
 {
     conf->ca_chain   = ca_chain;
     conf->ca_crl     = ca_crl;
+#if defined(MBEDTLS_X509_CRT_STORE)
+    conf->ca_store   = NULL;
+#endif
+}
+
+#if defined(MBEDTLS_X509_CRT_STORE)
+void mbedtls_ssl_conf_ca_store( mbedtls_ssl_config *conf,
+                                mbedtls_x509_crt_store *ca_store,
+                                mbedtls_x509_crl *ca_crl )
+{
+    conf->ca_chain   = ca_store->ca_chain;
+    conf->ca_crl     = ca_crl;
+    conf->ca_store   = ca_store;
 }
+#endif /* MBEDTLS_X509_CRT_STORE */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
@@ -8003,6 +8803,25 @@ void mbedtls_ssl_set_async_operation_data( mbedtls_ssl_context *ssl,
 }
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+void mbedtls_ssl_conf_async_record_cb( mbedtls_ssl_config *conf,
+                                       mbedtls_ssl_async_record_start_t *f_start,
+                                       mbedtls_ssl_async_record_resume_t *f_resume,
+                                       mbedtls_ssl_async_record_cancel_t *f_cancel,
+                                       void *config_data )
+{
+    conf->f_async_record_start = f_start;
+    conf->f_async_record_resume = f_resume;
+    conf->f_async_record_cancel = f_cancel;
+    conf->p_async_record_config_data = config_data;
+}
+
+void *mbedtls_ssl_conf_get_async_record_config_data( const mbedtls_ssl_config *conf )
+{
+    return( conf->p_async_record_config_data );
+}
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
+
 /*
  * SSL get accessors
  */
@@ -8037,6 +8856,15 @@ int mbedtls_ssl_check_pending( const mbedtls_ssl_context *ssl )
     }
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+    if( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+        ssl->in_left > ssl->next_record_offset )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 3, ( "ssl_check_pending: read-ahead data in input buffer" ) );
+        return( 1 );
+    }
+#endif /* MBEDTLS_SSL_READ_AHEAD */
+
     /*
      * Case C: A handshake message is being processed.
      */
@@ -8328,6 +9156,16 @@ int mbedtls_ssl_handshake( mbedtls_ssl_context *ssl )
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> handshake" ) );
 
+#if defined(MBEDTLS_SSL_WRITE_CORK) || defined(MBEDTLS_SSL_ASYNC_RECORD)
+    /* Application data written before a renegotiation goes out first */
+    if( ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER &&
+        ( ret = ssl_flush_pending_app_data( ssl ) ) != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "ssl_flush_pending_app_data", ret );
+        return( ret );
+    }
+#endif
+
     while( ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER )
     {
         ret = mbedtls_ssl_handshake_step( ssl );
@@ -8433,6 +9271,11 @@ int mbedtls_ssl_renegotiate( mbedtls_ssl_context *ssl )
 
         ssl->renego_status = MBEDTLS_SSL_RENEGOTIATION_PENDING;
 
+#if defined(MBEDTLS_SSL_WRITE_CORK) || defined(MBEDTLS_SSL_ASYNC_RECORD)
+        if( ( ret = ssl_flush_pending_app_data( ssl ) ) != 0 )
+            return( ret );
+#endif
+
         /* Did we already try/start sending HelloRequest? */
         if( ssl->out_left != 0 )
             return( mbedtls_ssl_flush_output( ssl ) );
@@ -8504,30 +9347,99 @@ static int ssl_check_ctr_renegotiate( mbedtls_ssl_context *ssl )
 /*
  * Receive application data decrypted from the SSL layer
  */
-int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len )
+/*
+ * Copy application data from the current record to the caller's buffer
+ */
+static size_t ssl_read_consume( mbedtls_ssl_context *ssl,
+                                unsigned char *buf, size_t len )
 {
-    int ret;
-    size_t n;
-
-    if( ssl == NULL || ssl->conf == NULL )
-        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    size_t n = ( len < ssl->in_msglen )
+               ? len : ssl->in_msglen;
 
-    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> read" ) );
+    memcpy( buf, ssl->in_offt, n );
+    ssl->in_msglen -= n;
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM )
+    if( ssl->in_msglen == 0 )
     {
-        if( ( ret = mbedtls_ssl_flush_output( ssl ) ) != 0 )
-            return( ret );
-
-        if( ssl->handshake != NULL &&
-            ssl->handshake->retransmit_state == MBEDTLS_SSL_RETRANS_SENDING )
-        {
-            if( ( ret = mbedtls_ssl_flight_transmit( ssl ) ) != 0 )
-                return( ret );
-        }
+        /* all bytes consumed */
+        ssl->in_offt = NULL;
+        ssl->keep_current_message = 0;
+    }
+    else
+    {
+        /* more data available */
+        ssl->in_offt += n;
     }
-#endif
+
+    return( n );
+}
+
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+/*
+ * Is a complete application data record waiting in the input buffer?
+ */
+static int ssl_read_ahead_has_record( const mbedtls_ssl_context *ssl )
+{
+    const size_t hdr_len = mbedtls_ssl_hdr_len( ssl );
+    const unsigned char *hdr = ssl->in_hdr + ssl->next_record_offset;
+    size_t rec_len;
+
+    if( ! ssl_read_ahead_applies( ssl ) )
+        return( 0 );
+
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    /* Leave records to the main loop while a HelloRequest is outstanding */
+    if( ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING )
+        return( 0 );
+#endif
+
+    if( ssl->in_left < ssl->next_record_offset + hdr_len )
+        return( 0 );
+
+    if( hdr[0] != MBEDTLS_SSL_MSG_APPLICATION_DATA )
+        return( 0 );
+
+    /* Type, version, then the two-byte length */
+    rec_len = ( hdr[3] << 8 ) | hdr[4];
+
+    return( ssl->in_left - ssl->next_record_offset - hdr_len >= rec_len );
+}
+#endif /* MBEDTLS_SSL_READ_AHEAD */
+
+int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len )
+{
+    int ret;
+    size_t n;
+
+    if( ssl == NULL || ssl->conf == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> read" ) );
+
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+    /* Reported now, since the previous read returned data */
+    if( ssl->read_ahead_ret != 0 )
+    {
+        ret = ssl->read_ahead_ret;
+        ssl->read_ahead_ret = 0;
+        return( ret );
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM )
+    {
+        if( ( ret = mbedtls_ssl_flush_output( ssl ) ) != 0 )
+            return( ret );
+
+        if( ssl->handshake != NULL &&
+            ssl->handshake->retransmit_state == MBEDTLS_SSL_RETRANS_SENDING )
+        {
+            if( ( ret = mbedtls_ssl_flight_transmit( ssl ) ) != 0 )
+                return( ret );
+        }
+    }
+#endif
 
     /*
      * Check if renegotiation is necessary and/or handshake is
@@ -8782,23 +9694,43 @@ int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len )
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
     }
 
-    n = ( len < ssl->in_msglen )
-        ? len : ssl->in_msglen;
-
-    memcpy( buf, ssl->in_offt, n );
-    ssl->in_msglen -= n;
+    n = ssl_read_consume( ssl, buf, len );
 
-    if( ssl->in_msglen == 0 )
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+    /*
+     * Decrypt further application data records that were read ahead,
+     * as long as the caller's buffer has room and no I/O is needed.
+     * The data copied so far has been consumed from the connection: if a
+     * later record fails, return it and keep the error for the next call.
+     */
+    while( n < len && ssl->in_offt == NULL &&
+           ssl_read_ahead_has_record( ssl ) )
     {
-        /* all bytes consumed */
-        ssl->in_offt = NULL;
-        ssl->keep_current_message = 0;
+        if( ( ret = mbedtls_ssl_read_record( ssl, 1 ) ) != 0 )
+        {
+            MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_read_record", ret );
+            ssl->read_ahead_ret = ret;
+            break;
+        }
+
+        if( ssl->in_msgtype != MBEDTLS_SSL_MSG_APPLICATION_DATA )
+        {
+            MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
+            ssl->read_ahead_ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+            break;
+        }
+
+        ssl->in_offt = ssl->in_msg;
+        n += ssl_read_consume( ssl, buf + n, len - n );
     }
-    else
+
+    if( n == 0 && ssl->read_ahead_ret != 0 )
     {
-        /* more data available */
-        ssl->in_offt += n;
+        ret = ssl->read_ahead_ret;
+        ssl->read_ahead_ret = 0;
+        return( ret );
     }
+#endif /* MBEDTLS_SSL_READ_AHEAD */
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= read" ) );
 
@@ -8829,6 +9761,14 @@ static int ssl_write_real( mbedtls_ssl_context *ssl,
         return( ret );
     }
 
+#if defined(MBEDTLS_SSL_WRITE_CORK) || defined(MBEDTLS_SSL_ASYNC_RECORD)
+    if( ( ret = ssl_flush_pending_app_data( ssl ) ) != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "ssl_flush_pending_app_data", ret );
+        return( ret );
+    }
+#endif
+
     if( len > max_len )
     {
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -8879,6 +9819,19 @@ static int ssl_write_real( mbedtls_ssl_context *ssl,
     return( (int) len );
 }
 
+#if defined(MBEDTLS_SSL_CBC_RECORD_SPLITTING)
+/*
+ * Is 1/n-1 record splitting in effect for the current connection?
+ */
+static int ssl_cbc_record_splitting_applies( const mbedtls_ssl_context *ssl )
+{
+    return( ssl->conf->cbc_record_splitting !=
+                MBEDTLS_SSL_CBC_RECORD_SPLITTING_DISABLED &&
+            ssl->minor_ver <= MBEDTLS_SSL_MINOR_VERSION_1 &&
+            mbedtls_cipher_get_cipher_mode( &ssl->transform_out->cipher_ctx_enc )
+                                == MBEDTLS_MODE_CBC );
+}
+
 /*
  * Write application data, doing 1/n-1 splitting if necessary.
  *
@@ -8886,18 +9839,12 @@ static int ssl_write_real( mbedtls_ssl_context *ssl,
  * then the caller will call us again with the same arguments, so
  * remember whether we already did the split or not.
  */
-#if defined(MBEDTLS_SSL_CBC_RECORD_SPLITTING)
 static int ssl_write_split( mbedtls_ssl_context *ssl,
                             const unsigned char *buf, size_t len )
 {
     int ret;
 
-    if( ssl->conf->cbc_record_splitting ==
-            MBEDTLS_SSL_CBC_RECORD_SPLITTING_DISABLED ||
-        len <= 1 ||
-        ssl->minor_ver > MBEDTLS_SSL_MINOR_VERSION_1 ||
-        mbedtls_cipher_get_cipher_mode( &ssl->transform_out->cipher_ctx_enc )
-                                != MBEDTLS_MODE_CBC )
+    if( len <= 1 || ! ssl_cbc_record_splitting_applies( ssl ) )
     {
         return( ssl_write_real( ssl, buf, len ) );
     }
@@ -8917,6 +9864,405 @@ static int ssl_write_split( mbedtls_ssl_context *ssl,
 }
 #endif /* MBEDTLS_SSL_CBC_RECORD_SPLITTING */
 
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+/*
+ * Should application data be coalesced for the current connection?
+ */
+static int ssl_cork_applies( const mbedtls_ssl_context *ssl )
+{
+    if( ssl->out_cork == MBEDTLS_SSL_WRITE_CORK_DISABLED ||
+        ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM )
+        return( 0 );
+
+#if defined(MBEDTLS_ZLIB_SUPPORT)
+    if( ssl->session_out->compression != MBEDTLS_SSL_COMPRESS_NULL )
+        return( 0 );
+#endif
+
+#if defined(MBEDTLS_SSL_CBC_RECORD_SPLITTING)
+    if( ssl_cbc_record_splitting_applies( ssl ) )
+        return( 0 );
+#endif
+
+    return( 1 );
+}
+
+/*
+ * Number of plaintext bytes that can still be appended to the open record,
+ * given the maximum record payload and the space left in the output buffer
+ * behind the records not yet sent.
+ */
+static int ssl_cork_room( const mbedtls_ssl_context *ssl, size_t max_len )
+{
+    int ret;
+    size_t used, avail;
+
+    if( ( ret = mbedtls_ssl_get_record_expansion( ssl ) ) < 0 )
+        return( ret );
+
+    used = (size_t)( ssl->out_hdr - ssl->out_buf ) + (size_t) ret;
+    if( used >= MBEDTLS_SSL_OUT_BUFFER_LEN )
+        return( 0 );
+
+    avail = MBEDTLS_SSL_OUT_BUFFER_LEN - used;
+    if( avail > max_len )
+        avail = max_len;
+
+    if( avail <= ssl->out_cork_len )
+        return( 0 );
+
+    return( (int)( avail - ssl->out_cork_len ) );
+}
+
+/*
+ * Append application data to the open record, sealing it and flushing the
+ * output buffer only when there is no room left.
+ */
+static int ssl_write_corked( mbedtls_ssl_context *ssl,
+                             const unsigned char *buf, size_t len )
+{
+    int ret = mbedtls_ssl_get_max_out_record_payload( ssl );
+    const size_t max_len = (size_t) ret;
+    size_t room;
+
+    if( ret < 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_get_max_out_record_payload", ret );
+        return( ret );
+    }
+
+    if( len > max_len )
+        len = max_len;
+
+    if( len == 0 )
+        return( 0 );
+
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    /* Records from before corking was enabled go first */
+    if( ssl->async_rec_count != 0 &&
+        ( ret = mbedtls_ssl_flush_output( ssl ) ) != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_flush_output", ret );
+        return( ret );
+    }
+#endif
+
+    /*
+     * Only open a new record behind the ones waiting to be sent if it can
+     * grow to full size, rather than splitting the data into short records.
+     */
+    while( ( ret = ssl_cork_room( ssl, max_len ) ) == 0 ||
+           ( ret > 0 && (size_t) ret < max_len &&
+             ssl->out_cork_len == 0 && ssl->out_left != 0 ) )
+    {
+        if( ssl->out_cork_len != 0 )
+            ret = ssl_cork_seal( ssl );
+        else if( ssl->out_left != 0 )
+            ret = mbedtls_ssl_flush_output( ssl );
+        else
+            ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+
+        if( ret != 0 )
+        {
+            MBEDTLS_SSL_DEBUG_RET( 1, "ssl_write_corked", ret );
+            return( ret );
+        }
+    }
+
+    if( ret < 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "ssl_cork_room", ret );
+        return( ret );
+    }
+
+    room = (size_t) ret;
+    if( len > room )
+        len = room;
+
+    memcpy( ssl->out_msg + ssl->out_cork_len, buf, len );
+    ssl->out_cork_len += len;
+
+    return( (int) len );
+}
+#endif /* MBEDTLS_SSL_WRITE_CORK */
+
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+/*
+ * Should application records be protected by the asynchronous callbacks?
+ * This is limited to TLS 1.2 AEAD ciphersuites, whose records only depend
+ * on the key, the fixed IV and the sequence number.
+ */
+static int ssl_async_record_applies( const mbedtls_ssl_context *ssl )
+{
+    mbedtls_cipher_mode_t mode;
+
+    if( ssl->conf->f_async_record_start == NULL ||
+        ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM ||
+        ssl->minor_ver != MBEDTLS_SSL_MINOR_VERSION_3 ||
+        ssl->transform_out == NULL ||
+        ssl->transform_out->keylen > sizeof( ssl->transform_out->key_enc ) ||
+        ssl->transform_out->ivlen != 12 )
+        return( 0 );
+
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    if( ssl->out_cork != MBEDTLS_SSL_WRITE_CORK_DISABLED )
+        return( 0 );
+#endif
+
+#if defined(MBEDTLS_ZLIB_SUPPORT)
+    if( ssl->session_out->compression != MBEDTLS_SSL_COMPRESS_NULL )
+        return( 0 );
+#endif
+
+#if defined(MBEDTLS_SSL_HW_RECORD_ACCEL)
+    if( mbedtls_ssl_hw_record_write != NULL )
+        return( 0 );
+#endif
+
+    mode = mbedtls_cipher_get_cipher_mode( &ssl->transform_out->cipher_ctx_enc );
+
+    return( mode == MBEDTLS_MODE_GCM ||
+            mode == MBEDTLS_MODE_CCM ||
+            mode == MBEDTLS_MODE_CHACHAPOLY );
+}
+
+/*
+ * Allocate the record slots on first use
+ */
+static int ssl_async_record_setup( mbedtls_ssl_context *ssl )
+{
+    size_t i;
+
+    if( ssl->async_rec != NULL )
+        return( 0 );
+
+    ssl->async_rec = mbedtls_calloc( MBEDTLS_SSL_ASYNC_RECORD_SLOTS,
+                                     sizeof( mbedtls_ssl_async_record ) );
+    if( ssl->async_rec == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    for( i = 0; i < MBEDTLS_SSL_ASYNC_RECORD_SLOTS; i++ )
+        mbedtls_cipher_init( &ssl->async_rec[i].cipher );
+
+    for( i = 0; i < MBEDTLS_SSL_ASYNC_RECORD_SLOTS; i++ )
+    {
+        ssl->async_rec[i].buf = mbedtls_calloc( 1, MBEDTLS_SSL_OUT_BUFFER_LEN );
+        if( ssl->async_rec[i].buf == NULL )
+        {
+            MBEDTLS_SSL_DEBUG_MSG( 1, ( "alloc(%d bytes) failed",
+                                        MBEDTLS_SSL_OUT_BUFFER_LEN ) );
+            ssl_async_record_free( ssl );
+            return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+        }
+    }
+
+    return( 0 );
+}
+
+/*
+ * Make sure the cipher context of a slot uses the current outgoing key
+ */
+static int ssl_async_record_setkey( mbedtls_ssl_context *ssl,
+                                    mbedtls_ssl_async_record *rec )
+{
+    int ret;
+    const mbedtls_ssl_transform *transform = ssl->transform_out;
+    const mbedtls_cipher_info_t *cipher_info =
+        transform->cipher_ctx_enc.cipher_info;
+
+    if( rec->cipher_info == cipher_info &&
+        mbedtls_ssl_safer_memcmp( rec->key, transform->key_enc,
+                                  transform->keylen ) == 0 )
+        return( 0 );
+
+    mbedtls_cipher_free( &rec->cipher );
+    mbedtls_cipher_init( &rec->cipher );
+    rec->cipher_info = NULL;
+
+    if( ( ret = mbedtls_cipher_setup( &rec->cipher, cipher_info ) ) != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_cipher_setup", ret );
+        return( ret );
+    }
+
+    if( ( ret = mbedtls_cipher_setkey( &rec->cipher, transform->key_enc,
+                                       cipher_info->key_bitlen,
+                                       MBEDTLS_ENCRYPT ) ) != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_cipher_setkey", ret );
+        return( ret );
+    }
+
+    memcpy( rec->key, transform->key_enc, transform->keylen );
+    rec->cipher_info = cipher_info;
+
+    return( 0 );
+}
+
+/*
+ * Build an application data record in the next free slot, taking the next
+ * sequence number, and start protecting it.
+ * See ssl_encrypt_buf() for the construction of the IV and additional data.
+ */
+static int ssl_async_record_queue( mbedtls_ssl_context *ssl,
+                                   const unsigned char *buf, size_t len )
+{
+    int ret;
+    unsigned i;
+    mbedtls_ssl_transform *transform = ssl->transform_out;
+    size_t hdr_len = mbedtls_ssl_hdr_len( ssl );
+    size_t explicit_ivlen = transform->ivlen - transform->fixed_ivlen;
+    size_t slot = ( ssl->async_rec_head + ssl->async_rec_count ) %
+                  MBEDTLS_SSL_ASYNC_RECORD_SLOTS;
+    mbedtls_ssl_async_record *rec = &ssl->async_rec[slot];
+
+    if( ( ret = ssl_async_record_setkey( ssl, rec ) ) != 0 )
+        return( ret );
+
+    rec->taglen = transform->ciphersuite_info->flags &
+                  MBEDTLS_CIPHERSUITE_SHORT_TAG ? 8 : 16;
+    rec->hdr_len = hdr_len + explicit_ivlen;
+    rec->len = len;
+
+    memcpy( rec->add_data, ssl->cur_out_ctr, 8 );
+    rec->add_data[8]  = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    mbedtls_ssl_write_version( ssl->major_ver, ssl->minor_ver,
+                               ssl->conf->transport, rec->add_data + 9 );
+    rec->add_data[11] = (unsigned char)( len >> 8 );
+    rec->add_data[12] = (unsigned char)( len      );
+
+    if( transform->fixed_ivlen == 4 )
+    {
+        /* GCM and CCM: fixed || explicit (=seqnum) */
+        memcpy( rec->iv, transform->iv_enc, 4 );
+        memcpy( rec->iv + 4, ssl->cur_out_ctr, 8 );
+        memcpy( rec->buf + hdr_len, ssl->cur_out_ctr, 8 );
+    }
+    else if( transform->fixed_ivlen == 12 )
+    {
+        /* ChachaPoly: fixed XOR sequence number */
+        memcpy( rec->iv, transform->iv_enc, 12 );
+
+        for( i = 0; i < 8; i++ )
+            rec->iv[i + 4] ^= ssl->cur_out_ctr[i];
+    }
+    else
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+    }
+
+    rec->buf[0] = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    mbedtls_ssl_write_version( ssl->major_ver, ssl->minor_ver,
+                               ssl->conf->transport, rec->buf + 1 );
+    rec->buf[3] = (unsigned char)( ( explicit_ivlen + len + rec->taglen ) >> 8 );
+    rec->buf[4] = (unsigned char)( ( explicit_ivlen + len + rec->taglen )      );
+
+    memcpy( rec->buf + rec->hdr_len, buf, len );
+
+    for( i = 8; i > ssl_ep_len( ssl ); i-- )
+        if( ++ssl->cur_out_ctr[i - 1] != 0 )
+            break;
+
+    /* The loop goes to its end iff the counter is wrapping */
+    if( i == ssl_ep_len( ssl ) )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "outgoing message counter would wrap" ) );
+        return( MBEDTLS_ERR_SSL_COUNTER_WRAPPING );
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG( 3, ( "queue record for async protection, "
+                                "slot = %d, msglen = %d",
+                                (int) slot, (int) len ) );
+
+    rec->ret = 0;
+    rec->user_data = NULL;
+    rec->state = SSL_ASYNC_RECORD_RUNNING;
+
+    ret = ssl->conf->f_async_record_start( ssl, rec );
+    if( ret == MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH )
+    {
+        mbedtls_ssl_async_record_protect( rec );
+        rec->state = SSL_ASYNC_RECORD_DONE;
+    }
+    else if( ret != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "f_async_record_start", ret );
+        rec->state = SSL_ASYNC_RECORD_IDLE;
+        return( ret );
+    }
+
+    ssl->async_rec_count++;
+
+    return( 0 );
+}
+
+/*
+ * Split application data into records handed to the asynchronous
+ * callbacks, as long as there are free slots, and send the records that
+ * are ready.
+ */
+static int ssl_write_async( mbedtls_ssl_context *ssl,
+                            const unsigned char *buf, size_t len )
+{
+    int ret = mbedtls_ssl_get_max_out_record_payload( ssl );
+    const size_t max_len = (size_t) ret;
+    size_t written = 0, chunk;
+
+    if( ret < 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_get_max_out_record_payload", ret );
+        return( ret );
+    }
+
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    /* Data left over from corked writes goes first */
+    if( ( ret = ssl_cork_seal( ssl ) ) != 0 )
+        return( ret );
+#endif
+
+    if( ( ret = ssl_async_record_setup( ssl ) ) != 0 )
+        return( ret );
+
+    if( ssl->async_rec_count != 0 || ssl->out_left != 0 )
+    {
+        ret = mbedtls_ssl_flush_output( ssl );
+        if( ret != 0 &&
+            ( ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS ||
+              ssl->async_rec_count == MBEDTLS_SSL_ASYNC_RECORD_SLOTS ) )
+        {
+            MBEDTLS_SSL_DEBUG_RET( 2, "mbedtls_ssl_flush_output", ret );
+            return( ret );
+        }
+    }
+
+    while( written < len &&
+           ssl->async_rec_count < MBEDTLS_SSL_ASYNC_RECORD_SLOTS )
+    {
+        chunk = len - written;
+        if( chunk > max_len )
+            chunk = max_len;
+
+        if( ( ret = ssl_async_record_queue( ssl, buf + written, chunk ) ) != 0 )
+            return( ret );
+
+        written += chunk;
+    }
+
+    /* Send whatever is ready now; the rest goes out on later calls */
+    ret = mbedtls_ssl_flush_output( ssl );
+    if( ret != 0 &&
+        ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS &&
+        ret != MBEDTLS_ERR_SSL_WANT_WRITE )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_flush_output", ret );
+        return( ret );
+    }
+
+    return( (int) written );
+}
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
+
 /*
  * Write application data (public-facing wrapper)
  */
@@ -8946,6 +10292,16 @@ int mbedtls_ssl_write( mbedtls_ssl_context *ssl, const unsigned char *buf, size_
         }
     }
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    if( ssl_async_record_applies( ssl ) )
+        ret = ssl_write_async( ssl, buf, len );
+    else
+#endif
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    if( ssl_cork_applies( ssl ) )
+        ret = ssl_write_corked( ssl, buf, len );
+    else
+#endif
 #if defined(MBEDTLS_SSL_CBC_RECORD_SPLITTING)
     ret = ssl_write_split( ssl, buf, len );
 #else
@@ -8957,6 +10313,34 @@ int mbedtls_ssl_write( mbedtls_ssl_context *ssl, const unsigned char *buf, size_
     return( ret );
 }
 
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+void mbedtls_ssl_set_write_cork( mbedtls_ssl_context *ssl, int cork )
+{
+    ssl->out_cork = ( cork != MBEDTLS_SSL_WRITE_CORK_DISABLED );
+}
+#endif /* MBEDTLS_SSL_WRITE_CORK */
+
+#if defined(MBEDTLS_SSL_WRITE_CORK) || defined(MBEDTLS_SSL_ASYNC_RECORD)
+/*
+ * Send buffered application data (public-facing wrapper)
+ */
+int mbedtls_ssl_flush( mbedtls_ssl_context *ssl )
+{
+    int ret;
+
+    if( ssl == NULL || ssl->conf == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> flush" ) );
+
+    ret = mbedtls_ssl_flush_output( ssl );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= flush" ) );
+
+    return( ret );
+}
+#endif /* MBEDTLS_SSL_WRITE_CORK || MBEDTLS_SSL_ASYNC_RECORD */
+
 /*
  * Notify the peer that the connection is being closed
  */
@@ -9015,6 +10399,9 @@ static void ssl_key_cert_free( mbedtls_ssl_key_cert *key_cert )
     while( cur != NULL )
     {
         next = cur->next;
+#if defined(MBEDTLS_SSL_CERT_MSG_CACHE)
+        mbedtls_free( cur->cert_msg );
+#endif
         mbedtls_free( cur );
         cur = next;
     }
@@ -9085,6 +10472,7 @@ void mbedtls_ssl_handshake_free( mbedtls_ssl_context *ssl )
     mbedtls_sha512_free(   &handshake->fin_sha512    );
 #endif
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    ssl_transcript_free( handshake );
 
 #if defined(MBEDTLS_DHM_C)
     mbedtls_dhm_free( &handshake->dhm_ctx );
@@ -9178,16 +10566,21 @@ void mbedtls_ssl_free( mbedtls_ssl_context *ssl )
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> free" ) );
 
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    /* Wait for the workers before freeing anything they could touch */
+    ssl_async_record_free( ssl );
+#endif
+
     if( ssl->out_buf != NULL )
     {
         mbedtls_platform_zeroize( ssl->out_buf, MBEDTLS_SSL_OUT_BUFFER_LEN );
-        mbedtls_free( ssl->out_buf );
+        ssl_obj_free( ssl->conf, SSL_OBJ_OUT_BUF, ssl->out_buf );
     }
 
     if( ssl->in_buf != NULL )
     {
         mbedtls_platform_zeroize( ssl->in_buf, MBEDTLS_SSL_IN_BUFFER_LEN );
-        mbedtls_free( ssl->in_buf );
+        ssl_obj_free( ssl->conf, SSL_OBJ_IN_BUF, ssl->in_buf );
     }
 
 #if defined(MBEDTLS_ZLIB_SUPPORT)
@@ -9201,7 +10594,7 @@ void mbedtls_ssl_free( mbedtls_ssl_context *ssl )
     if( ssl->transform )
     {
         mbedtls_ssl_transform_free( ssl->transform );
-        mbedtls_free( ssl->transform );
+        ssl_obj_free( ssl->conf, SSL_OBJ_TRANSFORM, ssl->transform );
     }
 
     if( ssl->handshake )
@@ -9210,8 +10603,8 @@ void mbedtls_ssl_free( mbedtls_ssl_context *ssl )
         mbedtls_ssl_transform_free( ssl->transform_negotiate );
         mbedtls_ssl_session_free( ssl->session_negotiate );
 
-        mbedtls_free( ssl->handshake );
-        mbedtls_free( ssl->transform_negotiate );
+        ssl_obj_free( ssl->conf, SSL_OBJ_HANDSHAKE, ssl->handshake );
+        ssl_obj_free( ssl->conf, SSL_OBJ_TRANSFORM, ssl->transform_negotiate );
         mbedtls_free( ssl->session_negotiate );
     }
 
@@ -9455,6 +10848,10 @@ int mbedtls_ssl_config_defaults( mbedtls_ssl_config *conf,
 #endif
     }
 
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    ssl_conf_ciphersuite_index( conf );
+#endif
+
     return( 0 );
 }
 
@@ -9490,6 +10887,10 @@ void mbedtls_ssl_config_free( mbedtls_ssl_config *conf )
     ssl_key_cert_free( conf->key_cert );
 #endif
 
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    ssl_conf_ciphersuite_index_free( conf );
+#endif
+
     mbedtls_platform_zeroize( conf, sizeof( mbedtls_ssl_config ) );
 }
 
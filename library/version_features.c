@@ -258,6 +258,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_AES_FEWER_TABLES)
     "MBEDTLS_AES_FEWER_TABLES",
 #endif /* MBEDTLS_AES_FEWER_TABLES */
+#if defined(MBEDTLS_BASE64_SIMD)
+    "MBEDTLS_BASE64_SIMD",
+#endif /* MBEDTLS_BASE64_SIMD */
 #if defined(MBEDTLS_CAMELLIA_SMALL_MEMORY)
     "MBEDTLS_CAMELLIA_SMALL_MEMORY",
 #endif /* MBEDTLS_CAMELLIA_SMALL_MEMORY */
@@ -387,6 +390,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_GENPRIME)
     "MBEDTLS_GENPRIME",
 #endif /* MBEDTLS_GENPRIME */
+#if defined(MBEDTLS_MPI_SCRATCH)
+    "MBEDTLS_MPI_SCRATCH",
+#endif /* MBEDTLS_MPI_SCRATCH */
 #if defined(MBEDTLS_FS_IO)
     "MBEDTLS_FS_IO",
 #endif /* MBEDTLS_FS_IO */
@@ -402,6 +408,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_ENTROPY_NV_SEED)
     "MBEDTLS_ENTROPY_NV_SEED",
 #endif /* MBEDTLS_ENTROPY_NV_SEED */
+#if defined(MBEDTLS_ENTROPY_BACKGROUND)
+    "MBEDTLS_ENTROPY_BACKGROUND",
+#endif /* MBEDTLS_ENTROPY_BACKGROUND */
 #if defined(MBEDTLS_PSA_HAS_ITS_IO)
     "MBEDTLS_PSA_HAS_ITS_IO",
 #endif /* MBEDTLS_PSA_HAS_ITS_IO */
@@ -411,6 +420,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_MEMORY_BACKTRACE)
     "MBEDTLS_MEMORY_BACKTRACE",
 #endif /* MBEDTLS_MEMORY_BACKTRACE */
+#if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS)
+    "MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS",
+#endif /* MBEDTLS_MEMORY_BUFFER_ALLOC_ARENAS */
 #if defined(MBEDTLS_PK_RSA_ALT_SUPPORT)
     "MBEDTLS_PK_RSA_ALT_SUPPORT",
 #endif /* MBEDTLS_PK_RSA_ALT_SUPPORT */
@@ -420,9 +432,15 @@ static const char *features[] = {
 #if defined(MBEDTLS_PKCS1_V21)
     "MBEDTLS_PKCS1_V21",
 #endif /* MBEDTLS_PKCS1_V21 */
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_CACHE)
+    "MBEDTLS_PSA_CRYPTO_KEY_CACHE",
+#endif /* MBEDTLS_PSA_CRYPTO_KEY_CACHE */
 #if defined(MBEDTLS_PSA_CRYPTO_SPM)
     "MBEDTLS_PSA_CRYPTO_SPM",
 #endif /* MBEDTLS_PSA_CRYPTO_SPM */
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP)
+    "MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP",
+#endif /* MBEDTLS_PSA_CRYPTO_STORAGE_LOG_MMAP */
 #if defined(MBEDTLS_PSA_HAS_ITS_IO)
     "MBEDTLS_PSA_HAS_ITS_IO",
 #endif /* MBEDTLS_PSA_HAS_ITS_IO */
@@ -441,6 +459,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
     "MBEDTLS_SSL_ASYNC_PRIVATE",
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+#if defined(MBEDTLS_SSL_ASYNC_RECORD)
+    "MBEDTLS_SSL_ASYNC_RECORD",
+#endif /* MBEDTLS_SSL_ASYNC_RECORD */
 #if defined(MBEDTLS_SSL_DEBUG_ALL)
     "MBEDTLS_SSL_DEBUG_ALL",
 #endif /* MBEDTLS_SSL_DEBUG_ALL */
@@ -459,6 +480,18 @@ static const char *features[] = {
 #if defined(MBEDTLS_SSL_CBC_RECORD_SPLITTING)
     "MBEDTLS_SSL_CBC_RECORD_SPLITTING",
 #endif /* MBEDTLS_SSL_CBC_RECORD_SPLITTING */
+#if defined(MBEDTLS_SSL_CERT_MSG_CACHE)
+    "MBEDTLS_SSL_CERT_MSG_CACHE",
+#endif /* MBEDTLS_SSL_CERT_MSG_CACHE */
+#if defined(MBEDTLS_SSL_CIPHERSUITE_INDEX)
+    "MBEDTLS_SSL_CIPHERSUITE_INDEX",
+#endif /* MBEDTLS_SSL_CIPHERSUITE_INDEX */
+#if defined(MBEDTLS_SSL_WRITE_CORK)
+    "MBEDTLS_SSL_WRITE_CORK",
+#endif /* MBEDTLS_SSL_WRITE_CORK */
+#if defined(MBEDTLS_SSL_READ_AHEAD)
+    "MBEDTLS_SSL_READ_AHEAD",
+#endif /* MBEDTLS_SSL_READ_AHEAD */
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
     "MBEDTLS_SSL_RENEGOTIATION",
 #endif /* MBEDTLS_SSL_RENEGOTIATION */
@@ -540,6 +573,12 @@ static const char *features[] = {
 #if defined(MBEDTLS_X509_CHECK_EXTENDED_KEY_USAGE)
     "MBEDTLS_X509_CHECK_EXTENDED_KEY_USAGE",
 #endif /* MBEDTLS_X509_CHECK_EXTENDED_KEY_USAGE */
+#if defined(MBEDTLS_X509_CRT_STORE)
+    "MBEDTLS_X509_CRT_STORE",
+#endif /* MBEDTLS_X509_CRT_STORE */
+#if defined(MBEDTLS_X509_CRT_PARSE_BULK)
+    "MBEDTLS_X509_CRT_PARSE_BULK",
+#endif /* MBEDTLS_X509_CRT_PARSE_BULK */
 #if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
     "MBEDTLS_X509_RSASSA_PSS_SUPPORT",
 #endif /* MBEDTLS_X509_RSASSA_PSS_SUPPORT */
@@ -597,6 +636,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_CTR_DRBG_C)
     "MBEDTLS_CTR_DRBG_C",
 #endif /* MBEDTLS_CTR_DRBG_C */
+#if defined(MBEDTLS_CTR_DRBG_THREAD_C)
+    "MBEDTLS_CTR_DRBG_THREAD_C",
+#endif /* MBEDTLS_CTR_DRBG_THREAD_C */
 #if defined(MBEDTLS_DEBUG_C)
     "MBEDTLS_DEBUG_C",
 #endif /* MBEDTLS_DEBUG_C */
@@ -705,6 +747,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C)
     "MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C",
 #endif /* MBEDTLS_PSA_CRYPTO_STORAGE_ITS_C */
+#if defined(MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C)
+    "MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C",
+#endif /* MBEDTLS_PSA_CRYPTO_STORAGE_LOG_C */
 #if defined(MBEDTLS_RIPEMD160_C)
     "MBEDTLS_RIPEMD160_C",
 #endif /* MBEDTLS_RIPEMD160_C */
@@ -726,6 +771,12 @@ static const char *features[] = {
 #if defined(MBEDTLS_SSL_COOKIE_C)
     "MBEDTLS_SSL_COOKIE_C",
 #endif /* MBEDTLS_SSL_COOKIE_C */
+#if defined(MBEDTLS_SSL_ECDHE_POOL_C)
+    "MBEDTLS_SSL_ECDHE_POOL_C",
+#endif /* MBEDTLS_SSL_ECDHE_POOL_C */
+#if defined(MBEDTLS_SSL_POOL_C)
+    "MBEDTLS_SSL_POOL_C",
+#endif /* MBEDTLS_SSL_POOL_C */
 #if defined(MBEDTLS_SSL_TICKET_C)
     "MBEDTLS_SSL_TICKET_C",
 #endif /* MBEDTLS_SSL_TICKET_C */
@@ -753,6 +804,9 @@ static const char *features[] = {
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
     "MBEDTLS_X509_CRT_PARSE_C",
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+    "MBEDTLS_X509_CRT_CACHE_C",
+#endif /* MBEDTLS_X509_CRT_CACHE_C */
 #if defined(MBEDTLS_X509_CRL_PARSE_C)
     "MBEDTLS_X509_CRL_PARSE_C",
 #endif /* MBEDTLS_X509_CRL_PARSE_C */
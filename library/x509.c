@@ -341,9 +341,9 @@ int mbedtls_x509_get_rsassa_pss_params( const mbedtls_x509_buf *params,
  *
  *  AttributeValue ::= ANY DEFINED BY AttributeType
  */
-static int x509_get_attr_type_value( unsigned char **p,
-                                     const unsigned char *end,
-                                     mbedtls_x509_name *cur )
+int mbedtls_x509_get_attr_type_value( unsigned char **p,
+                                      const unsigned char *end,
+                                      mbedtls_x509_name *cur )
 {
     int ret;
     size_t len;
@@ -436,7 +436,7 @@ int mbedtls_x509_get_name( unsigned char **p, const unsigned char *end,
 
         while( 1 )
         {
-            if( ( ret = x509_get_attr_type_value( p, end_set, cur ) ) != 0 )
+            if( ( ret = mbedtls_x509_get_attr_type_value( p, end_set, cur ) ) != 0 )
                 return( ret );
 
             if( *p == end_set )
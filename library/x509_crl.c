@@ -47,10 +47,11 @@
 #include "mbedtls/pem.h"
 #endif
 
+#include <stdlib.h>
+
 #if defined(MBEDTLS_PLATFORM_C)
 #include "mbedtls/platform.h"
 #else
-#include <stdlib.h>
 #include <stdio.h>
 #define mbedtls_free       free
 #define mbedtls_calloc    calloc
@@ -228,16 +229,65 @@ static int x509_get_crl_entry_ext( unsigned char **p,
     return( 0 );
 }
 
+/*
+ * Order CRL entries by serial number: shorter serials first, then by
+ * contents, so that equal serials as compared by mbedtls_x509_crt_is_revoked()
+ * are adjacent.
+ */
+static int x509_crl_entry_cmp( const void *a, const void *b )
+{
+    const mbedtls_x509_crl_entry *x = *(const mbedtls_x509_crl_entry **) a;
+    const mbedtls_x509_crl_entry *y = *(const mbedtls_x509_crl_entry **) b;
+
+    if( x->serial.len != y->serial.len )
+        return( x->serial.len < y->serial.len ? -1 : 1 );
+
+    return( memcmp( x->serial.p, y->serial.p, x->serial.len ) );
+}
+
+/*
+ * Build the index of entries sorted by serial number
+ */
+static int x509_crl_index_entries( mbedtls_x509_crl *crl )
+{
+    const mbedtls_x509_crl_entry *cur;
+    size_t count = 0;
+
+    for( cur = &crl->entry; cur != NULL && cur->serial.len != 0;
+         cur = cur->next )
+        count++;
+
+    if( count == 0 )
+        return( 0 );
+
+    crl->entry_index = mbedtls_calloc( count, sizeof( *crl->entry_index ) );
+    if( crl->entry_index == NULL )
+        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+
+    for( cur = &crl->entry; crl->entry_count < count; cur = cur->next )
+        crl->entry_index[crl->entry_count++] = cur;
+
+    qsort( (void *) crl->entry_index, count, sizeof( *crl->entry_index ),
+           x509_crl_entry_cmp );
+
+    return( 0 );
+}
+
 /*
  * X.509 CRL Entries
+ *
+ * The entries following the first one are carved from a single block sized
+ * by a first pass over the list, so that large CRLs do not cost one heap
+ * allocation per entry.
  */
 static int x509_get_entries( unsigned char **p,
                              const unsigned char *end,
-                             mbedtls_x509_crl_entry *entry )
+                             mbedtls_x509_crl *crl )
 {
     int ret;
-    size_t entry_len;
-    mbedtls_x509_crl_entry *cur_entry = entry;
+    size_t entry_len, count, used = 0;
+    unsigned char *q;
+    mbedtls_x509_crl_entry *cur_entry = &crl->entry;
 
     if( *p == end )
         return( 0 );
@@ -253,6 +303,25 @@ static int x509_get_entries( unsigned char **p,
 
     end = *p + entry_len;
 
+    for( q = *p, count = 0; q < end; count++ )
+    {
+        if( mbedtls_asn1_get_tag( &q, end, &entry_len,
+                MBEDTLS_ASN1_SEQUENCE | MBEDTLS_ASN1_CONSTRUCTED ) != 0 )
+            break;
+
+        q += entry_len;
+    }
+
+    if( count > 1 )
+    {
+        crl->entry_block = mbedtls_calloc( count - 1,
+                                           sizeof( mbedtls_x509_crl_entry ) );
+        if( crl->entry_block == NULL )
+            return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+
+        crl->entry_block_len = count - 1;
+    }
+
     while( *p < end )
     {
         size_t len2;
@@ -282,7 +351,12 @@ static int x509_get_entries( unsigned char **p,
 
         if( *p < end )
         {
-            cur_entry->next = mbedtls_calloc( 1, sizeof( mbedtls_x509_crl_entry ) );
+            /* Entries beyond the count only occur in malformed lists */
+            if( used < crl->entry_block_len )
+                cur_entry->next = &crl->entry_block[used++];
+            else
+                cur_entry->next = mbedtls_calloc( 1,
+                                            sizeof( mbedtls_x509_crl_entry ) );
 
             if( cur_entry->next == NULL )
                 return( MBEDTLS_ERR_X509_ALLOC_FAILED );
@@ -291,7 +365,7 @@ static int x509_get_entries( unsigned char **p,
         }
     }
 
-    return( 0 );
+    return( x509_crl_index_entries( crl ) );
 }
 
 /*
@@ -467,7 +541,7 @@ int mbedtls_x509_crl_parse_der( mbedtls_x509_crl *chain,
      *                                   -- if present, MUST be v2
      *                        } OPTIONAL
      */
-    if( ( ret = x509_get_entries( &p, end, &crl->entry ) ) != 0 )
+    if( ( ret = x509_get_entries( &p, end, crl ) ) != 0 )
     {
         mbedtls_x509_crl_free( crl );
         return( ret );
@@ -718,6 +792,7 @@ void mbedtls_x509_crl_free( mbedtls_x509_crl *crl )
     mbedtls_x509_name *name_prv;
     mbedtls_x509_crl_entry *entry_cur;
     mbedtls_x509_crl_entry *entry_prv;
+    size_t i;
 
     if( crl == NULL )
         return;
@@ -737,7 +812,11 @@ void mbedtls_x509_crl_free( mbedtls_x509_crl *crl )
             mbedtls_free( name_prv );
         }
 
+        /* The first entries come from entry_block, any others from the heap */
         entry_cur = crl_cur->entry.next;
+        for( i = 0; i < crl_cur->entry_block_len && entry_cur != NULL; i++ )
+            entry_cur = entry_cur->next;
+
         while( entry_cur != NULL )
         {
             entry_prv = entry_cur;
@@ -747,6 +826,15 @@ void mbedtls_x509_crl_free( mbedtls_x509_crl *crl )
             mbedtls_free( entry_prv );
         }
 
+        if( crl_cur->entry_block != NULL )
+        {
+            mbedtls_platform_zeroize( crl_cur->entry_block,
+                crl_cur->entry_block_len * sizeof( mbedtls_x509_crl_entry ) );
+            mbedtls_free( crl_cur->entry_block );
+        }
+
+        mbedtls_free( (void *) crl_cur->entry_index );
+
         if( crl_cur->raw.p != NULL )
         {
             mbedtls_platform_zeroize( crl_cur->raw.p, crl_cur->raw.len );
@@ -68,6 +68,15 @@
 #include "mbedtls/threading.h"
 #endif
 
+#if defined(MBEDTLS_X509_CRT_STORE)
+#include <stdlib.h>
+#endif
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+#include "mbedtls/x509_crt_cache.h"
+#include "mbedtls/sha256.h"
+#endif
+
 #if defined(_WIN32) && !defined(EFIX64) && !defined(EFI32)
 #include <windows.h>
 #else
@@ -83,6 +92,12 @@
 #endif /* !_WIN32 || EFIX64 || EFI32 */
 #endif
 
+#if defined(MBEDTLS_X509_CRT_PARSE_BULK)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 /*
  * Item in a verification chain: cert and flags for it
  */
@@ -321,7 +336,104 @@ static int x509_string_cmp( const mbedtls_x509_buf *a, const mbedtls_x509_buf *b
 }
 
 /*
- * Compare two X.509 Names (aka rdnSequence).
+ * Walk the items of an X.509 Name in its raw form, the way
+ * mbedtls_x509_get_name() does but without building a list, so that names
+ * of certificates whose lists are not decoded can be used too.
+ */
+typedef struct
+{
+    unsigned char *p;               /* next item                    */
+    const unsigned char *end;       /* end of the rdnSequence       */
+    const unsigned char *end_set;   /* end of the current RDN       */
+}
+x509_name_iter;
+
+static void x509_name_iter_init( x509_name_iter *it,
+                                 unsigned char *p, const unsigned char *end )
+{
+    it->p = p;
+    it->end = end;
+    it->end_set = p;
+}
+
+/*
+ * Start on the raw Name, including its SEQUENCE header
+ */
+static int x509_name_iter_init_raw( x509_name_iter *it,
+                                    const mbedtls_x509_buf *raw )
+{
+    int ret;
+    size_t len;
+    unsigned char *p = raw->p;
+
+    if( ( ret = mbedtls_asn1_get_tag( &p, raw->p + raw->len, &len,
+            MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
+        return( MBEDTLS_ERR_X509_INVALID_NAME + ret );
+
+    x509_name_iter_init( it, p, p + len );
+
+    return( 0 );
+}
+
+/*
+ * Fill in the type and value of the next item, and set next_merged if more
+ * items follow in the same set.
+ *
+ * Return 0 if successful, 1 at the end of the Name, or the error
+ * mbedtls_x509_get_name() would return.
+ */
+static int x509_name_iter_next( x509_name_iter *it, mbedtls_x509_name *cur )
+{
+    int ret;
+    size_t set_len;
+
+    if( it->p == it->end_set )
+    {
+        if( it->p == it->end )
+            return( 1 );
+
+        if( ( ret = mbedtls_asn1_get_tag( &it->p, it->end, &set_len,
+                MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET ) ) != 0 )
+            return( MBEDTLS_ERR_X509_INVALID_NAME + ret );
+
+        it->end_set = it->p + set_len;
+    }
+
+    if( ( ret = mbedtls_x509_get_attr_type_value( &it->p, it->end_set,
+                                                  cur ) ) != 0 )
+        return( ret );
+
+    cur->next_merged = ( it->p != it->end_set );
+
+    return( 0 );
+}
+
+/*
+ * Check a Name the way mbedtls_x509_get_name() parses it
+ */
+static int x509_name_check( unsigned char **p, const unsigned char *end )
+{
+    int ret;
+    x509_name_iter it;
+    mbedtls_x509_name cur;
+
+    if( *p == end )
+        return( MBEDTLS_ERR_X509_INVALID_NAME + MBEDTLS_ERR_ASN1_OUT_OF_DATA );
+
+    x509_name_iter_init( &it, *p, end );
+    while( ( ret = x509_name_iter_next( &it, &cur ) ) == 0 )
+        ;
+
+    if( ret < 0 )
+        return( ret );
+
+    *p = it.p;
+
+    return( 0 );
+}
+
+/*
+ * Compare two raw X.509 Names (aka rdnSequence).
  *
  * See RFC 5280 section 7.1, though we don't implement the whole algorithm:
  * we sometimes return unequal when the full algorithm would return equal,
@@ -330,38 +442,484 @@ static int x509_string_cmp( const mbedtls_x509_buf *a, const mbedtls_x509_buf *b
  *
  * Return 0 if equal, -1 otherwise.
  */
-static int x509_name_cmp( const mbedtls_x509_name *a, const mbedtls_x509_name *b )
+static int x509_name_cmp( const mbedtls_x509_buf *a_raw,
+                          const mbedtls_x509_buf *b_raw )
 {
-    /* Avoid recursion, it might not be optimised by the compiler */
-    while( a != NULL || b != NULL )
+    x509_name_iter it_a, it_b;
+    mbedtls_x509_name a, b;
+    int ret_a, ret_b;
+
+    /* Identical encodings are the common case */
+    if( a_raw->len == b_raw->len &&
+        memcmp( a_raw->p, b_raw->p, b_raw->len ) == 0 )
+    {
+        return( 0 );
+    }
+
+    if( x509_name_iter_init_raw( &it_a, a_raw ) != 0 ||
+        x509_name_iter_init_raw( &it_b, b_raw ) != 0 )
+    {
+        return( -1 );
+    }
+
+    while( 1 )
     {
-        if( a == NULL || b == NULL )
+        ret_a = x509_name_iter_next( &it_a, &a );
+        ret_b = x509_name_iter_next( &it_b, &b );
+
+        if( ret_a < 0 || ret_b < 0 || ret_a != ret_b )
             return( -1 );
 
+        /* both at the end */
+        if( ret_a == 1 )
+            return( 0 );
+
         /* type */
-        if( a->oid.tag != b->oid.tag ||
-            a->oid.len != b->oid.len ||
-            memcmp( a->oid.p, b->oid.p, b->oid.len ) != 0 )
+        if( a.oid.tag != b.oid.tag ||
+            a.oid.len != b.oid.len ||
+            memcmp( a.oid.p, b.oid.p, b.oid.len ) != 0 )
         {
             return( -1 );
         }
 
         /* value */
-        if( x509_string_cmp( &a->val, &b->val ) != 0 )
+        if( x509_string_cmp( &a.val, &b.val ) != 0 )
             return( -1 );
 
         /* structure of the list of sets */
-        if( a->next_merged != b->next_merged )
+        if( a.next_merged != b.next_merged )
+            return( -1 );
+    }
+}
+
+/*
+ * Find the value of a v3 extension by scanning the raw extensions, so that
+ * extensions the parser skips can be used too.
+ *
+ * Return 0 and set the extnValue contents in val if found, -1 otherwise.
+ */
+static int x509_crt_find_ext( const mbedtls_x509_crt *crt,
+                              const char *oid, size_t oid_len,
+                              mbedtls_x509_buf *val )
+{
+    unsigned char *p = crt->v3_ext.p;
+    const unsigned char *end, *end_ext;
+    size_t len;
+    int ret, is_critical;
+
+    if( p == NULL )
+        return( -1 );
+
+    end = p + crt->v3_ext.len;
+
+    if( mbedtls_asn1_get_tag( &p, end, &len,
+            MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) != 0 )
+        return( -1 );
+
+    while( p < end )
+    {
+        if( mbedtls_asn1_get_tag( &p, end, &len,
+                MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) != 0 )
+            return( -1 );
+
+        end_ext = p + len;
+
+        if( mbedtls_asn1_get_tag( &p, end_ext, &len, MBEDTLS_ASN1_OID ) != 0 )
             return( -1 );
 
-        a = a->next;
-        b = b->next;
+        if( len == oid_len && memcmp( p, oid, oid_len ) == 0 )
+        {
+            p += len;
+
+            /* Get optional critical */
+            if( ( ret = mbedtls_asn1_get_bool( &p, end_ext,
+                                               &is_critical ) ) != 0 &&
+                ret != MBEDTLS_ERR_ASN1_UNEXPECTED_TAG )
+                return( -1 );
+
+            if( mbedtls_asn1_get_tag( &p, end_ext, &val->len,
+                                      MBEDTLS_ASN1_OCTET_STRING ) != 0 )
+                return( -1 );
+
+            val->tag = MBEDTLS_ASN1_OCTET_STRING;
+            val->p = p;
+            return( 0 );
+        }
+
+        p = (unsigned char *) end_ext;
+    }
+
+    return( -1 );
+}
+
+#if defined(MBEDTLS_X509_CRT_STORE)
+/*
+ * FNV-1a, used to index names and key identifiers
+ */
+#define X509_HASH_INIT      0x811c9dc5u
+
+static uint32_t x509_hash_update( uint32_t hash,
+                                  const unsigned char *p, size_t len )
+{
+    while( len-- > 0 )
+    {
+        hash ^= *p++;
+        hash *= 0x01000193u;
+    }
+
+    return( hash );
+}
+
+/*
+ * Hash an X.509 Name so that names that are equal according to
+ * x509_name_cmp() have the same hash: the string types and case that
+ * x509_string_cmp() ignores are left out.
+ */
+static uint32_t x509_name_hash( const mbedtls_x509_buf *raw )
+{
+    uint32_t hash = X509_HASH_INIT;
+    x509_name_iter it;
+    mbedtls_x509_name name;
+    unsigned char c;
+    size_t i;
+
+    if( x509_name_iter_init_raw( &it, raw ) != 0 )
+        return( hash );
+
+    while( x509_name_iter_next( &it, &name ) == 0 )
+    {
+        c = (unsigned char) name.oid.tag;
+        hash = x509_hash_update( hash, &c, 1 );
+        hash = x509_hash_update( hash, name.oid.p, name.oid.len );
+
+        if( name.val.tag == MBEDTLS_ASN1_UTF8_STRING ||
+            name.val.tag == MBEDTLS_ASN1_PRINTABLE_STRING )
+        {
+            for( i = 0; i < name.val.len; i++ )
+            {
+                c = name.val.p[i];
+                if( c >= 'A' && c <= 'Z' )
+                    c += 'a' - 'A';
+
+                hash = x509_hash_update( hash, &c, 1 );
+            }
+        }
+        else
+        {
+            c = (unsigned char) name.val.tag;
+            hash = x509_hash_update( hash, &c, 1 );
+            hash = x509_hash_update( hash, name.val.p, name.val.len );
+        }
+
+        c = name.next_merged ? 1 : 0;
+        hash = x509_hash_update( hash, &c, 1 );
     }
 
-    /* a == NULL == b */
+    return( hash );
+}
+
+/*
+ * SubjectKeyIdentifier ::= KeyIdentifier
+ * KeyIdentifier ::= OCTET STRING
+ */
+static int x509_crt_subject_key_id( const mbedtls_x509_crt *crt,
+                                    mbedtls_x509_buf *key_id )
+{
+    mbedtls_x509_buf ext;
+    unsigned char *p;
+
+    if( x509_crt_find_ext( crt, MBEDTLS_OID_SUBJECT_KEY_IDENTIFIER,
+                           MBEDTLS_OID_SIZE( MBEDTLS_OID_SUBJECT_KEY_IDENTIFIER ),
+                           &ext ) != 0 )
+        return( -1 );
+
+    p = ext.p;
+    if( mbedtls_asn1_get_tag( &p, ext.p + ext.len, &key_id->len,
+                              MBEDTLS_ASN1_OCTET_STRING ) != 0 ||
+        key_id->len == 0 )
+        return( -1 );
+
+    key_id->tag = MBEDTLS_ASN1_OCTET_STRING;
+    key_id->p = p;
+
+    return( 0 );
+}
+
+/*
+ * AuthorityKeyIdentifier ::= SEQUENCE {
+ *      keyIdentifier             [0] KeyIdentifier           OPTIONAL,
+ *      authorityCertIssuer       [1] GeneralNames            OPTIONAL,
+ *      authorityCertSerialNumber [2] CertificateSerialNumber OPTIONAL  }
+ */
+static int x509_crt_authority_key_id( const mbedtls_x509_crt *crt,
+                                      mbedtls_x509_buf *key_id )
+{
+    mbedtls_x509_buf ext;
+    unsigned char *p;
+    const unsigned char *end;
+    size_t len;
+
+    if( x509_crt_find_ext( crt, MBEDTLS_OID_AUTHORITY_KEY_IDENTIFIER,
+                           MBEDTLS_OID_SIZE( MBEDTLS_OID_AUTHORITY_KEY_IDENTIFIER ),
+                           &ext ) != 0 )
+        return( -1 );
+
+    p = ext.p;
+    end = ext.p + ext.len;
+
+    if( mbedtls_asn1_get_tag( &p, end, &len,
+            MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) != 0 )
+        return( -1 );
+
+    if( mbedtls_asn1_get_tag( &p, p + len, &key_id->len,
+                              MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0 ) != 0 ||
+        key_id->len == 0 )
+        return( -1 );
+
+    key_id->tag = MBEDTLS_ASN1_OCTET_STRING;
+    key_id->p = p;
+
+    return( 0 );
+}
+
+static int x509_crt_store_entry_cmp( const void *a, const void *b )
+{
+    const mbedtls_x509_crt_store_entry *x = a, *y = b;
+
+    if( x->hash != y->hash )
+        return( x->hash < y->hash ? -1 : 1 );
+
+    /* Keep the order of the list among equal hashes */
+    if( x->order != y->order )
+        return( x->order < y->order ? -1 : 1 );
+
+    return( 0 );
+}
+
+/*
+ * First entry with the given hash, or the end of the array
+ */
+static const mbedtls_x509_crt_store_entry *x509_crt_store_lookup(
+                    const mbedtls_x509_crt_store_entry *entries,
+                    size_t count, uint32_t hash )
+{
+    size_t lo = 0, hi = count, mid;
+
+    while( lo < hi )
+    {
+        mid = lo + ( hi - lo ) / 2;
+
+        if( entries[mid].hash < hash )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return( entries + lo );
+}
+
+void mbedtls_x509_crt_store_init( mbedtls_x509_crt_store *store )
+{
+    memset( store, 0, sizeof( mbedtls_x509_crt_store ) );
+}
+
+int mbedtls_x509_crt_store_setup( mbedtls_x509_crt_store *store,
+                                  mbedtls_x509_crt *ca_chain )
+{
+    mbedtls_x509_crt *cur;
+    mbedtls_x509_crt_store_entry *e;
+    size_t count = 0;
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+    mbedtls_x509_crt_cache_context *cache = store->cache;
+    uint32_t generation = store->generation;
+#endif
+
+    mbedtls_x509_crt_store_free( store );
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+    store->cache = cache;
+    store->generation = generation + 1;
+#endif
+
+    for( cur = ca_chain; cur != NULL; cur = cur->next )
+        if( cur->raw.p != NULL )
+            count++;
+
+    store->ca_chain = ca_chain;
+
+    if( count == 0 )
+        return( 0 );
+
+    store->by_subject = mbedtls_calloc( count, sizeof( *store->by_subject ) );
+    store->by_key_id = mbedtls_calloc( count, sizeof( *store->by_key_id ) );
+    if( store->by_subject == NULL || store->by_key_id == NULL )
+    {
+        mbedtls_x509_crt_store_free( store );
+        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+    }
+
+    for( cur = ca_chain; cur != NULL; cur = cur->next )
+    {
+        if( cur->raw.p == NULL )
+            continue;
+
+        e = &store->by_subject[store->subject_count];
+        e->order = store->subject_count++;
+        e->crt = cur;
+        e->hash = x509_name_hash( &cur->subject_raw );
+
+        if( x509_crt_subject_key_id( cur, &e->key_id ) != 0 )
+            continue;
+
+        store->by_key_id[store->key_id_count] = *e;
+        store->by_key_id[store->key_id_count].hash =
+            x509_hash_update( X509_HASH_INIT, e->key_id.p, e->key_id.len );
+        store->key_id_count++;
+    }
+
+    qsort( store->by_subject, store->subject_count,
+           sizeof( *store->by_subject ), x509_crt_store_entry_cmp );
+    qsort( store->by_key_id, store->key_id_count,
+           sizeof( *store->by_key_id ), x509_crt_store_entry_cmp );
+
     return( 0 );
 }
 
+void mbedtls_x509_crt_store_free( mbedtls_x509_crt_store *store )
+{
+    if( store == NULL )
+        return;
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+    if( store->cache != NULL )
+        mbedtls_x509_crt_cache_purge( store->cache, store );
+#endif
+
+    mbedtls_free( store->by_subject );
+    mbedtls_free( store->by_key_id );
+
+    mbedtls_platform_zeroize( store, sizeof( mbedtls_x509_crt_store ) );
+}
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+void mbedtls_x509_crt_store_set_cache( mbedtls_x509_crt_store *store,
+                                       mbedtls_x509_crt_cache_context *cache )
+{
+    if( store->cache != NULL && store->cache != cache )
+        mbedtls_x509_crt_cache_purge( store->cache, store );
+
+    store->cache = cache;
+}
+#endif /* MBEDTLS_X509_CRT_CACHE_C */
+#endif /* MBEDTLS_X509_CRT_STORE */
+
+/*
+ * Potential parents of a certificate: either a plain list, or with a trust
+ * store, the certificates whose subject key identifier matches the child's
+ * authority key identifier followed by the others whose subject name hash
+ * matches the child's issuer.
+ */
+typedef struct
+{
+    mbedtls_x509_crt *list;
+#if defined(MBEDTLS_X509_CRT_STORE)
+    const mbedtls_x509_crt_store_entry *key_id, *key_id_end;
+    const mbedtls_x509_crt_store_entry *subject, *subject_end;
+    mbedtls_x509_buf aki;
+#endif
+} x509_crt_candidates;
+
+static void x509_crt_candidates_init( x509_crt_candidates *cand,
+                                      const mbedtls_x509_crt *child,
+                                      mbedtls_x509_crt *list,
+                                      const mbedtls_x509_crt_store *store )
+{
+    memset( cand, 0, sizeof( x509_crt_candidates ) );
+
+#if defined(MBEDTLS_X509_CRT_STORE)
+    if( store != NULL )
+    {
+        const mbedtls_x509_crt_store_entry *end;
+        uint32_t hash;
+
+        if( x509_crt_authority_key_id( child, &cand->aki ) == 0 )
+        {
+            hash = x509_hash_update( X509_HASH_INIT,
+                                     cand->aki.p, cand->aki.len );
+            end = store->by_key_id + store->key_id_count;
+
+            cand->key_id = x509_crt_store_lookup( store->by_key_id,
+                                                  store->key_id_count, hash );
+            for( cand->key_id_end = cand->key_id;
+                 cand->key_id_end < end && cand->key_id_end->hash == hash;
+                 cand->key_id_end++ )
+                ;
+        }
+        else
+            cand->aki.p = NULL;
+
+        hash = x509_name_hash( &child->issuer_raw );
+        end = store->by_subject + store->subject_count;
+
+        cand->subject = x509_crt_store_lookup( store->by_subject,
+                                               store->subject_count, hash );
+        for( cand->subject_end = cand->subject;
+             cand->subject_end < end && cand->subject_end->hash == hash;
+             cand->subject_end++ )
+            ;
+
+        return;
+    }
+#else
+    (void) child;
+    (void) store;
+#endif /* MBEDTLS_X509_CRT_STORE */
+
+    cand->list = list;
+}
+
+#if defined(MBEDTLS_X509_CRT_STORE)
+static int x509_crt_candidates_key_id_match( const x509_crt_candidates *cand,
+                                  const mbedtls_x509_crt_store_entry *e )
+{
+    return( cand->aki.p != NULL && e->key_id.p != NULL &&
+            e->key_id.len == cand->aki.len &&
+            memcmp( e->key_id.p, cand->aki.p, cand->aki.len ) == 0 );
+}
+#endif
+
+static mbedtls_x509_crt *x509_crt_candidates_next( x509_crt_candidates *cand )
+{
+    mbedtls_x509_crt *crt;
+
+#if defined(MBEDTLS_X509_CRT_STORE)
+    while( cand->key_id < cand->key_id_end )
+    {
+        const mbedtls_x509_crt_store_entry *e = cand->key_id++;
+
+        if( x509_crt_candidates_key_id_match( cand, e ) )
+            return( e->crt );
+    }
+
+    while( cand->subject < cand->subject_end )
+    {
+        const mbedtls_x509_crt_store_entry *e = cand->subject++;
+
+        /* Already returned from the key identifier index */
+        if( x509_crt_candidates_key_id_match( cand, e ) )
+            continue;
+
+        return( e->crt );
+    }
+#endif /* MBEDTLS_X509_CRT_STORE */
+
+    crt = cand->list;
+    if( crt != NULL )
+        cand->list = crt->next;
+
+    return( crt );
+}
+
 /*
  * Reset (init or clear) a verify_chain
  */
@@ -572,12 +1130,41 @@ static int x509_get_key_usage( unsigned char **p,
  * ExtKeyUsageSyntax ::= SEQUENCE SIZE (1..MAX) OF KeyPurposeId
  *
  * KeyPurposeId ::= OBJECT IDENTIFIER
+ *
+ * With a NULL ext_key_usage, only check the encoding.
  */
 static int x509_get_ext_key_usage( unsigned char **p,
                                const unsigned char *end,
                                mbedtls_x509_sequence *ext_key_usage)
 {
     int ret;
+    size_t len;
+
+    if( ext_key_usage == NULL )
+    {
+        if( ( ret = mbedtls_asn1_get_tag( p, end, &len,
+                MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
+            return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS + ret );
+
+        if( *p + len != end )
+            return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS +
+                    MBEDTLS_ERR_ASN1_LENGTH_MISMATCH );
+
+        if( len == 0 )
+            return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS +
+                    MBEDTLS_ERR_ASN1_INVALID_LENGTH );
+
+        while( *p < end )
+        {
+            if( ( ret = mbedtls_asn1_get_tag( p, end, &len,
+                                              MBEDTLS_ASN1_OID ) ) != 0 )
+                return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS + ret );
+
+            *p += len;
+        }
+
+        return( 0 );
+    }
 
     if( ( ret = mbedtls_asn1_get_sequence_of( p, end, ext_key_usage, MBEDTLS_ASN1_OID ) ) != 0 )
         return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS + ret );
@@ -615,6 +1202,8 @@ static int x509_get_ext_key_usage( unsigned char **p,
  *      partyName               [1]     DirectoryString }
  *
  * NOTE: we only parse and use dNSName at this point.
+ *
+ * With a NULL subject_alt_name, only check the encoding.
  */
 static int x509_get_subject_alt_name( unsigned char **p,
                                       const unsigned char *end,
@@ -654,7 +1243,7 @@ static int x509_get_subject_alt_name( unsigned char **p,
         }
 
         /* Skip everything but DNS name */
-        if( tag != ( MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2 ) )
+        if( tag != ( MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2 ) || cur == NULL )
         {
             *p += tag_len;
             continue;
@@ -683,7 +1272,8 @@ static int x509_get_subject_alt_name( unsigned char **p,
     }
 
     /* Set final sequence entry's next pointer to NULL */
-    cur->next = NULL;
+    if( cur != NULL )
+        cur->next = NULL;
 
     if( *p != end )
         return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS +
@@ -801,14 +1391,14 @@ static int x509_get_crt_ext( unsigned char **p,
         case MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE:
             /* Parse extended key usage */
             if( ( ret = x509_get_ext_key_usage( p, end_ext_octet,
-                    &crt->ext_key_usage ) ) != 0 )
+                    crt->lazy ? NULL : &crt->ext_key_usage ) ) != 0 )
                 return( ret );
             break;
 
         case MBEDTLS_X509_EXT_SUBJECT_ALT_NAME:
             /* Parse subject alt name */
             if( ( ret = x509_get_subject_alt_name( p, end_ext_octet,
-                    &crt->subject_alt_names ) ) != 0 )
+                    crt->lazy ? NULL : &crt->subject_alt_names ) ) != 0 )
                 return( ret );
             break;
 
@@ -832,10 +1422,12 @@ static int x509_get_crt_ext( unsigned char **p,
 }
 
 /*
- * Parse and fill a single X.509 certificate in DER format
+ * Parse and fill a single X.509 certificate in DER format.
+ *
+ * Without make_copy, reference buf and leave the name lists undecoded.
  */
 static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *buf,
-                                    size_t buflen )
+                                    size_t buflen, int make_copy )
 {
     int ret;
     size_t len;
@@ -877,18 +1469,29 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *
                 MBEDTLS_ERR_ASN1_LENGTH_MISMATCH );
     }
     crt_end = p + len;
-
-    // Create and populate a new buffer for the raw field
     crt->raw.len = crt_end - buf;
-    crt->raw.p = p = mbedtls_calloc( 1, crt->raw.len );
-    if( p == NULL )
-        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
 
-    memcpy( p, buf, crt->raw.len );
+    if( make_copy != 0 )
+    {
+        // Create and populate a new buffer for the raw field
+        crt->raw.p = p = mbedtls_calloc( 1, crt->raw.len );
+        if( p == NULL )
+            return( MBEDTLS_ERR_X509_ALLOC_FAILED );
 
-    // Direct pointers to the new buffer
-    p += crt->raw.len - len;
-    end = crt_end = p + len;
+        memcpy( p, buf, crt->raw.len );
+        crt->own_buffer = 1;
+
+        // Direct pointers to the new buffer
+        p += crt->raw.len - len;
+        end = crt_end = p + len;
+    }
+    else
+    {
+        crt->raw.p = (unsigned char *) buf;
+        crt->lazy = 1;
+
+        end = crt_end;
+    }
 
     /*
      * TBSCertificate  ::=  SEQUENCE  {
@@ -949,7 +1552,12 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *
         return( MBEDTLS_ERR_X509_INVALID_FORMAT + ret );
     }
 
-    if( ( ret = mbedtls_x509_get_name( &p, p + len, &crt->issuer ) ) != 0 )
+    if( crt->lazy )
+        ret = x509_name_check( &p, p + len );
+    else
+        ret = mbedtls_x509_get_name( &p, p + len, &crt->issuer );
+
+    if( ret != 0 )
     {
         mbedtls_x509_crt_free( crt );
         return( ret );
@@ -982,10 +1590,18 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *
         return( MBEDTLS_ERR_X509_INVALID_FORMAT + ret );
     }
 
-    if( len && ( ret = mbedtls_x509_get_name( &p, p + len, &crt->subject ) ) != 0 )
+    if( len != 0 )
     {
-        mbedtls_x509_crt_free( crt );
-        return( ret );
+        if( crt->lazy )
+            ret = x509_name_check( &p, p + len );
+        else
+            ret = mbedtls_x509_get_name( &p, p + len, &crt->subject );
+
+        if( ret != 0 )
+        {
+            mbedtls_x509_crt_free( crt );
+            return( ret );
+        }
     }
 
     crt->subject_raw.len = p - crt->subject_raw.p;
@@ -1091,8 +1707,9 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt, const unsigned char *
  * Parse one X.509 certificate in DER format from a buffer and add them to a
  * chained list
  */
-int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *buf,
-                        size_t buflen )
+static int x509_crt_parse_der_internal( mbedtls_x509_crt *chain,
+                                        const unsigned char *buf,
+                                        size_t buflen, int make_copy )
 {
     int ret;
     mbedtls_x509_crt *crt = chain, *prev = NULL;
@@ -1124,7 +1741,7 @@ int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *bu
         crt = crt->next;
     }
 
-    if( ( ret = x509_crt_parse_der_core( crt, buf, buflen ) ) != 0 )
+    if( ( ret = x509_crt_parse_der_core( crt, buf, buflen, make_copy ) ) != 0 )
     {
         if( prev )
             prev->next = NULL;
@@ -1138,6 +1755,162 @@ int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *bu
     return( 0 );
 }
 
+int mbedtls_x509_crt_parse_der( mbedtls_x509_crt *chain, const unsigned char *buf,
+                        size_t buflen )
+{
+    return( x509_crt_parse_der_internal( chain, buf, buflen, 1 ) );
+}
+
+int mbedtls_x509_crt_parse_der_nocopy( mbedtls_x509_crt *chain,
+                                       const unsigned char *buf,
+                                       size_t buflen )
+{
+    return( x509_crt_parse_der_internal( chain, buf, buflen, 0 ) );
+}
+
+/*
+ * Free the name lists of a certificate and clear their heads
+ */
+static void x509_crt_free_lists( mbedtls_x509_crt *crt )
+{
+    mbedtls_x509_name *name_cur;
+    mbedtls_x509_name *name_prv;
+    mbedtls_x509_sequence *seq_cur;
+    mbedtls_x509_sequence *seq_prv;
+
+    name_cur = crt->issuer.next;
+    while( name_cur != NULL )
+    {
+        name_prv = name_cur;
+        name_cur = name_cur->next;
+        mbedtls_platform_zeroize( name_prv, sizeof( mbedtls_x509_name ) );
+        mbedtls_free( name_prv );
+    }
+
+    name_cur = crt->subject.next;
+    while( name_cur != NULL )
+    {
+        name_prv = name_cur;
+        name_cur = name_cur->next;
+        mbedtls_platform_zeroize( name_prv, sizeof( mbedtls_x509_name ) );
+        mbedtls_free( name_prv );
+    }
+
+    seq_cur = crt->ext_key_usage.next;
+    while( seq_cur != NULL )
+    {
+        seq_prv = seq_cur;
+        seq_cur = seq_cur->next;
+        mbedtls_platform_zeroize( seq_prv,
+                                  sizeof( mbedtls_x509_sequence ) );
+        mbedtls_free( seq_prv );
+    }
+
+    seq_cur = crt->subject_alt_names.next;
+    while( seq_cur != NULL )
+    {
+        seq_prv = seq_cur;
+        seq_cur = seq_cur->next;
+        mbedtls_platform_zeroize( seq_prv,
+                                  sizeof( mbedtls_x509_sequence ) );
+        mbedtls_free( seq_prv );
+    }
+
+    memset( &crt->issuer, 0, sizeof( mbedtls_x509_name ) );
+    memset( &crt->subject, 0, sizeof( mbedtls_x509_name ) );
+    memset( &crt->ext_key_usage, 0, sizeof( mbedtls_x509_sequence ) );
+    memset( &crt->subject_alt_names, 0, sizeof( mbedtls_x509_sequence ) );
+}
+
+/*
+ * Decode the name lists of a certificate parsed without them
+ */
+static int x509_crt_decode_lists( mbedtls_x509_crt *crt )
+{
+    int ret;
+    size_t len;
+    unsigned char *p;
+    mbedtls_x509_buf ext;
+
+    p = crt->issuer_raw.p;
+    if( ( ret = mbedtls_asn1_get_tag( &p, p + crt->issuer_raw.len, &len,
+            MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
+    {
+        ret = MBEDTLS_ERR_X509_INVALID_FORMAT + ret;
+        goto cleanup;
+    }
+
+    if( ( ret = mbedtls_x509_get_name( &p, p + len, &crt->issuer ) ) != 0 )
+        goto cleanup;
+
+    p = crt->subject_raw.p;
+    if( ( ret = mbedtls_asn1_get_tag( &p, p + crt->subject_raw.len, &len,
+            MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
+    {
+        ret = MBEDTLS_ERR_X509_INVALID_FORMAT + ret;
+        goto cleanup;
+    }
+
+    if( len != 0 &&
+        ( ret = mbedtls_x509_get_name( &p, p + len, &crt->subject ) ) != 0 )
+        goto cleanup;
+
+    if( crt->ext_types & MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE )
+    {
+        if( x509_crt_find_ext( crt, MBEDTLS_OID_EXTENDED_KEY_USAGE,
+                    MBEDTLS_OID_SIZE( MBEDTLS_OID_EXTENDED_KEY_USAGE ),
+                    &ext ) != 0 )
+        {
+            ret = MBEDTLS_ERR_X509_INVALID_EXTENSIONS;
+            goto cleanup;
+        }
+
+        p = ext.p;
+        if( ( ret = x509_get_ext_key_usage( &p, ext.p + ext.len,
+                                            &crt->ext_key_usage ) ) != 0 )
+            goto cleanup;
+    }
+
+    if( crt->ext_types & MBEDTLS_X509_EXT_SUBJECT_ALT_NAME )
+    {
+        if( x509_crt_find_ext( crt, MBEDTLS_OID_SUBJECT_ALT_NAME,
+                    MBEDTLS_OID_SIZE( MBEDTLS_OID_SUBJECT_ALT_NAME ),
+                    &ext ) != 0 )
+        {
+            ret = MBEDTLS_ERR_X509_INVALID_EXTENSIONS;
+            goto cleanup;
+        }
+
+        p = ext.p;
+        if( ( ret = x509_get_subject_alt_name( &p, ext.p + ext.len,
+                                               &crt->subject_alt_names ) ) != 0 )
+            goto cleanup;
+    }
+
+    crt->lazy = 0;
+
+    return( 0 );
+
+cleanup:
+    x509_crt_free_lists( crt );
+
+    return( ret );
+}
+
+int mbedtls_x509_crt_decode( mbedtls_x509_crt *chain )
+{
+    int ret;
+    mbedtls_x509_crt *crt;
+
+    for( crt = chain; crt != NULL; crt = crt->next )
+    {
+        if( crt->lazy && ( ret = x509_crt_decode_lists( crt ) ) != 0 )
+            return( ret );
+    }
+
+    return( 0 );
+}
+
 /*
  * Parse one or more PEM certificates from a buffer and add them to the chained
  * list
@@ -1348,54 +2121,389 @@ cleanup:
     if( dir == NULL )
         return( MBEDTLS_ERR_X509_FILE_IO_ERROR );
 
-#if defined(MBEDTLS_THREADING_C)
-    if( ( ret = mbedtls_mutex_lock( &mbedtls_threading_readdir_mutex ) ) != 0 )
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &mbedtls_threading_readdir_mutex ) ) != 0 )
+    {
+        closedir( dir );
+        return( ret );
+    }
+#endif /* MBEDTLS_THREADING_C */
+
+    while( ( entry = readdir( dir ) ) != NULL )
+    {
+        snp_ret = mbedtls_snprintf( entry_name, sizeof entry_name,
+                                    "%s/%s", path, entry->d_name );
+
+        if( snp_ret < 0 || (size_t)snp_ret >= sizeof entry_name )
+        {
+            ret = MBEDTLS_ERR_X509_BUFFER_TOO_SMALL;
+            goto cleanup;
+        }
+        else if( stat( entry_name, &sb ) == -1 )
+        {
+            ret = MBEDTLS_ERR_X509_FILE_IO_ERROR;
+            goto cleanup;
+        }
+
+        if( !S_ISREG( sb.st_mode ) )
+            continue;
+
+        // Ignore parse errors
+        //
+        t_ret = mbedtls_x509_crt_parse_file( chain, entry_name );
+        if( t_ret < 0 )
+            ret++;
+        else
+            ret += t_ret;
+    }
+
+cleanup:
+    closedir( dir );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &mbedtls_threading_readdir_mutex ) != 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif /* MBEDTLS_THREADING_C */
+
+#endif /* _WIN32 */
+
+    return( ret );
+}
+
+#if defined(MBEDTLS_X509_CRT_PARSE_BULK)
+/*
+ * A file to load, and what was parsed from it
+ */
+typedef struct
+{
+    char *name;                 /* path of the file                     */
+    mbedtls_x509_crt *chain;    /* certificates parsed from it          */
+    int ret;                    /* as from mbedtls_x509_crt_parse_file() */
+}
+x509_crt_bulk_file;
+
+typedef struct
+{
+    x509_crt_bulk_file *files;
+    size_t count;
+    size_t next;                /* next file to parse                   */
+#if defined(MBEDTLS_THREADING_PTHREAD)
+    mbedtls_threading_mutex_t mutex;
+#endif
+}
+x509_crt_bulk_context;
+
+/*
+ * Read a whole file with a terminating null byte, for files that cannot
+ * be mapped with one
+ */
+static int x509_crt_bulk_read( int fd, unsigned char **buf, size_t n )
+{
+    size_t done = 0;
+    ssize_t len;
+
+    if( n + 1 == 0 ||
+        ( *buf = mbedtls_calloc( 1, n + 1 ) ) == NULL )
+        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+
+    while( done < n )
+    {
+        len = read( fd, *buf + done, n - done );
+        if( len <= 0 )
+        {
+            mbedtls_platform_zeroize( *buf, n );
+            mbedtls_free( *buf );
+            return( MBEDTLS_ERR_X509_FILE_IO_ERROR );
+        }
+
+        done += (size_t) len;
+    }
+
+    return( 0 );
+}
+
+/*
+ * Parse one file as mbedtls_x509_crt_parse_file() would
+ */
+static int x509_crt_bulk_parse_file( x509_crt_bulk_file *file )
+{
+    int ret, fd;
+    struct stat sb;
+    unsigned char *buf = MAP_FAILED;
+    size_t n;
+    long page = sysconf( _SC_PAGESIZE );
+
+    if( ( file->chain = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) ) ) == NULL )
+        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+
+    mbedtls_x509_crt_init( file->chain );
+
+    if( ( fd = open( file->name, O_RDONLY ) ) == -1 )
+        return( MBEDTLS_ERR_X509_FILE_IO_ERROR );
+
+    if( fstat( fd, &sb ) == -1 )
+    {
+        close( fd );
+        return( MBEDTLS_ERR_X509_FILE_IO_ERROR );
+    }
+
+    n = (size_t) sb.st_size;
+
+    /*
+     * The rest of the last page of a mapping is zero-filled, which gives the
+     * null byte PEM detection needs. Files that end on a page boundary, and
+     * empty files, are read instead.
+     */
+    if( n != 0 && page > 0 && n % (size_t) page != 0 )
+        buf = mmap( NULL, n, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    if( buf == MAP_FAILED )
+    {
+        ret = x509_crt_bulk_read( fd, &buf, n );
+        close( fd );
+
+        if( ret != 0 )
+            return( ret );
+
+        ret = mbedtls_x509_crt_parse( file->chain, buf,
+                  strstr( (const char *) buf, "-----BEGIN " ) != NULL ? n + 1 : n );
+
+        mbedtls_platform_zeroize( buf, n );
+        mbedtls_free( buf );
+
+        return( ret );
+    }
+
+    close( fd );
+
+    ret = mbedtls_x509_crt_parse( file->chain, buf,
+              strstr( (const char *) buf, "-----BEGIN " ) != NULL ? n + 1 : n );
+
+    munmap( buf, n );
+
+    return( ret );
+}
+
+static void *x509_crt_bulk_worker( void *arg )
+{
+    x509_crt_bulk_context *ctx = arg;
+    size_t i;
+
+    while( 1 )
+    {
+#if defined(MBEDTLS_THREADING_PTHREAD)
+        if( mbedtls_mutex_lock( &ctx->mutex ) != 0 )
+            break;
+#endif
+
+        i = ctx->next;
+        if( i < ctx->count )
+            ctx->next++;
+
+#if defined(MBEDTLS_THREADING_PTHREAD)
+        if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+            break;
+#endif
+
+        if( i >= ctx->count )
+            break;
+
+        ctx->files[i].ret = x509_crt_bulk_parse_file( &ctx->files[i] );
+    }
+
+    return( NULL );
+}
+
+/*
+ * List the regular files of a directory, in readdir() order
+ */
+static int x509_crt_bulk_list( x509_crt_bulk_context *ctx, const char *path )
+{
+    int ret = 0;
+    int snp_ret;
+    size_t size = 0;
+    struct stat sb;
+    struct dirent *entry;
+    x509_crt_bulk_file *files;
+    char entry_name[MBEDTLS_X509_MAX_FILE_PATH_LEN];
+    DIR *dir = opendir( path );
+
+    if( dir == NULL )
+        return( MBEDTLS_ERR_X509_FILE_IO_ERROR );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &mbedtls_threading_readdir_mutex ) ) != 0 )
+    {
+        closedir( dir );
+        return( ret );
+    }
+#endif /* MBEDTLS_THREADING_C */
+
+    while( ( entry = readdir( dir ) ) != NULL )
+    {
+        snp_ret = mbedtls_snprintf( entry_name, sizeof entry_name,
+                                    "%s/%s", path, entry->d_name );
+
+        if( snp_ret < 0 || (size_t)snp_ret >= sizeof entry_name )
+        {
+            ret = MBEDTLS_ERR_X509_BUFFER_TOO_SMALL;
+            goto cleanup;
+        }
+        else if( stat( entry_name, &sb ) == -1 )
+        {
+            ret = MBEDTLS_ERR_X509_FILE_IO_ERROR;
+            goto cleanup;
+        }
+
+        if( !S_ISREG( sb.st_mode ) )
+            continue;
+
+        if( ctx->count == size )
+        {
+            size = size == 0 ? 64 : 2 * size;
+            if( ( files = mbedtls_calloc( size, sizeof( *files ) ) ) == NULL )
+            {
+                ret = MBEDTLS_ERR_X509_ALLOC_FAILED;
+                goto cleanup;
+            }
+
+            if( ctx->count != 0 )
+                memcpy( files, ctx->files, ctx->count * sizeof( *files ) );
+
+            mbedtls_free( ctx->files );
+            ctx->files = files;
+        }
+
+        if( ( ctx->files[ctx->count].name =
+                  mbedtls_calloc( 1, (size_t) snp_ret + 1 ) ) == NULL )
+        {
+            ret = MBEDTLS_ERR_X509_ALLOC_FAILED;
+            goto cleanup;
+        }
+
+        memcpy( ctx->files[ctx->count++].name, entry_name, (size_t) snp_ret );
+    }
+
+cleanup:
+    closedir( dir );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &mbedtls_threading_readdir_mutex ) != 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif /* MBEDTLS_THREADING_C */
+
+    return( ret );
+}
+
+int mbedtls_x509_crt_parse_path_bulk( mbedtls_x509_crt *chain,
+                                      const char *path, int threads )
+{
+    int ret;
+    size_t i;
+    mbedtls_x509_crt *last, *crt;
+    x509_crt_bulk_context ctx;
+#if defined(MBEDTLS_THREADING_PTHREAD)
+    pthread_t *tids = NULL;
+    int started = 0;
+#endif
+
+    if( chain == NULL || path == NULL )
+        return( MBEDTLS_ERR_X509_BAD_INPUT_DATA );
+
+    memset( &ctx, 0, sizeof( ctx ) );
+
+    if( ( ret = x509_crt_bulk_list( &ctx, path ) ) != 0 )
+        goto cleanup;
+
+#if defined(MBEDTLS_THREADING_PTHREAD)
+    mbedtls_mutex_init( &ctx.mutex );
+
+    if( threads > 1 && (size_t) threads > ctx.count )
+        threads = (int) ctx.count;
+
+    if( threads > 1 &&
+        ( tids = mbedtls_calloc( threads - 1, sizeof( pthread_t ) ) ) != NULL )
+    {
+        /* Run with fewer threads if some cannot be started */
+        for( ; started < threads - 1; started++ )
+            if( pthread_create( &tids[started], NULL,
+                                x509_crt_bulk_worker, &ctx ) != 0 )
+                break;
+    }
+#else
+    (void) threads;
+#endif
+
+    x509_crt_bulk_worker( &ctx );
+
+#if defined(MBEDTLS_THREADING_PTHREAD)
+    while( started > 0 )
+        pthread_join( tids[--started], NULL );
+
+    mbedtls_free( tids );
+    mbedtls_mutex_free( &ctx.mutex );
+#endif
+
+    /*
+     * Link the certificates of each file in directory order, starting from
+     * the first empty certificate of the chain like mbedtls_x509_crt_parse_der()
+     */
+    for( last = chain; last->version != 0 && last->next != NULL; )
+        last = last->next;
+
+    for( i = 0; i < ctx.count; i++ )
     {
-        closedir( dir );
-        return( ret );
-    }
-#endif /* MBEDTLS_THREADING_C */
+        if( ctx.files[i].ret < 0 )
+            ret++;
+        else
+            ret += ctx.files[i].ret;
 
-    while( ( entry = readdir( dir ) ) != NULL )
-    {
-        snp_ret = mbedtls_snprintf( entry_name, sizeof entry_name,
-                                    "%s/%s", path, entry->d_name );
+        crt = ctx.files[i].chain;
+        ctx.files[i].chain = NULL;
 
-        if( snp_ret < 0 || (size_t)snp_ret >= sizeof entry_name )
+        if( crt == NULL )
+            continue;
+
+        if( crt->version == 0 )
         {
-            ret = MBEDTLS_ERR_X509_BUFFER_TOO_SMALL;
-            goto cleanup;
+            mbedtls_x509_crt_free( crt );
+            mbedtls_free( crt );
+            continue;
         }
-        else if( stat( entry_name, &sb ) == -1 )
+
+        if( last->version == 0 )
         {
-            ret = MBEDTLS_ERR_X509_FILE_IO_ERROR;
-            goto cleanup;
+            /* Certificates do not point into their own structure */
+            *last = *crt;
+            mbedtls_free( crt );
         }
-
-        if( !S_ISREG( sb.st_mode ) )
-            continue;
-
-        // Ignore parse errors
-        //
-        t_ret = mbedtls_x509_crt_parse_file( chain, entry_name );
-        if( t_ret < 0 )
-            ret++;
         else
-            ret += t_ret;
+        {
+            last->next = crt;
+            last = crt;
+        }
+
+        while( last->next != NULL )
+            last = last->next;
     }
 
 cleanup:
-    closedir( dir );
+    for( i = 0; i < ctx.count; i++ )
+    {
+        mbedtls_free( ctx.files[i].name );
 
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &mbedtls_threading_readdir_mutex ) != 0 )
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
+        if( ctx.files[i].chain != NULL )
+        {
+            mbedtls_x509_crt_free( ctx.files[i].chain );
+            mbedtls_free( ctx.files[i].chain );
+        }
+    }
 
-#endif /* _WIN32 */
+    mbedtls_free( ctx.files );
 
     return( ret );
 }
+#endif /* MBEDTLS_X509_CRT_PARSE_BULK */
 #endif /* MBEDTLS_FS_IO */
 
 static int x509_info_subject_alt_name( char **buf, size_t *size,
@@ -1532,8 +2640,8 @@ static int x509_info_ext_key_usage( char **buf, size_t *size,
  */
 #define BEFORE_COLON    18
 #define BC              "18"
-int mbedtls_x509_crt_info( char *buf, size_t size, const char *prefix,
-                   const mbedtls_x509_crt *crt )
+static int x509_crt_info( char *buf, size_t size, const char *prefix,
+                          const mbedtls_x509_crt *crt )
 {
     int ret;
     size_t n;
@@ -1664,6 +2772,25 @@ int mbedtls_x509_crt_info( char *buf, size_t size, const char *prefix,
     return( (int) ( size - n ) );
 }
 
+int mbedtls_x509_crt_info( char *buf, size_t size, const char *prefix,
+                   const mbedtls_x509_crt *crt )
+{
+    int ret;
+    mbedtls_x509_crt decoded;
+
+    if( crt == NULL || ! crt->lazy )
+        return( x509_crt_info( buf, size, prefix, crt ) );
+
+    /* Decode the lists in a copy, the certificate may be shared */
+    decoded = *crt;
+    if( ( ret = x509_crt_decode_lists( &decoded ) ) == 0 )
+        ret = x509_crt_info( buf, size, prefix, &decoded );
+
+    x509_crt_free_lists( &decoded );
+
+    return( ret );
+}
+
 struct x509_crt_verify_string {
     int code;
     const char *string;
@@ -1751,26 +2878,48 @@ int mbedtls_x509_crt_check_extended_key_usage( const mbedtls_x509_crt *crt,
                                        const char *usage_oid,
                                        size_t usage_len )
 {
-    const mbedtls_x509_sequence *cur;
+    mbedtls_x509_buf ext, cur_oid;
+    unsigned char *p;
+    const unsigned char *end;
+    size_t len;
 
     /* Extension is not mandatory, absent means no restriction */
     if( ( crt->ext_types & MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE ) == 0 )
         return( 0 );
 
+    if( x509_crt_find_ext( crt, MBEDTLS_OID_EXTENDED_KEY_USAGE,
+                           MBEDTLS_OID_SIZE( MBEDTLS_OID_EXTENDED_KEY_USAGE ),
+                           &ext ) != 0 )
+        return( MBEDTLS_ERR_X509_BAD_INPUT_DATA );
+
+    p = ext.p;
+    end = ext.p + ext.len;
+
+    if( mbedtls_asn1_get_tag( &p, end, &len,
+            MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) != 0 )
+        return( MBEDTLS_ERR_X509_BAD_INPUT_DATA );
+
     /*
-     * Look for the requested usage (or wildcard ANY) in our list
+     * Look for the requested usage (or wildcard ANY) in the extension,
+     * whose encoding was checked by the parser
      */
-    for( cur = &crt->ext_key_usage; cur != NULL; cur = cur->next )
+    while( p < end )
     {
-        const mbedtls_x509_buf *cur_oid = &cur->buf;
+        if( mbedtls_asn1_get_tag( &p, end, &cur_oid.len,
+                                  MBEDTLS_ASN1_OID ) != 0 )
+            break;
 
-        if( cur_oid->len == usage_len &&
-            memcmp( cur_oid->p, usage_oid, usage_len ) == 0 )
+        cur_oid.tag = MBEDTLS_ASN1_OID;
+        cur_oid.p = p;
+        p += cur_oid.len;
+
+        if( cur_oid.len == usage_len &&
+            memcmp( cur_oid.p, usage_oid, usage_len ) == 0 )
         {
             return( 0 );
         }
 
-        if( MBEDTLS_OID_CMP( MBEDTLS_OID_ANY_EXTENDED_KEY_USAGE, cur_oid ) == 0 )
+        if( MBEDTLS_OID_CMP( MBEDTLS_OID_ANY_EXTENDED_KEY_USAGE, &cur_oid ) == 0 )
             return( 0 );
     }
 
@@ -1785,6 +2934,41 @@ int mbedtls_x509_crt_check_extended_key_usage( const mbedtls_x509_crt *crt,
 int mbedtls_x509_crt_is_revoked( const mbedtls_x509_crt *crt, const mbedtls_x509_crl *crl )
 {
     const mbedtls_x509_crl_entry *cur = &crl->entry;
+    size_t lo, hi, mid;
+
+    if( crl->entry_index != NULL )
+    {
+        /* Lower bound of the serial, in the order of x509_crl_entry_cmp() */
+        lo = 0;
+        hi = crl->entry_count;
+        while( lo < hi )
+        {
+            mid = lo + ( hi - lo ) / 2;
+            cur = crl->entry_index[mid];
+
+            if( cur->serial.len < crt->serial.len ||
+                ( cur->serial.len == crt->serial.len &&
+                  memcmp( cur->serial.p, crt->serial.p,
+                          crt->serial.len ) < 0 ) )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for( ; lo < crl->entry_count; lo++ )
+        {
+            cur = crl->entry_index[lo];
+
+            if( crt->serial.len != cur->serial.len ||
+                memcmp( crt->serial.p, cur->serial.p, crt->serial.len ) != 0 )
+                break;
+
+            if( mbedtls_x509_time_is_past( &cur->revocation_date ) )
+                return( 1 );
+        }
+
+        return( 0 );
+    }
 
     while( cur != NULL && cur->serial.len != 0 )
     {
@@ -1819,7 +3003,7 @@ static int x509_crt_verifycrl( mbedtls_x509_crt *crt, mbedtls_x509_crt *ca,
     while( crl_list != NULL )
     {
         if( crl_list->version == 0 ||
-            x509_name_cmp( &crl_list->issuer, &ca->subject ) != 0 )
+            x509_name_cmp( &crl_list->issuer_raw, &ca->subject_raw ) != 0 )
         {
             crl_list = crl_list->next;
             continue;
@@ -1959,7 +3143,7 @@ static int x509_crt_check_parent( const mbedtls_x509_crt *child,
     int need_ca_bit;
 
     /* Parent must be the issuer */
-    if( x509_name_cmp( &child->issuer, &parent->subject ) != 0 )
+    if( x509_name_cmp( &child->issuer_raw, &parent->subject_raw ) != 0 )
         return( -1 );
 
     /* Parent must have the basicConstraints CA bit set as a general rule */
@@ -2012,7 +3196,7 @@ static int x509_crt_check_parent( const mbedtls_x509_crt *child,
  *
  * Arguments:
  *  - [in] child: certificate for which we're looking for a parent
- *  - [in] candidates: chained list of potential parents
+ *  - [in-out] candidates: iterator over potential parents
  *  - [out] r_parent: parent found (or NULL)
  *  - [out] r_signature_is_good: 1 if child signature by parent is valid, or 0
  *  - [in] top: 1 if candidates consists of trusted roots, ie we're at the top
@@ -2028,7 +3212,7 @@ static int x509_crt_check_parent( const mbedtls_x509_crt *child,
  */
 static int x509_crt_find_parent_in(
                         mbedtls_x509_crt *child,
-                        mbedtls_x509_crt *candidates,
+                        x509_crt_candidates *candidates,
                         mbedtls_x509_crt **r_parent,
                         int *r_signature_is_good,
                         int top,
@@ -2041,6 +3225,8 @@ static int x509_crt_find_parent_in(
     int signature_is_good, fallback_signature_is_good;
 
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
+    mbedtls_x509_crt *cur;
+
     /* did we have something in progress? */
     if( rs_ctx != NULL && rs_ctx->parent != NULL )
     {
@@ -2054,6 +3240,11 @@ static int x509_crt_find_parent_in(
         rs_ctx->fallback_parent = NULL;
         rs_ctx->fallback_signature_is_good = 0;
 
+        /* move the iterator past the saved parent */
+        do
+            cur = x509_crt_candidates_next( candidates );
+        while( cur != NULL && cur != parent );
+
         /* resume where we left */
         goto check_signature;
     }
@@ -2062,7 +3253,9 @@ static int x509_crt_find_parent_in(
     fallback_parent = NULL;
     fallback_signature_is_good = 0;
 
-    for( parent = candidates; parent != NULL; parent = parent->next )
+    for( parent = x509_crt_candidates_next( candidates );
+         parent != NULL;
+         parent = x509_crt_candidates_next( candidates ) )
     {
         /* basic parenting skills (name, CA bit, key usage) */
         if( x509_crt_check_parent( child, parent, top ) != 0 )
@@ -2139,6 +3332,7 @@ check_signature:
  *  - [in] child: certificate for which we're looking for a parent, followed
  *         by a chain of possible intermediates
  *  - [in] trust_ca: list of locally trusted certificates
+ *  - [in] store: index of trust_ca, or NULL
  *  - [out] parent: parent found (or NULL)
  *  - [out] parent_is_trusted: 1 if returned `parent` is trusted, or 0
  *  - [out] signature_is_good: 1 if child signature by parent is valid, or 0
@@ -2154,6 +3348,7 @@ check_signature:
 static int x509_crt_find_parent(
                         mbedtls_x509_crt *child,
                         mbedtls_x509_crt *trust_ca,
+                        const mbedtls_x509_crt_store *store,
                         mbedtls_x509_crt **parent,
                         int *parent_is_trusted,
                         int *signature_is_good,
@@ -2162,7 +3357,7 @@ static int x509_crt_find_parent(
                         mbedtls_x509_crt_restart_ctx *rs_ctx )
 {
     int ret;
-    mbedtls_x509_crt *search_list;
+    x509_crt_candidates candidates;
 
     *parent_is_trusted = 1;
 
@@ -2176,9 +3371,12 @@ static int x509_crt_find_parent(
 #endif
 
     while( 1 ) {
-        search_list = *parent_is_trusted ? trust_ca : child->next;
+        if( *parent_is_trusted )
+            x509_crt_candidates_init( &candidates, child, trust_ca, store );
+        else
+            x509_crt_candidates_init( &candidates, child, child->next, NULL );
 
-        ret = x509_crt_find_parent_in( child, search_list,
+        ret = x509_crt_find_parent_in( child, &candidates,
                                        parent, signature_is_good,
                                        *parent_is_trusted,
                                        path_cnt, self_cnt, rs_ctx );
@@ -2220,16 +3418,19 @@ static int x509_crt_find_parent(
  */
 static int x509_crt_check_ee_locally_trusted(
                     mbedtls_x509_crt *crt,
-                    mbedtls_x509_crt *trust_ca )
+                    mbedtls_x509_crt *trust_ca,
+                    const mbedtls_x509_crt_store *store )
 {
     mbedtls_x509_crt *cur;
+    x509_crt_candidates candidates;
 
     /* must be self-issued */
-    if( x509_name_cmp( &crt->issuer, &crt->subject ) != 0 )
+    if( x509_name_cmp( &crt->issuer_raw, &crt->subject_raw ) != 0 )
         return( -1 );
 
     /* look for an exact match with trusted cert */
-    for( cur = trust_ca; cur != NULL; cur = cur->next )
+    x509_crt_candidates_init( &candidates, crt, trust_ca, store );
+    while( ( cur = x509_crt_candidates_next( &candidates ) ) != NULL )
     {
         if( crt->raw.len == cur->raw.len &&
             memcmp( crt->raw.p, cur->raw.p, crt->raw.len ) == 0 )
@@ -2271,6 +3472,7 @@ static int x509_crt_check_ee_locally_trusted(
  * Arguments:
  *  - [in] crt: the cert list EE, C1, ..., Cn
  *  - [in] trust_ca: the trusted list R1, ..., Rp
+ *  - [in] store: index of trust_ca, or NULL
  *  - [in] ca_crl, profile: as in verify_with_profile()
  *  - [out] ver_chain: the built and verified chain
  *      Only valid when return value is 0, may contain garbage otherwise!
@@ -2285,6 +3487,7 @@ static int x509_crt_check_ee_locally_trusted(
 static int x509_crt_verify_chain(
                 mbedtls_x509_crt *crt,
                 mbedtls_x509_crt *trust_ca,
+                const mbedtls_x509_crt_store *store,
                 mbedtls_x509_crl *ca_crl,
                 const mbedtls_x509_crt_profile *profile,
                 mbedtls_x509_crt_verify_chain *ver_chain,
@@ -2352,7 +3555,7 @@ static int x509_crt_verify_chain(
 
         /* Special case: EE certs that are locally trusted */
         if( ver_chain->len == 1 &&
-            x509_crt_check_ee_locally_trusted( child, trust_ca ) == 0 )
+            x509_crt_check_ee_locally_trusted( child, trust_ca, store ) == 0 )
         {
             return( 0 );
         }
@@ -2361,7 +3564,7 @@ static int x509_crt_verify_chain(
 find_parent:
 #endif
         /* Look for a parent in trusted CAs or up the chain */
-        ret = x509_crt_find_parent( child, trust_ca, &parent,
+        ret = x509_crt_find_parent( child, trust_ca, store, &parent,
                                        &parent_is_trusted, &signature_is_good,
                                        ver_chain->len - 1, self_cnt, rs_ctx );
 
@@ -2390,7 +3593,7 @@ find_parent:
          * These can occur with some strategies for key rollover, see [SIRO],
          * and should be excluded from max_pathlen checks. */
         if( ver_chain->len != 1 &&
-            x509_name_cmp( &child->issuer, &child->subject ) == 0 )
+            x509_name_cmp( &child->issuer_raw, &child->subject_raw ) == 0 )
         {
             self_cnt++;
         }
@@ -2449,6 +3652,49 @@ static int x509_crt_check_cn( const mbedtls_x509_buf *name,
     return( -1 );
 }
 
+/*
+ * Check the requested CN against the dNSName entries of the raw
+ * subjectAltName extension, whose encoding was checked by the parser
+ */
+static int x509_crt_check_san( const mbedtls_x509_crt *crt,
+                               const char *cn, size_t cn_len )
+{
+    mbedtls_x509_buf ext, name;
+    unsigned char *p;
+    const unsigned char *end;
+    size_t len;
+
+    if( x509_crt_find_ext( crt, MBEDTLS_OID_SUBJECT_ALT_NAME,
+                           MBEDTLS_OID_SIZE( MBEDTLS_OID_SUBJECT_ALT_NAME ),
+                           &ext ) != 0 )
+        return( -1 );
+
+    p = ext.p;
+    end = ext.p + ext.len;
+
+    if( mbedtls_asn1_get_tag( &p, end, &len,
+            MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) != 0 )
+        return( -1 );
+
+    while( p < end )
+    {
+        name.tag = *p++;
+        if( mbedtls_asn1_get_len( &p, end, &name.len ) != 0 )
+            return( -1 );
+
+        name.p = p;
+        p += name.len;
+
+        if( name.tag == ( MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2 ) &&
+            x509_crt_check_cn( &name, cn, cn_len ) == 0 )
+        {
+            return( 0 );
+        }
+    }
+
+    return( -1 );
+}
+
 /*
  * Verify the requested CN - only call this if cn is not NULL!
  */
@@ -2456,34 +3702,30 @@ static void x509_crt_verify_name( const mbedtls_x509_crt *crt,
                                   const char *cn,
                                   uint32_t *flags )
 {
-    const mbedtls_x509_name *name;
-    const mbedtls_x509_sequence *cur;
+    x509_name_iter it;
+    mbedtls_x509_name name;
     size_t cn_len = strlen( cn );
 
     if( crt->ext_types & MBEDTLS_X509_EXT_SUBJECT_ALT_NAME )
     {
-        for( cur = &crt->subject_alt_names; cur != NULL; cur = cur->next )
-        {
-            if( x509_crt_check_cn( &cur->buf, cn, cn_len ) == 0 )
-                break;
-        }
-
-        if( cur == NULL )
+        if( x509_crt_check_san( crt, cn, cn_len ) != 0 )
             *flags |= MBEDTLS_X509_BADCERT_CN_MISMATCH;
     }
     else
     {
-        for( name = &crt->subject; name != NULL; name = name->next )
+        if( x509_name_iter_init_raw( &it, &crt->subject_raw ) == 0 )
         {
-            if( MBEDTLS_OID_CMP( MBEDTLS_OID_AT_CN, &name->oid ) == 0 &&
-                x509_crt_check_cn( &name->val, cn, cn_len ) == 0 )
+            while( x509_name_iter_next( &it, &name ) == 0 )
             {
-                break;
+                if( MBEDTLS_OID_CMP( MBEDTLS_OID_AT_CN, &name.oid ) == 0 &&
+                    x509_crt_check_cn( &name.val, cn, cn_len ) == 0 )
+                {
+                    return;
+                }
             }
         }
 
-        if( name == NULL )
-            *flags |= MBEDTLS_X509_BADCERT_CN_MISMATCH;
+        *flags |= MBEDTLS_X509_BADCERT_CN_MISMATCH;
     }
 }
 
@@ -2546,6 +3788,179 @@ int mbedtls_x509_crt_verify_with_profile( mbedtls_x509_crt *crt,
                 profile, cn, flags, f_vrfy, p_vrfy, NULL ) );
 }
 
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+static void x509_crt_cache_update_u32( mbedtls_sha256_context *ctx,
+                                       uint32_t n )
+{
+    unsigned char buf[4];
+
+    buf[0] = (unsigned char)( n >> 24 );
+    buf[1] = (unsigned char)( n >> 16 );
+    buf[2] = (unsigned char)( n >>  8 );
+    buf[3] = (unsigned char)( n       );
+
+    mbedtls_sha256_update_ret( ctx, buf, sizeof( buf ) );
+}
+
+/*
+ * Hash everything the result of chain building depends on, apart from the
+ * current time: the presented certificates, the generation of the trust
+ * store, the CRLs (identified by their signature) and the profile.
+ */
+static int x509_crt_cache_key( const mbedtls_x509_crt *crt,
+                               const mbedtls_x509_crt_store *store,
+                               const mbedtls_x509_crl *ca_crl,
+                               const mbedtls_x509_crt_profile *profile,
+                               unsigned char key[32] )
+{
+    int ret;
+    mbedtls_sha256_context ctx;
+    const mbedtls_x509_crt *cur;
+    const mbedtls_x509_crl *crl;
+
+    mbedtls_sha256_init( &ctx );
+
+    if( ( ret = mbedtls_sha256_starts_ret( &ctx, 0 ) ) != 0 )
+        goto exit;
+
+    x509_crt_cache_update_u32( &ctx, store->generation );
+    x509_crt_cache_update_u32( &ctx, profile->allowed_mds );
+    x509_crt_cache_update_u32( &ctx, profile->allowed_pks );
+    x509_crt_cache_update_u32( &ctx, profile->allowed_curves );
+    x509_crt_cache_update_u32( &ctx, profile->rsa_min_bitlen );
+
+    for( cur = crt; cur != NULL && cur->raw.p != NULL; cur = cur->next )
+    {
+        x509_crt_cache_update_u32( &ctx, (uint32_t) cur->raw.len );
+        mbedtls_sha256_update_ret( &ctx, cur->raw.p, cur->raw.len );
+    }
+
+    /* No certificate is empty, so this ends the list unambiguously */
+    x509_crt_cache_update_u32( &ctx, 0 );
+
+    for( crl = ca_crl; crl != NULL; crl = crl->next )
+    {
+        x509_crt_cache_update_u32( &ctx, (uint32_t) crl->sig.len );
+        mbedtls_sha256_update_ret( &ctx, crl->sig.p, crl->sig.len );
+    }
+
+    ret = mbedtls_sha256_finish_ret( &ctx, key );
+
+exit:
+    mbedtls_sha256_free( &ctx );
+
+    return( ret );
+}
+
+static int x509_time_cmp( const mbedtls_x509_time *a,
+                          const mbedtls_x509_time *b )
+{
+    if( a->year != b->year ) return( a->year < b->year ? -1 : 1 );
+    if( a->mon  != b->mon  ) return( a->mon  < b->mon  ? -1 : 1 );
+    if( a->day  != b->day  ) return( a->day  < b->day  ? -1 : 1 );
+    if( a->hour != b->hour ) return( a->hour < b->hour ? -1 : 1 );
+    if( a->min  != b->min  ) return( a->min  < b->min  ? -1 : 1 );
+    if( a->sec  != b->sec  ) return( a->sec  < b->sec  ? -1 : 1 );
+
+    return( 0 );
+}
+
+/*
+ * Record a chain that verified without any flag
+ */
+static void x509_crt_cache_save( const mbedtls_x509_crt *crt,
+                                 const mbedtls_x509_crt_store *store,
+                                 const mbedtls_x509_crl *ca_crl,
+                                 const mbedtls_x509_crt_verify_chain *ver_chain,
+                                 const unsigned char key[32] )
+{
+    mbedtls_x509_crt_cache_entry entry;
+    const mbedtls_x509_crt *cur;
+    const mbedtls_x509_crl *crl;
+    size_t i, pos;
+
+    memset( &entry, 0, sizeof( entry ) );
+
+    for( i = 0; i < ver_chain->len; i++ )
+    {
+        const mbedtls_x509_crt_verify_chain_item *item = &ver_chain->items[i];
+
+        if( item->flags != 0 )
+            return;
+
+        for( cur = crt, pos = 0; cur != NULL && cur != item->crt;
+             cur = cur->next, pos++ )
+            ;
+
+        if( cur == NULL )
+        {
+            /* Only the top of the chain can come from the trust store */
+            if( i != ver_chain->len - 1 )
+                return;
+
+            entry.trusted = item->crt;
+        }
+        else if( pos > 0xFF )
+            return;
+        else
+            entry.pos[i] = (unsigned char) pos;
+
+        if( i == 0 || x509_time_cmp( &item->crt->valid_to,
+                                     &entry.valid_to ) < 0 )
+            entry.valid_to = item->crt->valid_to;
+    }
+
+    for( crl = ca_crl; crl != NULL; crl = crl->next )
+    {
+        if( crl->version != 0 &&
+            x509_time_cmp( &crl->next_update, &entry.valid_to ) < 0 )
+            entry.valid_to = crl->next_update;
+    }
+
+    entry.owner = store;
+    entry.len = ver_chain->len;
+    memcpy( entry.key, key, sizeof( entry.key ) );
+
+    (void) mbedtls_x509_crt_cache_set( store->cache, &entry );
+}
+
+/*
+ * Rebuild a verified chain from a cache entry
+ */
+static int x509_crt_cache_restore( mbedtls_x509_crt *crt,
+                                   const mbedtls_x509_crt_cache_entry *entry,
+                                   mbedtls_x509_crt_verify_chain *ver_chain )
+{
+    mbedtls_x509_crt *cur;
+    size_t i, pos;
+
+    if( entry->len == 0 || entry->len > MBEDTLS_X509_MAX_VERIFY_CHAIN_SIZE )
+        return( -1 );
+
+    for( i = 0; i < entry->len; i++ )
+    {
+        if( i == entry->len - 1 && entry->trusted != NULL )
+            cur = entry->trusted;
+        else
+        {
+            for( cur = crt, pos = 0; cur != NULL && pos < entry->pos[i];
+                 cur = cur->next, pos++ )
+                ;
+
+            if( cur == NULL )
+                return( -1 );
+        }
+
+        ver_chain->items[i].crt = cur;
+        ver_chain->items[i].flags = 0;
+    }
+
+    ver_chain->len = entry->len;
+
+    return( 0 );
+}
+#endif /* MBEDTLS_X509_CRT_CACHE_C */
+
 /*
  * Verify the certificate validity, with profile, restartable version
  *
@@ -2556,8 +3971,9 @@ int mbedtls_x509_crt_verify_with_profile( mbedtls_x509_crt *crt,
  *  - builds and verifies the chain
  *  - then calls the callback and merges the flags
  */
-int mbedtls_x509_crt_verify_restartable( mbedtls_x509_crt *crt,
+static int x509_crt_verify_restartable_ca( mbedtls_x509_crt *crt,
                      mbedtls_x509_crt *trust_ca,
+                     const mbedtls_x509_crt_store *store,
                      mbedtls_x509_crl *ca_crl,
                      const mbedtls_x509_crt_profile *profile,
                      const char *cn, uint32_t *flags,
@@ -2569,6 +3985,11 @@ int mbedtls_x509_crt_verify_restartable( mbedtls_x509_crt *crt,
     mbedtls_pk_type_t pk_type;
     mbedtls_x509_crt_verify_chain ver_chain;
     uint32_t ee_flags;
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+    mbedtls_x509_crt_cache_entry cache_entry;
+    unsigned char cache_key[32];
+    int use_cache = 0;
+#endif
 
     *flags = 0;
     ee_flags = 0;
@@ -2593,12 +4014,39 @@ int mbedtls_x509_crt_verify_restartable( mbedtls_x509_crt *crt,
     if( x509_profile_check_key( profile, &crt->pk ) != 0 )
         ee_flags |= MBEDTLS_X509_BADCERT_BAD_KEY;
 
-    /* Check the chain */
-    ret = x509_crt_verify_chain( crt, trust_ca, ca_crl, profile,
-                                 &ver_chain, rs_ctx );
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+    /* Look for the same chain verified earlier with the same inputs */
+    if( store != NULL && store->cache != NULL &&
+        x509_crt_cache_key( crt, store, ca_crl, profile, cache_key ) == 0 )
+    {
+        use_cache = 1;
 
-    if( ret != 0 )
-        goto exit;
+#if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
+        if( rs_ctx == NULL || rs_ctx->in_progress == x509_crt_rs_none )
+#endif
+        if( mbedtls_x509_crt_cache_get( store->cache, store, cache_key,
+                                        &cache_entry ) == 0 &&
+            x509_crt_cache_restore( crt, &cache_entry, &ver_chain ) == 0 )
+        {
+            use_cache = 0;
+        }
+    }
+
+    if( ver_chain.len == 0 )
+#endif /* MBEDTLS_X509_CRT_CACHE_C */
+    {
+        /* Check the chain */
+        ret = x509_crt_verify_chain( crt, trust_ca, store, ca_crl, profile,
+                                     &ver_chain, rs_ctx );
+
+        if( ret != 0 )
+            goto exit;
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+        if( use_cache )
+            x509_crt_cache_save( crt, store, ca_crl, &ver_chain, cache_key );
+#endif
+    }
 
     /* Merge end-entity flags */
     ver_chain.items[0].flags |= ee_flags;
@@ -2630,6 +4078,52 @@ exit:
     return( 0 );
 }
 
+int mbedtls_x509_crt_verify_restartable( mbedtls_x509_crt *crt,
+                     mbedtls_x509_crt *trust_ca,
+                     mbedtls_x509_crl *ca_crl,
+                     const mbedtls_x509_crt_profile *profile,
+                     const char *cn, uint32_t *flags,
+                     int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                     void *p_vrfy,
+                     mbedtls_x509_crt_restart_ctx *rs_ctx )
+{
+    return( x509_crt_verify_restartable_ca( crt, trust_ca, NULL, ca_crl,
+                profile, cn, flags, f_vrfy, p_vrfy, rs_ctx ) );
+}
+
+#if defined(MBEDTLS_X509_CRT_STORE)
+/*
+ * Verify the certificate validity, with trust store (not restartable)
+ */
+int mbedtls_x509_crt_verify_with_store( mbedtls_x509_crt *crt,
+                     const mbedtls_x509_crt_store *store,
+                     mbedtls_x509_crl *ca_crl,
+                     const mbedtls_x509_crt_profile *profile,
+                     const char *cn, uint32_t *flags,
+                     int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                     void *p_vrfy )
+{
+    return( x509_crt_verify_restartable_ca( crt, store->ca_chain, store,
+                ca_crl, profile, cn, flags, f_vrfy, p_vrfy, NULL ) );
+}
+
+/*
+ * Verify the certificate validity, with trust store, restartable version
+ */
+int mbedtls_x509_crt_verify_with_store_restartable( mbedtls_x509_crt *crt,
+                     const mbedtls_x509_crt_store *store,
+                     mbedtls_x509_crl *ca_crl,
+                     const mbedtls_x509_crt_profile *profile,
+                     const char *cn, uint32_t *flags,
+                     int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                     void *p_vrfy,
+                     mbedtls_x509_crt_restart_ctx *rs_ctx )
+{
+    return( x509_crt_verify_restartable_ca( crt, store->ca_chain, store,
+                ca_crl, profile, cn, flags, f_vrfy, p_vrfy, rs_ctx ) );
+}
+#endif /* MBEDTLS_X509_CRT_STORE */
+
 /*
  * Initialize a certificate chain
  */
@@ -2645,10 +4139,6 @@ void mbedtls_x509_crt_free( mbedtls_x509_crt *crt )
 {
     mbedtls_x509_crt *cert_cur = crt;
     mbedtls_x509_crt *cert_prv;
-    mbedtls_x509_name *name_cur;
-    mbedtls_x509_name *name_prv;
-    mbedtls_x509_sequence *seq_cur;
-    mbedtls_x509_sequence *seq_prv;
 
     if( crt == NULL )
         return;
@@ -2661,45 +4151,9 @@ void mbedtls_x509_crt_free( mbedtls_x509_crt *crt )
         mbedtls_free( cert_cur->sig_opts );
 #endif
 
-        name_cur = cert_cur->issuer.next;
-        while( name_cur != NULL )
-        {
-            name_prv = name_cur;
-            name_cur = name_cur->next;
-            mbedtls_platform_zeroize( name_prv, sizeof( mbedtls_x509_name ) );
-            mbedtls_free( name_prv );
-        }
-
-        name_cur = cert_cur->subject.next;
-        while( name_cur != NULL )
-        {
-            name_prv = name_cur;
-            name_cur = name_cur->next;
-            mbedtls_platform_zeroize( name_prv, sizeof( mbedtls_x509_name ) );
-            mbedtls_free( name_prv );
-        }
-
-        seq_cur = cert_cur->ext_key_usage.next;
-        while( seq_cur != NULL )
-        {
-            seq_prv = seq_cur;
-            seq_cur = seq_cur->next;
-            mbedtls_platform_zeroize( seq_prv,
-                                      sizeof( mbedtls_x509_sequence ) );
-            mbedtls_free( seq_prv );
-        }
-
-        seq_cur = cert_cur->subject_alt_names.next;
-        while( seq_cur != NULL )
-        {
-            seq_prv = seq_cur;
-            seq_cur = seq_cur->next;
-            mbedtls_platform_zeroize( seq_prv,
-                                      sizeof( mbedtls_x509_sequence ) );
-            mbedtls_free( seq_prv );
-        }
+        x509_crt_free_lists( cert_cur );
 
-        if( cert_cur->raw.p != NULL )
+        if( cert_cur->raw.p != NULL && cert_cur->own_buffer )
         {
             mbedtls_platform_zeroize( cert_cur->raw.p, cert_cur->raw.len );
             mbedtls_free( cert_cur->raw.p );
@@ -0,0 +1,302 @@
+/*
+ *  Cache of verified certificate chains
+ *
+ *  Copyright (C) 2006-2018, ARM Limited, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file is part of mbed TLS (https://tls.mbed.org)
+ */
+/*
+ * Verified chains are kept in a simple chained list, keyed by a hash of
+ * everything the result of chain building depends on. The hash is computed
+ * by the verification code in x509_crt.c.
+ */
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_X509_CRT_CACHE_C)
+
+#if defined(MBEDTLS_PLATFORM_C)
+#include "mbedtls/platform.h"
+#else
+#include <stdlib.h>
+#define mbedtls_calloc    calloc
+#define mbedtls_free      free
+#endif
+
+#include "mbedtls/x509_crt_cache.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+void mbedtls_x509_crt_cache_init( mbedtls_x509_crt_cache_context *cache )
+{
+    memset( cache, 0, sizeof( mbedtls_x509_crt_cache_context ) );
+
+    cache->timeout = MBEDTLS_X509_CRT_CACHE_DEFAULT_TIMEOUT;
+    cache->max_entries = MBEDTLS_X509_CRT_CACHE_DEFAULT_MAX_ENTRIES;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init( &cache->mutex );
+#endif
+}
+
+/*
+ * Is the entry past its timeout or the expiry of its chain?
+ */
+static int x509_crt_cache_expired( const mbedtls_x509_crt_cache_context *cache,
+                                   const mbedtls_x509_crt_cache_entry *entry
+#if defined(MBEDTLS_HAVE_TIME)
+                                   , mbedtls_time_t t
+#endif
+                                   )
+{
+#if defined(MBEDTLS_HAVE_TIME)
+    if( cache->timeout != 0 &&
+        (int) ( t - entry->timestamp ) > cache->timeout )
+        return( 1 );
+#else
+    (void) cache;
+#endif
+
+    return( mbedtls_x509_time_is_past( &entry->valid_to ) );
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+#define X509_CRT_CACHE_EXPIRED( cache, entry )    \
+    x509_crt_cache_expired( cache, entry, t )
+#else
+#define X509_CRT_CACHE_EXPIRED( cache, entry )    \
+    x509_crt_cache_expired( cache, entry )
+#endif
+
+int mbedtls_x509_crt_cache_get( mbedtls_x509_crt_cache_context *cache,
+                                const void *owner,
+                                const unsigned char key[32],
+                                mbedtls_x509_crt_cache_entry *entry )
+{
+    int ret = 1;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t t = mbedtls_time( NULL );
+#endif
+    mbedtls_x509_crt_cache_entry *cur;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &cache->mutex ) != 0 )
+        return( 1 );
+#endif
+
+    for( cur = cache->chain; cur != NULL; cur = cur->next )
+    {
+        if( cur->owner != owner || memcmp( cur->key, key, 32 ) != 0 )
+            continue;
+
+        if( X509_CRT_CACHE_EXPIRED( cache, cur ) )
+            break;
+
+        memcpy( entry, cur, sizeof( mbedtls_x509_crt_cache_entry ) );
+        entry->next = NULL;
+
+        ret = 0;
+        break;
+    }
+
+    if( ret == 0 )
+        cache->hits++;
+    else
+        cache->misses++;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &cache->mutex ) != 0 )
+        ret = 1;
+#endif
+
+    return( ret );
+}
+
+int mbedtls_x509_crt_cache_set( mbedtls_x509_crt_cache_context *cache,
+                                const mbedtls_x509_crt_cache_entry *entry )
+{
+    int ret = 0;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t t = mbedtls_time( NULL );
+#endif
+    mbedtls_x509_crt_cache_entry *cur, *prv;
+    int count = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &cache->mutex ) != 0 )
+        return( 1 );
+#endif
+
+    cur = cache->chain;
+    prv = NULL;
+
+    while( cur != NULL )
+    {
+        count++;
+
+        if( X509_CRT_CACHE_EXPIRED( cache, cur ) )
+            break; /* expired, reuse this slot */
+
+        if( cur->owner == entry->owner &&
+            memcmp( cur->key, entry->key, 32 ) == 0 )
+            break; /* verified again, refresh */
+
+        prv = cur;
+        cur = cur->next;
+    }
+
+    if( cur == NULL )
+    {
+        if( count >= cache->max_entries )
+        {
+            /*
+             * Reuse the first entry, the one set the longest ago,
+             * but move it to last place
+             */
+            if( cache->chain == NULL )
+            {
+                ret = 1;
+                goto exit;
+            }
+
+            cur = cache->chain;
+            if( cur->next != NULL )
+            {
+                cache->chain = cur->next;
+                prv->next = cur;
+            }
+        }
+        else
+        {
+            cur = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt_cache_entry ) );
+            if( cur == NULL )
+            {
+                ret = 1;
+                goto exit;
+            }
+
+            if( prv == NULL )
+                cache->chain = cur;
+            else
+                prv->next = cur;
+        }
+    }
+    else if( cur->next != NULL )
+    {
+        /* Move to last place, as the most recently set */
+        if( prv == NULL )
+            cache->chain = cur->next;
+        else
+            prv->next = cur->next;
+
+        for( prv = cur->next; prv->next != NULL; prv = prv->next )
+            ;
+        prv->next = cur;
+    }
+
+    memcpy( cur, entry, sizeof( mbedtls_x509_crt_cache_entry ) );
+    cur->next = NULL;
+#if defined(MBEDTLS_HAVE_TIME)
+    cur->timestamp = t;
+#endif
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &cache->mutex ) != 0 )
+        ret = 1;
+#endif
+
+    return( ret );
+}
+
+void mbedtls_x509_crt_cache_purge( mbedtls_x509_crt_cache_context *cache,
+                                   const void *owner )
+{
+    mbedtls_x509_crt_cache_entry *cur, **prv;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &cache->mutex ) != 0 )
+        return;
+#endif
+
+    prv = &cache->chain;
+    while( ( cur = *prv ) != NULL )
+    {
+        if( cur->owner != owner )
+        {
+            prv = &cur->next;
+            continue;
+        }
+
+        *prv = cur->next;
+        mbedtls_platform_zeroize( cur, sizeof( mbedtls_x509_crt_cache_entry ) );
+        mbedtls_free( cur );
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock( &cache->mutex );
+#endif
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+void mbedtls_x509_crt_cache_set_timeout( mbedtls_x509_crt_cache_context *cache,
+                                         int timeout )
+{
+    if( timeout < 0 ) timeout = 0;
+
+    cache->timeout = timeout;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+void mbedtls_x509_crt_cache_set_max_entries( mbedtls_x509_crt_cache_context *cache,
+                                             int max )
+{
+    if( max < 0 ) max = 0;
+
+    cache->max_entries = max;
+}
+
+void mbedtls_x509_crt_cache_free( mbedtls_x509_crt_cache_context *cache )
+{
+    mbedtls_x509_crt_cache_entry *cur, *prv;
+
+    if( cache == NULL )
+        return;
+
+    cur = cache->chain;
+
+    while( cur != NULL )
+    {
+        prv = cur;
+        cur = cur->next;
+
+        mbedtls_platform_zeroize( prv, sizeof( mbedtls_x509_crt_cache_entry ) );
+        mbedtls_free( prv );
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free( &cache->mutex );
+#endif
+
+    mbedtls_platform_zeroize( cache, sizeof( mbedtls_x509_crt_cache_context ) );
+}
+
+#endif /* MBEDTLS_X509_CRT_CACHE_C */